@@ -0,0 +1,202 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define BENCHMARK_MIN_TIME 0.2      // Seconds each repetition runs for, at least
+#define BENCHMARK_REPETITIONS 5
+#define BENCHMARK_MAX_ITERATIONS 1000000000
+
+// What the benchmarks were compiled with (make benchmarks passes it in), so
+// results from different builds aren't taken for each other
+#ifndef BUILD_FLAGS
+#define BUILD_FLAGS "unknown"
+#endif
+
+// Runs iterations of whatever is being measured, on a fixture built beforehand
+typedef void (*BenchmarkFunction)(void* context, size_t iterations);
+
+// Keeps the compiler from optimising away a result nothing else reads
+template <typename T>
+inline void keep(const T& value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  asm volatile("" : : "g"(&value) : "memory");
+#else
+  static volatile const void* sink;
+  sink = &value;
+#endif
+}
+
+struct BenchmarkResult
+{
+  std::string name;
+  std::string label;       // What the items are
+  size_t iterations;       // Per repetition
+  double nsPerIteration;   // Wall clock, median of the repetitions
+  double cpuNsPerIteration;
+  double itemsPerSecond;
+};
+
+// A small runner in the manner of Google Benchmark, in a header so each
+// program in Benchmarks/ stays one file with nothing to install. Each
+// benchmark is run with doubling iteration counts until it takes long
+// enough to time, then repeated, and the median is reported as a table or,
+// with --json, in Google Benchmark's JSON format for tracking over time.
+//
+// Options: --json, --filter SUBSTRING, --min-time SECONDS
+class BenchmarkRunner
+{
+private:
+  std::vector<BenchmarkResult> results;
+  const char* program;
+  const char* filter;
+  double minTime;
+  bool json;
+  
+  static double now()
+  {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+  
+  static double measure(BenchmarkFunction function, void* context, size_t iterations, double* cpuTime)
+  {
+    clock_t cpuStart = clock();
+    double start = now();
+    function(context, iterations);
+    double elapsed = now() - start;
+    *cpuTime = (double)(clock() - cpuStart) / CLOCKS_PER_SEC;
+    return elapsed;
+  }
+
+public:
+  BenchmarkRunner(int argc, char* argv[])
+    : program(argv[0]), filter(NULL), minTime(BENCHMARK_MIN_TIME), json(false)
+  {
+    for(int i = 1; i < argc; ++i)
+    {
+      if(strcmp(argv[i], "--json") == 0)
+      {
+        json = true;
+      }
+      else if(strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+      {
+        filter = argv[++i];
+      }
+      else if(strcmp(argv[i], "--min-time") == 0 && i + 1 < argc)
+      {
+        minTime = atof(argv[++i]);
+      }
+    }
+    
+    if(!json)
+    {
+      printf("%-40s %14s %14s %16s %12s\n", "benchmark", "ns/op", "cpu ns/op", "items/s", "iterations");
+    }
+  }
+  
+  // Whether a benchmark passes the filter, to skip building its fixture
+  bool wants(const char* name)
+  {
+    return !filter || strstr(name, filter) != NULL;
+  }
+  
+  // Measures one benchmark, which handles itemsPerIteration items (bodies,
+  // springs, ...) each iteration
+  void run(const char* name, BenchmarkFunction function, void* context, double itemsPerIteration, const char* label)
+  {
+    if(!wants(name))
+    {
+      return;
+    }
+    
+    // Find an iteration count that takes long enough to time. The first run
+    // also warms the caches.
+    size_t iterations = 1;
+    double cpuTime;
+    for(;;)
+    {
+      double elapsed = measure(function, context, iterations, &cpuTime);
+      if(elapsed >= minTime || iterations >= BENCHMARK_MAX_ITERATIONS)
+      {
+        break;
+      }
+      
+      // Aim a little past the minimum, but grow at most tenfold at once
+      double predicted = elapsed > 0.0 ? iterations * minTime * 1.4 / elapsed : iterations * 10.0;
+      predicted = std::min(predicted, iterations * 10.0);
+      iterations = (size_t)std::max(predicted, iterations * 2.0);
+      iterations = std::min(iterations, (size_t)BENCHMARK_MAX_ITERATIONS);
+    }
+    
+    std::vector<double> wall(BENCHMARK_REPETITIONS), cpu(BENCHMARK_REPETITIONS);
+    for(int i = 0; i < BENCHMARK_REPETITIONS; ++i)
+    {
+      wall[i] = measure(function, context, iterations, &cpu[i]);
+    }
+    std::sort(wall.begin(), wall.end());
+    std::sort(cpu.begin(), cpu.end());
+    
+    BenchmarkResult result;
+    result.name = name;
+    result.label = label;
+    result.iterations = iterations;
+    result.nsPerIteration = wall[BENCHMARK_REPETITIONS / 2] * 1e9 / iterations;
+    result.cpuNsPerIteration = cpu[BENCHMARK_REPETITIONS / 2] * 1e9 / iterations;
+    result.itemsPerSecond = itemsPerIteration * 1e9 / result.nsPerIteration;
+    results.push_back(result);
+    
+    if(!json)
+    {
+      char items[64];
+      snprintf(items, sizeof(items), "%.4g %s", result.itemsPerSecond, label);
+      printf("%-40s %14.1f %14.1f %16s %12zu\n", name, result.nsPerIteration, result.cpuNsPerIteration, items, iterations);
+      fflush(stdout);
+    }
+  }
+  
+  // Prints the JSON, if asked for. Returns the exit status for main.
+  int finish()
+  {
+    if(!json)
+    {
+      return 0;
+    }
+    
+    char date[64];
+    time_t seconds = time(NULL);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", localtime(&seconds));
+    printf("{\n  \"context\": {\n");
+    printf("    \"date\": \"%s\",\n", date);
+    printf("    \"executable\": \"%s\",\n", program);
+    printf("    \"build_flags\": \"%s\",\n", BUILD_FLAGS);
+    printf("    \"num_cpus\": %u,\n", std::thread::hardware_concurrency());
+    printf("    \"repetitions\": %d\n", BENCHMARK_REPETITIONS);
+    printf("  },\n  \"benchmarks\": [");
+    for(size_t i = 0; i < results.size(); ++i)
+    {
+      const BenchmarkResult& result = results[i];
+      printf("%s\n    {\n", i > 0 ? "," : "");
+      printf("      \"name\": \"%s\",\n", result.name.c_str());
+      printf("      \"iterations\": %zu,\n", result.iterations);
+      printf("      \"real_time\": %.3f,\n", result.nsPerIteration);
+      printf("      \"cpu_time\": %.3f,\n", result.cpuNsPerIteration);
+      printf("      \"time_unit\": \"ns\",\n");
+      printf("      \"items_per_second\": %.6g,\n", result.itemsPerSecond);
+      printf("      \"label\": \"%s\"\n", result.label.c_str());
+      printf("    }");
+    }
+    printf("\n  ]\n}\n");
+    return 0;
+  }
+};
+
+#endif
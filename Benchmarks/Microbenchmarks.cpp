@@ -0,0 +1,445 @@
+/*
+ * Times the physics hot paths one at a time: a body's own RK4 step, force
+ * evaluation with growing numbers of forces, the two spring kernels, the
+ * narrow phase, and picking bodies with a ray. Each reports ns per iteration
+ * and items (bodies, springs, pairs or rays) per second.
+ *
+ *   Benchmarks/Microbenchmarks [--json] [--filter SUBSTRING] [--min-time SECONDS]
+ *
+ * Run from the repository root (meshes are loaded by relative path).
+ */
+
+#include <stdio.h>
+
+#include "Benchmark.h"
+#include "../Scene.h"
+#include "../SceneGenerator.h"
+#include "../GravitationalForce.h"
+#include "../SpringForce.h"
+#include "../TwoWaySpringForce.h"
+#include "../Narrowphase.h"
+#include "../Random.h"
+
+#define BENCHMARK_SEED 1
+#define NUM_BODIES 1000
+#define NUM_RECORDS 1024  // Springs, collider pairs or rays per iteration
+#define STEP_DT (1.0f / 60.0f)
+
+static Mesh* sphereMesh;
+static Mesh* bunnyMesh;
+static PhysState restingState; // Of a body made by createBody
+
+static PhysModel* createBody(Mesh* mesh, glm::vec3 position)
+{
+  PhysModel* body = new PhysModel(mesh, Material(), 1.0f, position);
+  body->scale(GENERATOR_RADIUS);
+  return body;
+}
+
+// A random state, moving and spinning, around the origin
+static PhysState randomState(Random* random)
+{
+  PhysState state = restingState;
+  state.position = random->nextVec3(-10.0f, 10.0f);
+  state.linearMomentum = random->nextVec3(-1.0f, 1.0f);
+  state.orientation = glm::normalize(glm::quat(random->nextFloat(-1.0f, 1.0f), random->nextVec3(-1.0f, 1.0f)));
+  state.angularMomentum = random->nextVec3(-0.1f, 0.1f);
+  return state;
+}
+
+// PhysModel::step
+
+static void stepBodies(void* context, size_t iterations)
+{
+  std::vector<PhysModel*>* bodies = (std::vector<PhysModel*>*)context;
+  for(size_t i = 0; i < iterations; ++i)
+  {
+    for(size_t j = 0; j < bodies->size(); ++j)
+    {
+      (*bodies)[j]->step(i * STEP_DT, STEP_DT);
+    }
+  }
+}
+
+static void benchmarkStep(BenchmarkRunner* runner)
+{
+  if(!runner->wants("PhysModel::step"))
+  {
+    return;
+  }
+  
+  // Tethered to where they start, so they stay put however long this runs
+  std::vector<PhysModel*> bodies(NUM_BODIES);
+  Random random(BENCHMARK_SEED);
+  for(int i = 0; i < NUM_BODIES; ++i)
+  {
+    bodies[i] = createBody(sphereMesh, random.nextVec3(-10.0f, 10.0f));
+    GravitationalForce::create(bodies[i]);
+    SpringForce::create(bodies[i], bodies[i]->getState().position, 10.0f, 0.5f, glm::vec3());
+  }
+  
+  runner->run("PhysModel::step/rk4", stepBodies, &bodies, NUM_BODIES, "bodies");
+  
+  for(int i = 0; i < NUM_BODIES; ++i)
+  {
+    delete bodies[i];
+  }
+}
+
+// PhysModel::applyForces, through evaluate (which adds the body's velocity
+// and spin to it)
+
+static void evaluateBody(void* context, size_t iterations)
+{
+  PhysModel* body = (PhysModel*)context;
+  PhysState state = body->getState();
+  for(size_t i = 0; i < iterations; ++i)
+  {
+    Derivative derivative = body->evaluate(state);
+    keep(derivative);
+  }
+}
+
+static void benchmarkApplyForces(BenchmarkRunner* runner)
+{
+  static const int counts[] = { 0, 1, 10, 100 };
+  Random random(BENCHMARK_SEED);
+  for(size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i)
+  {
+    char name[64];
+    snprintf(name, sizeof(name), "PhysModel::applyForces/%d", counts[i]);
+    if(!runner->wants(name))
+    {
+      continue;
+    }
+    
+    // Gravity first, then springs to random anchors
+    PhysModel* body = createBody(sphereMesh, glm::vec3());
+    for(int j = 0; j < counts[i]; ++j)
+    {
+      if(j == 0)
+      {
+        GravitationalForce::create(body);
+      }
+      else
+      {
+        SpringForce::create(body, random.nextVec3(-5.0f, 5.0f), 10.0f, 0.5f, random.nextVec3(-1.0f, 1.0f));
+      }
+    }
+    
+    runner->run(name, evaluateBody, body, 1, "bodies");
+    delete body;
+  }
+}
+
+// SpringForce::applyForce
+
+struct AnchorFixture
+{
+  std::vector<AnchorSpring> springs;
+  std::vector<PhysState> states;
+  std::vector<Derivative> derivatives;
+};
+
+static void applyAnchorSprings(void* context, size_t iterations)
+{
+  AnchorFixture* fixture = (AnchorFixture*)context;
+  for(size_t i = 0; i < iterations; ++i)
+  {
+    for(size_t j = 0; j < fixture->springs.size(); ++j)
+    {
+      SpringForce::applyForce(fixture->springs[j], 1.0f, fixture->states[j], &fixture->derivatives[j]);
+    }
+    keep(fixture->derivatives[0]);
+  }
+}
+
+static void benchmarkAnchorSprings(BenchmarkRunner* runner)
+{
+  if(!runner->wants("SpringForce::applyForce"))
+  {
+    return;
+  }
+  
+  AnchorFixture fixture;
+  Random random(BENCHMARK_SEED);
+  fixture.springs.resize(NUM_RECORDS);
+  fixture.states.resize(NUM_RECORDS);
+  fixture.derivatives.resize(NUM_RECORDS);
+  for(int i = 0; i < NUM_RECORDS; ++i)
+  {
+    fixture.springs[i].anchor = random.nextVec3(-10.0f, 10.0f);
+    fixture.springs[i].attachOffset = random.nextVec3(-1.0f, 1.0f);
+    fixture.springs[i].k = 10.0f;
+    fixture.springs[i].b = 0.5f;
+    fixture.states[i] = randomState(&random);
+    fixture.derivatives[i] = Derivative();
+  }
+  
+  runner->run("SpringForce::applyForce", applyAnchorSprings, &fixture, NUM_RECORDS, "springs");
+}
+
+// TwoWaySpringForce::applyForce
+
+struct LinkFixture
+{
+  std::vector<NetworkSpring> springs;
+  std::vector<PhysState> states;
+  std::vector<Derivative> derivatives;
+};
+
+static void applyLinkSprings(void* context, size_t iterations)
+{
+  LinkFixture* fixture = (LinkFixture*)context;
+  for(size_t i = 0; i < iterations; ++i)
+  {
+    for(size_t j = 0; j < fixture->springs.size(); ++j)
+    {
+      const NetworkSpring& spring = fixture->springs[j];
+      TwoWaySpringForce::applyForce(spring, fixture->states[spring.a], fixture->states[spring.b],
+                                    &fixture->derivatives[spring.a], &fixture->derivatives[spring.b]);
+    }
+    keep(fixture->derivatives[0]);
+  }
+}
+
+static void benchmarkLinkSprings(BenchmarkRunner* runner)
+{
+  if(!runner->wants("TwoWaySpringForce::applyForce"))
+  {
+    return;
+  }
+  
+  // Springs between random pairs, so reads and writes are scattered the way
+  // they are in a real network
+  LinkFixture fixture;
+  Random random(BENCHMARK_SEED);
+  fixture.springs.resize(NUM_RECORDS);
+  fixture.states.resize(NUM_RECORDS);
+  fixture.derivatives.resize(NUM_RECORDS);
+  for(int i = 0; i < NUM_RECORDS; ++i)
+  {
+    NetworkSpring& spring = fixture.springs[i];
+    spring.a = random.next() % NUM_RECORDS;
+    spring.b = (spring.a + 1 + random.next() % (NUM_RECORDS - 1)) % NUM_RECORDS;
+    spring.offsetA = random.nextVec3(-1.0f, 1.0f);
+    spring.offsetB = random.nextVec3(-1.0f, 1.0f);
+    spring.k = 10.0f;
+    spring.damping = 0.5f;
+    spring.restLength = 1.0f;
+    fixture.states[i] = randomState(&random);
+    fixture.derivatives[i] = Derivative();
+  }
+  
+  runner->run("TwoWaySpringForce::applyForce", applyLinkSprings, &fixture, NUM_RECORDS, "springs");
+}
+
+// The narrow phase: intersects() between bodies, and findPenetration()
+// against the ground slab (what collision with the ground comes down to)
+
+struct ColliderFixture
+{
+  std::vector<Collider> a, b;
+};
+
+static void intersectPairs(void* context, size_t iterations)
+{
+  ColliderFixture* fixture = (ColliderFixture*)context;
+  for(size_t i = 0; i < iterations; ++i)
+  {
+    int hits = 0;
+    for(size_t j = 0; j < fixture->a.size(); ++j)
+    {
+      hits += intersects(fixture->a[j], fixture->b[j]);
+    }
+    keep(hits);
+  }
+}
+
+static void penetratePairs(void* context, size_t iterations)
+{
+  ColliderFixture* fixture = (ColliderFixture*)context;
+  for(size_t i = 0; i < iterations; ++i)
+  {
+    for(size_t j = 0; j < fixture->a.size(); ++j)
+    {
+      Penetration penetration;
+      bool hit = findPenetration(fixture->a[j], fixture->b[j], &penetration);
+      keep(hit);
+      keep(penetration);
+    }
+  }
+}
+
+static Collider randomCollider(Random* random, int type, glm::vec3 position)
+{
+  Collider collider;
+  collider.type = type;
+  collider.hull = bunnyMesh->hull;
+  collider.size = type == COLLIDER_BOX ? glm::vec3(1.0f, 0.5f, 0.75f) : glm::vec3(1.0f);
+  collider.position = position;
+  collider.orientation = glm::normalize(glm::quat(random->nextFloat(-1.0f, 1.0f), random->nextVec3(-1.0f, 1.0f)));
+  collider.scale = 0.5f;
+  return collider;
+}
+
+static void benchmarkNarrowphase(BenchmarkRunner* runner)
+{
+  static const int types[] = { COLLIDER_SPHERE, COLLIDER_BOX, COLLIDER_HULL };
+  static const char* names[] = { "sphere", "box", "hull" };
+  for(int i = 0; i < 3; ++i)
+  {
+    char name[64];
+    snprintf(name, sizeof(name), "intersects/%s", names[i]);
+    if(!runner->wants(name))
+    {
+      continue;
+    }
+    
+    // Centres up to twice the size apart, so roughly half of them overlap
+    ColliderFixture fixture;
+    Random random(BENCHMARK_SEED);
+    for(int j = 0; j < NUM_RECORDS; ++j)
+    {
+      fixture.a.push_back(randomCollider(&random, types[i], glm::vec3()));
+      fixture.b.push_back(randomCollider(&random, types[i], random.nextVec3(-1.0f, 1.0f)));
+    }
+    runner->run(name, intersectPairs, &fixture, NUM_RECORDS, "pairs");
+  }
+  
+  for(int i = 0; i < 3; ++i)
+  {
+    char name[64];
+    snprintf(name, sizeof(name), "findPenetration/ground/%s", names[i]);
+    if(!runner->wants(name))
+    {
+      continue;
+    }
+    
+    // Resting on a slab like CollisionWorld's, sunk in a little
+    Collider ground;
+    ground.type = COLLIDER_BOX;
+    ground.hull = NULL;
+    ground.size = glm::vec3(90.0f, 0.5f, 90.0f);
+    ground.position = glm::vec3(0.0f, -0.5f, 0.0f);
+    ground.orientation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+    ground.scale = 1.0f;
+    
+    ColliderFixture fixture;
+    Random random(BENCHMARK_SEED);
+    for(int j = 0; j < NUM_RECORDS; ++j)
+    {
+      glm::vec3 position(random.nextFloat(-50.0f, 50.0f), random.nextFloat(0.3f, 0.5f), random.nextFloat(-50.0f, 50.0f));
+      fixture.a.push_back(randomCollider(&random, types[i], position));
+      fixture.b.push_back(ground);
+    }
+    runner->run(name, penetratePairs, &fixture, NUM_RECORDS, "pairs");
+  }
+}
+
+// Model::intersectionDepth
+
+struct RayFixture
+{
+  Model* model;
+  std::vector<glm::vec3> starts, ends;
+};
+
+static void castRays(void* context, size_t iterations)
+{
+  RayFixture* fixture = (RayFixture*)context;
+  for(size_t i = 0; i < iterations; ++i)
+  {
+    int hits = 0;
+    for(size_t j = 0; j < fixture->starts.size(); ++j)
+    {
+      float depth;
+      hits += fixture->model->intersectionDepth(fixture->starts[j], fixture->ends[j], &depth);
+    }
+    keep(hits);
+  }
+}
+
+static void benchmarkIntersectionDepth(BenchmarkRunner* runner)
+{
+  if(!runner->wants("Model::intersectionDepth"))
+  {
+    return;
+  }
+  
+  RayFixture fixture;
+  fixture.model = new Model(bunnyMesh, Material());
+  Random random(BENCHMARK_SEED);
+  for(int i = 0; i < NUM_RECORDS; ++i)
+  {
+    fixture.starts.push_back(random.nextVec3(-10.0f, 10.0f));
+    fixture.ends.push_back(random.nextVec3(-1.0f, 1.0f));
+  }
+  
+  runner->run("Model::intersectionDepth", castRays, &fixture, NUM_RECORDS, "rays");
+  delete fixture.model;
+}
+
+// Scene::select
+
+struct SelectFixture
+{
+  Scene* scene;
+  glm::vec3 start, end;
+};
+
+static void selectBodies(void* context, size_t iterations)
+{
+  SelectFixture* fixture = (SelectFixture*)context;
+  for(size_t i = 0; i < iterations; ++i)
+  {
+    PhysModel* hit = fixture->scene->select(fixture->start, fixture->end);
+    keep(hit);
+  }
+}
+
+static void benchmarkSelect(BenchmarkRunner* runner)
+{
+  static const int counts[] = { 1000, 100000 };
+  for(int i = 0; i < 2; ++i)
+  {
+    char name[64];
+    snprintf(name, sizeof(name), "Scene::select/%d", counts[i]);
+    if(!runner->wants(name))
+    {
+      continue;
+    }
+    
+    // Looking down into a dropped pile from above one corner
+    Scene scene;
+    SelectFixture fixture;
+    fixture.scene = &scene;
+    SceneGenerator::generate("drop", counts[i], &scene, glm::vec3(), BENCHMARK_SEED);
+    fixture.start = glm::vec3(-100.0f, 100.0f, -100.0f);
+    fixture.end = glm::vec3(0.0f, GENERATOR_DROP_HEIGHT, 0.0f);
+    
+    runner->run(name, selectBodies, &fixture, counts[i], "bodies");
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  GLBridge::setHeadless(true);
+  BenchmarkRunner runner(argc, argv);
+  
+  sphereMesh = Mesh::load("SimpleModels/sphere.obj", true);
+  bunnyMesh = Mesh::load("Models/bunny.orig.m", true);
+  PhysModel* body = createBody(sphereMesh, glm::vec3());
+  restingState = body->getState();
+  delete body;
+  
+  benchmarkStep(&runner);
+  benchmarkApplyForces(&runner);
+  benchmarkAnchorSprings(&runner);
+  benchmarkLinkSprings(&runner);
+  benchmarkNarrowphase(&runner);
+  benchmarkIntersectionDepth(&runner);
+  benchmarkSelect(&runner);
+  
+  return runner.finish();
+}
@@ -0,0 +1,319 @@
+/*
+ * Steps standard scenes headless and reports how fast they run: steps per
+ * second, median and 99th percentile step times, peak memory and heap
+ * allocations per step. Each scene is half a pile of bunnies dropped on the
+ * floor and half bunnies hanging in spring chains over it, at 1k, 10k and
+ * 100k bodies unless told otherwise.
+ *
+ *   Benchmarks/SceneThroughput [--sizes 1000,10000] [--steps N] [--json]
+ *                              [--save-baseline PATH] [--baseline PATH]
+ *                              [--max-regression PERCENT]
+ *
+ * --save-baseline writes the results (the same JSON --json prints) for later
+ * runs to be held to with --baseline: a scene whose steps per second fall, or
+ * whose p99 step time grows, by more than --max-regression percent (10 by
+ * default) fails the run with exit status 1. Baselines only mean something
+ * on the machine they were saved on, and one saved by a build with other
+ * compiler flags is refused.
+ *
+ * Peak memory is the whole process's, so scenes are run smallest first and
+ * each one's figure is the peak up to and including it.
+ *
+ * Run from the repository root (meshes are loaded by relative path).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <sys/resource.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "Benchmark.h"
+#include "../Scene.h"
+#include "../SceneGenerator.h"
+#include "../Json.h"
+
+#define THROUGHPUT_SEED 1
+#define THROUGHPUT_STEPS 100
+#define THROUGHPUT_WARMUP_STEPS 10
+#define THROUGHPUT_MAX_REGRESSION 10.0
+#define THROUGHPUT_MAX_SIZES 16
+#define STEP_DT (1.0f / 60.0f)
+
+struct ThroughputResult
+{
+  int size;
+  int bodies, springs;
+  double stepsPerSecond;
+  double p50, p99;         // Milliseconds
+  long peakKilobytes;
+  double allocationsPerStep;
+};
+
+static double now()
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static long peakKilobytes()
+{
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  return usage.ru_maxrss / 1024; // Bytes there, kilobytes on Linux
+#else
+  return usage.ru_maxrss;
+#endif
+}
+
+static void buildScene(Scene* scene, int size)
+{
+  Model* floor = SceneGenerator::ground(scene, Material(), 10.0f);
+  
+  Mesh* bunnyMesh = Mesh::load("Models/bunny.orig.m", true);
+  Material material;
+  glm::vec3 baseColor(0.65f, 0.0f, 1.0f);
+  material.ambient = baseColor * 0.2f;
+  material.diffuse = baseColor * 0.4f;
+  material.specular = glm::vec3(0.4f, 0.4f, 0.4f);
+  material.emission = glm::vec3(0.0f);
+  material.shininess = 200.0f;
+  
+  int dropped = size / 2;
+  SceneGenerator::pileAndChains(scene, bunnyMesh, material, dropped, (size - dropped) / GENERATOR_CHAIN_LENGTH,
+                                GENERATOR_CHAIN_LENGTH, floor->getPosition(), THROUGHPUT_SEED);
+}
+
+static ThroughputResult run(int size, int steps)
+{
+  Scene scene;
+  buildScene(&scene, size);
+  
+  ThroughputResult result;
+  result.size = size;
+  result.bodies = scene.getNumPhysObjects();
+  result.springs = 0;
+  for(int i = 0; i < result.bodies; ++i)
+  {
+    PhysModel* body = scene.getPhysObject(i);
+    result.springs += body->getAnchorSprings().size() + body->getLinkSprings().size();
+  }
+  
+  // The first steps build the spring network and islands and fill the
+  // scratch space, so they aren't counted
+  int step = 0;
+  for(; step < THROUGHPUT_WARMUP_STEPS; ++step)
+  {
+    scene.step(step * STEP_DT, STEP_DT);
+  }
+  
+  std::vector<double> times(steps);
+  uint64_t allocations = 0;
+  double start = now();
+  for(int i = 0; i < steps; ++i, ++step)
+  {
+    double stepStart = now();
+    scene.step(step * STEP_DT, STEP_DT);
+    times[i] = now() - stepStart;
+    allocations += scene.getLastAllocations();
+  }
+  double elapsed = now() - start;
+  result.allocationsPerStep = (double)allocations / steps;
+  
+  std::sort(times.begin(), times.end());
+  result.stepsPerSecond = steps / elapsed;
+  result.p50 = times[(steps - 1) / 2] * 1000.0;
+  result.p99 = times[(size_t)((steps - 1) * 0.99)] * 1000.0;
+  result.peakKilobytes = peakKilobytes();
+  return result;
+}
+
+static void writeJson(FILE* file, const std::vector<ThroughputResult>& results, int steps)
+{
+  char date[64];
+  time_t seconds = time(NULL);
+  strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", localtime(&seconds));
+  fprintf(file, "{\n  \"context\": {\n");
+  fprintf(file, "    \"date\": \"%s\",\n", date);
+  fprintf(file, "    \"build_flags\": \"%s\",\n", BUILD_FLAGS);
+  fprintf(file, "    \"steps\": %d\n", steps);
+  fprintf(file, "  },\n  \"benchmarks\": [");
+  for(size_t i = 0; i < results.size(); ++i)
+  {
+    const ThroughputResult& result = results[i];
+    fprintf(file, "%s\n    {\n", i > 0 ? "," : "");
+    fprintf(file, "      \"name\": \"scene/%d\",\n", result.size);
+    fprintf(file, "      \"bodies\": %d,\n", result.bodies);
+    fprintf(file, "      \"springs\": %d,\n", result.springs);
+    fprintf(file, "      \"steps_per_second\": %.4f,\n", result.stepsPerSecond);
+    fprintf(file, "      \"p50_ms\": %.4f,\n", result.p50);
+    fprintf(file, "      \"p99_ms\": %.4f,\n", result.p99);
+    fprintf(file, "      \"peak_rss_kb\": %ld,\n", result.peakKilobytes);
+    fprintf(file, "      \"allocations_per_step\": %.2f\n", result.allocationsPerStep);
+    fprintf(file, "    }");
+  }
+  fprintf(file, "\n  ]\n}\n");
+}
+
+// Returns false if any scene has regressed past the limit against the
+// baseline, or the baseline can't be read or came from a build with other flags
+static bool compare(const char* path, const std::vector<ThroughputResult>& results, double maxRegression)
+{
+  std::vector<char> text;
+  FILE* file = fopen(path, "rb");
+  if(file)
+  {
+    char buffer[4096];
+    size_t read;
+    while((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+      text.insert(text.end(), buffer, buffer + read);
+    }
+    fclose(file);
+  }
+  
+  JsonDocument baseline;
+  std::string error;
+  if(text.empty() || !baseline.parse(text.data(), text.size(), &error))
+  {
+    fprintf(stderr, "Can't read the baseline %s%s%s\n", path, error.empty() ? "" : ": ", error.c_str());
+    return false;
+  }
+  
+  const JsonValue* context = baseline.getRoot().find("context");
+  const JsonValue* flags = context ? context->find("build_flags") : NULL;
+  if(!flags || strcmp(flags->getString(), BUILD_FLAGS) != 0)
+  {
+    fprintf(stderr, "The baseline %s was built with \"%s\", not \"%s\"\n", path,
+            flags ? flags->getString() : "unknown flags", BUILD_FLAGS);
+    return false;
+  }
+  
+  const JsonValue* benchmarks = baseline.getRoot().find("benchmarks");
+  bool passed = true;
+  for(size_t i = 0; i < results.size(); ++i)
+  {
+    const ThroughputResult& result = results[i];
+    char name[32];
+    snprintf(name, sizeof(name), "scene/%d", result.size);
+    
+    const JsonValue* saved = NULL;
+    for(size_t j = 0; benchmarks && j < benchmarks->size(); ++j)
+    {
+      const JsonValue* savedName = (*benchmarks)[j].find("name");
+      if(savedName && strcmp(savedName->getString(), name) == 0)
+      {
+        saved = &(*benchmarks)[j];
+      }
+    }
+    const JsonValue* savedRate = saved ? saved->find("steps_per_second") : NULL;
+    const JsonValue* savedP99 = saved ? saved->find("p99_ms") : NULL;
+    if(!savedRate || !savedP99)
+    {
+      fprintf(stderr, "%-14s not in the baseline\n", name);
+      continue;
+    }
+    
+    // Positive is worse for both
+    double rateChange = (savedRate->getNumber() - result.stepsPerSecond) / savedRate->getNumber() * 100.0;
+    double p99Change = (result.p99 - savedP99->getNumber()) / savedP99->getNumber() * 100.0;
+    bool failed = rateChange > maxRegression || p99Change > maxRegression;
+    fprintf(stderr, "%-14s steps/s %+.1f%%, p99 %+.1f%% %s\n", name, -rateChange, p99Change, failed ? "REGRESSED" : "ok");
+    passed = passed && !failed;
+  }
+  
+  return passed;
+}
+
+int main(int argc, char* argv[])
+{
+  GLBridge::setHeadless(true);
+  
+  int sizes[THROUGHPUT_MAX_SIZES] = { 1000, 10000, 100000 };
+  int numSizes = 3;
+  int steps = THROUGHPUT_STEPS;
+  bool json = false;
+  const char* savePath = NULL;
+  const char* baselinePath = NULL;
+  double maxRegression = THROUGHPUT_MAX_REGRESSION;
+  for(int i = 1; i < argc; ++i)
+  {
+    if(strcmp(argv[i], "--json") == 0)
+    {
+      json = true;
+    }
+    else if(strcmp(argv[i], "--sizes") == 0 && i + 1 < argc)
+    {
+      numSizes = 0;
+      for(char* size = strtok(argv[++i], ","); size && numSizes < THROUGHPUT_MAX_SIZES; size = strtok(NULL, ","))
+      {
+        sizes[numSizes++] = atoi(size);
+      }
+      std::sort(sizes, sizes + numSizes);
+    }
+    else if(strcmp(argv[i], "--steps") == 0 && i + 1 < argc)
+    {
+      steps = std::max(atoi(argv[++i]), 1);
+    }
+    else if(strcmp(argv[i], "--save-baseline") == 0 && i + 1 < argc)
+    {
+      savePath = argv[++i];
+    }
+    else if(strcmp(argv[i], "--baseline") == 0 && i + 1 < argc)
+    {
+      baselinePath = argv[++i];
+    }
+    else if(strcmp(argv[i], "--max-regression") == 0 && i + 1 < argc)
+    {
+      maxRegression = atof(argv[++i]);
+    }
+  }
+  
+  if(!json)
+  {
+    printf("%d steps at dt = 1/60 after %d to warm up\n", steps, THROUGHPUT_WARMUP_STEPS);
+    printf("%-14s %8s %8s %10s %10s %10s %12s %12s\n", "scene", "bodies", "springs", "steps/s", "p50 ms", "p99 ms", "peak RSS MB", "allocs/step");
+  }
+  
+  std::vector<ThroughputResult> results;
+  for(int i = 0; i < numSizes; ++i)
+  {
+    ThroughputResult result = run(sizes[i], steps);
+    results.push_back(result);
+    if(!json)
+    {
+      char name[32];
+      snprintf(name, sizeof(name), "scene/%d", result.size);
+      printf("%-14s %8d %8d %10.2f %10.3f %10.3f %12.1f %12.1f\n", name, result.bodies, result.springs, result.stepsPerSecond,
+             result.p50, result.p99, result.peakKilobytes / 1024.0, result.allocationsPerStep);
+      fflush(stdout);
+    }
+  }
+  
+  if(json)
+  {
+    writeJson(stdout, results, steps);
+  }
+  if(savePath)
+  {
+    FILE* file = fopen(savePath, "w");
+    if(!file)
+    {
+      fprintf(stderr, "Can't write the baseline %s\n", savePath);
+      return 1;
+    }
+    writeJson(file, results, steps);
+    fclose(file);
+  }
+  if(baselinePath && !compare(baselinePath, results, maxRegression))
+  {
+    return 1;
+  }
+  
+  return 0;
+}
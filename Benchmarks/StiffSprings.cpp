@@ -0,0 +1,119 @@
+/*
+ * Hangs a chain of bodies from stiff springs and runs it with each integrator,
+ * to show where explicit RK4 diverges at the default timestep and implicit
+ * Euler and XPBD do not. Adaptive RK45 stays stable by taking more substeps.
+ * The iters column is CG iterations for implicit Euler and substeps for RK45.
+ *
+ * Run from the repository root (meshes are loaded by relative path).
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <sys/time.h>
+
+#include "../Scene.h"
+#include "../GravitationalForce.h"
+#include "../SpringForce.h"
+#include "../TwoWaySpringForce.h"
+
+#define CHAIN_LENGTH 32
+#define LINK_LENGTH 0.5f
+#define NUM_STEPS 600
+#define DIVERGED_DISTANCE 1000.0f
+
+static double now()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void buildChain(Scene* scene, Mesh* mesh, float k)
+{
+  Material material = Material();
+  PhysModel* last = NULL;
+  for(int i = 0; i < CHAIN_LENGTH; ++i)
+  {
+    PhysModel* body = new PhysModel(mesh, material, 1.0f, glm::vec3(i * LINK_LENGTH, 0.0f, 0.0f));
+    body->scale(0.1f);
+    GravitationalForce::create(body);
+    
+    if(last)
+    {
+      TwoWaySpringForce::create(last, body, k, 0.5f, glm::vec3(), glm::vec3(), LINK_LENGTH);
+    }
+    else
+    {
+      SpringForce::create(body, glm::vec3(), k, 0.5f, glm::vec3());
+    }
+    
+    scene->add(body);
+    last = body;
+  }
+}
+
+// Returns the worst distance of any body from the origin, or -1 on NaN
+static float run(int integrator, float k, double* msPerStep, float* iterations)
+{
+  Mesh* mesh = Mesh::load("SimpleModels/sphere.obj", true);
+  Scene scene;
+  scene.setIntegrator(integrator);
+  scene.setSleepEnabled(false); // Time every step, even once the chain settles
+  buildChain(&scene, mesh, k);
+  
+  const float dt = 1.0f / 60.0f;
+  float worst = 0.0f;
+  int totalIterations = 0;
+  double start = now();
+  for(int step = 0; step < NUM_STEPS; ++step)
+  {
+    scene.step(step * dt, dt);
+    if(integrator == INTEGRATOR_RK45)
+    {
+      totalIterations += scene.getLastSubsteps();
+    }
+    else
+    {
+      totalIterations += scene.getImplicitSolver()->getLastIterations();
+    }
+  }
+  *msPerStep = (now() - start) * 1000.0 / NUM_STEPS;
+  *iterations = totalIterations / (float)NUM_STEPS;
+  
+  for(int i = 0; i < scene.getNumPhysObjects(); ++i)
+  {
+    float distance = glm::length(scene.getPhysObject(i)->getState().position);
+    if(distance != distance)
+    {
+      return -1.0f;
+    }
+    worst = distance > worst ? distance : worst;
+  }
+  
+  return worst;
+}
+
+int main()
+{
+  GLBridge::setHeadless(true);
+  
+  static const float stiffnesses[] = { 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f };
+  static const int integrators[] = { INTEGRATOR_RK4, INTEGRATOR_RK45, INTEGRATOR_IMPLICIT_EULER, INTEGRATOR_XPBD };
+  static const char* names[] = { "rk4", "rk45", "implicit", "xpbd" };
+  
+  printf("%d body chain, %d steps at dt = 1/60\n", CHAIN_LENGTH, NUM_STEPS);
+  printf("%-10s %-10s %-10s %-12s %-10s %s\n", "k", "integrator", "result", "max dist", "ms/step", "iters");
+  for(size_t i = 0; i < sizeof(stiffnesses) / sizeof(stiffnesses[0]); ++i)
+  {
+    for(int j = 0; j < 4; ++j)
+    {
+      double msPerStep;
+      float iterations;
+      float worst = run(integrators[j], stiffnesses[i], &msPerStep, &iterations);
+      bool diverged = worst < 0.0f || worst > DIVERGED_DISTANCE;
+      printf("%-10g %-10s %-10s %-12g %-10.3f %.1f\n", stiffnesses[i], names[j], diverged ? "DIVERGED" : "stable", worst, msPerStep, iterations);
+    }
+  }
+  
+  return 0;
+}
@@ -0,0 +1,48 @@
+#ifndef COLLIDER_H
+#define COLLIDER_H
+
+#include "glm/glm.hpp"
+#include "glm/gtc/quaternion.hpp"
+
+#include "ConvexHull.h"
+
+#define COLLIDER_HULL 0
+#define COLLIDER_SPHERE 1
+#define COLLIDER_BOX 2
+
+// A convex collision proxy placed in the world. Everything the narrow phase
+// needs from a shape is its support point: the point furthest along a given
+// direction.
+struct Collider
+{
+  int type;
+  const ConvexHull* hull;
+  glm::vec3 size;       // Sphere: radius in x; box: half extents (both unscaled)
+  glm::vec3 position;
+  glm::quat orientation;
+  float scale;
+  
+  glm::vec3 support(glm::vec3 direction) const
+  {
+    glm::vec3 local = glm::conjugate(orientation) * direction;
+    glm::vec3 point;
+    switch(type)
+    {
+    case COLLIDER_SPHERE:
+      point = glm::normalize(local) * size.x;
+      break;
+    case COLLIDER_BOX:
+      point = glm::vec3(local.x < 0.0f ? -size.x : size.x,
+                        local.y < 0.0f ? -size.y : size.y,
+                        local.z < 0.0f ? -size.z : size.z);
+      break;
+    default:
+      point = hull->support(local);
+      break;
+    }
+    
+    return position + orientation * (point * scale);
+  }
+};
+
+#endif
@@ -0,0 +1,567 @@
+#include "CollisionWorld.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cmath>
+
+static bool byMin(const SweepInterval& a, const SweepInterval& b)
+{
+  return a.min < b.min;
+}
+
+static bool overlap(const Bounds& a, const Bounds& b)
+{
+  return a.min.y <= b.max.y && b.min.y <= a.max.y
+      && a.min.z <= b.max.z && b.min.z <= a.max.z;
+}
+
+static bool overlapAll(const Bounds& a, const Bounds& b)
+{
+  return a.min.x <= b.max.x && b.min.x <= a.max.x && overlap(a, b);
+}
+
+static Bounds boundsOf(const Collider& collider)
+{
+  Bounds bounds;
+  for(int axis = 0; axis < 3; ++axis)
+  {
+    glm::vec3 direction;
+    direction[axis] = 1.0f;
+    bounds.max[axis] = collider.support(direction)[axis];
+    bounds.min[axis] = collider.support(-direction)[axis];
+  }
+  
+  return bounds;
+}
+
+// Twice the area of the quadrilateral through four points, whatever their order
+static float quadArea(glm::vec3 p0, glm::vec3 p1, glm::vec3 p2, glm::vec3 p3)
+{
+  float a = glm::length(glm::cross(p0 - p1, p2 - p3));
+  float b = glm::length(glm::cross(p0 - p2, p1 - p3));
+  float c = glm::length(glm::cross(p0 - p3, p1 - p2));
+  return glm::max(a, glm::max(b, c));
+}
+
+CollisionWorld::CollisionWorld()
+  : manifolds(ManifoldMap::key_compare(), ManifoldMap::allocator_type(&manifoldNodes))
+{
+  numBroadphasePairs = 0;
+  numFastBodies = 0;
+  hasGround = false;
+}
+
+void CollisionWorld::setGround(Model* surface)
+{
+  hasGround = surface != NULL;
+  if(!hasGround)
+  {
+    return;
+  }
+  
+  // A slab filling the surface's bounds, with its top at the top of the surface
+  Bounds bounds = surface->getMesh()->bounds;
+  groundBounds.min = bounds.min * surface->getScale() + surface->getPosition();
+  groundBounds.max = bounds.max * surface->getScale() + surface->getPosition();
+  groundBounds.min.y = groundBounds.max.y - GROUND_THICKNESS;
+  
+  ground.type = COLLIDER_BOX;
+  ground.hull = NULL;
+  ground.size = (groundBounds.max - groundBounds.min) * 0.5f;
+  ground.position = (groundBounds.max + groundBounds.min) * 0.5f;
+  ground.orientation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+  ground.scale = 1.0f;
+}
+
+// Rough size of a collider, to pick which one of a pair to tilt
+static float extentOf(const Collider& collider)
+{
+  glm::vec3 diagonal = collider.support(glm::vec3(1.0f)) - collider.support(glm::vec3(-1.0f));
+  return glm::length(diagonal);
+}
+
+void CollisionWorld::collide(PhysModel* a, PhysModel* b, unsigned int indexA, unsigned int indexB, const Collider& colliderB)
+{
+  Collider colliderA = a->getCollider();
+  Penetration penetration;
+  if(!findPenetration(colliderA, colliderB, &penetration))
+  {
+    return;
+  }
+  
+  // Looked up before inserting, as inserting a pair that's already there still
+  // allocates a node (and throws it away)
+  ManifoldMap::key_type key(indexA, indexB);
+  ManifoldMap::iterator entry = manifolds.lower_bound(key);
+  if(entry == manifolds.end() || entry->first != key)
+  {
+    ContactManifold added = ContactManifold();
+    added.a = a;
+    added.b = b;
+    added.numPoints = 0;
+    entry = manifolds.insert(entry, std::make_pair(key, added));
+  }
+  ContactManifold* manifold = &entry->second;
+  addPoint(manifold, penetration);
+  
+  if(manifold->numPoints >= MANIFOLD_MAX_POINTS)
+  {
+    return;
+  }
+  
+  // One query only ever finds one point of a resting face, which can't stop it
+  // tipping. Tilting the smaller shape a little each way about the normal finds
+  // the corners of the contact patch.
+  bool tiltA = extentOf(colliderA) <= extentOf(colliderB);
+  glm::vec3 normal = penetration.normal;
+  glm::vec3 side = fabsf(normal.x) < 0.57f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+  glm::vec3 tangent = glm::normalize(glm::cross(normal, side));
+  for(int i = 0; i < MANIFOLD_PERTURBATIONS; ++i)
+  {
+    float around = 2.0f * (float)M_PI * i / MANIFOLD_PERTURBATIONS;
+    glm::quat tilt = glm::angleAxis(MANIFOLD_PERTURBATION_ANGLE, glm::angleAxis(around, normal) * tangent);
+    Collider tiltedA = colliderA, tiltedB = colliderB;
+    Collider* tilted = tiltA ? &tiltedA : &tiltedB;
+    tilted->orientation = tilt * tilted->orientation;
+    
+    Penetration found;
+    if(!findPenetration(tiltedA, tiltedB, &found))
+    {
+      continue;
+    }
+    
+    // Put the point found on the tilted shape back where it really is, and
+    // measure it along the untilted normal
+    if(tiltA)
+    {
+      found.pointA = colliderA.position + glm::conjugate(tilt) * (found.pointA - colliderA.position);
+    }
+    else
+    {
+      found.pointB = colliderB.position + glm::conjugate(tilt) * (found.pointB - colliderB.position);
+    }
+    found.normal = normal;
+    found.depth = glm::dot(found.pointA - found.pointB, normal);
+    if(found.depth < -CONTACT_BREAKING_DISTANCE)
+    {
+      continue;
+    }
+    if(tiltA)
+    {
+      found.pointB = found.pointA - normal * found.depth;
+    }
+    else
+    {
+      found.pointA = found.pointB + normal * found.depth;
+    }
+    addPoint(manifold, found);
+  }
+}
+
+// Where the second body of a manifold is; the ground never moves
+static void placeOf(const ContactManifold* manifold, const Collider& ground, glm::vec3* position, glm::quat* orientation)
+{
+  if(manifold->b)
+  {
+    const PhysState& state = manifold->b->getState();
+    *position = state.position;
+    *orientation = state.orientation;
+  }
+  else
+  {
+    *position = ground.position;
+    *orientation = ground.orientation;
+  }
+}
+
+void CollisionWorld::refresh(ContactManifold* manifold)
+{
+  const PhysState& stateA = manifold->a->getState();
+  glm::vec3 positionB;
+  glm::quat orientationB;
+  placeOf(manifold, ground, &positionB, &orientationB);
+  
+  // Follow each point with its bodies, dropping any that have come apart
+  for(int i = 0; i < manifold->numPoints;)
+  {
+    ContactPoint& point = manifold->points[i];
+    point.worldA = stateA.position + stateA.orientation * point.localA;
+    point.worldB = positionB + orientationB * point.localB;
+    
+    glm::vec3 separation = point.worldA - point.worldB;
+    point.depth = glm::dot(separation, manifold->normal);
+    glm::vec3 drift = separation - manifold->normal * point.depth;
+    if(point.depth < -CONTACT_BREAKING_DISTANCE || glm::length(drift) > CONTACT_BREAKING_DISTANCE)
+    {
+      manifold->points[i] = manifold->points[--manifold->numPoints];
+    }
+    else
+    {
+      ++i;
+    }
+  }
+}
+
+void CollisionWorld::addPoint(ContactManifold* manifold, const Penetration& penetration)
+{
+  const PhysState& stateA = manifold->a->getState();
+  glm::vec3 positionB;
+  glm::quat orientationB;
+  placeOf(manifold, ground, &positionB, &orientationB);
+  
+  ContactPoint point;
+  point.worldA = penetration.pointA;
+  point.worldB = penetration.pointB;
+  point.localA = glm::conjugate(stateA.orientation) * (penetration.pointA - stateA.position);
+  point.localB = glm::conjugate(orientationB) * (penetration.pointB - positionB);
+  point.depth = penetration.depth;
+  point.normalImpulse = 0.0f;
+  point.tangentImpulse[0] = point.tangentImpulse[1] = 0.0f;
+  manifold->normal = penetration.normal;
+  
+  // The same point as last step keeps its impulses
+  for(int i = 0; i < manifold->numPoints; ++i)
+  {
+    ContactPoint& old = manifold->points[i];
+    if(glm::length(old.localA - point.localA) < CONTACT_MATCH_DISTANCE)
+    {
+      point.normalImpulse = old.normalImpulse;
+      point.tangentImpulse[0] = old.tangentImpulse[0];
+      point.tangentImpulse[1] = old.tangentImpulse[1];
+      old = point;
+      return;
+    }
+  }
+  
+  if(manifold->numPoints < MANIFOLD_MAX_POINTS)
+  {
+    manifold->points[manifold->numPoints++] = point;
+    return;
+  }
+  
+  // Full: replace whichever old point leaves the widest patch, but never the
+  // deepest one
+  int deepest = 0;
+  for(int i = 1; i < MANIFOLD_MAX_POINTS; ++i)
+  {
+    if(manifold->points[i].depth > manifold->points[deepest].depth)
+    {
+      deepest = i;
+    }
+  }
+  
+  glm::vec3 current[MANIFOLD_MAX_POINTS];
+  for(int i = 0; i < MANIFOLD_MAX_POINTS; ++i)
+  {
+    current[i] = manifold->points[i].localA;
+  }
+  float currentArea = quadArea(current[0], current[1], current[2], current[3]);
+  
+  int replace = -1;
+  float widest = -1.0f;
+  for(int i = 0; i < MANIFOLD_MAX_POINTS; ++i)
+  {
+    if(i == deepest)
+    {
+      continue;
+    }
+    
+    glm::vec3 kept[MANIFOLD_MAX_POINTS];
+    for(int j = 0; j < MANIFOLD_MAX_POINTS; ++j)
+    {
+      kept[j] = j == i ? point.localA : manifold->points[j].localA;
+    }
+    
+    float candidateArea = quadArea(kept[0], kept[1], kept[2], kept[3]);
+    if(candidateArea > widest)
+    {
+      widest = candidateArea;
+      replace = i;
+    }
+  }
+  
+  // A point inside the patch adds nothing, and taking it would throw away
+  // another point's accumulated impulses
+  if(widest <= currentArea && point.depth <= manifold->points[deepest].depth)
+  {
+    return;
+  }
+  
+  manifold->points[replace] = point;
+}
+
+// Normalised lerp between orientations, the short way round. Close enough over
+// one step, and unlike glm::mix it copes with no turn at all.
+static glm::quat turnAt(glm::quat from, glm::quat to, float t)
+{
+  if(glm::dot(from, to) < 0.0f)
+  {
+    to = -to;
+  }
+  return glm::normalize(from * (1.0f - t) + to * t);
+}
+
+// Whether a pose overlaps an obstacle it was clear of, or sinks further into
+// one it already overlapped
+static bool blocked(const Collider& collider, const std::vector<SweepObstacle>& obstacles)
+{
+  for(size_t i = 0; i < obstacles.size(); ++i)
+  {
+    const SweepObstacle& obstacle = obstacles[i];
+    Penetration penetration;
+    if(obstacle.startDepth < 0.0f
+       ? intersects(collider, obstacle.collider)
+       : findPenetration(collider, obstacle.collider, &penetration)
+         && penetration.depth > obstacle.startDepth + CONTACT_BREAKING_DISTANCE)
+    {
+      return true;
+    }
+  }
+  
+  return false;
+}
+
+static SweepObstacle obstacleAt(const Collider& collider, const Collider& obstacle)
+{
+  SweepObstacle result;
+  result.collider = obstacle;
+  Penetration penetration;
+  result.startDepth = findPenetration(collider, obstacle, &penetration) ? penetration.depth : -1.0f;
+  return result;
+}
+
+// A body that moved further than half its thinnest width this step may have
+// passed right through something between its start and end poses. Its path is
+// sampled at that spacing against whatever lies in its swept bounds, and the
+// body is stopped at the first pose that touches something new, or sinks
+// further into something it was resting on. Everything else is taken at its
+// latest pose. The rest of the move is lost, but the contact is then found and
+// resolved like any other.
+bool CollisionWorld::sweep(const std::vector<PhysModel*>& bodies, size_t index)
+{
+  PhysModel* body = bodies[index];
+  const PhysState& start = body->getStartState();
+  glm::vec3 size = bounds[index].max - bounds[index].min - glm::vec3(2.0f * BROADPHASE_MARGIN);
+  float extent = 0.5f * glm::min(size.x, glm::min(size.y, size.z));
+  glm::vec3 from = start.position;
+  glm::vec3 to = body->getState().position;
+  float travel = glm::length(to - from);
+  if(body->isAsleep() || travel <= extent)
+  {
+    return false;
+  }
+  ++numFastBodies;
+  
+  Collider collider = body->getCollider();
+  glm::quat turnFrom = glm::normalize(start.orientation);
+  glm::quat turnTo = collider.orientation;
+  collider.position = from;
+  collider.orientation = turnFrom;
+  Bounds swept = boundsOf(collider);
+  swept.min = glm::min(swept.min, bounds[index].min);
+  swept.max = glm::max(swept.max, bounds[index].max);
+  
+  obstacles.clear();
+  for(size_t i = 0; i < bodies.size(); ++i)
+  {
+    if(i != index && overlapAll(swept, bounds[i]))
+    {
+      obstacles.push_back(obstacleAt(collider, bodies[i]->getCollider()));
+    }
+  }
+  if(hasGround && overlapAll(swept, groundBounds))
+  {
+    obstacles.push_back(obstacleAt(collider, ground));
+  }
+  if(obstacles.empty())
+  {
+    return false;
+  }
+  
+  int samples = glm::min((int)ceilf(travel / extent), CCD_MAX_SAMPLES);
+  float clear = 0.0f;
+  float hit = -1.0f;
+  for(int i = 1; i <= samples && hit < 0.0f; ++i)
+  {
+    float t = (float)i / samples;
+    collider.position = glm::mix(from, to, t);
+    collider.orientation = turnAt(turnFrom, turnTo, t);
+    if(blocked(collider, obstacles))
+    {
+      hit = t;
+    }
+    else
+    {
+      clear = t;
+    }
+  }
+  if(hit < 0.0f)
+  {
+    return false;
+  }
+  
+  // Narrow down to a pose only just touching, so the narrow phase finds a
+  // shallow contact there
+  for(int i = 0; i < CCD_BISECTIONS; ++i)
+  {
+    float t = 0.5f * (clear + hit);
+    collider.position = glm::mix(from, to, t);
+    collider.orientation = turnAt(turnFrom, turnTo, t);
+    if(blocked(collider, obstacles))
+    {
+      hit = t;
+    }
+    else
+    {
+      clear = t;
+    }
+  }
+  
+  body->setPose(glm::mix(from, to, hit), turnAt(turnFrom, turnTo, hit));
+  return true;
+}
+
+void CollisionWorld::update(const std::vector<PhysModel*>& bodies, Model* surface)
+{
+  PROFILE_ZONE("CollisionWorld::update");
+  
+  setGround(surface);
+  
+  for(ManifoldMap::iterator it = manifolds.begin(); it != manifolds.end(); ++it)
+  {
+    refresh(&it->second);
+  }
+  
+  // Broad phase: sort the bodies by where they start along x, then only bodies
+  // that start before another ends can touch it
+  size_t numBodies = bodies.size();
+  bounds.resize(numBodies);
+  intervals.resize(numBodies);
+  for(size_t i = 0; i < numBodies; ++i)
+  {
+    bounds[i] = bodies[i]->getWorldBounds();
+    bounds[i].min -= glm::vec3(BROADPHASE_MARGIN);
+    bounds[i].max += glm::vec3(BROADPHASE_MARGIN);
+    intervals[i].min = bounds[i].min.x;
+    intervals[i].max = bounds[i].max.x;
+    intervals[i].body = i;
+  }
+  
+  // Only bodies that moved further than their own size pay for a sweep
+  numFastBodies = 0;
+  for(size_t i = 0; i < numBodies; ++i)
+  {
+    if(sweep(bodies, i))
+    {
+      bounds[i] = bodies[i]->getWorldBounds();
+      bounds[i].min -= glm::vec3(BROADPHASE_MARGIN);
+      bounds[i].max += glm::vec3(BROADPHASE_MARGIN);
+      intervals[i].min = bounds[i].min.x;
+      intervals[i].max = bounds[i].max.x;
+    }
+  }
+  std::sort(intervals.begin(), intervals.end(), byMin);
+  
+  numBroadphasePairs = 0;
+  for(size_t i = 0; i < numBodies; ++i)
+  {
+    for(size_t j = i + 1; j < numBodies && intervals[j].min <= intervals[i].max; ++j)
+    {
+      PhysModel* first = bodies[intervals[i].body];
+      PhysModel* second = bodies[intervals[j].body];
+      if((first->isAsleep() && second->isAsleep())
+         || !overlap(bounds[intervals[i].body], bounds[intervals[j].body]))
+      {
+        continue;
+      }
+      ++numBroadphasePairs;
+      
+      // Narrow phase, with the pair in a fixed order so its manifold is found
+      // again next step
+      unsigned int firstIndex = first->getHandle().index;
+      unsigned int secondIndex = second->getHandle().index;
+      if(secondIndex < firstIndex)
+      {
+        std::swap(first, second);
+        std::swap(firstIndex, secondIndex);
+      }
+      
+      collide(first, second, firstIndex, secondIndex, second->getCollider());
+    }
+  }
+  
+  // The ground is one big box, so every awake body is tested against it
+  for(size_t i = 0; hasGround && i < numBodies; ++i)
+  {
+    if(!bodies[i]->isAsleep()
+       && bounds[i].min.y <= groundBounds.max.y
+       && bounds[i].max.x >= groundBounds.min.x && bounds[i].min.x <= groundBounds.max.x
+       && bounds[i].max.z >= groundBounds.min.z && bounds[i].min.z <= groundBounds.max.z)
+    {
+      collide(bodies[i], NULL, bodies[i]->getHandle().index, POOL_INVALID_INDEX, ground);
+    }
+  }
+  
+  touching.clear();
+  for(ManifoldMap::iterator it = manifolds.begin(); it != manifolds.end();)
+  {
+    if(it->second.numPoints == 0)
+    {
+      manifolds.erase(it++);
+    }
+    else
+    {
+      touching.push_back(&it->second);
+      ++it;
+    }
+  }
+}
+
+void CollisionWorld::removeBody(PhysModel* body)
+{
+  for(ManifoldMap::iterator it = manifolds.begin(); it != manifolds.end();)
+  {
+    if(it->second.a == body || (it->second.b && it->second.b == body))
+    {
+      manifolds.erase(it++);
+    }
+    else
+    {
+      ++it;
+    }
+  }
+  touching.clear();
+}
+
+void CollisionWorld::addManifold(const ContactManifold& manifold)
+{
+  // Kept under the same key collide() would use, so it is found again
+  ContactManifold added = manifold;
+  unsigned int indexA = added.a->getHandle().index;
+  unsigned int indexB = added.b ? added.b->getHandle().index : POOL_INVALID_INDEX;
+  if(indexB < indexA)
+  {
+    // Seen from the other body. The friction directions depend on the normal,
+    // so their impulses don't carry over.
+    std::swap(added.a, added.b);
+    std::swap(indexA, indexB);
+    added.normal = -added.normal;
+    for(int i = 0; i < added.numPoints; ++i)
+    {
+      ContactPoint& point = added.points[i];
+      std::swap(point.localA, point.localB);
+      std::swap(point.worldA, point.worldB);
+      point.tangentImpulse[0] = point.tangentImpulse[1] = 0.0f;
+    }
+  }
+  
+  std::pair<ManifoldMap::iterator, bool> inserted = manifolds.insert(std::make_pair(std::make_pair(indexA, indexB), added));
+  if(inserted.second)
+  {
+    touching.push_back(&inserted.first->second);
+  }
+  else
+  {
+    inserted.first->second = added;
+  }
+}
@@ -0,0 +1,124 @@
+#ifndef COLLISION_WORLD_H
+#define COLLISION_WORLD_H
+
+#include <functional>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "PhysModel.h"
+#include "Pool.h"
+#include "Narrowphase.h"
+
+#define MANIFOLD_MAX_POINTS 4
+#define CONTACT_BREAKING_DISTANCE 0.02f // Drift at which a kept point is dropped
+#define CONTACT_MATCH_DISTANCE 0.02f    // New points this close to old ones replace them
+#define BROADPHASE_MARGIN 0.01f
+#define MANIFOLD_PERTURBATIONS 4        // Tilted queries run to fill a manifold
+#define MANIFOLD_PERTURBATION_ANGLE 0.1f // Radians
+#define GROUND_THICKNESS 1.0f           // Depth of the solid below the collision surface
+#define CCD_MAX_SAMPLES 64              // Poses tested along a fast body's path
+#define CCD_BISECTIONS 8                // Halvings to narrow down the first touching pose
+
+// A point of contact between two bodies. The local points are in each body's
+// frame, so the point can be followed as the bodies move. The accumulated
+// impulses persist with the point from step to step, so a solver can start
+// from last step's answer (warm starting).
+struct ContactPoint
+{
+  glm::vec3 localA, localB;
+  glm::vec3 worldA, worldB;
+  float depth;
+  float normalImpulse;
+  float tangentImpulse[2];
+};
+
+// Up to MANIFOLD_MAX_POINTS contact points between a pair of bodies. Each step
+// adds the deepest point the narrow phase found; points from earlier steps stay
+// while the bodies haven't slid apart, so resting contact builds up a stable
+// patch.
+struct ContactManifold
+{
+  PhysModel* a;
+  PhysModel* b;     // NULL for the ground
+  glm::vec3 normal; // From a towards b
+  ContactPoint points[MANIFOLD_MAX_POINTS];
+  int numPoints;
+};
+
+// A body's extent along the sweep axis
+struct SweepInterval
+{
+  float min, max;
+  unsigned int body;
+};
+
+// Something in a fast body's way, and how deeply the body already overlapped
+// it at the start of the step (negative if it didn't)
+struct SweepObstacle
+{
+  Collider collider;
+  float startDepth;
+};
+
+// Finds the contacts between bodies, and with the ground: a sweep and prune
+// broad phase over world bounds along x, GJK/EPA on the pairs that overlap
+// there, and a persistent manifold for each touching pair. Bodies that moved
+// far enough in a step to have passed through something are swept along
+// their path first (continuous collision detection).
+class CollisionWorld
+{
+private:
+  // Keyed by the bodies' pool indices, lower first. Contacts come and go every
+  // step, so the map's nodes are recycled rather than allocated each time.
+  typedef std::pair<unsigned int, unsigned int> ManifoldKey;
+  typedef std::map<ManifoldKey, ContactManifold, std::less<ManifoldKey>,
+                   RecyclingAllocator<std::pair<const ManifoldKey, ContactManifold> > > ManifoldMap;
+  NodeRecycler manifoldNodes; // Before the map, which it must outlive
+  ManifoldMap manifolds;
+  std::vector<SweepInterval> intervals;
+  std::vector<Bounds> bounds;
+  std::vector<ContactManifold*> touching;
+  std::vector<SweepObstacle> obstacles;
+  int numBroadphasePairs;
+  int numFastBodies;
+  
+  bool hasGround;
+  Collider ground;
+  Bounds groundBounds;
+  
+  void setGround(Model* surface);
+  bool sweep(const std::vector<PhysModel*>& bodies, size_t index);
+  void collide(PhysModel* a, PhysModel* b, unsigned int indexA, unsigned int indexB, const Collider& colliderB);
+  void refresh(ContactManifold* manifold);
+  void addPoint(ContactManifold* manifold, const Penetration& penetration);
+
+public:
+  CollisionWorld();
+  
+  // Updates the contacts between bodies, and between bodies and the solid
+  // slab under the surface (if any), at their latest states
+  void update(const std::vector<PhysModel*>& bodies, Model* surface);
+  // Forgets every contact of a body that is leaving the scene
+  void removeBody(PhysModel* body);
+  // Adds a manifold found elsewhere (such as in a snapshot), replacing any the
+  // pair already has
+  void addManifold(const ContactManifold& manifold);
+  
+  // Manifolds with at least one point, as of the last update
+  const std::vector<ContactManifold*>& getManifolds()
+  {
+    return touching;
+  }
+  int getNumBroadphasePairs()
+  {
+    return numBroadphasePairs;
+  }
+  // Bodies swept along their path in the last update
+  int getNumFastBodies()
+  {
+    return numFastBodies;
+  }
+};
+
+#endif
@@ -0,0 +1,263 @@
+#include "ContactSolver.h"
+#include "Profiler.h"
+
+#include <cmath>
+
+#define SLOT_NONE 0xFFFFFFFFu
+
+// Two unit vectors perpendicular to the normal and to each other. The same
+// normal always gives the same tangents, so warm started tangential impulses
+// still point the right way.
+static void tangentsOf(glm::vec3 normal, glm::vec3* tangents)
+{
+  glm::vec3 side = fabsf(normal.x) < 0.57f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+  tangents[0] = glm::normalize(glm::cross(normal, side));
+  tangents[1] = glm::cross(normal, tangents[0]);
+}
+
+// The inverse of how much an impulse along a direction changes the relative
+// velocity of the two points along it
+static float effectiveMass(const SolverBody& a, const SolverBody& b, glm::vec3 armA, glm::vec3 armB, glm::vec3 direction)
+{
+  glm::vec3 axisA = glm::cross(armA, direction);
+  glm::vec3 axisB = glm::cross(armB, direction);
+  float inverseMass = a.inverseMass + b.inverseMass
+                    + glm::dot(axisA, a.inverseInertia * axisA)
+                    + glm::dot(axisB, b.inverseInertia * axisB);
+  return inverseMass > 0.0f ? 1.0f / inverseMass : 0.0f;
+}
+
+// Velocity of the point on b relative to the point on a
+static glm::vec3 relativeVelocity(const SolverBody& a, const SolverBody& b, glm::vec3 armA, glm::vec3 armB)
+{
+  return b.linearVelocity + glm::cross(b.angularVelocity, armB)
+       - a.linearVelocity - glm::cross(a.angularVelocity, armA);
+}
+
+ContactSolver::ContactSolver()
+{
+  iterations = CONTACT_DEFAULT_ITERATIONS;
+}
+
+unsigned int ContactSolver::slotOf(PhysModel* body)
+{
+  if(!body)
+  {
+    return 0;
+  }
+  
+  unsigned int& slot = slots[body->getIslandIndex()];
+  if(slot == SLOT_NONE)
+  {
+    const PhysState& state = body->getState();
+    SolverBody solverBody;
+    solverBody.body = body;
+    solverBody.linearVelocity = state.velocity();
+    solverBody.angularVelocity = state.angularVelocity();
+    solverBody.inverseMass = state.inverseMass;
+    solverBody.inverseInertia = state.worldInverseInertia();
+    slot = solverBodies.size();
+    solverBodies.push_back(solverBody);
+  }
+  
+  return slot;
+}
+
+void ContactSolver::prepare(const std::vector<ContactManifold*>& manifolds, float dt)
+{
+  SolverBody ground;
+  ground.body = NULL;
+  ground.linearVelocity = ground.angularVelocity = glm::vec3(0.0f);
+  ground.inverseMass = 0.0f;
+  ground.inverseInertia = glm::mat3(0.0f);
+  solverBodies.clear();
+  solverBodies.push_back(ground);
+  constraints.clear();
+  
+  for(size_t m = 0; m < manifolds.size(); ++m)
+  {
+    // Only pairs that are both asleep are left touching a sleeping body, and
+    // those stay as they are
+    ContactManifold* manifold = manifolds[m];
+    if(manifold->a->isAsleep())
+    {
+      continue;
+    }
+    
+    unsigned int a = slotOf(manifold->a);
+    unsigned int b = slotOf(manifold->b);
+    const ContactMaterial& materialA = manifold->a->getContactMaterial();
+    const ContactMaterial& materialB = manifold->b ? manifold->b->getContactMaterial() : materialA;
+    glm::vec3 positionA = manifold->a->getState().position;
+    glm::vec3 positionB = manifold->b ? manifold->b->getState().position : glm::vec3(0.0f);
+    
+    for(int p = 0; p < manifold->numPoints; ++p)
+    {
+      ContactPoint* point = &manifold->points[p];
+      
+      ContactConstraint constraint;
+      constraint.point = point;
+      constraint.a = a;
+      constraint.b = b;
+      constraint.armA = point->worldA - positionA;
+      constraint.armB = manifold->b ? point->worldB - positionB : glm::vec3(0.0f);
+      constraint.normal = manifold->normal;
+      tangentsOf(constraint.normal, constraint.tangents);
+      
+      const SolverBody& bodyA = solverBodies[a];
+      const SolverBody& bodyB = solverBodies[b];
+      constraint.normalMass = effectiveMass(bodyA, bodyB, constraint.armA, constraint.armB, constraint.normal);
+      for(int t = 0; t < 2; ++t)
+      {
+        constraint.tangentMass[t] = effectiveMass(bodyA, bodyB, constraint.armA, constraint.armB, constraint.tangents[t]);
+      }
+      
+      // Combined like most engines do: friction by geometric mean, and the
+      // bouncier surface wins
+      glm::vec3 velocity = relativeVelocity(bodyA, bodyB, constraint.armA, constraint.armB);
+      float approach = glm::dot(velocity, constraint.normal);
+      float sliding = glm::length(velocity - constraint.normal * approach);
+      constraint.friction = sliding < CONTACT_STATIC_SPEED
+                          ? sqrtf(materialA.staticFriction * materialB.staticFriction)
+                          : sqrtf(materialA.kineticFriction * materialB.kineticFriction);
+      
+      // Points still apart may close the gap over the next step, but no more
+      // (speculative contact), so a tilted body isn't propped up on them
+      float restitution = glm::max(materialA.restitution, materialB.restitution);
+      if(point->depth < 0.0f)
+      {
+        constraint.target = point->depth / dt;
+      }
+      else
+      {
+        constraint.target = approach < -CONTACT_RESTITUTION_SPEED ? -restitution * approach : 0.0f;
+      }
+      
+      constraints.push_back(constraint);
+    }
+  }
+}
+
+void ContactSolver::apply(const ContactConstraint& constraint, glm::vec3 impulse)
+{
+  SolverBody& a = solverBodies[constraint.a];
+  SolverBody& b = solverBodies[constraint.b];
+  a.linearVelocity -= impulse * a.inverseMass;
+  a.angularVelocity -= a.inverseInertia * glm::cross(constraint.armA, impulse);
+  b.linearVelocity += impulse * b.inverseMass;
+  b.angularVelocity += b.inverseInertia * glm::cross(constraint.armB, impulse);
+}
+
+void ContactSolver::warmStart()
+{
+  for(size_t i = 0; i < constraints.size(); ++i)
+  {
+    const ContactConstraint& constraint = constraints[i];
+    const ContactPoint* point = constraint.point;
+    glm::vec3 impulse = constraint.normal * point->normalImpulse
+                      + constraint.tangents[0] * point->tangentImpulse[0]
+                      + constraint.tangents[1] * point->tangentImpulse[1];
+    apply(constraint, impulse);
+  }
+}
+
+void ContactSolver::solveVelocities()
+{
+  for(int iteration = 0; iteration < iterations; ++iteration)
+  {
+    for(size_t i = 0; i < constraints.size(); ++i)
+    {
+      const ContactConstraint& constraint = constraints[i];
+      ContactPoint* point = constraint.point;
+      
+      // Friction first, bounded by the normal impulse so far. Each tangent is
+      // solved on its own, then the pair is clamped to the cone together.
+      glm::vec3 velocity = relativeVelocity(solverBodies[constraint.a], solverBodies[constraint.b], constraint.armA, constraint.armB);
+      float old[2] = { point->tangentImpulse[0], point->tangentImpulse[1] };
+      float accumulated[2];
+      for(int t = 0; t < 2; ++t)
+      {
+        accumulated[t] = old[t] - glm::dot(velocity, constraint.tangents[t]) * constraint.tangentMass[t];
+      }
+      
+      float limit = constraint.friction * point->normalImpulse;
+      float magnitude = sqrtf(accumulated[0] * accumulated[0] + accumulated[1] * accumulated[1]);
+      if(magnitude > limit)
+      {
+        float scale = magnitude > 0.0f ? limit / magnitude : 0.0f;
+        accumulated[0] *= scale;
+        accumulated[1] *= scale;
+      }
+      point->tangentImpulse[0] = accumulated[0];
+      point->tangentImpulse[1] = accumulated[1];
+      apply(constraint, constraint.tangents[0] * (accumulated[0] - old[0])
+                      + constraint.tangents[1] * (accumulated[1] - old[1]));
+      
+      // Then stop the points approaching faster than the target allows, never
+      // pulling them together
+      velocity = relativeVelocity(solverBodies[constraint.a], solverBodies[constraint.b], constraint.armA, constraint.armB);
+      float approach = glm::dot(velocity, constraint.normal);
+      float oldNormal = point->normalImpulse;
+      point->normalImpulse = glm::max(oldNormal + (constraint.target - approach) * constraint.normalMass, 0.0f);
+      apply(constraint, constraint.normal * (point->normalImpulse - oldNormal));
+    }
+  }
+}
+
+void ContactSolver::correctPositions()
+{
+  // Each point is measured again at the bodies' corrected poses, so pushing
+  // one pair apart can be made up for when it pushes another together
+  for(int iteration = 0; iteration < CONTACT_POSITION_ITERATIONS; ++iteration)
+  {
+    for(size_t i = 0; i < constraints.size(); ++i)
+    {
+      const ContactConstraint& constraint = constraints[i];
+      const ContactPoint* point = constraint.point;
+      SolverBody& a = solverBodies[constraint.a];
+      SolverBody& b = solverBodies[constraint.b];
+      
+      const PhysState& stateA = a.body->getState();
+      glm::vec3 armA = glm::normalize(stateA.orientation) * point->localA;
+      glm::vec3 armB(0.0f);
+      glm::vec3 worldB = point->worldB;
+      if(b.body)
+      {
+        const PhysState& stateB = b.body->getState();
+        armB = glm::normalize(stateB.orientation) * point->localB;
+        worldB = stateB.position + armB;
+      }
+      
+      float depth = glm::dot(stateA.position + armA - worldB, constraint.normal);
+      if(depth <= CONTACT_SLOP)
+      {
+        continue;
+      }
+      
+      float mass = effectiveMass(a, b, armA, armB, constraint.normal);
+      glm::vec3 impulse = constraint.normal * ((depth - CONTACT_SLOP) * CONTACT_CORRECTION * mass);
+      a.body->displace(-impulse * a.inverseMass, -(a.inverseInertia * glm::cross(armA, impulse)));
+      if(b.body)
+      {
+        b.body->displace(impulse * b.inverseMass, b.inverseInertia * glm::cross(armB, impulse));
+      }
+    }
+  }
+}
+
+void ContactSolver::solve(const std::vector<PhysModel*>& bodies, const std::vector<ContactManifold*>& manifolds, float dt)
+{
+  PROFILE_ZONE("ContactSolver::solve");
+  
+  slots.assign(bodies.size(), SLOT_NONE);
+  prepare(manifolds, dt);
+  warmStart();
+  solveVelocities();
+  
+  for(size_t i = 1; i < solverBodies.size(); ++i)
+  {
+    solverBodies[i].body->setVelocities(solverBodies[i].linearVelocity, solverBodies[i].angularVelocity);
+  }
+  
+  correctPositions();
+}
@@ -0,0 +1,87 @@
+#ifndef CONTACT_SOLVER_H
+#define CONTACT_SOLVER_H
+
+#include <vector>
+
+#include "PhysModel.h"
+#include "CollisionWorld.h"
+
+#define CONTACT_DEFAULT_ITERATIONS 10
+#define CONTACT_POSITION_ITERATIONS 10
+#define CONTACT_SLOP 0.005f             // Penetration left alone, so resting contact persists
+#define CONTACT_CORRECTION 0.3f         // Fraction of the penetration removed per pass
+#define CONTACT_RESTITUTION_SPEED 0.5f  // Slower impacts than this don't bounce
+#define CONTACT_STATIC_SPEED 0.05f      // Slower sliding than this is held by static friction
+
+// A body's velocities while the solver works on them. Slot 0 is the ground,
+// which has no inverse mass, so it never moves.
+struct SolverBody
+{
+  PhysModel* body;
+  glm::vec3 linearVelocity, angularVelocity;
+  float inverseMass;
+  glm::mat3 inverseInertia; // World frame
+};
+
+// One contact point as a non-penetration constraint plus two friction
+// constraints along the tangents
+struct ContactConstraint
+{
+  ContactPoint* point;
+  unsigned int a, b;        // Solver body slots
+  glm::vec3 armA, armB;     // From each body's position to the point
+  glm::vec3 normal;         // From a towards b
+  glm::vec3 tangents[2];
+  float normalMass;
+  float tangentMass[2];
+  float friction;
+  float target;             // Lowest normal speed allowed: to bounce, or to close a gap
+};
+
+// Sequential impulses (projected Gauss-Seidel) on the contact manifolds, run
+// on the velocities after integration. Each point's normal impulse is kept
+// non-negative and its tangential impulse inside the friction cone, on the
+// impulses accumulated over the iterations rather than on each correction.
+// The accumulated impulses are stored with the points and applied up front on
+// the next step (warm starting), so a resting stack starts from the impulses
+// that held it last step and needs few iterations. Penetration is then pushed
+// out at the points directly on positions and orientations, so it never adds
+// energy.
+class ContactSolver
+{
+private:
+  int iterations;
+  
+  std::vector<SolverBody> solverBodies;
+  std::vector<unsigned int> slots;      // Solver body of each scene body
+  std::vector<ContactConstraint> constraints;
+  
+  unsigned int slotOf(PhysModel* body);
+  void prepare(const std::vector<ContactManifold*>& manifolds, float dt);
+  void warmStart();
+  void solveVelocities();
+  void correctPositions();
+  void apply(const ContactConstraint& constraint, glm::vec3 impulse);
+
+public:
+  ContactSolver();
+  
+  // Resolves the touching manifolds, changing the latest states of the bodies.
+  // Bodies must carry their index in bodies as their island index.
+  void solve(const std::vector<PhysModel*>& bodies, const std::vector<ContactManifold*>& manifolds, float dt);
+  
+  void setIterations(int iterations)
+  {
+    this->iterations = iterations;
+  }
+  int getIterations()
+  {
+    return iterations;
+  }
+  size_t getNumConstraints()
+  {
+    return constraints.size();
+  }
+};
+
+#endif
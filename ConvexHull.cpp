@@ -0,0 +1,358 @@
+#include "ConvexHull.h"
+
+#include <cmath>
+#include <map>
+#include <set>
+#include <utility>
+
+struct HullFace
+{
+  unsigned int v[3];
+  glm::vec3 normal;
+  float offset;
+  std::vector<unsigned int> outside; // Points above this face
+  bool alive;
+};
+
+static HullFace makeFace(const std::vector<glm::vec3>& points, unsigned int a, unsigned int b, unsigned int c)
+{
+  HullFace face;
+  face.v[0] = a;
+  face.v[1] = b;
+  face.v[2] = c;
+  face.normal = glm::normalize(glm::cross(points[b] - points[a], points[c] - points[a]));
+  face.offset = glm::dot(face.normal, points[a]);
+  face.alive = true;
+  return face;
+}
+
+static float distanceAbove(const HullFace& face, glm::vec3 point)
+{
+  return glm::dot(face.normal, point) - face.offset;
+}
+
+// Hands each point to the face it is furthest above, if any
+static void assignOutside(std::vector<HullFace>* faces, size_t firstFace, const std::vector<glm::vec3>& points,
+                          const std::vector<unsigned int>& candidates, float epsilon)
+{
+  for(size_t i = 0; i < candidates.size(); ++i)
+  {
+    unsigned int point = candidates[i];
+    float best = epsilon;
+    HullFace* owner = NULL;
+    for(size_t f = firstFace; f < faces->size(); ++f)
+    {
+      HullFace& face = (*faces)[f];
+      if(face.alive)
+      {
+        float distance = distanceAbove(face, points[point]);
+        if(distance > best)
+        {
+          best = distance;
+          owner = &face;
+        }
+      }
+    }
+    
+    if(owner)
+    {
+      owner->outside.push_back(point);
+    }
+  }
+}
+
+static glm::vec3 supportOf(const std::vector<glm::vec3>& points, glm::vec3 direction)
+{
+  size_t best = 0;
+  float bestDot = glm::dot(points[0], direction);
+  for(size_t i = 1; i < points.size(); ++i)
+  {
+    float dot = glm::dot(points[i], direction);
+    if(dot > bestDot)
+    {
+      bestDot = dot;
+      best = i;
+    }
+  }
+  
+  return points[best];
+}
+
+// Collects up to count distinct support points of directions spread evenly over
+// the sphere (a Fibonacci spiral), trying more directions until there are
+// enough or more stop turning up new points
+static void spreadSupportPoints(const std::vector<glm::vec3>& points, size_t count, std::vector<glm::vec3>* kept)
+{
+  for(size_t numDirections = count; kept->size() < count && numDirections <= count * 8; numDirections *= 2)
+  {
+    std::set<std::pair<float, std::pair<float, float> > > seen;
+    kept->clear();
+    for(size_t i = 0; i < numDirections && kept->size() < count; ++i)
+    {
+      float y = 1.0f - 2.0f * (i + 0.5f) / numDirections;
+      float radius = sqrtf(1.0f - y * y);
+      float angle = 2.39996323f * i; // Golden angle
+      glm::vec3 point = supportOf(points, glm::vec3(cosf(angle) * radius, y, sinf(angle) * radius));
+      if(seen.insert(std::make_pair(point.x, std::make_pair(point.y, point.z))).second)
+      {
+        kept->push_back(point);
+      }
+    }
+  }
+}
+
+ConvexHull* ConvexHull::build(const float* points, size_t count, size_t maxVertices)
+{
+  ConvexHull* hull = new ConvexHull();
+  if(count == 0)
+  {
+    hull->vertices.push_back(glm::vec3());
+    return hull;
+  }
+  
+  std::vector<glm::vec3> cloud(count);
+  glm::vec3 min(points[0], points[1], points[2]), max = min;
+  for(size_t i = 0; i < count; ++i)
+  {
+    cloud[i] = glm::vec3(points[i * 3], points[i * 3 + 1], points[i * 3 + 2]);
+    min = glm::min(min, cloud[i]);
+    max = glm::max(max, cloud[i]);
+  }
+  
+  // Tolerance relative to the size of the cloud
+  glm::vec3 extent = max - min;
+  float epsilon = 1e-5f * glm::max(extent.x, glm::max(extent.y, extent.z));
+  
+  hull->quickhull(cloud, epsilon);
+  
+  if(maxVertices == 0 || hull->vertices.size() <= maxVertices)
+  {
+    return hull;
+  }
+  
+  // Decimate: rebuild from the hull's support points in spread out directions
+  std::vector<glm::vec3> kept;
+  spreadSupportPoints(hull->vertices, maxVertices, &kept);
+  
+  hull->vertices.clear();
+  hull->faces.clear();
+  hull->quickhull(kept, epsilon);
+  return hull;
+}
+
+void ConvexHull::quickhull(const std::vector<glm::vec3>& points, float epsilon)
+{
+  // Initial simplex: the furthest apart of the extreme points along each axis,
+  // then the point furthest from their line, then from their plane
+  unsigned int extremes[6] = { 0, 0, 0, 0, 0, 0 };
+  for(unsigned int i = 0; i < points.size(); ++i)
+  {
+    for(int axis = 0; axis < 3; ++axis)
+    {
+      if(points[i][axis] < points[extremes[axis * 2]][axis])
+      {
+        extremes[axis * 2] = i;
+      }
+      if(points[i][axis] > points[extremes[axis * 2 + 1]][axis])
+      {
+        extremes[axis * 2 + 1] = i;
+      }
+    }
+  }
+  
+  unsigned int a = 0, b = 0;
+  float widest = -1.0f;
+  for(int axis = 0; axis < 3; ++axis)
+  {
+    float width = glm::length(points[extremes[axis * 2 + 1]] - points[extremes[axis * 2]]);
+    if(width > widest)
+    {
+      widest = width;
+      a = extremes[axis * 2];
+      b = extremes[axis * 2 + 1];
+    }
+  }
+  
+  unsigned int c = a, d = a;
+  float furthest = 0.0f;
+  glm::vec3 line = points[b] - points[a];
+  for(unsigned int i = 0; i < points.size(); ++i)
+  {
+    float distance = glm::length(glm::cross(points[i] - points[a], line));
+    if(distance > furthest)
+    {
+      furthest = distance;
+      c = i;
+    }
+  }
+  
+  furthest = 0.0f;
+  glm::vec3 normal = glm::cross(line, points[c] - points[a]);
+  float normalLength = glm::length(normal);
+  for(unsigned int i = 0; i < points.size() && normalLength > 0.0f; ++i)
+  {
+    float distance = fabs(glm::dot(points[i] - points[a], normal)) / normalLength;
+    if(distance > furthest)
+    {
+      furthest = distance;
+      d = i;
+    }
+  }
+  
+  if(widest <= epsilon || furthest <= epsilon)
+  {
+    // Flat: there is no volume to wrap, but the outline still gives a usable
+    // support function
+    spreadSupportPoints(points, HULL_MAX_VERTICES, &vertices);
+    return;
+  }
+  
+  // Wind the simplex so every face points away from d
+  std::vector<HullFace> hullFaces;
+  if(glm::dot(points[d] - points[a], normal) > 0.0f)
+  {
+    std::swap(b, c);
+  }
+  hullFaces.push_back(makeFace(points, a, b, c));
+  hullFaces.push_back(makeFace(points, a, d, b));
+  hullFaces.push_back(makeFace(points, b, d, c));
+  hullFaces.push_back(makeFace(points, c, d, a));
+  
+  std::vector<unsigned int> candidates;
+  for(unsigned int i = 0; i < points.size(); ++i)
+  {
+    if(i != a && i != b && i != c && i != d)
+    {
+      candidates.push_back(i);
+    }
+  }
+  assignOutside(&hullFaces, 0, points, candidates, epsilon);
+  
+  // Each directed edge, to the face it belongs to
+  std::map<std::pair<unsigned int, unsigned int>, unsigned int> edges;
+  for(unsigned int f = 0; f < hullFaces.size(); ++f)
+  {
+    for(int e = 0; e < 3; ++e)
+    {
+      edges[std::make_pair(hullFaces[f].v[e], hullFaces[f].v[(e + 1) % 3])] = f;
+    }
+  }
+  
+  size_t next = 0;
+  while(next < hullFaces.size())
+  {
+    if(!hullFaces[next].alive || hullFaces[next].outside.empty())
+    {
+      ++next;
+      continue;
+    }
+    
+    // Add the point furthest above this face
+    std::vector<unsigned int>& outside = hullFaces[next].outside;
+    unsigned int eye = outside[0];
+    float eyeDistance = distanceAbove(hullFaces[next], points[eye]);
+    for(size_t i = 1; i < outside.size(); ++i)
+    {
+      float distance = distanceAbove(hullFaces[next], points[outside[i]]);
+      if(distance > eyeDistance)
+      {
+        eyeDistance = distance;
+        eye = outside[i];
+      }
+    }
+    
+    // Flood out from this face over every face the point can see. Keeping to
+    // the connected region keeps the horizon a single loop even when rounding
+    // makes faces elsewhere look visible.
+    std::vector<unsigned int> visible(1, next);
+    std::vector<std::pair<unsigned int, unsigned int> > horizon;
+    hullFaces[next].alive = false;
+    candidates.clear();
+    for(size_t v = 0; v < visible.size(); ++v)
+    {
+      HullFace& face = hullFaces[visible[v]];
+      candidates.insert(candidates.end(), face.outside.begin(), face.outside.end());
+      face.outside.clear();
+      
+      for(int e = 0; e < 3; ++e)
+      {
+        unsigned int from = face.v[e], to = face.v[(e + 1) % 3];
+        HullFace& neighbor = hullFaces[edges[std::make_pair(to, from)]];
+        if(!neighbor.alive)
+        {
+          continue; // Already visible (or this edge was handled from its side)
+        }
+        
+        if(distanceAbove(neighbor, points[eye]) > epsilon)
+        {
+          neighbor.alive = false;
+          visible.push_back(edges[std::make_pair(to, from)]);
+        }
+        else
+        {
+          horizon.push_back(std::make_pair(from, to));
+        }
+      }
+    }
+    
+    for(size_t v = 0; v < visible.size(); ++v)
+    {
+      const HullFace& face = hullFaces[visible[v]];
+      for(int e = 0; e < 3; ++e)
+      {
+        edges.erase(std::make_pair(face.v[e], face.v[(e + 1) % 3]));
+      }
+    }
+    
+    // Fan new faces from the point to the horizon
+    size_t firstNew = hullFaces.size();
+    for(size_t h = 0; h < horizon.size(); ++h)
+    {
+      unsigned int index = hullFaces.size();
+      hullFaces.push_back(makeFace(points, horizon[h].first, horizon[h].second, eye));
+      edges[horizon[h]] = index;
+      edges[std::make_pair(horizon[h].second, eye)] = index;
+      edges[std::make_pair(eye, horizon[h].first)] = index;
+    }
+    
+    for(size_t i = 0; i < candidates.size(); ++i)
+    {
+      if(candidates[i] == eye)
+      {
+        candidates[i] = candidates.back();
+        candidates.pop_back();
+        break;
+      }
+    }
+    assignOutside(&hullFaces, firstNew, points, candidates, epsilon);
+    
+    // Faces before next can only have lost points, so carry on from there
+  }
+  
+  // Keep the vertices the remaining faces use
+  std::map<unsigned int, unsigned int> remap;
+  for(size_t f = 0; f < hullFaces.size(); ++f)
+  {
+    if(!hullFaces[f].alive)
+    {
+      continue;
+    }
+    
+    for(int corner = 0; corner < 3; ++corner)
+    {
+      unsigned int point = hullFaces[f].v[corner];
+      std::map<unsigned int, unsigned int>::iterator it = remap.find(point);
+      if(it == remap.end())
+      {
+        it = remap.insert(std::make_pair(point, (unsigned int)vertices.size())).first;
+        vertices.push_back(points[point]);
+      }
+      faces.push_back(it->second);
+    }
+  }
+}
+
+glm::vec3 ConvexHull::support(glm::vec3 direction) const
+{
+  return supportOf(vertices, direction);
+}
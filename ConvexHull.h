@@ -0,0 +1,50 @@
+#ifndef CONVEX_HULL_H
+#define CONVEX_HULL_H
+
+#include <cstddef>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#define HULL_MAX_VERTICES 64
+
+// A convex polyhedron, used as a cheap collision proxy for a mesh. Faces are
+// triangles wound counterclockwise seen from outside. Hulls of flat or
+// degenerate point sets have vertices but no faces; support() still works.
+class ConvexHull
+{
+private:
+  std::vector<glm::vec3> vertices;
+  std::vector<unsigned int> faces; // Three vertex indices per face
+
+  ConvexHull()
+  {
+    //
+  }
+  void quickhull(const std::vector<glm::vec3>& points, float epsilon);
+
+public:
+  // Builds the hull of count points (x, y, z triples) with quickhull. If the
+  // hull has more than maxVertices vertices (0 for no limit), it is rebuilt
+  // from the support points of evenly spread directions, which keeps its
+  // overall shape with fewer vertices.
+  static ConvexHull* build(const float* points, size_t count, size_t maxVertices = HULL_MAX_VERTICES);
+
+  // The vertex furthest along direction
+  glm::vec3 support(glm::vec3 direction) const;
+
+  const std::vector<glm::vec3>& getVertices() const
+  {
+    return vertices;
+  }
+  const std::vector<unsigned int>& getFaces() const
+  {
+    return faces;
+  }
+  size_t getNumFaces() const
+  {
+    return faces.size() / 3;
+  }
+};
+
+#endif
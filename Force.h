@@ -16,10 +16,24 @@ protected:
 public:
   virtual ~Force()
   {
-    target->removeForce(this);
+    detach();
+  }
+
+  // Unregisters the force from the model(s) it acts on, without destroying it.
+  // A detached force no longer affects the simulation and can be deleted later.
+  virtual void detach()
+  {
+    if(target)
+    {
+      target->removeForce(this);
+      target = NULL;
+    }
+  }
+  PhysModel* getTarget()
+  {
+    return target;
   }
 
-  virtual void applyForce(PhysModel* target, const PhysState& state, Derivative* derivative) = 0;
   virtual void draw(float alpha) = 0;
 };
 
@@ -12,6 +12,10 @@ GLint GLBridge::numLights;
 LightHandles GLBridge::lightHandlesArray[MAX_LIGHTS];
 int GLBridge::lightHandlesInUse;
 
+bool GLBridge::headless;
+
+int GLBridge::drawCalls;
+
 int GLBridge::InstallShader(const GLchar *vShaderName, const GLchar *fShaderName)
 {
   GLuint VS; //handles to shader object
@@ -134,6 +138,17 @@ LightHandles GLBridge::getLightHandles()
 void GLBridge::onDraw()
 {
   lightHandlesInUse = 0;
+  drawCalls = 0;
+}
+
+void GLBridge::countDrawCall()
+{
+  ++drawCalls;
+}
+
+int GLBridge::getNumDrawCalls()
+{
+  return drawCalls;
 }
 
 GLint GLBridge::getUViewMatrix()
@@ -154,4 +169,14 @@ GLint GLBridge::getUCameraPos()
 int GLBridge::getShaderProgram()
 {
   return shaderProgram;
-}
\ No newline at end of file
+}
+
+void GLBridge::setHeadless(bool headless)
+{
+  GLBridge::headless = headless;
+}
+
+bool GLBridge::isHeadless()
+{
+  return headless;
+}
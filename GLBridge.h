@@ -64,18 +64,31 @@ private:
   static LightHandles lightHandlesArray[MAX_LIGHTS];
   static int lightHandlesInUse;
 
+  static bool headless;
+
+  static int drawCalls;
+
 public:
   static int InstallShader(const GLchar *vShaderName, const GLchar *fShaderName);
 
   static TransHandles getTransHandles();
   static MaterialHandles getMaterialHandles();
   static LightHandles getLightHandles();
+  // Starts a frame: resets the light handles and the draw call count
   static void onDraw();
+  static void countDrawCall();
+  // Draw calls made since the frame started
+  static int getNumDrawCalls();
   static GLint getUViewMatrix();
   static GLint getUProjMatrix();
   static GLint getUCameraPos();
   static int getShaderProgram();
   static GLint getNumLightsHandle();
+  
+  // With no GL context (benchmarks, batch runs) meshes are loaded for their
+  // geometry only and never uploaded
+  static void setHeadless(bool headless);
+  static bool isHeadless();
 };
 
 #endif
\ No newline at end of file
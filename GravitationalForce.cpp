@@ -1,17 +1,16 @@
 #include "GravitationalForce.h"
 #include "PhysModel.h"
 
+DEFINE_POOLED(GravitationalForce, MEMORY_FORCES)
+
+glm::vec3 GravitationalForce::field(0.0f, GRAVITY, 0.0f);
+
 GravitationalForce* GravitationalForce::create(PhysModel* target)
 {
   return new GravitationalForce(target);
 }
 
-void GravitationalForce::applyForce(PhysModel* target, const PhysState& state, Derivative* derivative)
-{
-  derivative->force += glm::vec3(0.0f, state.mass * GRAVITY, 0.0f);
-}
-
 void GravitationalForce::draw(float alpha)
 {
   //
-}
\ No newline at end of file
+}
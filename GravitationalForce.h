@@ -11,13 +11,30 @@ private:
   GravitationalForce(PhysModel* target)
       : Force(target)
   {
-    //
+    target->addGravity(1);
   }
 public:
+  DECLARE_POOLED(GravitationalForce)
+  
+  // Gravity is the same everywhere in the world, so bodies only keep a count of
+  // how many gravitational forces act on them and scale this by their mass
+  static glm::vec3 field;
+  
   static GravitationalForce* create(PhysModel* target);
+  virtual ~GravitationalForce()
+  {
+    detach();
+  }
+  virtual void detach()
+  {
+    if(target)
+    {
+      target->addGravity(-1);
+    }
+    Force::detach();
+  }
   
-  virtual void applyForce(PhysModel* target, const PhysState& state, Derivative* derivative);
   virtual void draw(float alpha);
 };
 
-#endif
\ No newline at end of file
+#endif
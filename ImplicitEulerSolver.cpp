@@ -0,0 +1,280 @@
+#include "ImplicitEulerSolver.h"
+
+// Cross product matrix: skew(r) * v == cross(r, v)
+static glm::mat3 skew(glm::vec3 r)
+{
+  return glm::mat3(0.0f, r.z, -r.y,
+                   -r.z, 0.0f, r.x,
+                   r.y, -r.x, 0.0f);
+}
+
+// Adds sign * Jrow^T * c * Jcol to a block, where J = [I, -skew(arm)] maps a
+// generalized velocity to the velocity of the point at arm
+static void addCoupling(Block6* block, const glm::mat3& c, glm::vec3 rowArm, glm::vec3 columnArm, float sign)
+{
+  glm::mat3 columnS = -skew(columnArm);
+  glm::mat3 rowST = skew(rowArm);
+  glm::mat3 signedC = c * sign;
+  
+  block->ll += signedC;
+  block->la += signedC * columnS;
+  block->al += rowST * signedC;
+  block->aa += rowST * signedC * columnS;
+}
+
+// Velocity of the point at arm
+static glm::vec3 pointVelocity(const Vec6& velocity, glm::vec3 arm)
+{
+  return velocity.linear + glm::cross(velocity.angular, arm);
+}
+
+static double dot(const std::vector<Vec6>& a, const std::vector<Vec6>& b)
+{
+  double sum = 0.0;
+  for(size_t i = 0; i < a.size(); ++i)
+  {
+    sum += glm::dot(a[i].linear, b[i].linear) + glm::dot(a[i].angular, b[i].angular);
+  }
+  return sum;
+}
+
+ImplicitEulerSolver::ImplicitEulerSolver()
+{
+  tolerance = IMPLICIT_DEFAULT_TOLERANCE;
+  maxIterations = IMPLICIT_DEFAULT_MAX_ITERATIONS;
+  lastIterations = 0;
+  lastResidual = 0.0f;
+}
+
+void ImplicitEulerSolver::step(const std::vector<PhysModel*>& bodies,
+                               const SpringNetwork& network,
+                               const std::vector<PhysState>& states,
+                               const std::vector<Derivative>& derivatives,
+                               float dt,
+                               std::vector<PhysState>* result)
+{
+  size_t numBodies = bodies.size();
+  const std::vector<NetworkSpring>& springs = network.getSprings();
+  const std::vector<unsigned int>& rowStart = network.getRowStart();
+  const std::vector<unsigned int>& adjacency = network.getAdjacency();
+  float dt2 = dt * dt;
+  
+  velocities.resize(numBodies);
+  rhs.resize(numBodies);
+  diagonal.resize(numBodies);
+  
+  // Mass, friction and the forces at the start of the step
+  for(size_t i = 0; i < numBodies; ++i)
+  {
+    const PhysState& state = states[i];
+    velocities[i].linear = state.velocity();
+    velocities[i].angular = state.angularVelocity();
+    
+    Block6& block = diagonal[i];
+    block.ll = glm::mat3(state.mass + dt * state.friction);
+    block.aa = state.worldInertia() * (1.0f + dt * state.friction * state.inverseMass);
+    block.la = block.al = glm::mat3(0.0f);
+    
+    rhs[i].linear = derivatives[i].force * dt;
+    rhs[i].angular = derivatives[i].torque * dt;
+    
+    // Springs to fixed points only couple the body with itself
+    const std::vector<AnchorSpring>& anchors = bodies[i]->getAnchorSprings();
+    float scale = bodies[i]->getScale();
+    for(size_t j = 0; j < anchors.size(); ++j)
+    {
+      glm::vec3 arm = state.orientation * (anchors[j].attachOffset * scale);
+      glm::mat3 k(-anchors[j].k);
+      glm::mat3 c = k * dt2 - glm::mat3(anchors[j].b * dt);
+      addCoupling(&block, c, arm, arm, -1.0f);
+      
+      glm::vec3 g = k * pointVelocity(velocities[i], arm);
+      rhs[i].linear += g * dt2;
+      rhs[i].angular += glm::cross(arm, g) * dt2;
+    }
+  }
+  
+  // Linearize every spring of the network once
+  stiffness.resize(springs.size());
+  coupling.resize(springs.size());
+  armsA.resize(springs.size());
+  armsB.resize(springs.size());
+  for(size_t s = 0; s < springs.size(); ++s)
+  {
+    const NetworkSpring& spring = springs[s];
+    const PhysState& stateA = states[spring.a];
+    const PhysState& stateB = states[spring.b];
+    glm::vec3 armA = stateA.orientation * spring.offsetA;
+    glm::vec3 armB = stateB.orientation * spring.offsetB;
+    
+    // Stiffness of the spring with respect to its stretch. Below rest length the
+    // transverse term is dropped to keep the matrix positive definite.
+    glm::mat3 k(-spring.k);
+    glm::vec3 x = (stateA.position + armA) - (stateB.position + armB);
+    float length = glm::length(x);
+    if(spring.restLength > 0.0f && length > 0.0f)
+    {
+      glm::vec3 dir = x / length;
+      glm::mat3 along = glm::outerProduct(dir, dir);
+      float transverse = glm::max(0.0f, 1.0f - spring.restLength / length);
+      k = (along + (glm::mat3(1.0f) - along) * transverse) * -spring.k;
+    }
+    
+    stiffness[s] = k;
+    coupling[s] = k * dt2 - glm::mat3(spring.damping * dt);
+    armsA[s] = armA;
+    armsB[s] = armB;
+    
+    addCoupling(&diagonal[spring.a], coupling[s], armA, armA, -1.0f);
+    addCoupling(&diagonal[spring.b], coupling[s], armB, armB, -1.0f);
+    
+    glm::vec3 g = k * (pointVelocity(velocities[spring.a], armA) - pointVelocity(velocities[spring.b], armB));
+    rhs[spring.a].linear += g * dt2;
+    rhs[spring.a].angular += glm::cross(armA, g) * dt2;
+    rhs[spring.b].linear -= g * dt2;
+    rhs[spring.b].angular -= glm::cross(armB, g) * dt2;
+  }
+  
+  // Off diagonal blocks, one per spring end, in the network's rows
+  rows = rowStart;
+  offDiagonal.resize(adjacency.size());
+  column.resize(adjacency.size());
+  for(size_t i = 0; i < numBodies; ++i)
+  {
+    for(unsigned int e = rowStart[i]; e < rowStart[i + 1]; ++e)
+    {
+      unsigned int s = adjacency[e];
+      const NetworkSpring& spring = springs[s];
+      Block6& block = offDiagonal[e];
+      block.ll = block.la = block.al = block.aa = glm::mat3(0.0f);
+      
+      if(spring.a == i)
+      {
+        column[e] = spring.b;
+        addCoupling(&block, coupling[s], armsA[s], armsB[s], 1.0f);
+      }
+      else
+      {
+        column[e] = spring.a;
+        addCoupling(&block, coupling[s], armsB[s], armsA[s], 1.0f);
+      }
+    }
+  }
+  
+  preconditionLinear.resize(numBodies);
+  preconditionAngular.resize(numBodies);
+  for(size_t i = 0; i < numBodies; ++i)
+  {
+    preconditionLinear[i] = glm::inverse(diagonal[i].ll);
+    preconditionAngular[i] = glm::inverse(diagonal[i].aa);
+  }
+  
+  solve();
+  
+  // Apply the velocity change, then move with the new velocities
+  result->resize(numBodies);
+  for(size_t i = 0; i < numBodies; ++i)
+  {
+    PhysState& state = (*result)[i];
+    state = states[i];
+    
+    glm::vec3 velocity = velocities[i].linear + x[i].linear;
+    glm::vec3 angularVelocity = velocities[i].angular + x[i].angular;
+    state.linearMomentum = velocity * state.mass;
+    state.angularMomentum = states[i].worldInertia() * angularVelocity;
+    
+    state.position += velocity * dt;
+    glm::quat spin = 0.5f * glm::quat(0.0f, angularVelocity.x, angularVelocity.y, angularVelocity.z) * state.orientation;
+    state.orientation = glm::normalize(state.orientation + spin * dt);
+  }
+}
+
+void ImplicitEulerSolver::multiply(const std::vector<Vec6>& in, std::vector<Vec6>* out)
+{
+  for(size_t i = 0; i < diagonal.size(); ++i)
+  {
+    const Block6& block = diagonal[i];
+    Vec6 result;
+    result.linear = block.ll * in[i].linear + block.la * in[i].angular;
+    result.angular = block.al * in[i].linear + block.aa * in[i].angular;
+    
+    for(unsigned int e = rows[i]; e < rows[i + 1]; ++e)
+    {
+      const Block6& offBlock = offDiagonal[e];
+      const Vec6& other = in[column[e]];
+      result.linear += offBlock.ll * other.linear + offBlock.la * other.angular;
+      result.angular += offBlock.al * other.linear + offBlock.aa * other.angular;
+    }
+    
+    (*out)[i] = result;
+  }
+}
+
+void ImplicitEulerSolver::precondition(const std::vector<Vec6>& in, std::vector<Vec6>* out)
+{
+  for(size_t i = 0; i < in.size(); ++i)
+  {
+    (*out)[i].linear = preconditionLinear[i] * in[i].linear;
+    (*out)[i].angular = preconditionAngular[i] * in[i].angular;
+  }
+}
+
+void ImplicitEulerSolver::solve()
+{
+  size_t n = rhs.size();
+  x.assign(n, Vec6());
+  r = rhs;
+  z.resize(n);
+  p.resize(n);
+  q.resize(n);
+  
+  double rhsNorm = dot(rhs, rhs);
+  lastIterations = 0;
+  lastResidual = 0.0f;
+  if(rhsNorm == 0.0)
+  {
+    return;
+  }
+  
+  precondition(r, &z);
+  p = z;
+  double rz = dot(r, z);
+  double threshold = tolerance * tolerance * rhsNorm;
+  
+  for(int it = 0; it < maxIterations; ++it)
+  {
+    multiply(p, &q);
+    double pq = dot(p, q);
+    if(pq <= 0.0)
+    {
+      break; // Lost positive definiteness, keep what we have
+    }
+    
+    float alpha = rz / pq;
+    for(size_t i = 0; i < n; ++i)
+    {
+      x[i].linear += p[i].linear * alpha;
+      x[i].angular += p[i].angular * alpha;
+      r[i].linear -= q[i].linear * alpha;
+      r[i].angular -= q[i].angular * alpha;
+    }
+    
+    lastIterations = it + 1;
+    double rr = dot(r, r);
+    lastResidual = sqrt(rr / rhsNorm);
+    if(rr <= threshold)
+    {
+      break;
+    }
+    
+    precondition(r, &z);
+    double rzNext = dot(r, z);
+    float beta = rzNext / rz;
+    rz = rzNext;
+    for(size_t i = 0; i < n; ++i)
+    {
+      p[i].linear = z[i].linear + p[i].linear * beta;
+      p[i].angular = z[i].angular + p[i].angular * beta;
+    }
+  }
+}
@@ -0,0 +1,89 @@
+#ifndef IMPLICIT_EULER_SOLVER_H
+#define IMPLICIT_EULER_SOLVER_H
+
+#include <vector>
+
+#include "PhysModel.h"
+#include "SpringNetwork.h"
+
+#define IMPLICIT_DEFAULT_TOLERANCE 1e-5f
+#define IMPLICIT_DEFAULT_MAX_ITERATIONS 200
+
+// A generalized (linear, angular) velocity or force of one body
+struct Vec6
+{
+  glm::vec3 linear, angular;
+};
+
+// A 6x6 block of the system matrix, as four 3x3 blocks
+struct Block6
+{
+  glm::mat3 ll, la, al, aa;
+};
+
+// Backward Euler for bodies coupled by springs. Spring and friction forces are
+// linearized around the current state, and
+//
+//   (M - h D - h^2 K) du = h (f + h K u)
+//
+// is solved for the change in generalized velocity with conjugate gradients,
+// preconditioned by the inverses of the diagonal 3x3 blocks. The matrix has one
+// 6x6 block per body on the diagonal and one per spring end off it, laid out in
+// the same compressed rows as the network. Unlike RK4 this stays stable for
+// arbitrarily stiff springs at large timesteps (at the cost of extra damping).
+class ImplicitEulerSolver
+{
+private:
+  float tolerance;
+  int maxIterations;
+  int lastIterations;
+  float lastResidual;
+  
+  // System, with offDiagonal / column aligned to the network's adjacency
+  std::vector<Block6> diagonal;
+  std::vector<Block6> offDiagonal;
+  std::vector<unsigned int> rows, column;
+  std::vector<glm::mat3> preconditionLinear, preconditionAngular;
+  
+  // Per spring linearization
+  std::vector<glm::mat3> stiffness, coupling;
+  std::vector<glm::vec3> armsA, armsB;
+  
+  // Solver vectors
+  std::vector<Vec6> velocities, rhs, x, r, z, p, q;
+  
+  void multiply(const std::vector<Vec6>& in, std::vector<Vec6>* out);
+  void precondition(const std::vector<Vec6>& in, std::vector<Vec6>* out);
+  void solve();
+
+public:
+  ImplicitEulerSolver();
+  
+  // Takes the states at the start of the step along with the derivatives
+  // evaluated there, and writes the states at the end of the step.
+  void step(const std::vector<PhysModel*>& bodies,
+            const SpringNetwork& network,
+            const std::vector<PhysState>& states,
+            const std::vector<Derivative>& derivatives,
+            float dt,
+            std::vector<PhysState>* result);
+  
+  void setTolerance(float tolerance)
+  {
+    this->tolerance = tolerance;
+  }
+  void setMaxIterations(int maxIterations)
+  {
+    this->maxIterations = maxIterations;
+  }
+  int getLastIterations()
+  {
+    return lastIterations;
+  }
+  float getLastResidual()
+  {
+    return lastResidual;
+  }
+};
+
+#endif
@@ -0,0 +1,106 @@
+#include "Islands.h"
+
+IslandBuilder::IslandBuilder()
+{
+  for(int i = 0; i < ISLAND_HISTOGRAM_BUCKETS; ++i)
+  {
+    histogram[i] = 0;
+  }
+}
+
+void IslandBuilder::reset(size_t numBodies)
+{
+  parent.resize(numBodies);
+  rank.assign(numBodies, 0);
+  for(size_t i = 0; i < numBodies; ++i)
+  {
+    parent[i] = i;
+  }
+}
+
+unsigned int IslandBuilder::find(unsigned int body)
+{
+  // Path halving: point every other node on the way at its grandparent
+  while(parent[body] != body)
+  {
+    parent[body] = parent[parent[body]];
+    body = parent[body];
+  }
+  
+  return body;
+}
+
+void IslandBuilder::join(unsigned int a, unsigned int b)
+{
+  a = find(a);
+  b = find(b);
+  if(a == b)
+  {
+    return;
+  }
+  
+  // Union by rank keeps the trees shallow
+  if(rank[a] < rank[b])
+  {
+    parent[a] = b;
+  }
+  else
+  {
+    parent[b] = a;
+    if(rank[a] == rank[b])
+    {
+      ++rank[a];
+    }
+  }
+}
+
+void IslandBuilder::build()
+{
+  size_t numBodies = parent.size();
+  
+  // Number the roots in body order, so islands come out in a stable order
+  islandOf.resize(numBodies);
+  unsigned int numIslands = 0;
+  for(size_t i = 0; i < numBodies; ++i)
+  {
+    if(find(i) == i)
+    {
+      islandOf[i] = numIslands++;
+    }
+  }
+  
+  // Counting sort of the bodies by island
+  islandStart.assign(numIslands + 1, 0);
+  for(size_t i = 0; i < numBodies; ++i)
+  {
+    islandOf[i] = islandOf[find(i)];
+    ++islandStart[islandOf[i] + 1];
+  }
+  for(unsigned int i = 0; i < numIslands; ++i)
+  {
+    islandStart[i + 1] += islandStart[i];
+  }
+  
+  for(int i = 0; i < ISLAND_HISTOGRAM_BUCKETS; ++i)
+  {
+    histogram[i] = 0;
+  }
+  for(unsigned int i = 0; i < numIslands; ++i)
+  {
+    unsigned int size = islandStart[i + 1] - islandStart[i];
+    int bucket = 0;
+    while(size > 1 && bucket < ISLAND_HISTOGRAM_BUCKETS - 1)
+    {
+      size >>= 1;
+      ++bucket;
+    }
+    ++histogram[bucket];
+  }
+  
+  islandBodies.resize(numBodies);
+  fill.assign(islandStart.begin(), islandStart.end() - 1);
+  for(size_t i = 0; i < numBodies; ++i)
+  {
+    islandBodies[fill[islandOf[i]]++] = i;
+  }
+}
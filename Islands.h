@@ -0,0 +1,59 @@
+#ifndef ISLANDS_H
+#define ISLANDS_H
+
+#include <cstddef>
+#include <vector>
+
+#define ISLAND_HISTOGRAM_BUCKETS 16
+
+// Groups bodies into simulation islands: sets of bodies coupled to each other
+// (directly or through other bodies), which is what has to be simulated, put to
+// sleep and woken together. Bodies are joined with a union-find, then gathered
+// into islands laid out one after another: the bodies of island i are
+// islandBodies[islandStart[i]] up to islandBodies[islandStart[i + 1]].
+class IslandBuilder
+{
+private:
+  std::vector<unsigned int> parent;
+  std::vector<unsigned int> rank;
+  std::vector<unsigned int> islandOf;
+  std::vector<unsigned int> islandStart;
+  std::vector<unsigned int> islandBodies;
+  std::vector<unsigned int> fill; // Scratch, kept to avoid allocating every build
+  unsigned int histogram[ISLAND_HISTOGRAM_BUCKETS];
+
+public:
+  IslandBuilder();
+  
+  // Starts over with every body in an island of its own
+  void reset(size_t numBodies);
+  unsigned int find(unsigned int body);
+  void join(unsigned int a, unsigned int b);
+  // Gathers the islands joined so far
+  void build();
+  
+  size_t getNumIslands() const
+  {
+    return islandStart.empty() ? 0 : islandStart.size() - 1;
+  }
+  size_t getIslandSize(size_t island) const
+  {
+    return islandStart[island + 1] - islandStart[island];
+  }
+  const unsigned int* getIsland(size_t island) const
+  {
+    return &islandBodies[islandStart[island]];
+  }
+  unsigned int getIslandOf(unsigned int body) const
+  {
+    return islandOf[body];
+  }
+  // Bucket i counts the islands of 2^i up to 2^(i+1) - 1 bodies; the last
+  // bucket also counts everything bigger
+  const unsigned int* getSizeHistogram() const
+  {
+    return histogram;
+  }
+};
+
+#endif
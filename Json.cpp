@@ -0,0 +1,486 @@
+#include "Json.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+
+#define JSON_MAX_NUMBER_LENGTH 64
+#define JSON_EXACT_DIGITS 15
+#define JSON_EXACT_POWERS 22
+#define JSON_BYTES_PER_VALUE 16
+
+struct JsonParser
+{
+  JsonDocument* document;
+  std::vector<uint32_t> pending; // Children of the containers being parsed
+  const char* next;
+  const char* end;
+  int line;
+  std::string* error;
+  
+  bool fail(const char* message)
+  {
+    if(error)
+    {
+      char description[128];
+      snprintf(description, sizeof(description), "line %d: %s", line, message);
+      *error = description;
+    }
+    return false;
+  }
+  
+  void skipSpace()
+  {
+    while(next < end && (*next == ' ' || *next == '\t' || *next == '\n' || *next == '\r'))
+    {
+      if(*next == '\n')
+      {
+        ++line;
+      }
+      ++next;
+    }
+  }
+  
+  bool expect(const char* word)
+  {
+    size_t length = strlen(word);
+    if((size_t)(end - next) < length || memcmp(next, word, length) != 0)
+    {
+      return fail("unexpected character");
+    }
+    next += length;
+    return true;
+  }
+  
+  bool parseHex(unsigned int* code)
+  {
+    *code = 0;
+    for(int i = 0; i < 4; ++i, ++next)
+    {
+      if(next == end)
+      {
+        return fail("unfinished escape");
+      }
+      
+      char c = *next;
+      unsigned int digit;
+      if(c >= '0' && c <= '9')
+      {
+        digit = c - '0';
+      }
+      else if(c >= 'a' && c <= 'f')
+      {
+        digit = c - 'a' + 10;
+      }
+      else if(c >= 'A' && c <= 'F')
+      {
+        digit = c - 'A' + 10;
+      }
+      else
+      {
+        return fail("bad \\u escape");
+      }
+      *code = (*code << 4) | digit;
+    }
+    return true;
+  }
+  
+  static void putUtf8(unsigned int code, std::string* string)
+  {
+    if(code < 0x80)
+    {
+      string->push_back((char)code);
+    }
+    else if(code < 0x800)
+    {
+      string->push_back((char)(0xC0 | (code >> 6)));
+      string->push_back((char)(0x80 | (code & 0x3F)));
+    }
+    else if(code < 0x10000)
+    {
+      string->push_back((char)(0xE0 | (code >> 12)));
+      string->push_back((char)(0x80 | ((code >> 6) & 0x3F)));
+      string->push_back((char)(0x80 | (code & 0x3F)));
+    }
+    else
+    {
+      string->push_back((char)(0xF0 | (code >> 18)));
+      string->push_back((char)(0x80 | ((code >> 12) & 0x3F)));
+      string->push_back((char)(0x80 | ((code >> 6) & 0x3F)));
+      string->push_back((char)(0x80 | (code & 0x3F)));
+    }
+  }
+  
+  // Unescapes a string onto the end of the document's strings, terminated
+  bool parseString(uint32_t* offset, uint32_t* length)
+  {
+    std::string* string = &document->strings;
+    *offset = string->size();
+    ++next; // Opening quote
+    for(;;)
+    {
+      // Copy plain runs in one go
+      const char* run = next;
+      while(next < end && *next != '"' && *next != '\\' && (unsigned char)*next >= 0x20)
+      {
+        ++next;
+      }
+      string->append(run, next);
+      
+      if(next == end)
+      {
+        return fail("unfinished string");
+      }
+      if(*next == '"')
+      {
+        ++next;
+        *length = string->size() - *offset;
+        string->push_back('\0');
+        return true;
+      }
+      if(*next != '\\')
+      {
+        return fail("control character in string");
+      }
+      
+      if(++next == end)
+      {
+        return fail("unfinished escape");
+      }
+      char c = *next++;
+      switch(c)
+      {
+      case '"': case '\\': case '/':
+        string->push_back(c);
+        break;
+      case 'b':
+        string->push_back('\b');
+        break;
+      case 'f':
+        string->push_back('\f');
+        break;
+      case 'n':
+        string->push_back('\n');
+        break;
+      case 'r':
+        string->push_back('\r');
+        break;
+      case 't':
+        string->push_back('\t');
+        break;
+      case 'u':
+        {
+          unsigned int code;
+          if(!parseHex(&code))
+          {
+            return false;
+          }
+          
+          // Characters outside the basic plane come as a surrogate pair
+          if(code >= 0xD800 && code < 0xDC00)
+          {
+            unsigned int low;
+            if(end - next < 2 || next[0] != '\\' || next[1] != 'u')
+            {
+              return fail("unpaired surrogate");
+            }
+            next += 2;
+            if(!parseHex(&low))
+            {
+              return false;
+            }
+            if(low < 0xDC00 || low >= 0xE000)
+            {
+              return fail("unpaired surrogate");
+            }
+            code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+          }
+          putUtf8(code, string);
+        }
+        break;
+      default:
+        return fail("bad escape");
+      }
+    }
+  }
+  
+  bool parseNumber(double* number)
+  {
+    // Checked against the grammar here, since strtod accepts more (hex,
+    // infinity, leading spaces). Digits are gathered on the way, so most
+    // numbers never need strtod at all.
+    const char* start = next;
+    bool negative = next < end && *next == '-';
+    if(negative)
+    {
+      ++next;
+    }
+    
+    uint64_t mantissa = 0;
+    int digits = 0, exponent = 0;
+    if(next < end && *next == '0')
+    {
+      ++next;
+    }
+    else if(next < end && *next >= '1' && *next <= '9')
+    {
+      for(; next < end && *next >= '0' && *next <= '9'; ++next, ++digits)
+      {
+        mantissa = mantissa * 10 + (*next - '0');
+      }
+    }
+    else
+    {
+      return fail("bad number");
+    }
+    if(next < end && *next == '.')
+    {
+      if(++next == end || *next < '0' || *next > '9')
+      {
+        return fail("bad number");
+      }
+      for(; next < end && *next >= '0' && *next <= '9'; ++next)
+      {
+        // Leading zeros of a fraction don't count towards the precision
+        if(mantissa > 0 || *next != '0')
+        {
+          ++digits;
+        }
+        mantissa = mantissa * 10 + (*next - '0');
+        --exponent;
+      }
+    }
+    bool exact = digits <= JSON_EXACT_DIGITS;
+    if(next < end && (*next == 'e' || *next == 'E'))
+    {
+      ++next;
+      bool negativeExponent = next < end && *next == '-';
+      if(next < end && (*next == '+' || *next == '-'))
+      {
+        ++next;
+      }
+      if(next == end || *next < '0' || *next > '9')
+      {
+        return fail("bad number");
+      }
+      int written = 0;
+      for(; next < end && *next >= '0' && *next <= '9'; ++next)
+      {
+        written = written < 10000 ? written * 10 + (*next - '0') : written;
+      }
+      exponent += negativeExponent ? -written : written;
+    }
+    
+    // A mantissa of up to 15 digits and a power of ten up to 10^22 are both
+    // exact as doubles, so one multiplication or division rounds correctly
+    // (Clinger's fast path)
+    if(exact && exponent >= -JSON_EXACT_POWERS && exponent <= JSON_EXACT_POWERS)
+    {
+      static const double powers[JSON_EXACT_POWERS + 1] =
+      {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+      };
+      double value = (double)mantissa;
+      value = exponent < 0 ? value / powers[-exponent] : value * powers[exponent];
+      *number = negative ? -value : value;
+      return true;
+    }
+    
+    // The text needn't be terminated, so strtod gets a copy
+    char copy[JSON_MAX_NUMBER_LENGTH];
+    size_t length = next - start;
+    if(length >= sizeof(copy))
+    {
+      return fail("number too long");
+    }
+    memcpy(copy, start, length);
+    copy[length] = '\0';
+    *number = strtod(copy, NULL);
+    return true;
+  }
+  
+  bool parseValue(int depth, uint32_t* index)
+  {
+    if(depth > JSON_MAX_DEPTH)
+    {
+      return fail("nested too deeply");
+    }
+    
+    skipSpace();
+    if(next == end)
+    {
+      return fail("unexpected end");
+    }
+    
+    // Values are added before their children, so the root is the first
+    *index = document->values.size();
+    JsonValue value;
+    value.document = document;
+    value.type = JSON_NULL;
+    value.key = 0;
+    value.number = 0.0;
+    document->values.push_back(value);
+    
+    switch(*next)
+    {
+    case '{':
+      return parseContainer(JSON_OBJECT, '}', depth, *index);
+    case '[':
+      return parseContainer(JSON_ARRAY, ']', depth, *index);
+    case '"':
+      document->values[*index].type = JSON_STRING;
+      return parseString(&document->values[*index].text.offset, &document->values[*index].text.length);
+    case 't':
+      document->values[*index].type = JSON_BOOL;
+      document->values[*index].number = 1.0;
+      return expect("true");
+    case 'f':
+      document->values[*index].type = JSON_BOOL;
+      return expect("false");
+    case 'n':
+      return expect("null");
+    default:
+      document->values[*index].type = JSON_NUMBER;
+      return parseNumber(&document->values[*index].number);
+    }
+  }
+  
+  // Children are gathered on the pending stack as they're parsed (their own
+  // children go above them and are gone again by the time they're finished),
+  // then listed together in the child table
+  bool parseContainer(int type, char close, int depth, uint32_t index)
+  {
+    document->values[index].type = type;
+    size_t first = pending.size();
+    ++next;
+    skipSpace();
+    if(next < end && *next == close)
+    {
+      ++next;
+      return true;
+    }
+    
+    for(;;)
+    {
+      uint32_t key = 0, keyLength;
+      if(type == JSON_OBJECT)
+      {
+        skipSpace();
+        if(next == end || *next != '"')
+        {
+          return fail("expected a key");
+        }
+        if(!parseString(&key, &keyLength))
+        {
+          return false;
+        }
+        
+        skipSpace();
+        if(next == end || *next != ':')
+        {
+          return fail("expected ':'");
+        }
+        ++next;
+      }
+      
+      uint32_t child;
+      if(!parseValue(depth + 1, &child))
+      {
+        return false;
+      }
+      document->values[child].key = key;
+      pending.push_back(child);
+      
+      skipSpace();
+      if(next < end && *next == ',')
+      {
+        ++next;
+      }
+      else if(next < end && *next == close)
+      {
+        ++next;
+        break;
+      }
+      else
+      {
+        return fail(type == JSON_OBJECT ? "expected ',' or '}'" : "expected ',' or ']'");
+      }
+    }
+    
+    JsonValue& value = document->values[index];
+    value.list.count = pending.size() - first;
+    value.list.first = document->children.size();
+    document->children.insert(document->children.end(), pending.begin() + first, pending.end());
+    pending.resize(first);
+    return true;
+  }
+};
+
+bool JsonDocument::parse(const char* text, size_t size, std::string* error)
+{
+  // Roughly what a dense document needs, so the arrays seldom grow (and copy
+  // everything) while parsing
+  values.clear();
+  values.reserve(size / JSON_BYTES_PER_VALUE + 1);
+  children.clear();
+  children.reserve(size / JSON_BYTES_PER_VALUE + 1);
+  strings.clear();
+  
+  JsonParser parser;
+  parser.document = this;
+  parser.next = text;
+  parser.end = text + size;
+  parser.line = 1;
+  parser.error = error;
+  
+  uint32_t root;
+  if(!parser.parseValue(0, &root))
+  {
+    return false;
+  }
+  
+  parser.skipSpace();
+  if(parser.next != parser.end)
+  {
+    return parser.fail("text after the document");
+  }
+  
+  return true;
+}
+
+const char* JsonValue::getString() const
+{
+  return type == JSON_STRING ? document->strings.c_str() + text.offset : "";
+}
+
+const JsonValue& JsonValue::operator[](size_t index) const
+{
+  return document->values[document->children[list.first + index]];
+}
+
+const char* JsonValue::getKey(size_t index) const
+{
+  return document->strings.c_str() + (*this)[index].key;
+}
+
+const JsonValue* JsonValue::find(const char* key) const
+{
+  if(type != JSON_OBJECT)
+  {
+    return NULL;
+  }
+  
+  const char* strings = document->strings.c_str();
+  for(uint32_t i = 0; i < list.count; ++i)
+  {
+    const JsonValue& member = document->values[document->children[list.first + i]];
+    if(strcmp(strings + member.key, key) == 0)
+    {
+      return &member;
+    }
+  }
+  
+  return NULL;
+}
@@ -0,0 +1,118 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#define JSON_NULL 0
+#define JSON_BOOL 1
+#define JSON_NUMBER 2
+#define JSON_STRING 3
+#define JSON_ARRAY 4
+#define JSON_OBJECT 5
+
+#define JSON_MAX_DEPTH 256
+
+class JsonDocument;
+struct JsonParser;
+
+// One value in a parsed document. Values only live inside their document and
+// are handed out by reference.
+class JsonValue
+{
+private:
+  const JsonDocument* document;
+  int type;
+  uint32_t key;           // Of a member of an object, the offset of its key
+  union
+  {
+    double number;        // Booleans are 0 or 1
+    struct
+    {
+      uint32_t offset;    // In the document's strings
+      uint32_t length;
+    } text;
+    struct
+    {
+      uint32_t count;
+      uint32_t first;     // Where they're listed in the document's child table
+    } list;
+  };
+  
+  friend class JsonDocument;
+  friend struct JsonParser;
+
+public:
+  int getType() const
+  {
+    return type;
+  }
+  bool isNumber() const
+  {
+    return type == JSON_NUMBER;
+  }
+  bool isString() const
+  {
+    return type == JSON_STRING;
+  }
+  bool isArray() const
+  {
+    return type == JSON_ARRAY;
+  }
+  bool isObject() const
+  {
+    return type == JSON_OBJECT;
+  }
+  double getNumber() const
+  {
+    return type == JSON_NUMBER || type == JSON_BOOL ? number : 0.0;
+  }
+  bool getBool() const
+  {
+    return getNumber() != 0.0;
+  }
+  // Terminated, though a \u0000 escape can end it early
+  const char* getString() const;
+  uint32_t getLength() const
+  {
+    return type == JSON_STRING ? text.length : 0;
+  }
+  // Elements of an array, or members of an object
+  size_t size() const
+  {
+    return type == JSON_ARRAY || type == JSON_OBJECT ? list.count : 0;
+  }
+  const JsonValue& operator[](size_t index) const;
+  const char* getKey(size_t index) const;
+  // The member of an object with a key, or NULL if there isn't one. Objects
+  // are searched in order, which suits the small ones of scene files.
+  const JsonValue* find(const char* key) const;
+};
+
+// A parsed JSON document (RFC 8259). Every value, every list of children and
+// every string goes into one of three arrays, so parsing makes few
+// allocations however big the document, and freeing it makes three.
+class JsonDocument
+{
+private:
+  std::vector<JsonValue> values;
+  std::vector<uint32_t> children;
+  std::string strings;
+  
+  friend class JsonValue;
+  friend struct JsonParser;
+
+public:
+  // Returns false on the first error, describing it and its line in error
+  bool parse(const char* text, size_t size, std::string* error);
+  
+  // Only there after a successful parse
+  const JsonValue& getRoot() const
+  {
+    return values[0];
+  }
+};
+
+#endif
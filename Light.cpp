@@ -10,6 +10,7 @@ Light::Light(glm::vec3 position, glm::vec3 color, float constFalloff, float line
   this->linearFalloff = linearFalloff;
   this->squareFalloff = squareFalloff;
   this->attachment = NULL;
+  this->model = NULL;
   //this->handles = GLBridge::getLightHandles();
 }
 
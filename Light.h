@@ -24,6 +24,22 @@ public:
   bool isAttachedTo(PhysModel* physModel);
   virtual void draw(float alpha); // override
   void drawModel();
+  glm::vec3 getColor()
+  {
+    return color;
+  }
+  glm::vec3 getFalloff()
+  {
+    return glm::vec3(constFalloff, linearFalloff, squareFalloff);
+  }
+  PhysModel* getAttachment()
+  {
+    return attachment;
+  }
+  bool hasModel()
+  {
+    return model != NULL;
+  }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,114 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+{
+  data = NULL;
+  size = 0;
+#ifdef _WIN32
+  file = mapping = NULL;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+  close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const char* path)
+{
+  close();
+  
+  file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  LARGE_INTEGER fileSize;
+  if(file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+  {
+    close();
+    return false;
+  }
+  
+  mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  if(mapping)
+  {
+    data = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+  }
+  if(!data)
+  {
+    close();
+    return false;
+  }
+  
+  size = fileSize.QuadPart;
+  return true;
+}
+
+void MappedFile::close()
+{
+  if(data)
+  {
+    UnmapViewOfFile(data);
+  }
+  if(mapping)
+  {
+    CloseHandle(mapping);
+  }
+  if(file && file != INVALID_HANDLE_VALUE)
+  {
+    CloseHandle(file);
+  }
+  
+  data = NULL;
+  size = 0;
+  file = mapping = NULL;
+}
+
+#else
+
+bool MappedFile::open(const char* path)
+{
+  close();
+  
+  int descriptor = ::open(path, O_RDONLY);
+  if(descriptor < 0)
+  {
+    return false;
+  }
+  
+  // The mapping holds on to the file by itself
+  struct stat status;
+  if(fstat(descriptor, &status) == 0 && status.st_size > 0)
+  {
+    void* address = mmap(NULL, status.st_size, PROT_READ, MAP_SHARED, descriptor, 0);
+    if(address != MAP_FAILED)
+    {
+      data = static_cast<const unsigned char*>(address);
+      size = status.st_size;
+    }
+  }
+  ::close(descriptor);
+  
+  return data != NULL;
+}
+
+void MappedFile::close()
+{
+  if(data)
+  {
+    munmap(const_cast<unsigned char*>(data), size);
+  }
+  
+  data = NULL;
+  size = 0;
+}
+
+#endif
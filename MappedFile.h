@@ -0,0 +1,41 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+
+// A whole file mapped read-only into memory. Pages are read in by the system
+// as they are touched and dropped again under memory pressure, so files much
+// larger than memory can be read from anywhere.
+class MappedFile
+{
+private:
+  const unsigned char* data;
+  size_t size;
+#ifdef _WIN32
+  void* file;
+  void* mapping;
+#endif
+
+public:
+  MappedFile();
+  ~MappedFile();
+  
+  // Returns false if the file can't be mapped, which includes it being empty
+  bool open(const char* path);
+  void close();
+  
+  bool isOpen()
+  {
+    return data != NULL;
+  }
+  const unsigned char* getData()
+  {
+    return data;
+  }
+  size_t getSize()
+  {
+    return size;
+  }
+};
+
+#endif
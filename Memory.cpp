@@ -0,0 +1,155 @@
+#include "Memory.h"
+
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+
+// In front of every block, keeping what follows aligned for anything
+struct alignas(16) MemoryHeader
+{
+  size_t size;
+  int tag;
+};
+
+// One line each, so threads allocating under different tags don't share one
+struct alignas(64) MemoryCounters
+{
+  std::atomic<int64_t> bytes;
+  std::atomic<int64_t> blocks;
+  std::atomic<uint64_t> allocations;
+};
+
+static MemoryCounters counters[MEMORY_TAGS];
+static thread_local int currentTag = MEMORY_OTHER;
+
+static const char* tagNames[MEMORY_TAGS] = { "other", "mesh", "physics", "forces", "render" };
+
+MemoryStats Memory::getStats(int tag)
+{
+  MemoryStats stats;
+  stats.bytes = counters[tag].bytes.load(std::memory_order_relaxed);
+  stats.blocks = counters[tag].blocks.load(std::memory_order_relaxed);
+  stats.allocations = counters[tag].allocations.load(std::memory_order_relaxed);
+  return stats;
+}
+
+const char* Memory::getTagName(int tag)
+{
+  return tagNames[tag];
+}
+
+uint64_t Memory::getNumAllocations()
+{
+  uint64_t allocations = 0;
+  for(int i = 0; i < MEMORY_TAGS; ++i)
+  {
+    allocations += counters[i].allocations.load(std::memory_order_relaxed);
+  }
+  return allocations;
+}
+
+int Memory::setTag(int tag)
+{
+  int previous = currentTag;
+  currentTag = tag;
+  return previous;
+}
+
+int Memory::getTag()
+{
+  return currentTag;
+}
+
+static void* allocate(size_t size)
+{
+  MemoryHeader* header = static_cast<MemoryHeader*>(malloc(sizeof(MemoryHeader) + size));
+  if(!header)
+  {
+    return NULL;
+  }
+  
+  header->size = size;
+  header->tag = currentTag;
+  MemoryCounters* tagCounters = &counters[header->tag];
+  tagCounters->bytes.fetch_add(size, std::memory_order_relaxed);
+  tagCounters->blocks.fetch_add(1, std::memory_order_relaxed);
+  tagCounters->allocations.fetch_add(1, std::memory_order_relaxed);
+  return header + 1;
+}
+
+static void release(void* memory)
+{
+  if(!memory)
+  {
+    return;
+  }
+  
+  MemoryHeader* header = static_cast<MemoryHeader*>(memory) - 1;
+  MemoryCounters* tagCounters = &counters[header->tag];
+  tagCounters->bytes.fetch_sub(header->size, std::memory_order_relaxed);
+  tagCounters->blocks.fetch_sub(1, std::memory_order_relaxed);
+  free(header);
+}
+
+// Kept out of line, or GCC sees free() called on memory from new once they're
+// inlined and warns
+#ifdef __GNUC__
+#define MEMORY_NOINLINE __attribute__((noinline))
+#else
+#define MEMORY_NOINLINE
+#endif
+
+MEMORY_NOINLINE void* operator new(size_t size)
+{
+  void* memory = allocate(size);
+  if(!memory)
+  {
+    throw std::bad_alloc();
+  }
+  return memory;
+}
+
+MEMORY_NOINLINE void* operator new[](size_t size)
+{
+  return operator new(size);
+}
+
+MEMORY_NOINLINE void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+  return allocate(size);
+}
+
+MEMORY_NOINLINE void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+  return allocate(size);
+}
+
+MEMORY_NOINLINE void operator delete(void* memory) noexcept
+{
+  release(memory);
+}
+
+MEMORY_NOINLINE void operator delete[](void* memory) noexcept
+{
+  release(memory);
+}
+
+MEMORY_NOINLINE void operator delete(void* memory, size_t) noexcept
+{
+  release(memory);
+}
+
+MEMORY_NOINLINE void operator delete[](void* memory, size_t) noexcept
+{
+  release(memory);
+}
+
+MEMORY_NOINLINE void operator delete(void* memory, const std::nothrow_t&) noexcept
+{
+  release(memory);
+}
+
+MEMORY_NOINLINE void operator delete[](void* memory, const std::nothrow_t&) noexcept
+{
+  release(memory);
+}
@@ -0,0 +1,61 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <stdint.h>
+
+#define MEMORY_OTHER 0
+#define MEMORY_MESH 1
+#define MEMORY_PHYSICS 2
+#define MEMORY_FORCES 3
+#define MEMORY_RENDER 4
+#define MEMORY_TAGS 5
+
+struct MemoryStats
+{
+  int64_t bytes;        // Live
+  int64_t blocks;       // Live
+  uint64_t allocations; // Made since the start
+};
+
+// Accounts for every heap allocation by subsystem. Global operator new and
+// delete are replaced (in Memory.cpp) to tag each block with the subsystem
+// current on the allocating thread, set by a MemoryScope, and to keep live
+// bytes and blocks per tag. Blocks are freed against the tag they were made
+// under, whichever scope frees them. Whatever isn't in a scope is
+// MEMORY_OTHER.
+//
+// The counts are shared by every thread, so a stretch of code measured with
+// getNumAllocations() includes whatever any other thread allocated meanwhile.
+class Memory
+{
+public:
+  static MemoryStats getStats(int tag);
+  static const char* getTagName(int tag);
+  // Allocations made so far, of every tag
+  static uint64_t getNumAllocations();
+  
+  // Returns the tag that was current before
+  static int setTag(int tag);
+  static int getTag();
+};
+
+// Attributes the allocations made on this thread, until it goes out of scope,
+// to a subsystem. Scopes nest.
+class MemoryScope
+{
+private:
+  int previous;
+
+public:
+  MemoryScope(int tag)
+    : previous(Memory::setTag(tag))
+  {
+    //
+  }
+  ~MemoryScope()
+  {
+    Memory::setTag(previous);
+  }
+};
+
+#endif
@@ -1,12 +1,18 @@
 #include "Mesh.h"
+#include "Profiler.h"
+#include "Memory.h"
 
-std::map<const char*, Mesh*> Mesh::meshMap;
+std::map<std::string, Mesh*> Mesh::meshMap;
 
 Mesh* Mesh::load(const char* filePath, bool scaleOnLoad)
 {
+  PROFILE_ZONE("Mesh::load");
+  MemoryScope scope(MEMORY_MESH);
+  
   // If the model has already been loaded once, just return a reference to it,
-  // otherwise load it.
-  std::map<const char*, Mesh*>::iterator it = meshMap.find(filePath);
+  // otherwise load it. Paths are compared by content, so any copy of the same
+  // path finds the same mesh.
+  std::map<std::string, Mesh*>::iterator it = meshMap.find(filePath);
   if(it != meshMap.end())
   {
     return it->second;
@@ -20,6 +26,9 @@ Mesh* Mesh::load(const char* filePath, bool scaleOnLoad)
 
 Mesh::Mesh(const char* filePath, bool scaleOnLoad)
 {
+  path = filePath;
+  scaledOnLoad = scaleOnLoad;
+  
   // Parse the model file
   BasicModel model(filePath);
   indexCount = model.Triangles.size();
@@ -95,6 +104,9 @@ Mesh::Mesh(const char* filePath, bool scaleOnLoad)
     vertNormals[indices[j + 2]] += faceNormal;
   }
 
+  computeMassProperties(vertices, indices);
+  hull = ConvexHull::build(vertices, model.Vertices.size());
+
   // Build the normal array
   for(int i = 0, j = 0; i < model.Vertices.size(); ++i, j += 3)
   {
@@ -105,29 +117,182 @@ Mesh::Mesh(const char* filePath, bool scaleOnLoad)
     normals[j + 2] = vertNormals[i].z;
   }
 
-  glGenBuffers(1, &vertexBuffObj);
-  glBindBuffer(GL_ARRAY_BUFFER, vertexBuffObj);
-  glBufferData(GL_ARRAY_BUFFER,
-               sizeof(float) * model.Vertices.size() * 3,
-               vertices,
-               GL_STATIC_DRAW);
-
-  glGenBuffers(1, &indexBuffObj);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffObj);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-               sizeof(unsigned int) * indexCount * 3,
-               indices,
-               GL_STATIC_DRAW);
-
-  glGenBuffers(1, &normalBuffObj);
-  glBindBuffer(GL_ARRAY_BUFFER, normalBuffObj);
-  glBufferData(GL_ARRAY_BUFFER,
-               sizeof(float) * model.Vertices.size() * 3,
-               normals,
-               GL_STATIC_DRAW);
+  vertexBuffObj = indexBuffObj = normalBuffObj = 0;
+  if(!GLBridge::isHeadless())
+  {
+    glGenBuffers(1, &vertexBuffObj);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffObj);
+    glBufferData(GL_ARRAY_BUFFER,
+                 sizeof(float) * model.Vertices.size() * 3,
+                 vertices,
+                 GL_STATIC_DRAW);
+
+    glGenBuffers(1, &indexBuffObj);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffObj);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                 sizeof(unsigned int) * indexCount * 3,
+                 indices,
+                 GL_STATIC_DRAW);
+
+    glGenBuffers(1, &normalBuffObj);
+    glBindBuffer(GL_ARRAY_BUFFER, normalBuffObj);
+    glBufferData(GL_ARRAY_BUFFER,
+                 sizeof(float) * model.Vertices.size() * 3,
+                 normals,
+                 GL_STATIC_DRAW);
+  }
 
   delete[] vertices;
   delete[] indices;
   delete[] vertNormals;
   delete[] normals;
-}
\ No newline at end of file
+}
+
+// Integrals of 1, x, y, z, x^2, y^2, z^2, xy, yz and zx over the enclosed
+// volume, from a sum over the surface triangles (Mirtich's algorithm, as
+// simplified by Eberly in "Polyhedral Mass Properties (Revisited)"). Triangles
+// are gathered into blocks of coordinate arrays first, so the per-triangle
+// math runs over contiguous floats without branches and vectorizes.
+static void integrateTriangles(const float* x[3], const float* y[3], const float* z[3], int count, double* integrals)
+{
+  float sums[10] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+  
+  for(int t = 0; t < count; ++t)
+  {
+    float x0 = x[0][t], x1 = x[1][t], x2 = x[2][t];
+    float y0 = y[0][t], y1 = y[1][t], y2 = y[2][t];
+    float z0 = z[0][t], z1 = z[1][t], z2 = z[2][t];
+    
+    // Twice the area weighted normal
+    float a1 = x1 - x0, b1 = y1 - y0, c1 = z1 - z0;
+    float a2 = x2 - x0, b2 = y2 - y0, c2 = z2 - z0;
+    float d0 = b1 * c2 - b2 * c1;
+    float d1 = a2 * c1 - a1 * c2;
+    float d2 = a1 * b2 - a2 * b1;
+    
+    // Polynomial subexpressions, per axis
+    float tx = x0 + x1, f1x = tx + x2, sx = x0 * x0 + x1 * tx, f2x = sx + x2 * f1x;
+    float f3x = x0 * x0 * x0 + x1 * sx + x2 * f2x;
+    float g0x = f2x + x0 * (f1x + x0), g1x = f2x + x1 * (f1x + x1), g2x = f2x + x2 * (f1x + x2);
+    
+    float ty = y0 + y1, f1y = ty + y2, sy = y0 * y0 + y1 * ty, f2y = sy + y2 * f1y;
+    float f3y = y0 * y0 * y0 + y1 * sy + y2 * f2y;
+    float g0y = f2y + y0 * (f1y + y0), g1y = f2y + y1 * (f1y + y1), g2y = f2y + y2 * (f1y + y2);
+    
+    float tz = z0 + z1, f1z = tz + z2, sz = z0 * z0 + z1 * tz, f2z = sz + z2 * f1z;
+    float f3z = z0 * z0 * z0 + z1 * sz + z2 * f2z;
+    float g0z = f2z + z0 * (f1z + z0), g1z = f2z + z1 * (f1z + z1), g2z = f2z + z2 * (f1z + z2);
+    
+    sums[0] += d0 * f1x;
+    sums[1] += d0 * f2x;
+    sums[2] += d1 * f2y;
+    sums[3] += d2 * f2z;
+    sums[4] += d0 * f3x;
+    sums[5] += d1 * f3y;
+    sums[6] += d2 * f3z;
+    sums[7] += d0 * (y0 * g0x + y1 * g1x + y2 * g2x);
+    sums[8] += d1 * (z0 * g0y + z1 * g1y + z2 * g2y);
+    sums[9] += d2 * (x0 * g0z + x1 * g1z + x2 * g2z);
+  }
+  
+  // Blocks are summed in double, so precision doesn't degrade with mesh size
+  for(int i = 0; i < 10; ++i)
+  {
+    integrals[i] += sums[i];
+  }
+}
+
+void Mesh::computeMassProperties(const float* vertices, const unsigned int* indices)
+{
+  double integrals[10] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+  float coordinates[9][MASS_BLOCK_SIZE];
+  const float* x[3] = { coordinates[0], coordinates[1], coordinates[2] };
+  const float* y[3] = { coordinates[3], coordinates[4], coordinates[5] };
+  const float* z[3] = { coordinates[6], coordinates[7], coordinates[8] };
+  
+  for(unsigned int first = 0; first < indexCount; first += MASS_BLOCK_SIZE)
+  {
+    int count = indexCount - first < MASS_BLOCK_SIZE ? indexCount - first : MASS_BLOCK_SIZE;
+    for(int t = 0; t < count; ++t)
+    {
+      for(int corner = 0; corner < 3; ++corner)
+      {
+        const float* vertex = &vertices[indices[(first + t) * 3 + corner] * 3];
+        coordinates[corner][t] = vertex[0];
+        coordinates[3 + corner][t] = vertex[1];
+        coordinates[6 + corner][t] = vertex[2];
+      }
+    }
+    integrateTriangles(x, y, z, count, integrals);
+  }
+  
+  static const double factors[10] = { 1.0 / 6.0, 1.0 / 24.0, 1.0 / 24.0, 1.0 / 24.0,
+                                       1.0 / 60.0, 1.0 / 60.0, 1.0 / 60.0,
+                                       1.0 / 120.0, 1.0 / 120.0, 1.0 / 120.0 };
+  for(int i = 0; i < 10; ++i)
+  {
+    integrals[i] *= factors[i];
+  }
+  
+  // Inward facing triangles give a negative volume, with every integral negated
+  if(integrals[0] < 0.0)
+  {
+    for(int i = 0; i < 10; ++i)
+    {
+      integrals[i] = -integrals[i];
+    }
+  }
+  
+  // Flat meshes enclose nothing
+  glm::vec3 extent = bounds.max - bounds.min;
+  double boxVolume = (double)extent.x * extent.y * extent.z;
+  if(integrals[0] <= 1e-6 * boxVolume || integrals[0] <= 0.0)
+  {
+    useBoxMassProperties();
+    return;
+  }
+  
+  double mass = integrals[0];
+  double cx = integrals[1] / mass, cy = integrals[2] / mass, cz = integrals[3] / mass;
+  
+  // Move the second moments to the center of mass, and divide out the mass
+  double xx = integrals[4] / mass - cx * cx;
+  double yy = integrals[5] / mass - cy * cy;
+  double zz = integrals[6] / mass - cz * cz;
+  double xy = integrals[7] / mass - cx * cy;
+  double yz = integrals[8] / mass - cy * cz;
+  double zx = integrals[9] / mass - cz * cx;
+  
+  volume = mass;
+  centerOfMass = glm::vec3(cx, cy, cz);
+  inertia = glm::mat3(yy + zz, -xy, -zx,
+                      -xy, xx + zz, -yz,
+                      -zx, -yz, xx + yy);
+  
+  // Holes in a mesh that isn't quite closed can leave a tensor no real body
+  // has, so fall back to the box for those
+  if(inertia[0][0] <= 0.0f || inertia[1][1] <= 0.0f || inertia[2][2] <= 0.0f
+     || inertia[0][0] + inertia[1][1] < inertia[2][2]
+     || inertia[1][1] + inertia[2][2] < inertia[0][0]
+     || inertia[2][2] + inertia[0][0] < inertia[1][1])
+  {
+    useBoxMassProperties();
+  }
+}
+
+void Mesh::useBoxMassProperties()
+{
+  // A solid box filling the bounds. Flat boxes are given a sliver of thickness,
+  // so every axis still resists rotation.
+  glm::vec3 extent = bounds.max - bounds.min;
+  float thickness = 0.01f * glm::max(extent.x, glm::max(extent.y, extent.z)) + 1e-6f;
+  extent = glm::max(extent, glm::vec3(thickness));
+  glm::vec3 squared = extent * extent;
+  
+  volume = extent.x * extent.y * extent.z;
+  centerOfMass = (bounds.min + bounds.max) * 0.5f;
+  inertia = glm::mat3(0.0f);
+  inertia[0][0] = (squared.y + squared.z) / 12.0f;
+  inertia[1][1] = (squared.x + squared.z) / 12.0f;
+  inertia[2][2] = (squared.x + squared.y) / 12.0f;
+}
@@ -5,9 +5,13 @@
 #include "glm/gtx/transform.hpp" // TODO needed?
 
 #include "GLBridge.h"
+#include "ConvexHull.h"
 #include "NewMeshParser/BasicModel.h"
 #include <vector>
 #include <map>
+#include <string>
+
+#define MASS_BLOCK_SIZE 256
 
 typedef struct
 {
@@ -18,12 +22,28 @@ class Mesh
 {
 private:
   Mesh(const char* filePath, bool scaleOnLoad);
-  static std::map<const char*, Mesh*> meshMap;
+  static std::map<std::string, Mesh*> meshMap;
+
+  void computeMassProperties(const float* vertices, const unsigned int* indices);
+  void useBoxMassProperties();
 
 public: // TODO
   GLuint vertexBuffObj, indexBuffObj, normalBuffObj;
   unsigned int indexCount;
   Bounds bounds;
+  
+  // Mass properties of the solid the mesh encloses, at uniform density. The
+  // inertia tensor is about the center of mass, for a mass of one.
+  float volume;
+  glm::vec3 centerOfMass;
+  glm::mat3 inertia;
+
+  // Collision proxy
+  ConvexHull* hull;
+
+  // What it was loaded from, so it can be loaded again
+  std::string path;
+  bool scaledOnLoad;
 
 public:
   static Mesh* load(const char* filePath, bool scaleOnLoad);
@@ -0,0 +1,358 @@
+#include "Metrics.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+void Metric::observe(double value)
+{
+  size_t bucket = 0;
+  while(bucket < bounds.size() && value > bounds[bucket])
+  {
+    ++bucket;
+  }
+  ++buckets[bucket];
+  
+  this->value = value;
+  sum += value;
+  ++count;
+}
+
+double Metric::quantile(double q) const
+{
+  if(count == 0 || bounds.empty())
+  {
+    return 0.0;
+  }
+  
+  uint64_t rank = (uint64_t)(q * count);
+  uint64_t seen = 0;
+  for(size_t i = 0; i < bounds.size(); ++i)
+  {
+    seen += buckets[i];
+    if(seen > rank)
+    {
+      return bounds[i];
+    }
+  }
+  
+  return bounds.back();
+}
+
+MetricsRegistry::~MetricsRegistry()
+{
+  for(size_t i = 0; i < metrics.size(); ++i)
+  {
+    delete metrics[i];
+  }
+}
+
+Metric* MetricsRegistry::add(const char* name, const char* help, int type)
+{
+  Metric* metric = new Metric();
+  metric->name = name;
+  metric->help = help;
+  metric->type = type;
+  metric->value = 0.0;
+  metric->sum = 0.0;
+  metric->count = 0;
+  metrics.push_back(metric);
+  return metric;
+}
+
+Metric* MetricsRegistry::addCounter(const char* name, const char* help)
+{
+  return add(name, help, METRIC_COUNTER);
+}
+
+Metric* MetricsRegistry::addGauge(const char* name, const char* help)
+{
+  return add(name, help, METRIC_GAUGE);
+}
+
+Metric* MetricsRegistry::addHistogram(const char* name, const char* help, const double* bounds, int numBounds)
+{
+  Metric* metric = add(name, help, METRIC_HISTOGRAM);
+  metric->bounds.assign(bounds, bounds + numBounds);
+  metric->buckets.assign(numBounds + 1, 0);
+  return metric;
+}
+
+static void appendLine(std::string* out, const char* format, const char* name, const char* label, double value)
+{
+  char line[256];
+  snprintf(line, sizeof(line), format, name, label, value);
+  *out += line;
+}
+
+void MetricsRegistry::format(std::string* out) const
+{
+  static const char* typeNames[] = { "counter", "gauge", "histogram" };
+  
+  for(size_t i = 0; i < metrics.size(); ++i)
+  {
+    const Metric* metric = metrics[i];
+    const char* name = metric->name.c_str();
+    *out += "# HELP " + metric->name + " " + metric->help + "\n";
+    *out += "# TYPE " + metric->name + " " + typeNames[metric->type] + "\n";
+    if(metric->type != METRIC_HISTOGRAM)
+    {
+      appendLine(out, "%s%s %.9g\n", name, "", metric->value);
+      continue;
+    }
+    
+    // Buckets are cumulative in the exposition format
+    uint64_t cumulative = 0;
+    char label[64];
+    for(size_t j = 0; j < metric->bounds.size(); ++j)
+    {
+      cumulative += metric->buckets[j];
+      snprintf(label, sizeof(label), "{le=\"%.9g\"}", metric->bounds[j]);
+      appendLine(out, "%s_bucket%s %.9g\n", name, label, (double)cumulative);
+    }
+    appendLine(out, "%s_bucket%s %.9g\n", name, "{le=\"+Inf\"}", (double)metric->count);
+    appendLine(out, "%s_sum%s %.9g\n", name, "", metric->sum);
+    appendLine(out, "%s_count%s %.9g\n", name, "", (double)metric->count);
+  }
+}
+
+MetricsExporter::MetricsExporter()
+{
+  listener = -1;
+}
+
+MetricsExporter::~MetricsExporter()
+{
+  close();
+}
+
+bool MetricsExporter::openFile(const char* path)
+{
+  filePath = path;
+  return writeFile();
+}
+
+#ifdef _WIN32
+
+bool MetricsExporter::openSocket(const char* path)
+{
+  return false;
+}
+
+void MetricsExporter::answerSocket()
+{
+  //
+}
+
+bool MetricsExporter::sendTo(MetricsClient*)
+{
+  return false;
+}
+
+void MetricsExporter::close()
+{
+  filePath.clear();
+}
+
+#else
+
+static bool refusesConnections(const sockaddr_un& address)
+{
+  // Not blocking, so a live exporter with a full backlog can't hold us up
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if(fd < 0 || fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0)
+  {
+    if(fd >= 0)
+    {
+      ::close(fd);
+    }
+    return false;
+  }
+  bool refused = connect(fd, (const sockaddr*)&address, sizeof(address)) != 0 && errno == ECONNREFUSED;
+  ::close(fd);
+  return refused;
+}
+
+bool MetricsExporter::openSocket(const char* path)
+{
+  sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if(strlen(path) >= sizeof(address.sun_path))
+  {
+    return false;
+  }
+  strcpy(address.sun_path, path);
+  
+  // A socket left behind by an earlier run that didn't get to close it refuses
+  // connections, and can go. One that's still answering belongs to a running
+  // exporter, and anything else there isn't ours to remove.
+  struct stat status;
+  if(lstat(path, &status) == 0)
+  {
+    if(!S_ISSOCK(status.st_mode) || !refusesConnections(address) || unlink(path) != 0)
+    {
+      return false;
+    }
+  }
+  else if(errno != ENOENT)
+  {
+    return false;
+  }
+  
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if(fd < 0)
+  {
+    return false;
+  }
+  if(bind(fd, (sockaddr*)&address, sizeof(address)) != 0 || listen(fd, 8) != 0 ||
+     fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0)
+  {
+    ::close(fd);
+    return false;
+  }
+  
+  listener = fd;
+  socketPath = path;
+  return true;
+}
+
+bool MetricsExporter::sendTo(MetricsClient* client)
+{
+#ifdef MSG_NOSIGNAL
+  int flags = MSG_NOSIGNAL;
+#else
+  int flags = 0;
+#endif
+  while(client->sent < client->text.size())
+  {
+    ssize_t sent = send(client->socket, client->text.data() + client->sent, client->text.size() - client->sent, flags);
+    if(sent < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if(sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+      // Its buffer is full; try again next time, unless it's had long enough
+      return ++client->waits < METRICS_CLIENT_PATIENCE;
+    }
+    if(sent <= 0)
+    {
+      return false; // Gone
+    }
+    client->sent += sent;
+  }
+  
+  return false;
+}
+
+void MetricsExporter::answerSocket()
+{
+  // Carry on with readers that didn't have room for all of it last time
+  for(size_t i = 0; i < clients.size();)
+  {
+    if(sendTo(&clients[i]))
+    {
+      ++i;
+      continue;
+    }
+    ::close(clients[i].socket);
+    clients[i] = clients.back();
+    clients.pop_back();
+  }
+  
+  // Then answer new ones, leaving any more than there's room for waiting
+  while(clients.size() < METRICS_MAX_CLIENTS)
+  {
+    int socket = accept(listener, NULL, NULL);
+    if(socket < 0)
+    {
+      if(errno == EINTR)
+      {
+        continue;
+      }
+      return; // None waiting
+    }
+    
+    // A reader that isn't reading mustn't hold up the frame
+    fcntl(socket, F_SETFL, fcntl(socket, F_GETFL) | O_NONBLOCK);
+#ifdef SO_NOSIGPIPE
+    int on = 1;
+    setsockopt(socket, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+    MetricsClient client;
+    client.socket = socket;
+    client.text = text;
+    client.sent = 0;
+    client.waits = 0;
+    if(sendTo(&client))
+    {
+      clients.push_back(client);
+    }
+    else
+    {
+      ::close(socket);
+    }
+  }
+}
+
+void MetricsExporter::close()
+{
+  for(size_t i = 0; i < clients.size(); ++i)
+  {
+    ::close(clients[i].socket);
+  }
+  clients.clear();
+  if(listener >= 0)
+  {
+    ::close(listener);
+    unlink(socketPath.c_str());
+    listener = -1;
+  }
+  socketPath.clear();
+  filePath.clear();
+}
+
+#endif
+
+bool MetricsExporter::writeFile()
+{
+  // Written alongside and renamed over the old one, which is atomic
+  std::string temporary = filePath + ".tmp";
+  FILE* file = fopen(temporary.c_str(), "w");
+  if(!file)
+  {
+    return false;
+  }
+  
+  bool written = fwrite(text.data(), 1, text.size(), file) == text.size();
+  written = fclose(file) == 0 && written;
+  if(!written)
+  {
+    remove(temporary.c_str());
+    return false;
+  }
+  
+  return rename(temporary.c_str(), filePath.c_str()) == 0;
+}
+
+bool MetricsExporter::publish(const MetricsRegistry& registry)
+{
+  text.clear();
+  registry.format(&text);
+  
+  if(listener >= 0)
+  {
+    answerSocket();
+  }
+  
+  return filePath.empty() || writeFile();
+}
@@ -0,0 +1,122 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#define METRIC_COUNTER 0
+#define METRIC_GAUGE 1
+#define METRIC_HISTOGRAM 2
+
+#define METRICS_MAX_CLIENTS 16      // Socket readers part way through their text
+#define METRICS_CLIENT_PATIENCE 120 // Publishes a reader gets to finish reading
+
+// One named value, in the manner of Prometheus: a counter only goes up, a
+// gauge is set to whatever it is now, and a histogram counts the values it is
+// given into buckets by upper bound (plus one for anything larger).
+struct Metric
+{
+  std::string name;
+  std::string help;
+  int type;
+  double value;                  // Counters and gauges; the last value observed for histograms
+  std::vector<double> bounds;    // Histograms only, ascending
+  std::vector<uint64_t> buckets; // Values up to each bound, not cumulative; one more than bounds
+  double sum;
+  uint64_t count;
+  
+  void increment(double amount = 1.0)
+  {
+    value += amount;
+  }
+  void set(double value)
+  {
+    this->value = value;
+  }
+  void observe(double value);
+  // Upper bound of the bucket the q quantile falls in (the largest bound, for
+  // values past it), or 0 with nothing observed
+  double quantile(double q) const;
+};
+
+// The metrics of a run, in the order they were added. Metrics are never
+// removed, so the pointers handed out stay valid as long as the registry.
+class MetricsRegistry
+{
+private:
+  std::vector<Metric*> metrics;
+  
+  Metric* add(const char* name, const char* help, int type);
+
+public:
+  ~MetricsRegistry();
+  
+  // Names follow Prometheus: letters, digits and underscores, with a unit
+  // suffix (_seconds, _total) where there is one
+  Metric* addCounter(const char* name, const char* help);
+  Metric* addGauge(const char* name, const char* help);
+  Metric* addHistogram(const char* name, const char* help, const double* bounds, int numBounds);
+  
+  int getNumMetrics()
+  {
+    return metrics.size();
+  }
+  Metric* getMetric(int index)
+  {
+    return metrics[index];
+  }
+  
+  // Appends every metric in Prometheus' text exposition format
+  void format(std::string* out) const;
+};
+
+// A socket reader, and the text it was given to read
+struct MetricsClient
+{
+  int socket;
+  std::string text;
+  size_t sent;
+  int waits;
+};
+
+// Publishes a registry every so often in Prometheus' text format: to a file,
+// replaced whole each time so a reader (node_exporter's textfile collector,
+// say) never sees half of one, and/or to anyone connecting to a UNIX socket
+// (socat - UNIX-CONNECT:path). Nothing here blocks; connections waiting on
+// the socket are answered at the next publish, and a reader slower than that
+// gets the rest of the same text at the publishes after, up to a point.
+class MetricsExporter
+{
+private:
+  std::string filePath;
+  std::string socketPath;
+  int listener;
+  std::string text;
+  std::vector<MetricsClient> clients;
+  
+  bool writeFile();
+  void answerSocket();
+  // Returns false once the client is done with, one way or another
+  bool sendTo(MetricsClient* client);
+
+public:
+  MetricsExporter();
+  ~MetricsExporter();
+  
+  bool openFile(const char* path);
+  // Not available on Windows. Fails rather than replace anything at path but
+  // a socket nobody is listening on (left by an earlier run that didn't get to
+  // close it).
+  bool openSocket(const char* path);
+  void close();
+  bool isOpen()
+  {
+    return !filePath.empty() || listener >= 0;
+  }
+  
+  // Returns false if the file couldn't be written
+  bool publish(const MetricsRegistry& registry);
+};
+
+#endif
@@ -86,6 +86,7 @@ void Model::draw(float alpha)
 
   // Draw
   glDrawElements(GL_TRIANGLES, mesh->indexCount * 3, GL_UNSIGNED_INT, 0);
+  GLBridge::countDrawCall();
 
   // Clean up
   glDisableVertexAttribArray(transHandles.aPosition);
@@ -29,7 +29,7 @@ public:
   Model(Mesh* mesh, Material material);
 
   void rotate(glm::vec3 axis, float angle);
-  void scale(float amount);
+  virtual void scale(float amount);
   void resetTransforms(); // override
 
   void setMaterial(Material material);
@@ -43,6 +43,12 @@ public:
   float getScale() {
     return scale_;
   }
+  glm::mat4 getRotation() {
+    return rotation_;
+  }
+  void setRotation(glm::mat4 rotation) {
+    rotation_ = rotation;
+  }
   
   float getExtrema();
 
@@ -0,0 +1,510 @@
+#include "Narrowphase.h"
+
+#include <cmath>
+#include <utility>
+#include <vector>
+
+// A point of the Minkowski difference a - b, with the points of a and b it came
+// from, so contact points can be recovered at the end
+struct SupportPoint
+{
+  glm::vec3 point, onA, onB;
+};
+
+static SupportPoint supportOf(const Collider& a, const Collider& b, glm::vec3 direction)
+{
+  SupportPoint support;
+  support.onA = a.support(direction);
+  support.onB = b.support(-direction);
+  support.point = support.onA - support.onB;
+  return support;
+}
+
+static bool sameDirection(glm::vec3 a, glm::vec3 b)
+{
+  return glm::dot(a, b) > 0.0f;
+}
+
+// Any vector perpendicular to v
+static glm::vec3 perpendicular(glm::vec3 v)
+{
+  glm::vec3 axis = fabs(v.x) < 0.57f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+  return glm::cross(v, axis);
+}
+
+// The simplex cases of GJK. simplex[0] is the newest point. Reduces the simplex
+// to the feature nearest the origin and picks the next search direction, or
+// returns true once a tetrahedron encloses the origin.
+static bool line(SupportPoint* simplex, int* count, glm::vec3* direction)
+{
+  glm::vec3 ab = simplex[1].point - simplex[0].point;
+  glm::vec3 ao = -simplex[0].point;
+  if(sameDirection(ab, ao))
+  {
+    *direction = glm::cross(glm::cross(ab, ao), ab);
+    if(glm::length(glm::cross(ab, ao)) <= GJK_TOLERANCE * glm::length(ab) * glm::length(ao))
+    {
+      // The origin is on the line, as it is when two spheres' support points
+      // line up through their centres
+      *direction = perpendicular(ab);
+    }
+  }
+  else
+  {
+    *count = 1;
+    *direction = ao;
+  }
+  return false;
+}
+
+static bool triangle(SupportPoint* simplex, int* count, glm::vec3* direction)
+{
+  SupportPoint a = simplex[0], b = simplex[1], c = simplex[2];
+  glm::vec3 ab = b.point - a.point;
+  glm::vec3 ac = c.point - a.point;
+  glm::vec3 ao = -a.point;
+  glm::vec3 abc = glm::cross(ab, ac);
+  
+  if(sameDirection(glm::cross(abc, ac), ao))
+  {
+    if(sameDirection(ac, ao))
+    {
+      simplex[1] = c;
+      *count = 2;
+      return line(simplex, count, direction);
+    }
+    
+    *count = 2;
+    return line(simplex, count, direction);
+  }
+  
+  if(sameDirection(glm::cross(ab, abc), ao))
+  {
+    *count = 2;
+    return line(simplex, count, direction);
+  }
+  
+  if(sameDirection(abc, ao))
+  {
+    *direction = abc;
+  }
+  else
+  {
+    simplex[1] = c;
+    simplex[2] = b;
+    *direction = -abc;
+  }
+  return false;
+}
+
+// Whether the origin is on the side of a face its normal points to, by more
+// than rounding: ao runs from a point of the face to the origin. With the origin
+// on a face, as it can be once the simplex runs through it, a plain sign test
+// flips from one iteration to the next and GJK cycles.
+static bool beyond(glm::vec3 normal, glm::vec3 ao)
+{
+  return glm::dot(normal, ao) > GJK_TOLERANCE * glm::length(normal) * glm::length(ao);
+}
+
+static bool tetrahedron(SupportPoint* simplex, int* count, glm::vec3* direction)
+{
+  SupportPoint a = simplex[0], b = simplex[1], c = simplex[2], d = simplex[3];
+  glm::vec3 ab = b.point - a.point;
+  glm::vec3 ac = c.point - a.point;
+  glm::vec3 ad = d.point - a.point;
+  glm::vec3 ao = -a.point;
+  
+  if(beyond(glm::cross(ab, ac), ao))
+  {
+    *count = 3;
+    return triangle(simplex, count, direction);
+  }
+  
+  if(beyond(glm::cross(ac, ad), ao))
+  {
+    simplex[1] = c;
+    simplex[2] = d;
+    *count = 3;
+    return triangle(simplex, count, direction);
+  }
+  
+  if(beyond(glm::cross(ad, ab), ao))
+  {
+    simplex[1] = d;
+    simplex[2] = b;
+    *count = 3;
+    return triangle(simplex, count, direction);
+  }
+  
+  return true;
+}
+
+static bool gjk(const Collider& a, const Collider& b, SupportPoint* simplex)
+{
+  glm::vec3 direction = a.position - b.position;
+  if(glm::dot(direction, direction) < 1e-12f)
+  {
+    direction = glm::vec3(1.0f, 0.0f, 0.0f);
+  }
+  
+  simplex[0] = supportOf(a, b, direction);
+  int count = 1;
+  direction = -simplex[0].point;
+  
+  for(int i = 0; i < GJK_MAX_ITERATIONS; ++i)
+  {
+    if(glm::dot(direction, direction) == 0.0f)
+    {
+      return false; // The origin is a point of the simplex, so touching at most
+    }
+    
+    SupportPoint support = supportOf(a, b, direction);
+    if(glm::dot(support.point, direction) <= 0.0f)
+    {
+      return false; // Can't get past the origin, so it isn't enclosed
+    }
+    
+    for(int j = count; j > 0; --j)
+    {
+      simplex[j] = simplex[j - 1];
+    }
+    simplex[0] = support;
+    ++count;
+    
+    bool enclosed;
+    switch(count)
+    {
+    case 2:
+      enclosed = line(simplex, &count, &direction);
+      break;
+    case 3:
+      enclosed = triangle(simplex, &count, &direction);
+      break;
+    default:
+      enclosed = tetrahedron(simplex, &count, &direction);
+      break;
+    }
+    
+    if(enclosed)
+    {
+      return true;
+    }
+  }
+  
+  return false;
+}
+
+struct PolytopeFace
+{
+  unsigned int v[3];
+  glm::vec3 normal;
+  float distance;
+};
+
+// EPA scratch space, kept around on each thread to avoid allocating every test
+static thread_local std::vector<SupportPoint> vertices;
+static thread_local std::vector<PolytopeFace> faces;
+static thread_local std::vector<std::pair<unsigned int, unsigned int> > edges;
+
+// Adds a face wound so that its normal points away from interior, a point
+// inside the polytope. The origin can lie on a face (or all but on it), so its
+// side of the face says nothing. Returns false for faces too thin to have a
+// normal.
+static bool addFace(unsigned int a, unsigned int b, unsigned int c, glm::vec3 interior)
+{
+  PolytopeFace face;
+  glm::vec3 normal = glm::cross(vertices[b].point - vertices[a].point, vertices[c].point - vertices[a].point);
+  float length = glm::length(normal);
+  if(length < 1e-12f)
+  {
+    return false;
+  }
+  
+  face.normal = normal / length;
+  face.v[0] = a;
+  face.v[1] = b;
+  face.v[2] = c;
+  if(glm::dot(face.normal, vertices[a].point - interior) < 0.0f)
+  {
+    face.normal = -face.normal;
+    face.v[1] = c;
+    face.v[2] = b;
+  }
+  face.distance = glm::dot(face.normal, vertices[a].point);
+  
+  faces.push_back(face);
+  return true;
+}
+
+// Adds an edge to the horizon, or removes it if its twin is already there: an
+// edge shared by two removed faces is not on the horizon
+static void addEdge(unsigned int a, unsigned int b)
+{
+  for(size_t i = 0; i < edges.size(); ++i)
+  {
+    if(edges[i].first == b && edges[i].second == a)
+    {
+      edges[i] = edges.back();
+      edges.pop_back();
+      return;
+    }
+  }
+  edges.push_back(std::make_pair(a, b));
+}
+
+// Grows the polytope out to vertices[index]: removes the faces it can see
+// (from further than epsilon) and patches the hole with faces to it. Returns
+// false if it saw none, being inside already, or if the patch came out broken.
+static bool expand(unsigned int index, glm::vec3 interior, float epsilon)
+{
+  glm::vec3 point = vertices[index].point;
+  bool removed = false;
+  edges.clear();
+  for(size_t f = 0; f < faces.size();)
+  {
+    if(glm::dot(faces[f].normal, point - vertices[faces[f].v[0]].point) > epsilon)
+    {
+      addEdge(faces[f].v[0], faces[f].v[1]);
+      addEdge(faces[f].v[1], faces[f].v[2]);
+      addEdge(faces[f].v[2], faces[f].v[0]);
+      faces[f] = faces.back();
+      faces.pop_back();
+      removed = true;
+    }
+    else
+    {
+      ++f;
+    }
+  }
+  
+  bool patched = true;
+  for(size_t e = 0; e < edges.size(); ++e)
+  {
+    patched = addFace(edges[e].first, edges[e].second, index, interior) && patched;
+  }
+  return removed && patched;
+}
+
+static size_t closestFace()
+{
+  size_t closest = 0;
+  for(size_t f = 1; f < faces.size(); ++f)
+  {
+    if(faces[f].distance < faces[closest].distance)
+    {
+      closest = f;
+    }
+  }
+  return closest;
+}
+
+static float volumeOf(unsigned int a, unsigned int b, unsigned int c, unsigned int d)
+{
+  glm::vec3 p = vertices[a].point;
+  return fabs(glm::dot(vertices[b].point - p, glm::cross(vertices[c].point - p, vertices[d].point - p)));
+}
+
+// Builds the polytope EPA starts from out of the simplex GJK ended with, which
+// encloses the origin but can be flat or even a line with the origin on it
+// (round shapes lined up give GJK points in a row). Then, support points along
+// the simplex's own axes are added, and the polytope is grown from the four
+// furthest apart to take in the rest. Sets *interior to a point inside it and
+// *size to how far it reaches from the origin. Returns false if the Minkowski
+// difference itself is flat, so the colliders only just touch.
+static bool buildPolytope(const Collider& a, const Collider& b, const SupportPoint* simplex,
+                          glm::vec3* interior, float* size)
+{
+  vertices.assign(simplex, simplex + 4);
+  faces.clear();
+  
+  float reach = 0.0f;
+  for(int i = 0; i < 4; ++i)
+  {
+    reach = glm::max(reach, glm::length(vertices[i].point));
+  }
+  if(reach < 1e-12f)
+  {
+    return false;
+  }
+  
+  unsigned int start[4] = { 0, 1, 2, 3 };
+  if(volumeOf(0, 1, 2, 3) < EPA_FLATNESS * reach * reach * reach)
+  {
+    // The two simplex points furthest apart give one axis of a frame
+    glm::vec3 axis(1.0f, 0.0f, 0.0f);
+    float longest = 0.0f;
+    for(int i = 0; i < 4; ++i)
+    {
+      for(int j = i + 1; j < 4; ++j)
+      {
+        glm::vec3 edge = vertices[j].point - vertices[i].point;
+        if(glm::length(edge) > longest)
+        {
+          longest = glm::length(edge);
+          axis = edge / longest;
+        }
+      }
+    }
+    glm::vec3 side = glm::normalize(perpendicular(axis));
+    glm::vec3 directions[3] = { axis, side, glm::cross(axis, side) };
+    for(int i = 0; i < 3; ++i)
+    {
+      vertices.push_back(supportOf(a, b, directions[i]));
+      vertices.push_back(supportOf(a, b, -directions[i]));
+    }
+    for(size_t i = 4; i < vertices.size(); ++i)
+    {
+      reach = glm::max(reach, glm::length(vertices[i].point));
+    }
+    
+    // Furthest pair, then furthest from their line, then from their plane
+    float best = -1.0f;
+    for(unsigned int i = 0; i < vertices.size(); ++i)
+    {
+      for(unsigned int j = i + 1; j < vertices.size(); ++j)
+      {
+        float length = glm::length(vertices[j].point - vertices[i].point);
+        if(length > best)
+        {
+          best = length;
+          start[0] = i;
+          start[1] = j;
+        }
+      }
+    }
+    best = -1.0f;
+    glm::vec3 line = vertices[start[1]].point - vertices[start[0]].point;
+    for(unsigned int i = 0; i < vertices.size(); ++i)
+    {
+      float area = glm::length(glm::cross(line, vertices[i].point - vertices[start[0]].point));
+      if(area > best)
+      {
+        best = area;
+        start[2] = i;
+      }
+    }
+    best = -1.0f;
+    for(unsigned int i = 0; i < vertices.size(); ++i)
+    {
+      float volume = volumeOf(start[0], start[1], start[2], i);
+      if(volume > best)
+      {
+        best = volume;
+        start[3] = i;
+      }
+    }
+    if(best < EPA_FLATNESS * reach * reach * reach)
+    {
+      return false;
+    }
+  }
+  
+  *interior = (vertices[start[0]].point + vertices[start[1]].point +
+               vertices[start[2]].point + vertices[start[3]].point) * 0.25f;
+  *size = reach;
+  if(!addFace(start[0], start[1], start[2], *interior) || !addFace(start[0], start[3], start[1], *interior) ||
+     !addFace(start[0], start[2], start[3], *interior) || !addFace(start[1], start[3], start[2], *interior))
+  {
+    return false;
+  }
+  
+  // Take in whatever is left of the simplex and the extra points
+  for(unsigned int i = 0; i < vertices.size(); ++i)
+  {
+    if(i != start[0] && i != start[1] && i != start[2] && i != start[3])
+    {
+      expand(i, *interior, EPA_TOLERANCE * reach);
+    }
+  }
+  return true;
+}
+
+// Spheres deep inside each other leave EPA refining an all but round polytope,
+// nowhere near converging by the caps. Their penetration is known exactly.
+static bool spherePenetration(const Collider& a, const Collider& b, Penetration* result)
+{
+  glm::vec3 offset = b.position - a.position;
+  float distance = glm::length(offset);
+  float radiusA = a.size.x * a.scale, radiusB = b.size.x * b.scale;
+  result->normal = distance > 1e-12f ? offset / distance : glm::vec3(0.0f, 1.0f, 0.0f);
+  result->depth = radiusA + radiusB - distance;
+  result->pointA = a.position + result->normal * radiusA;
+  result->pointB = b.position - result->normal * radiusB;
+  return result->depth > 0.0f;
+}
+
+bool intersects(const Collider& a, const Collider& b)
+{
+  SupportPoint simplex[4];
+  return gjk(a, b, simplex);
+}
+
+bool findPenetration(const Collider& a, const Collider& b, Penetration* result)
+{
+  SupportPoint simplex[4];
+  if(!gjk(a, b, simplex))
+  {
+    return false;
+  }
+  
+  // EPA: grow the polytope towards the surface of the Minkowski difference,
+  // until the face nearest the origin is on it
+  glm::vec3 interior;
+  float size;
+  if(!buildPolytope(a, b, simplex, &interior, &size))
+  {
+    return false;
+  }
+  
+  // Relative to the shapes, so small ones converge as far as large ones
+  float tolerance = EPA_TOLERANCE * size;
+  bool converged = false;
+  for(int iteration = 0; iteration < EPA_MAX_ITERATIONS && faces.size() <= EPA_MAX_FACES; ++iteration)
+  {
+    const PolytopeFace& closest = faces[closestFace()];
+    SupportPoint support = supportOf(a, b, closest.normal);
+    if(glm::dot(support.point, closest.normal) - closest.distance < tolerance)
+    {
+      converged = true;
+      break;
+    }
+    
+    vertices.push_back(support);
+    if(!expand(vertices.size() - 1, interior, tolerance * 1e-3f) || faces.empty())
+    {
+      return false;
+    }
+  }
+  
+  // Out of iterations or faces, the nearest face could still be well short of
+  // the surface, so there is no depth to trust
+  if(!converged)
+  {
+    return a.type == COLLIDER_SPHERE && b.type == COLLIDER_SPHERE && spherePenetration(a, b, result);
+  }
+  
+  // The origin's projection onto the closest face, in barycentric coordinates,
+  // picks out the matching points on a and b
+  const PolytopeFace& face = faces[closestFace()];
+  const SupportPoint& p0 = vertices[face.v[0]];
+  const SupportPoint& p1 = vertices[face.v[1]];
+  const SupportPoint& p2 = vertices[face.v[2]];
+  glm::vec3 projection = face.normal * face.distance;
+  glm::vec3 v0 = p1.point - p0.point, v1 = p2.point - p0.point, v2 = projection - p0.point;
+  float d00 = glm::dot(v0, v0), d01 = glm::dot(v0, v1), d11 = glm::dot(v1, v1);
+  float d20 = glm::dot(v2, v0), d21 = glm::dot(v2, v1);
+  float denominator = d00 * d11 - d01 * d01;
+  float u = 1.0f / 3.0f, v = 1.0f / 3.0f;
+  if(fabs(denominator) > 1e-12f)
+  {
+    u = (d11 * d20 - d01 * d21) / denominator;
+    v = (d00 * d21 - d01 * d20) / denominator;
+  }
+  float w = 1.0f - u - v;
+  
+  result->normal = face.normal;
+  result->depth = face.distance;
+  result->pointA = p0.onA * w + p1.onA * u + p2.onA * v;
+  result->pointB = p0.onB * w + p1.onB * u + p2.onB * v;
+  return result->depth > 0.0f;
+}
@@ -0,0 +1,31 @@
+#ifndef NARROWPHASE_H
+#define NARROWPHASE_H
+
+#include "Collider.h"
+
+#define GJK_MAX_ITERATIONS 64
+#define GJK_TOLERANCE 1e-5f // Of the lengths involved, below which the origin is on a feature
+#define EPA_MAX_ITERATIONS 64
+#define EPA_MAX_FACES 256
+#define EPA_TOLERANCE 1e-4f // Of the size of the shapes
+#define EPA_FLATNESS 1e-4f  // Volume, of the size cubed, below which a simplex is flat
+
+// How two overlapping colliders penetrate: moving a by depth along -normal
+// separates them. pointA is the deepest point of a inside b and pointB the
+// deepest point of b inside a, in world space.
+struct Penetration
+{
+  glm::vec3 normal; // From a towards b
+  float depth;
+  glm::vec3 pointA, pointB;
+};
+
+// GJK to find whether the colliders overlap, then EPA to find how deeply.
+// Returns false if they don't (or only just touch), or if EPA doesn't converge
+// within its caps, which only happens to shapes deep inside each other (two
+// spheres are then worked out exactly instead).
+bool findPenetration(const Collider& a, const Collider& b, Penetration* result);
+// GJK alone, for when only whether they overlap matters
+bool intersects(const Collider& a, const Collider& b);
+
+#endif
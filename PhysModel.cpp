@@ -1,13 +1,15 @@
 #include "PhysModel.h"
 #include "Force.h"
 #include "SpringForce.h"
+#include "TwoWaySpringForce.h"
 #include "Maths.h"
 #include "GravitationalForce.h"
+#include "SpringNetwork.h"
 #include "glm/gtx/quaternion.hpp"
 
 #define AIR_FRICTION 0.2f
-#define GROUND_STATIC_FRICTION 5.0f
-#define GROUND_KINETIC_FRICTION 2.0f
+
+DEFINE_POOLED(PhysModel, MEMORY_PHYSICS)
 
 PhysModel::PhysModel(Mesh* mesh,
                      Material material,
@@ -17,8 +19,6 @@ PhysModel::PhysModel(Mesh* mesh,
 {
   currentState.mass = lastState.mass = nextState.mass = mass;
   currentState.inverseMass = lastState.inverseMass = nextState.inverseMass = 1.0f / currentState.mass;
-  currentState.inertia = lastState.inertia = nextState.inertia = 1.0f; // TODO actually calculate based off of model size
-  currentState.inverseInertia = lastState.inverseInertia = nextState.inverseInertia = 1.0f / currentState.inertia;
   
   currentState.position = lastState.position = nextState.position = position_ = position;
   currentState.linearMomentum = lastState.linearMomentum = nextState.linearMomentum = glm::vec3();
@@ -26,7 +26,16 @@ PhysModel::PhysModel(Mesh* mesh,
   currentState.angularMomentum = lastState.angularMomentum = nextState.angularMomentum = glm::vec3();
   
   currentState.friction = lastState.friction = nextState.friction = AIR_FRICTION;
+  updateInertia();
   
+  gravityCount = 0;
+  networkIndex = NETWORK_INVALID_INDEX;
+  springChanges = 0;
+  islandIndex = NETWORK_INVALID_INDEX;
+  sleepCounter = 0;
+  asleep = false;
+  colliderType = COLLIDER_HULL;
+  onGround = false;
   visible = true;
 }
 
@@ -47,31 +56,22 @@ glm::quat PhysState::spin()
   return 0.5f * glm::quat(0, angularVel.x, angularVel.y, angularVel.z) * orientation;
 }
 
-Derivative PhysModel::evaluate(PhysState state) // float? double? time to make a decision!
+Derivative PhysModel::evaluate(PhysState state, bool includeSprings) // float? double? time to make a decision!
 {
   Derivative result;
   result.velocity = state.velocity();
   result.spin = state.spin();
 
   // Apply forces to the current state
-  applyForces(state, &result);
+  applyForces(state, &result, includeSprings);
 
   return result;
 }
 
-Derivative PhysModel::evaluate(PhysState state, float dt, const Derivative& derivative)
-{
-  state.position += derivative.velocity * dt;
-  state.linearMomentum += derivative.force * dt;
-  state.orientation = state.orientation + derivative.spin * dt;
-  state.angularMomentum += derivative.torque * dt;
-  
-  return evaluate(state);
-}
-
 void PhysModel::addForce(Force* force)
 {
   forces.push_back(force);
+  wake();
 }
 
 bool PhysModel::removeForce(Force* force)
@@ -81,6 +81,7 @@ bool PhysModel::removeForce(Force* force)
     if(*it == force)
     {
       forces.erase(it);
+      wake();
       return true;
     }
   }
@@ -88,25 +89,102 @@ bool PhysModel::removeForce(Force* force)
   return false;
 }
 
-void PhysModel::deleteSpringForce()
+SpringForce* PhysModel::findSpringForce()
 {
   for(size_t i = 0; i < forces.size(); ++i)
   {
     SpringForce* sForce = dynamic_cast<SpringForce*>(forces[i]);
     if(sForce)
     {
-      delete sForce;
-      return;
+      return sForce;
     }
   }
+  
+  return NULL;
 }
 
-void PhysModel::applyForces(const PhysState& state, Derivative* derivative)
+void PhysModel::addGravity(int count)
 {
-  // Sum up all current forces
-  for(size_t i = 0; i < forces.size(); ++i)
+  gravityCount += count;
+  wake();
+}
+
+size_t PhysModel::addAnchorSpring(const AnchorSpring& spring, SpringForce* owner)
+{
+  anchorSprings.push_back(spring);
+  anchorSpringOwners.push_back(owner);
+  return anchorSprings.size() - 1;
+}
+
+void PhysModel::removeAnchorSpring(size_t index)
+{
+  // Swap with the last record to keep the array dense, and tell the owner of the
+  // moved record where it went
+  size_t last = anchorSprings.size() - 1;
+  if(index != last)
   {
-    forces[i]->applyForce(this, state, derivative);
+    anchorSprings[index] = anchorSprings[last];
+    anchorSpringOwners[index] = anchorSpringOwners[last];
+    anchorSpringOwners[index]->relocate(index);
+  }
+  anchorSprings.pop_back();
+  anchorSpringOwners.pop_back();
+}
+
+size_t PhysModel::addLinkSpring(const LinkSpring& spring, TwoWaySpringForce* owner)
+{
+  linkSprings.push_back(spring);
+  linkSpringOwners.push_back(owner);
+  spring.other->wake();
+  wake();
+  ++springChanges;
+  return linkSprings.size() - 1;
+}
+
+void PhysModel::removeLinkSpring(size_t index)
+{
+  size_t last = linkSprings.size() - 1;
+  if(index != last)
+  {
+    linkSprings[index] = linkSprings[last];
+    linkSpringOwners[index] = linkSpringOwners[last];
+    linkSpringOwners[index]->relocate(index);
+  }
+  linkSprings.pop_back();
+  linkSpringOwners.pop_back();
+  ++springChanges;
+}
+
+glm::vec3 PhysModel::getAttachPosition(glm::vec3 attachOffset)
+{
+  // Uses the interpolated transform from the last draw, not the physics state
+  glm::vec4 attach = rotation_ * glm::vec4(attachOffset * scale_, 0.0f);
+  return position_ + glm::vec3(attach.x, attach.y, attach.z);
+}
+
+void PhysModel::detachForces(std::vector<Force*>* detached)
+{
+  // Detaching removes the force from our vector, so iterate backwards
+  for(size_t i = forces.size(); i > 0; --i)
+  {
+    Force* force = forces[i - 1];
+    force->detach();
+    detached->push_back(force);
+  }
+}
+
+void PhysModel::applyForces(const PhysState& state, Derivative* derivative, bool includeSprings)
+{
+  // Gravity is a uniform field, so it doesn't need a loop
+  derivative->force += GravitationalForce::field * (state.mass * gravityCount);
+  
+  // Sum up each type of force in its own loop
+  if(includeSprings)
+  {
+    for(size_t i = 0; i < anchorSprings.size(); ++i)
+    {
+      SpringForce::applyForce(anchorSprings[i], scale_, state, derivative);
+    }
   }
   
   // Apply friction
@@ -114,61 +192,124 @@ void PhysModel::applyForces(const PhysState& state, Derivative* derivative)
   inverseVelocity *= -state.friction;
   derivative->force += inverseVelocity;
   
-  glm::vec3 inverseAngularVelocity(state.angularVelocity());
-  inverseAngularVelocity *= -state.friction;
-  derivative->torque += inverseAngularVelocity;
+  // Spin decays at the same rate as a unit of mass slows down, whatever the
+  // shape. A torque of friction * angularVelocity blows up for small bodies,
+  // whose inertia is tiny next to their mass.
+  derivative->torque -= state.angularMomentum * (state.friction * state.inverseMass);
 }
 
 void PhysModel::step(const double t, const double dt)
 {
-  lastState = currentState;
-  currentState = nextState;
-  
-  // Integrate
-  Derivative a = evaluate(currentState);
-  Derivative b = evaluate(currentState, dt * 0.5f, a);
-  Derivative c = evaluate(currentState, dt * 0.5f, b);
-  Derivative d = evaluate(currentState, dt, c);
+  // Integrates this body on its own. Springs to other bodies are not included,
+  // the scene integrates those through its SpringNetwork.
+  PhysState state = beginStep();
   
-  float timeAdjust = 1.0f / 6.0f * dt;
+  Derivative a = evaluate(state);
+  PhysState stage = state;
+  integrate(&stage, a, dt * 0.5f);
+  Derivative b = evaluate(stage);
+  stage = state;
+  integrate(&stage, b, dt * 0.5f);
+  Derivative c = evaluate(stage);
+  stage = state;
+  integrate(&stage, c, dt);
+  Derivative d = evaluate(stage);
   
-  glm::vec3 dPos = (a.velocity + 2.0f * (b.velocity + c.velocity) + d.velocity);
-  dPos *= timeAdjust;
-  nextState.position += dPos;
+  integrate(&state, a, dt / 6.0f);
+  integrate(&state, b, dt / 3.0f);
+  integrate(&state, c, dt / 3.0f);
+  integrate(&state, d, dt / 6.0f);
   
-  glm::vec3 dLinMoment = (a.force + 2.0f * (b.force + c.force) + d.force);
-  dLinMoment *= timeAdjust;
-  nextState.linearMomentum += dLinMoment;
-  
-  glm::quat dOrient = (a.spin + 2.0f * (b.spin + c.spin) + d.spin);
-  dOrient *= timeAdjust;
-  nextState.orientation = nextState.orientation + dOrient;
-  
-  glm::vec3 dAngMoment = (a.torque + 2.0f * (b.torque + c.torque) + d.torque);
-  dAngMoment *= timeAdjust;
-  nextState.angularMomentum += dAngMoment;
-  
-  if(onGround)
+  endStep(state);
+}
+
+void PhysModel::updateSleepCounter()
+{
+  if(glm::length(nextState.velocity()) < SLEEP_LINEAR_THRESHOLD
+     && glm::length(nextState.angularVelocity()) < SLEEP_ANGULAR_THRESHOLD)
   {
-    if(glm::length(nextState.linearMomentum) < 1.0f)
-    {
-      nextState.friction = GROUND_STATIC_FRICTION;
-    }
-    else
-    {
-      nextState.friction = GROUND_KINETIC_FRICTION;
-    }
+    ++sleepCounter;
   }
   else
   {
-    nextState.friction = AIR_FRICTION;
+    sleepCounter = 0;
+  }
+}
+
+void PhysModel::sleep()
+{
+  // Come to a complete stop, with nothing left to interpolate while drawing
+  nextState.linearMomentum = glm::vec3();
+  nextState.angularMomentum = glm::vec3();
+  lastState = currentState = nextState;
+  asleep = true;
+}
+
+void PhysModel::restore(const PhysState& state, bool asleep, int sleepCounter)
+{
+  lastState = currentState = nextState = state;
+  position_ = state.position;
+  this->asleep = asleep;
+  this->sleepCounter = sleepCounter;
+}
+
+void PhysModel::setDrawnPoses(glm::vec3 fromPosition, glm::quat fromOrientation, glm::vec3 toPosition, glm::quat toOrientation)
+{
+  // Drawing blends the quaternions directly, so they have to be on the same
+  // side for it to turn the short way
+  if(glm::dot(fromOrientation, toOrientation) < 0.0f)
+  {
+    toOrientation = -toOrientation;
   }
+  
+  lastState.position = fromPosition;
+  lastState.orientation = fromOrientation;
+  currentState.position = nextState.position = toPosition;
+  currentState.orientation = nextState.orientation = toOrientation;
+}
+
+const PhysState& PhysModel::beginStep()
+{
+  lastState = currentState;
+  currentState = nextState;
+  return currentState;
+}
+  
+void PhysModel::endStep(const PhysState& state)
+{
+  // Friction with whatever the body rests on is applied by the contact solver;
+  // only air resistance is left as a drag force
+  nextState = state;
+  nextState.friction = AIR_FRICTION;
+}
+
+void PhysModel::updateInertia()
+{
+  // The mesh's tensor is for a unit mass at unit scale, about its center of
+  // mass; it grows with the square of the size. Bodies turn about the mesh's
+  // origin, so it's moved there with the parallel axis theorem.
+  float mass = nextState.mass;
+  glm::vec3 center = mesh->centerOfMass * scale_;
+  glm::mat3 inertia = mesh->inertia * (mass * scale_ * scale_)
+                      + (glm::mat3(glm::dot(center, center)) - glm::outerProduct(center, center)) * mass;
+  glm::mat3 inverseInertia = glm::inverse(inertia);
+  currentState.inertia = lastState.inertia = nextState.inertia = inertia;
+  currentState.inverseInertia = lastState.inverseInertia = nextState.inverseInertia = inverseInertia;
+}
+
+void PhysModel::scale(float amount)
+{
+  Model::scale(amount);
+  updateInertia();
+  // The network keeps attach offsets scaled
+  ++springChanges;
 }
 
 void PhysModel::translate(glm::vec3 trans)
 {
   position_ += trans;
   nextState.position += trans;
+  wake();
 }
 
 void PhysModel::draw(float alpha)
@@ -188,64 +329,37 @@ void PhysModel::draw(float alpha)
   }
 }
 
-bool PhysModel::intersects(Model* other)
+Collider PhysModel::getCollider()
 {
-  Bounds tRel, oRel;
-  
-  tRel.min = mesh->bounds.min * scale_ + nextState.position;
-  tRel.max = mesh->bounds.max * scale_ + nextState.position;
-  oRel.min = other->getMesh()->bounds.min * other->getScale() + other->getPosition();
-  oRel.max = other->getMesh()->bounds.max * other->getScale() + other->getPosition();
-
-  return !(max(tRel.min.x, oRel.min.x) > min(tRel.max.x, oRel.max.x)
-        || max(tRel.min.y, oRel.min.y) > min(tRel.max.y, oRel.max.y)
-        || max(tRel.min.z, oRel.min.z) > min(tRel.max.z, oRel.max.z));
+  Collider collider;
+  collider.type = colliderType;
+  collider.hull = mesh->hull;
+  collider.size = colliderSize;
+  collider.position = nextState.position;
+  collider.orientation = glm::normalize(nextState.orientation);
+  collider.scale = scale_;
+  return collider;
 }
 
-bool PhysModel::isInOrBelow(Model* other)
+Bounds PhysModel::getWorldBounds()
 {
-  Bounds tRel, oRel;
-  
-  tRel.min = mesh->bounds.min * scale_ + nextState.position;
-  tRel.max = mesh->bounds.max * scale_ + nextState.position;
-  oRel.min = other->getMesh()->bounds.min * other->getScale() + other->getPosition();
-  oRel.max = other->getMesh()->bounds.max * other->getScale() + other->getPosition();
-  
-  // Check if we are below
-  if(tRel.min.y < oRel.max.y)
+  // Support points along each world axis
+  Collider collider = getCollider();
+  Bounds bounds;
+  for(int axis = 0; axis < 3; ++axis)
   {
-    float diff = tRel.max.y - tRel.min.y;
-    tRel.min.y = oRel.min.y - 0.1f;
-    tRel.max.y = tRel.min.y + diff;
+    glm::vec3 direction;
+    direction[axis] = 1.0f;
+    bounds.max[axis] = collider.support(direction)[axis];
+    bounds.min[axis] = collider.support(-direction)[axis];
   }
-
-  return !(max(tRel.min.x, oRel.min.x) > min(tRel.max.x, oRel.max.x)
-        || max(tRel.min.y, oRel.min.y) > min(tRel.max.y, oRel.max.y)
-        || max(tRel.min.z, oRel.min.z) > min(tRel.max.z, oRel.max.z));
-}
-
-void PhysModel::bounce(float elasticity, Model* other)
-{
-  Bounds tRel, oRel;
-    
-  tRel.min = mesh->bounds.min * scale_ + nextState.position;
-  oRel.max = other->getMesh()->bounds.max * other->getScale() + other->getPosition();
   
-  float yDiff = oRel.max.y - tRel.min.y;
-  
-  nextState.linearMomentum.y *= -elasticity;
-  nextState.position.y += yDiff;
-  nextState.friction = GROUND_STATIC_FRICTION; // Slow down
+  return bounds;
 }
 
 void PhysModel::setOnGround(bool onGround)
 {
   this->onGround = onGround;
-  if(onGround)
-  {
-    nextState.linearMomentum.y = 0.0f;
-    nextState.position.y = currentState.position.y;
-  }
 }
 
 void PhysModel::toggleGravity()
@@ -262,35 +376,3 @@ void PhysModel::toggleGravity()
   
   GravitationalForce::create(this);
 }
-
-void PhysModel::addCollision(Model* other)
-{
-  collidingModels.push_back(other);
-}
-
-bool PhysModel::removeCollision(Model* other)
-{
-  for(std::vector<Model*>::iterator it = collidingModels.begin(); it != collidingModels.end(); ++it)
-  {
-    if(*it == other)
-    {
-      collidingModels.erase(it);
-      return true;
-    }
-  }
-  
-  return false;
-}
-
-bool PhysModel::wasCollidingWith(Model* other)
-{
-  for(std::vector<Model*>::iterator it = collidingModels.begin(); it != collidingModels.end(); ++it)
-  {
-    if(*it == other)
-    {
-      return true;
-    }
-  }
-  
-  return false;
-}
\ No newline at end of file
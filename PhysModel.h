@@ -4,14 +4,28 @@
 #include <vector>
 
 #include "Model.h"
+#include "Pool.h"
+#include "Collider.h"
+#include "glm/gtx/quaternion.hpp"
+
+#define SLEEP_LINEAR_THRESHOLD 0.05f  // Speed
+#define SLEEP_ANGULAR_THRESHOLD 0.05f // Angular speed
+#define SLEEP_STEPS 60                // Steps spent under both before sleeping
+
+#define DEFAULT_RESTITUTION 0.3f
+#define DEFAULT_STATIC_FRICTION 0.6f
+#define DEFAULT_KINETIC_FRICTION 0.4f
 
 class Force;
+class PhysModel;
+class SpringForce;
+class TwoWaySpringForce;
 
 struct PhysState
 {
   // Constants
   float mass, inverseMass;
-  float inertia, inverseInertia;
+  glm::mat3 inertia, inverseInertia; // In the body frame
   float friction;
   
   // Primary values
@@ -25,9 +39,20 @@ struct PhysState
   {
     return linearMomentum * inverseMass;
   }
+  // The inertia tensor rotated into the world frame, R I R^T
+  glm::mat3 worldInertia() const
+  {
+    glm::mat3 rotation = glm::toMat3(glm::normalize(orientation));
+    return rotation * inertia * glm::transpose(rotation);
+  }
+  glm::mat3 worldInverseInertia() const
+  {
+    glm::mat3 rotation = glm::toMat3(glm::normalize(orientation));
+    return rotation * inverseInertia * glm::transpose(rotation);
+  }
   glm::vec3 angularVelocity() const
   {
-    return angularMomentum * inverseInertia;
+    return worldInverseInertia() * angularMomentum;
   }
   glm::quat spin();
 };
@@ -40,52 +65,269 @@ struct Derivative
   glm::vec3 torque;
 };
 
+// Advances the primary values of a state along a derivative. Integrators build
+// their stage states and weighted sums out of repeated calls to this.
+inline void integrate(PhysState* state, const Derivative& derivative, float dt)
+{
+  state->position += derivative.velocity * dt;
+  state->linearMomentum += derivative.force * dt;
+  state->orientation = state->orientation + derivative.spin * dt;
+  state->angularMomentum += derivative.torque * dt;
+}
+
+// How a body's surface behaves in contact. Friction coefficients are Coulomb
+// coefficients: the tangential impulse is bounded by the normal one times
+// these.
+struct ContactMaterial
+{
+  float restitution;
+  float staticFriction, kineticFriction;
+  
+  ContactMaterial()
+    : restitution(DEFAULT_RESTITUTION),
+      staticFriction(DEFAULT_STATIC_FRICTION),
+      kineticFriction(DEFAULT_KINETIC_FRICTION)
+  {
+    //
+  }
+};
+
+// Flat per-type force records, evaluated in tight loops by applyForces(). The
+// Force objects that own them only handle creation, removal and drawing.
+
+// A spring between a point on the body and a fixed point in the world
+struct AnchorSpring
+{
+  glm::vec3 anchor;
+  glm::vec3 attachOffset;
+  float k, b;
+};
+
+// A spring between two bodies, recorded on the first body only. These are not
+// evaluated by the body itself, but gathered into the scene's SpringNetwork.
+struct LinkSpring
+{
+  PhysModel* other;
+  glm::vec3 attachOffset, otherAttachOffset;
+  float k, b;
+  float restLength;
+};
+
 class PhysModel : public Model
 {
 private:
   PhysState currentState, lastState, nextState;
   std::vector<Force*> forces;
-  std::vector<Model*> collidingModels;
+  
+  // Force data, by type
+  int gravityCount;
+  std::vector<AnchorSpring> anchorSprings;
+  std::vector<SpringForce*> anchorSpringOwners;
+  std::vector<LinkSpring> linkSprings;
+  std::vector<TwoWaySpringForce*> linkSpringOwners;
+  unsigned int networkIndex;
+  unsigned int springChanges; // Link springs added or removed, and rescales
+  unsigned int islandIndex;
+  
+  // Sleeping bodies are left out of the simulation until something wakes them
+  int sleepCounter;
+  bool asleep;
+  
+  // Collision proxy; the mesh's hull unless set otherwise
+  int colliderType;
+  glm::vec3 colliderSize;
+  ContactMaterial contactMaterial;
+  
   bool onGround;
   bool visible;
   
   // Calculations
-  Derivative evaluate(PhysState state);
-  Derivative evaluate(PhysState state, float dt, const Derivative& derivative);
-  void applyForces(const PhysState& state, Derivative* derivative);
+  void updateInertia();
+  void applyForces(const PhysState& state, Derivative* derivative, bool includeSprings);
 
 public:  
+  DECLARE_POOLED(PhysModel)
+  
   PhysModel(Mesh* mesh,
             Material material,
             float mass = 1.0f,
             glm::vec3 position = glm::vec3());
   ~PhysModel();
+  PoolHandle getHandle()
+  {
+    return getPool().handleOf(this);
+  }
+  static PhysModel* fromHandle(PoolHandle handle)
+  {
+    return getPool().get(handle);
+  }
   glm::vec3 getVelocity()
   {
     return currentState.velocity();
   }
-  void bounce(float elasticity, Model* other);
+  // The most recently integrated state (drawing lags a step behind this)
+  const PhysState& getState()
+  {
+    return nextState;
+  }
+  // The state the latest step started from
+  const PhysState& getStartState()
+  {
+    return currentState;
+  }
+  // Replaces every state with one, as if the body had been resting in it, and
+  // puts it to sleep or wakes it as given (for restoring snapshots)
+  void restore(const PhysState& state, bool asleep, int sleepCounter);
   void setOnGround(bool onGround);
   void step(const double t, const double dt);
+  const PhysState& beginStep();
+  void endStep(const PhysState& state);
+  // Solvers that treat springs as constraints leave them out of the forces
+  Derivative evaluate(PhysState state, bool includeSprings = true);
   void addForce(Force* force);
   bool removeForce(Force* force);
-  void deleteSpringForce();
+  SpringForce* findSpringForce();
+  void addGravity(int count);
+  size_t addAnchorSpring(const AnchorSpring& spring, SpringForce* owner);
+  void removeAnchorSpring(size_t index);
+  AnchorSpring* getAnchorSpring(size_t index)
+  {
+    return &anchorSprings[index];
+  }
+  const std::vector<AnchorSpring>& getAnchorSprings()
+  {
+    return anchorSprings;
+  }
+  size_t addLinkSpring(const LinkSpring& spring, TwoWaySpringForce* owner);
+  void removeLinkSpring(size_t index);
+  LinkSpring* getLinkSpring(size_t index)
+  {
+    return &linkSprings[index];
+  }
+  const std::vector<LinkSpring>& getLinkSprings()
+  {
+    return linkSprings;
+  }
+  void setNetworkIndex(unsigned int networkIndex)
+  {
+    this->networkIndex = networkIndex;
+  }
+  unsigned int getNetworkIndex()
+  {
+    return networkIndex;
+  }
+  // Goes up whenever something a SpringNetwork built from this body depends
+  // on changes
+  unsigned int getSpringChanges()
+  {
+    return springChanges;
+  }
+  void setIslandIndex(unsigned int islandIndex)
+  {
+    this->islandIndex = islandIndex;
+  }
+  unsigned int getIslandIndex()
+  {
+    return islandIndex;
+  }
+  bool isAsleep()
+  {
+    return asleep;
+  }
+  // Number of consecutive steps this body has been slow enough to sleep
+  int getSleepCounter()
+  {
+    return sleepCounter;
+  }
+  void updateSleepCounter();
+  void sleep();
+  void wake()
+  {
+    sleepCounter = 0;
+    asleep = false;
+  }
+  glm::vec3 getAttachPosition(glm::vec3 attachOffset);
+  void detachForces(std::vector<Force*>* detached);
   virtual void translate(glm::vec3 trans);
+  virtual void scale(float amount); // override
   virtual void draw(float alpha); // override
-  bool intersects(Model* other);
-  bool isInOrBelow(Model* other);
+  void setSphereCollider(float radius)
+  {
+    colliderType = COLLIDER_SPHERE;
+    colliderSize = glm::vec3(radius);
+  }
+  void setBoxCollider(glm::vec3 halfExtents)
+  {
+    colliderType = COLLIDER_BOX;
+    colliderSize = halfExtents;
+  }
+  // Any collider, as one of the COLLIDER_ types and its size
+  void setCollider(int type, glm::vec3 size)
+  {
+    colliderType = type;
+    colliderSize = size;
+  }
+  int getColliderType()
+  {
+    return colliderType;
+  }
+  glm::vec3 getColliderSize()
+  {
+    return colliderSize;
+  }
+  // The collision proxy at the latest state
+  Collider getCollider();
+  // Bounds of the collision proxy at the latest state, in world space
+  Bounds getWorldBounds();
+  // Replaces the latest state's velocities, keeping its position
+  void setVelocities(glm::vec3 linear, glm::vec3 angular)
+  {
+    nextState.linearMomentum = linear * nextState.mass;
+    nextState.angularMomentum = nextState.worldInertia() * angular;
+  }
+  // Moves and turns (by a small rotation vector) the latest state without
+  // waking the body, for contact correction
+  void displace(glm::vec3 delta, glm::vec3 rotation = glm::vec3(0.0f))
+  {
+    nextState.position += delta;
+    glm::quat turn(0.0f, rotation.x, rotation.y, rotation.z);
+    nextState.orientation = glm::normalize(nextState.orientation + 0.5f * turn * nextState.orientation);
+  }
+  // Puts the latest state at a pose without waking the body, keeping its
+  // momenta
+  void setPose(glm::vec3 position, glm::quat orientation)
+  {
+    nextState.position = position;
+    nextState.orientation = orientation;
+  }
+  // Sets the two poses drawing interpolates between, for replaying recorded
+  // motion with nothing simulated
+  void setDrawnPoses(glm::vec3 fromPosition, glm::quat fromOrientation, glm::vec3 toPosition, glm::quat toOrientation);
   bool isOnGround()
   {
     return onGround;
   }
+  void setContactMaterial(const ContactMaterial& material)
+  {
+    contactMaterial = material;
+  }
+  const ContactMaterial& getContactMaterial()
+  {
+    return contactMaterial;
+  }
   void setVisible(bool visible)
   {
     this->visible = visible;
   }
+  bool isVisible()
+  {
+    return visible;
+  }
+  int getGravityCount()
+  {
+    return gravityCount;
+  }
   void toggleGravity();
-  void addCollision(Model* other);
-  bool removeCollision(Model* other);
-  bool wasCollidingWith(Model* other);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,348 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <vector>
+
+#include "Memory.h"
+
+#define POOL_BLOCK_SIZE 1024
+#define POOL_INVALID_INDEX 0xFFFFFFFFu
+
+// Refers to an object in a Pool. The generation is bumped every time a slot is
+// recycled, so a handle to a destroyed object resolves to NULL instead of to
+// whatever now lives in its slot.
+struct PoolHandle
+{
+  unsigned int index;
+  unsigned int generation;
+
+  PoolHandle()
+    : index(POOL_INVALID_INDEX), generation(0)
+  {
+    //
+  }
+};
+
+// Fixed-size slot allocator for objects of type T. Slots live in blocks that are
+// never moved or freed, so addresses stay stable; freed slots are kept on an
+// intrusive free list, making both allocation and recycling O(1). Meant to back
+// a class-specific operator new / delete. Every member takes the pool's lock, so
+// objects can be made, destroyed and looked up from any thread.
+template <typename T>
+class Pool
+{
+private:
+  struct Slot
+  {
+    // Storage must come first, so an object pointer is also its slot pointer
+    alignas(T) unsigned char storage[sizeof(T)];
+    unsigned int index;
+    unsigned int generation;
+    unsigned int nextFree;
+    bool live;
+  };
+
+  std::vector<Slot*> blocks;
+  unsigned int freeHead;
+  unsigned int liveCount;
+  int tag;
+  mutable std::atomic_flag lock;
+
+  Slot* slotAt(unsigned int index)
+  {
+    return &blocks[index / POOL_BLOCK_SIZE][index % POOL_BLOCK_SIZE];
+  }
+
+  // Adds a block of free slots, threaded in order onto the free list at link
+  // (its end), and returns the new end. Slots are then handed out in the same
+  // order whether or not the pool was reserved ahead of time.
+  unsigned int* grow(unsigned int* link)
+  {
+    MemoryScope scope(tag);
+    unsigned int base = blocks.size() * POOL_BLOCK_SIZE;
+    Slot* block = static_cast<Slot*>(::operator new(sizeof(Slot) * POOL_BLOCK_SIZE));
+    blocks.push_back(block);
+
+    for(unsigned int i = 0; i < POOL_BLOCK_SIZE; ++i)
+    {
+      Slot* slot = &block[i];
+      slot->index = base + i;
+      slot->generation = 1;
+      slot->live = false;
+      slot->nextFree = i + 1 < POOL_BLOCK_SIZE ? base + i + 1 : POOL_INVALID_INDEX;
+    }
+    *link = base;
+    return &block[POOL_BLOCK_SIZE - 1].nextFree;
+  }
+
+  void acquire() const
+  {
+    while(lock.test_and_set(std::memory_order_acquire))
+    {
+      //
+    }
+  }
+
+  void unlock() const
+  {
+    lock.clear(std::memory_order_release);
+  }
+
+public:
+  // Blocks are accounted to the MEMORY_ tag given
+  Pool(int tag = MEMORY_OTHER)
+    : freeHead(POOL_INVALID_INDEX), liveCount(0), tag(tag)
+  {
+    lock.clear();
+  }
+
+  ~Pool()
+  {
+    // Objects still alive are simply abandoned with their storage
+    for(size_t i = 0; i < blocks.size(); ++i)
+    {
+      ::operator delete(blocks[i]);
+    }
+  }
+
+  // Makes sure at least count objects can be live without growing again.
+  void reserve(size_t count)
+  {
+    acquire();
+    if(blocks.size() * POOL_BLOCK_SIZE < count)
+    {
+      unsigned int* link = &freeHead;
+      while(*link != POOL_INVALID_INDEX)
+      {
+        link = &slotAt(*link)->nextFree;
+      }
+      while(blocks.size() * POOL_BLOCK_SIZE < count)
+      {
+        link = grow(link);
+      }
+    }
+    unlock();
+  }
+
+  void* allocate()
+  {
+    acquire();
+    if(freeHead == POOL_INVALID_INDEX)
+    {
+      grow(&freeHead);
+    }
+
+    Slot* slot = slotAt(freeHead);
+    freeHead = slot->nextFree;
+    slot->live = true;
+    ++liveCount;
+    unlock();
+
+    return slot->storage;
+  }
+
+  void release(void* object)
+  {
+    Slot* slot = reinterpret_cast<Slot*>(object);
+
+    acquire();
+    slot->live = false;
+    ++slot->generation;
+    slot->nextFree = freeHead;
+    freeHead = slot->index;
+    --liveCount;
+    unlock();
+  }
+
+  PoolHandle handleOf(const T* object) const
+  {
+    const Slot* slot = reinterpret_cast<const Slot*>(object);
+    PoolHandle handle;
+    acquire();
+    handle.index = slot->index;
+    handle.generation = slot->generation;
+    unlock();
+    return handle;
+  }
+
+  // Returns NULL if the object the handle referred to has been destroyed.
+  T* get(PoolHandle handle)
+  {
+    T* object = NULL;
+    acquire();
+    if(handle.index != POOL_INVALID_INDEX && handle.index < blocks.size() * POOL_BLOCK_SIZE)
+    {
+      Slot* slot = slotAt(handle.index);
+      if(slot->live && slot->generation == handle.generation)
+      {
+        object = reinterpret_cast<T*>(slot->storage);
+      }
+    }
+    unlock();
+
+    return object;
+  }
+
+  unsigned int size() const
+  {
+    acquire();
+    unsigned int count = liveCount;
+    unlock();
+    return count;
+  }
+
+  size_t capacity() const
+  {
+    acquire();
+    size_t count = blocks.size() * POOL_BLOCK_SIZE;
+    unlock();
+    return count;
+  }
+};
+
+// Keeps the nodes a node-based container (std::map, say) frees on a free list
+// for its next insert, instead of handing them back to the heap, so a
+// container whose size goes up and down only allocates when it grows past its
+// largest size so far. Nodes are all of the size of the first one asked for;
+// anything else goes to the global allocator. Not locked, so the container
+// must stay on one thread at a time, and not copyable, as its container holds
+// on to it.
+class NodeRecycler
+{
+private:
+  void* freeHead;
+  size_t nodeSize;
+
+  NodeRecycler(const NodeRecycler&);
+  NodeRecycler& operator=(const NodeRecycler&);
+
+public:
+  NodeRecycler()
+    : freeHead(NULL), nodeSize(0)
+  {
+    //
+  }
+
+  // After the container, which puts everything back
+  ~NodeRecycler()
+  {
+    while(freeHead)
+    {
+      void* node = freeHead;
+      freeHead = *static_cast<void**>(node);
+      ::operator delete(node);
+    }
+  }
+
+  void* allocate(size_t size)
+  {
+    if(nodeSize == 0 && size >= sizeof(void*))
+    {
+      nodeSize = size;
+    }
+    if(size != nodeSize || !freeHead)
+    {
+      return ::operator new(size);
+    }
+
+    void* node = freeHead;
+    freeHead = *static_cast<void**>(node);
+    return node;
+  }
+
+  void release(void* node, size_t size)
+  {
+    if(size != nodeSize)
+    {
+      ::operator delete(node);
+      return;
+    }
+    *static_cast<void**>(node) = freeHead;
+    freeHead = node;
+  }
+};
+
+// Allocator for a container whose nodes go through a NodeRecycler
+template <typename T>
+class RecyclingAllocator
+{
+public:
+  typedef T value_type;
+
+  NodeRecycler* recycler;
+
+  RecyclingAllocator(NodeRecycler* recycler)
+    : recycler(recycler)
+  {
+    //
+  }
+  template <typename U>
+  RecyclingAllocator(const RecyclingAllocator<U>& other)
+    : recycler(other.recycler)
+  {
+    //
+  }
+
+  T* allocate(size_t count)
+  {
+    return static_cast<T*>(count == 1 ? recycler->allocate(sizeof(T)) : ::operator new(count * sizeof(T)));
+  }
+  void deallocate(T* pointer, size_t count)
+  {
+    if(count == 1)
+    {
+      recycler->release(pointer, sizeof(T));
+    }
+    else
+    {
+      ::operator delete(pointer);
+    }
+  }
+
+  template <typename U>
+  bool operator==(const RecyclingAllocator<U>& other) const
+  {
+    return recycler == other.recycler;
+  }
+  template <typename U>
+  bool operator!=(const RecyclingAllocator<U>& other) const
+  {
+    return recycler != other.recycler;
+  }
+};
+
+// Declares a class-specific operator new / delete backed by a Pool, reached
+// through Type::getPool(). Allocations of a different size (i.e. a derived class
+// that did not declare its own pool) fall through to the global allocator.
+#define DECLARE_POOLED(Type) \
+  public: \
+    static Pool<Type>& getPool(); \
+    static void* operator new(size_t size) \
+    { \
+      return size == sizeof(Type) ? getPool().allocate() : ::operator new(size); \
+    } \
+    static void operator delete(void* object, size_t size) \
+    { \
+      if(size == sizeof(Type)) \
+      { \
+        getPool().release(object); \
+      } \
+      else \
+      { \
+        ::operator delete(object); \
+      } \
+    }
+
+// The pool is made on first use and never destroyed, so objects can still be
+// made or deleted by static constructors and destructors in any order.
+#define DEFINE_POOLED(Type, tag) \
+  Pool<Type>& Type::getPool() \
+  { \
+    static Pool<Type>* pool = new Pool<Type>(tag); \
+    return *pool; \
+  }
+
+#endif
@@ -0,0 +1,202 @@
+#include "Profiler.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+// One thread's zones. Only that thread writes to it; readers copy what they
+// want, then drop whatever the writer may have come round to and overwritten
+// while they did.
+struct ProfileBuffer
+{
+  ProfileEvent events[PROFILE_BUFFER_SIZE];
+  std::atomic<uint64_t> written;
+  uint64_t frameRead;   // How far frame totals have got (read by endFrame only)
+  int thread;
+};
+
+static std::mutex buffersMutex;
+static std::vector<ProfileBuffer*> buffers;
+static thread_local ProfileBuffer* localBuffer = NULL;
+
+static std::vector<ProfileEvent> scratch;
+static std::vector<ProfileTotal> frameTotals;
+static std::vector<ProfileTotal> reportTotals; // Summed over the frames since the last report
+static int reportFrames = 0;
+static uint64_t reportStart = 0;
+static bool reporting = false;
+
+uint64_t Profiler::now()
+{
+  // Local, so it's set before the first zone in any static initializer
+  static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void Profiler::record(const char* name, uint64_t start, uint64_t end)
+{
+  ProfileBuffer* buffer = localBuffer;
+  if(!buffer)
+  {
+    // Kept after the thread ends, for the trace
+    buffer = localBuffer = new ProfileBuffer();
+    buffer->written.store(0);
+    buffer->frameRead = 0;
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    buffer->thread = buffers.size();
+    buffers.push_back(buffer);
+  }
+  
+  uint64_t index = buffer->written.load(std::memory_order_relaxed);
+  ProfileEvent* event = &buffer->events[index & (PROFILE_BUFFER_SIZE - 1)];
+  event->name = name;
+  event->start = start;
+  event->duration = end - start;
+  buffer->written.store(index + 1, std::memory_order_release);
+}
+
+// Appends a buffer's events from one onwards, as far as are still there, and
+// returns where it got up to
+static uint64_t copyEvents(ProfileBuffer* buffer, uint64_t from, std::vector<ProfileEvent>* events)
+{
+  uint64_t written = buffer->written.load(std::memory_order_acquire);
+  if(written - from > PROFILE_BUFFER_SIZE)
+  {
+    from = written - PROFILE_BUFFER_SIZE;
+  }
+  
+  size_t first = events->size();
+  for(uint64_t i = from; i < written; ++i)
+  {
+    events->push_back(buffer->events[i & (PROFILE_BUFFER_SIZE - 1)]);
+  }
+  
+  std::atomic_thread_fence(std::memory_order_acquire);
+  uint64_t after = buffer->written.load(std::memory_order_relaxed);
+  if(after - from > PROFILE_BUFFER_SIZE)
+  {
+    size_t overwritten = std::min<uint64_t>(after - PROFILE_BUFFER_SIZE - from, written - from);
+    events->erase(events->begin() + first, events->begin() + first + overwritten);
+  }
+  
+  return written;
+}
+
+static void addTotal(std::vector<ProfileTotal>* totals, const char* name, uint64_t duration, int count)
+{
+  for(size_t i = 0; i < totals->size(); ++i)
+  {
+    if((*totals)[i].name == name)
+    {
+      (*totals)[i].duration += duration;
+      (*totals)[i].count += count;
+      return;
+    }
+  }
+  
+  if(totals->size() < PROFILE_MAX_ZONES)
+  {
+    ProfileTotal total;
+    total.name = name;
+    total.duration = duration;
+    total.count = count;
+    totals->push_back(total);
+  }
+}
+
+static bool longer(const ProfileTotal& a, const ProfileTotal& b)
+{
+  return a.duration > b.duration;
+}
+
+void Profiler::endFrame()
+{
+  frameTotals.clear();
+  {
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    for(size_t i = 0; i < buffers.size(); ++i)
+    {
+      scratch.clear();
+      buffers[i]->frameRead = copyEvents(buffers[i], buffers[i]->frameRead, &scratch);
+      for(size_t j = 0; j < scratch.size(); ++j)
+      {
+        addTotal(&frameTotals, scratch[j].name, scratch[j].duration, 1);
+      }
+    }
+  }
+  
+  for(size_t i = 0; i < frameTotals.size(); ++i)
+  {
+    addTotal(&reportTotals, frameTotals[i].name, frameTotals[i].duration, frameTotals[i].count);
+  }
+  if(++reportFrames < PROFILE_REPORT_FRAMES)
+  {
+    return;
+  }
+  
+  uint64_t end = now();
+  if(reporting)
+  {
+    std::sort(reportTotals.begin(), reportTotals.end(), longer);
+    printf("Per frame over %d frames (%.2f ms each):\n", reportFrames, (end - reportStart) / 1e6 / reportFrames);
+    for(size_t i = 0; i < reportTotals.size(); ++i)
+    {
+      printf("  %-32s %9.3f ms %8.1f calls\n", reportTotals[i].name,
+             reportTotals[i].duration / 1e6 / reportFrames, reportTotals[i].count / (double)reportFrames);
+    }
+    fflush(stdout);
+  }
+  reportTotals.clear();
+  reportFrames = 0;
+  reportStart = end;
+}
+
+const std::vector<ProfileTotal>& Profiler::getFrameBreakdown()
+{
+  return frameTotals;
+}
+
+void Profiler::setReporting(bool reporting)
+{
+  ::reporting = reporting;
+}
+
+bool Profiler::isReporting()
+{
+  return reporting;
+}
+
+bool Profiler::writeTrace(const char* path)
+{
+  FILE* file = fopen(path, "w");
+  if(!file)
+  {
+    return false;
+  }
+  
+  fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+  bool first = true;
+  std::vector<ProfileEvent> events;
+  std::lock_guard<std::mutex> lock(buffersMutex);
+  for(size_t i = 0; i < buffers.size(); ++i)
+  {
+    ProfileBuffer* buffer = buffers[i];
+    fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+            first ? "" : ",", buffer->thread, buffer->thread);
+    first = false;
+    
+    // Complete events, in microseconds
+    events.clear();
+    copyEvents(buffer, 0, &events);
+    for(size_t j = 0; j < events.size(); ++j)
+    {
+      fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+              events[j].name, buffer->thread, events[j].start / 1e3, events[j].duration / 1e3);
+    }
+  }
+  fprintf(file, "\n]}\n");
+  
+  return fclose(file) == 0;
+}
@@ -0,0 +1,91 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdint.h>
+#include <vector>
+
+#define PROFILE_BUFFER_SIZE 65536  // Zones kept per thread (a power of two)
+#define PROFILE_MAX_ZONES 64       // Distinct zones totalled per frame
+#define PROFILE_REPORT_FRAMES 60   // Frames averaged in each printed breakdown
+
+// Scoped timers for the hot paths. PROFILE_ZONE("name") at the top of a block
+// times the rest of it; PROFILE_FRAME() marks the end of a frame. Both
+// compile to nothing unless ENABLE_PROFILING is defined (make profile), so
+// release builds pay nothing for them.
+//
+// Each thread records the zones it finishes into a ring buffer of its own,
+// without locking, so the latest PROFILE_BUFFER_SIZE zones of every thread
+// are always at hand. Zone names must be string literals, or otherwise live
+// forever.
+#ifdef ENABLE_PROFILING
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_FRAME() Profiler::endFrame()
+#else
+#define PROFILE_ZONE(name)
+#define PROFILE_FRAME()
+#endif
+
+struct ProfileEvent
+{
+  const char* name;
+  uint64_t start;     // Nanoseconds since the profiler started
+  uint64_t duration;
+};
+
+// Time spent in one zone over a frame, including the zones inside it
+struct ProfileTotal
+{
+  const char* name;
+  uint64_t duration;
+  int count;
+};
+
+class Profiler
+{
+public:
+  static bool isEnabled()
+  {
+#ifdef ENABLE_PROFILING
+    return true;
+#else
+    return false;
+#endif
+  }
+  
+  static uint64_t now();
+  static void record(const char* name, uint64_t start, uint64_t end);
+  
+  // Totals up the zones finished, on any thread, since the last frame ended,
+  // and prints an average of the last PROFILE_REPORT_FRAMES frames' totals
+  // every so often if reporting
+  static void endFrame();
+  static const std::vector<ProfileTotal>& getFrameBreakdown();
+  static void setReporting(bool reporting);
+  static bool isReporting();
+  
+  // Writes every zone still in the buffers in Chrome's trace event format, to
+  // open in chrome://tracing or Perfetto
+  static bool writeTrace(const char* path);
+};
+
+class ProfileZone
+{
+private:
+  const char* name;
+  uint64_t start;
+
+public:
+  ProfileZone(const char* name)
+    : name(name), start(Profiler::now())
+  {
+    //
+  }
+  ~ProfileZone()
+  {
+    Profiler::record(name, start, Profiler::now());
+  }
+};
+
+#endif
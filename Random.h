@@ -0,0 +1,69 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <stdint.h>
+
+#include "glm/glm.hpp"
+
+#define RANDOM_DEFAULT_SEED 0x853c49e6748fea9bULL
+#define RANDOM_INCREMENT 0xda3e39cb94b95bdbULL
+
+// PCG32 (O'Neill): a small generator whose sequence depends on nothing but its
+// seed, unlike rand(), which is shared with anything else that calls it and
+// differs between C libraries.
+class Random
+{
+private:
+  uint64_t state;
+
+public:
+  Random(uint64_t seed = RANDOM_DEFAULT_SEED)
+  {
+    this->seed(seed);
+  }
+  
+  void seed(uint64_t seed)
+  {
+    state = 0;
+    next();
+    state += seed;
+    next();
+  }
+  
+  // The whole generator, to carry a sequence on elsewhere
+  uint64_t getState()
+  {
+    return state;
+  }
+  void setState(uint64_t state)
+  {
+    this->state = state;
+  }
+  
+  uint32_t next()
+  {
+    uint64_t old = state;
+    state = old * 6364136223846793005ULL + RANDOM_INCREMENT;
+    uint32_t shifted = (uint32_t)(((old >> 18) ^ old) >> 27);
+    uint32_t rotation = (uint32_t)(old >> 59);
+    return (shifted >> rotation) | (shifted << ((32 - rotation) & 31));
+  }
+  
+  // Uniform in [low, high), from the top 24 bits so every value is exact
+  float nextFloat(float low, float high)
+  {
+    return low + (next() >> 8) * (1.0f / 16777216.0f) * (high - low);
+  }
+  
+  glm::vec3 nextVec3(float low, float high)
+  {
+    // Drawn in a fixed order; the order function arguments are evaluated in
+    // is unspecified
+    float x = nextFloat(low, high);
+    float y = nextFloat(low, high);
+    float z = nextFloat(low, high);
+    return glm::vec3(x, y, z);
+  }
+};
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+
+#define CACHE_LINE_SIZE 64
+
+// Bounded single-producer / single-consumer ring buffer. One thread may push
+// and one (other) thread may pop without any locking. Capacity must be a power
+// of two; one slot is always kept free to tell a full queue from an empty one.
+template <typename T, size_t Capacity>
+class SPSCQueue
+{
+private:
+  T buffer[Capacity];
+  alignas(CACHE_LINE_SIZE) std::atomic<size_t> head; // Next slot to pop
+  alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail; // Next slot to push
+
+  static size_t next(size_t index)
+  {
+    return (index + 1) & (Capacity - 1);
+  }
+
+public:
+  SPSCQueue()
+    : head(0), tail(0)
+  {
+    static_assert((Capacity & (Capacity - 1)) == 0, "SPSCQueue capacity must be a power of two");
+  }
+
+  // Producer side. Returns false (and drops nothing) if the queue is full.
+  bool push(const T& value)
+  {
+    size_t currentTail = tail.load(std::memory_order_relaxed);
+    size_t nextTail = next(currentTail);
+    if(nextTail == head.load(std::memory_order_acquire))
+    {
+      return false;
+    }
+
+    buffer[currentTail] = value;
+    tail.store(nextTail, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side. Returns false if there was nothing to pop.
+  bool pop(T* value)
+  {
+    size_t currentHead = head.load(std::memory_order_relaxed);
+    if(currentHead == tail.load(std::memory_order_acquire))
+    {
+      return false;
+    }
+
+    *value = buffer[currentHead];
+    head.store(next(currentHead), std::memory_order_release);
+    return true;
+  }
+
+  bool empty() const
+  {
+    return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+  }
+};
+
+#endif
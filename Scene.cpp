@@ -1,11 +1,34 @@
 #include "Scene.h"
 #include "Force.h"
+#include "SpringForce.h"
+#include "TwoWaySpringForce.h"
+#include "Profiler.h"
+#include "Memory.h"
+
+#include <cstring>
+#include <ctime>
+
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
 
 MatrixStack Scene::stack;
 
 Scene::Scene()
 {
-  //
+  collisionSurface = NULL;
+  grabSpring = NULL;
+  droppedCommands = 0;
+  integrator = INTEGRATOR_RK4;
+  pool = ThreadPool::shared();
+  sleepEnabled = true;
+  random.seed(time(NULL));
+  deterministic = false;
+  stateHash = FNV_OFFSET_BASIS;
+  recorder = NULL;
+  adaptiveTolerance = RK45_DEFAULT_TOLERANCE;
+  adaptiveStep = 0.0f;
+  lastSubsteps = lastRejected = lastEvaluations = 0;
+  lastAllocations = 0;
 }
 
 void Scene::add(SceneObject* sceneObject)
@@ -49,6 +72,7 @@ bool Scene::remove(Light* light)
 void Scene::add(PhysModel* physObject)
 {
   physObjects.push_back(physObject);
+  network.invalidate();
 }
 
 bool Scene::remove(PhysModel* physObject)
@@ -72,6 +96,9 @@ bool Scene::remove(PhysModel* physObject)
       }
       
       physObjects.erase(it);
+      collisions.removeBody(physObject);
+      contactPairs.clear();
+      network.invalidate();
       return true;
     }
   }
@@ -79,8 +106,163 @@ bool Scene::remove(PhysModel* physObject)
   return false;
 }
 
+void Scene::addContact(const ContactManifold& manifold)
+{
+  collisions.addManifold(manifold);
+  if(manifold.b)
+  {
+    contactPairs.push_back(std::make_pair(manifold.a, manifold.b));
+  }
+}
+
+bool Scene::queue(const SceneCommand& command)
+{
+  if(!commands.push(command))
+  {
+    ++droppedCommands;
+    return false;
+  }
+  return true;
+}
+
+void Scene::applyCommands()
+{
+  // Anything removed at the previous boundary has had a full step to drop out
+  // of use, so it is now safe to destroy
+  releaseDeferred();
+  
+  SceneCommand command;
+  while(commands.pop(&command))
+  {
+    apply(command);
+  }
+}
+
+void Scene::deferDelete(PhysModel* physObject)
+{
+  deferredBodies.push_back(physObject);
+}
+
+void Scene::deferDelete(Force* force)
+{
+  deferredForces.push_back(force);
+}
+
+void Scene::releaseDeferred()
+{
+  // Forces first, as deleting a body would otherwise try to delete them again
+  for(size_t i = 0; i < deferredForces.size(); ++i)
+  {
+    delete deferredForces[i];
+  }
+  deferredForces.clear();
+  
+  for(size_t i = 0; i < deferredBodies.size(); ++i)
+  {
+    delete deferredBodies[i];
+  }
+  deferredBodies.clear();
+}
+
+bool Scene::contains(PhysModel* physObject)
+{
+  for(size_t i = 0; i < physObjects.size(); ++i)
+  {
+    if(physObjects[i] == physObject)
+    {
+      return true;
+    }
+  }
+  
+  return false;
+}
+
+void Scene::apply(const SceneCommand& command)
+{
+  // The bodies may have been removed by an earlier command in the queue
+  if(command.type != COMMAND_ADD_BODY
+     && ((command.body && !contains(command.body))
+         || (command.otherBody && !contains(command.otherBody))))
+  {
+    delete command.light;
+    return;
+  }
+  
+  switch(command.type)
+  {
+  case COMMAND_ADD_BODY:
+    add(command.body);
+    break;
+  case COMMAND_REMOVE_BODY:
+    if(remove(command.body))
+    {
+      if(grabSpring && grabSpring->getTarget() == command.body)
+      {
+        grabSpring = NULL;
+      }
+      
+      command.body->detachForces(&deferredForces);
+      deferDelete(command.body);
+    }
+    break;
+  case COMMAND_ADD_LIGHT:
+    command.light->attachTo(command.body);
+    add(command.light);
+    break;
+  case COMMAND_ADD_SPRING:
+    SpringForce::create(command.body, command.position, command.k, command.b, command.attachOffset);
+    break;
+  case COMMAND_ADD_TWO_WAY_SPRING:
+    TwoWaySpringForce::create(command.body, command.otherBody, command.k, command.b, command.attachOffset, command.otherAttachOffset);
+    break;
+  case COMMAND_REMOVE_SPRING:
+    {
+      SpringForce* spring = command.body->findSpringForce();
+      if(spring)
+      {
+        if(spring == grabSpring)
+        {
+          grabSpring = NULL;
+        }
+        
+        spring->detach();
+        deferDelete(spring);
+      }
+    }
+    break;
+  case COMMAND_TOGGLE_GRAVITY:
+    command.body->toggleGravity();
+    break;
+  case COMMAND_GRAB:
+    if(!grabSpring)
+    {
+      grabSpring = SpringForce::create(command.body, command.position, command.k, command.b, command.attachOffset);
+    }
+    break;
+  case COMMAND_MOVE_GRAB:
+    if(grabSpring)
+    {
+      grabSpring->translate(command.position);
+    }
+    break;
+  case COMMAND_RELEASE_GRAB:
+    if(grabSpring)
+    {
+      grabSpring->detach();
+      deferDelete(grabSpring);
+      grabSpring = NULL;
+    }
+    break;
+  default:
+    break;
+  }
+}
+
 void Scene::draw(float alpha)
 {
+  PROFILE_ZONE("Scene::draw");
+  MemoryScope scope(MEMORY_RENDER);
+  
   for(size_t i = 0; i < lights.size(); ++i)
   {
     lights[i]->draw(alpha);
@@ -97,36 +279,514 @@ void Scene::draw(float alpha)
   }
 }
 
-void Scene::step(float t, float dt)
+struct IslandTask
 {
-  for(unsigned int i = 0; i < physObjects.size(); ++i)
+  Scene* scene;
+  const std::vector<PhysState>* states;
+  std::vector<Derivative>* derivatives;
+  float dt;
+};
+
+void Scene::evaluateIslands(void* context, size_t begin, size_t end)
+{
+  PROFILE_ZONE("Scene::evaluateIslands");
+  
+  IslandTask* task = static_cast<IslandTask*>(context);
+  for(size_t island = begin; island < end; ++island)
+  {
+    task->scene->evaluate(task->scene->activeIslands[island], *task->states, task->derivatives);
+  }
+}
+
+void Scene::integrateIslandsRK4(void* context, size_t begin, size_t end)
+{
+  PROFILE_ZONE("Scene::integrateIslandsRK4");
+  
+  IslandTask* task = static_cast<IslandTask*>(context);
+  for(size_t island = begin; island < end; ++island)
+  {
+    task->scene->integrateRK4(task->scene->activeIslands[island], task->dt);
+  }
+}
+
+void Scene::evaluate(const IslandRange& island, const std::vector<PhysState>& states, std::vector<Derivative>* derivatives)
+{
+  // Forces acting on individual bodies
+  for(unsigned int i = island.bodyBegin; i < island.bodyEnd; ++i)
+  {
+    (*derivatives)[i] = activeObjects[i]->evaluate(states[i]);
+  }
+  
+  // Forces between bodies
+  network.applyForces(states, derivatives, island.springBegin, island.springEnd);
+}
+
+void Scene::evaluate(const std::vector<PhysState>& states, std::vector<Derivative>* derivatives)
+{
+  PROFILE_ZONE("Scene::evaluate");
+  
+  // Islands don't affect each other, so they can be evaluated in parallel. Each
+  // island's forces are summed in the same order whichever thread takes it, so
+  // the result doesn't depend on the number of threads.
+  IslandTask task;
+  task.scene = this;
+  task.states = &states;
+  task.derivatives = derivatives;
+  task.dt = 0.0f;
+  pool->parallelFor(activeIslands.size(), ISLAND_PARALLEL_GRAIN, evaluateIslands, &task);
+}
+
+void Scene::integrate(float dt)
+{
+  PROFILE_ZONE("Scene::integrate");
+  
+  size_t numBodies = activeObjects.size();
+  states.resize(numBodies);
+  stageStates.resize(numBodies);
+  for(int i = 0; i < RK45_STAGES; ++i)
+  {
+    derivatives[i].resize(numBodies);
+  }
+  
+  for(size_t i = 0; i < numBodies; ++i)
+  {
+    states[i] = activeObjects[i]->beginStep();
+  }
+  
+  switch(integrator)
+  {
+  case INTEGRATOR_IMPLICIT_EULER:
+    integrateImplicitEuler(dt);
+    break;
+  case INTEGRATOR_XPBD:
+    integrateXPBD(dt);
+    break;
+  case INTEGRATOR_RK45:
+    integrateRK45(dt);
+    break;
+  default:
+    integrateRK4(dt);
+    break;
+  }
+}
+
+void Scene::integrateRK4(float dt)
+{
+  // Each island is integrated on its own, as an independent task
+  IslandTask task;
+  task.scene = this;
+  task.states = NULL;
+  task.derivatives = NULL;
+  task.dt = dt;
+  pool->parallelFor(activeIslands.size(), ISLAND_PARALLEL_GRAIN, integrateIslandsRK4, &task);
+}
+  
+void Scene::integrateRK4(const IslandRange& island, float dt)
+{
+  // RK4, with every body's stage evaluated together so the springs between them
+  // see consistent states
+  static const float stageTime[3] = { 0.5f, 0.5f, 1.0f };
+  evaluate(island, states, &derivatives[0]);
+  for(int stage = 1; stage < 4; ++stage)
+  {
+    for(unsigned int i = island.bodyBegin; i < island.bodyEnd; ++i)
+    {
+      stageStates[i] = states[i];
+      ::integrate(&stageStates[i], derivatives[stage - 1][i], dt * stageTime[stage - 1]);
+    }
+    evaluate(island, stageStates, &derivatives[stage]);
+  }
+  
+  for(unsigned int i = island.bodyBegin; i < island.bodyEnd; ++i)
+  {
+    ::integrate(&states[i], derivatives[0][i], dt / 6.0f);
+    ::integrate(&states[i], derivatives[1][i], dt / 3.0f);
+    ::integrate(&states[i], derivatives[2][i], dt / 3.0f);
+    ::integrate(&states[i], derivatives[3][i], dt / 6.0f);
+    activeObjects[i]->endStep(states[i]);
+  }
+}
+
+// Dormand-Prince 5(4) tableau
+static const float rk45Nodes[RK45_STAGES][RK45_STAGES - 1] =
+{
+  { 0.0f },
+  { 1.0f / 5.0f },
+  { 3.0f / 40.0f, 9.0f / 40.0f },
+  { 44.0f / 45.0f, -56.0f / 15.0f, 32.0f / 9.0f },
+  { 19372.0f / 6561.0f, -25360.0f / 2187.0f, 64448.0f / 6561.0f, -212.0f / 729.0f },
+  { 9017.0f / 3168.0f, -355.0f / 33.0f, 46732.0f / 5247.0f, 49.0f / 176.0f, -5103.0f / 18656.0f },
+  { 35.0f / 384.0f, 0.0f, 500.0f / 1113.0f, 125.0f / 192.0f, -2187.0f / 6784.0f, 11.0f / 84.0f }
+};
+
+// Fifth order weights minus the embedded fourth order ones
+static const float rk45ErrorWeights[RK45_STAGES] =
+{
+  35.0f / 384.0f - 5179.0f / 57600.0f,
+  0.0f,
+  500.0f / 1113.0f - 7571.0f / 16695.0f,
+  125.0f / 192.0f - 393.0f / 640.0f,
+  -2187.0f / 6784.0f + 92097.0f / 339200.0f,
+  11.0f / 84.0f - 187.0f / 2100.0f,
+  -1.0f / 40.0f
+};
+
+static float scaledError(glm::vec3 error, glm::vec3 value, float tolerance)
+{
+  return glm::length(error) / (tolerance * (1.0f + glm::length(value)));
+}
+
+float Scene::estimateError(float h)
+{
+  // Largest error of any value of any body, as a multiple of the tolerance
+  float worst = 0.0f;
+  for(size_t i = 0; i < activeObjects.size(); ++i)
+  {
+    PhysState error;
+    error.position = error.linearMomentum = error.angularMomentum = glm::vec3();
+    error.orientation = glm::quat(0.0f, 0.0f, 0.0f, 0.0f);
+    for(int k = 0; k < RK45_STAGES; ++k)
+    {
+      ::integrate(&error, derivatives[k][i], h * rk45ErrorWeights[k]);
+    }
+    
+    const PhysState& value = stageStates[i];
+    worst = glm::max(worst, scaledError(error.position, value.position, adaptiveTolerance));
+    worst = glm::max(worst, scaledError(error.linearMomentum, value.linearMomentum, adaptiveTolerance));
+    worst = glm::max(worst, scaledError(error.angularMomentum, value.angularMomentum, adaptiveTolerance));
+    
+    // Orientations are unit quaternions, so their error is already relative
+    glm::vec4 orientationError(error.orientation.x, error.orientation.y, error.orientation.z, error.orientation.w);
+    worst = glm::max(worst, glm::length(orientationError) / adaptiveTolerance);
+  }
+  
+  return worst;
+}
+
+void Scene::integrateRK45(float dt)
+{
+  size_t numBodies = activeObjects.size();
+  lastSubsteps = lastRejected = lastEvaluations = 0;
+  
+  // Carry the step size over from the last frame, as stiffness rarely changes
+  // suddenly
+  float h = adaptiveStep > 0.0f ? glm::min(adaptiveStep, dt) : dt;
+  float remaining = dt;
+  bool haveFirstStage = false;
+  
+  while(remaining > 0.0f)
   {
-    physObjects[i]->step(t, dt);
+    // Out of substeps, the rest of the step is taken in one, whatever its error
+    bool forced = lastSubsteps + 1 >= RK45_MAX_SUBSTEPS;
+    bool last = forced || h >= remaining;
+    float substep = last ? remaining : h;
+    ++lastSubsteps;
+    
+    // The last stage of an accepted step is the first of the next one
+    if(!haveFirstStage)
+    {
+      evaluate(states, &derivatives[0]);
+      ++lastEvaluations;
+    }
     
-    if(collisionSurface)
+    for(int stage = 1; stage < RK45_STAGES; ++stage)
     {
-      if(physObjects[i]->isInOrBelow(collisionSurface))
+      for(size_t i = 0; i < numBodies; ++i)
       {
-        if(physObjects[i]->wasCollidingWith(collisionSurface))
+        stageStates[i] = states[i];
+        for(int k = 0; k < stage; ++k)
         {
-          physObjects[i]->setOnGround(true);
-          continue;
+          if(rk45Nodes[stage][k] != 0.0f)
+          {
+            ::integrate(&stageStates[i], derivatives[k][i], substep * rk45Nodes[stage][k]);
+          }
         }
-        else
+      }
+      evaluate(stageStates, &derivatives[stage]);
+      ++lastEvaluations;
+    }
+    
+    // stageStates now holds the fifth order solution
+    float error = estimateError(substep);
+    float factor = error > 0.0f ? 0.9f * powf(error, -0.2f) : 5.0f;
+    factor = glm::clamp(factor, 0.2f, 5.0f);
+    
+    if(error <= 1.0f || substep <= RK45_MIN_STEP || forced)
+    {
+      states.swap(stageStates);
+      derivatives[0].swap(derivatives[RK45_STAGES - 1]);
+      haveFirstStage = true;
+      remaining = last ? 0.0f : remaining - substep;
+      
+      // Don't let a short final substep shrink the next frame's step
+      if(!last || factor < 1.0f)
+      {
+        h = substep * factor;
+      }
+    }
+    else
+    {
+      ++lastRejected;
+      haveFirstStage = true; // Still valid, the start state didn't change
+      h = glm::max(substep * factor, RK45_MIN_STEP);
+    }
+  }
+  
+  adaptiveStep = h;
+  for(size_t i = 0; i < numBodies; ++i)
+  {
+    activeObjects[i]->endStep(states[i]);
+  }
+}
+
+void Scene::integrateXPBD(float dt)
+{
+  xpbdSolver.step(activeObjects, network, collisionSurface, states, dt, &stageStates);
+  
+  for(size_t i = 0; i < activeObjects.size(); ++i)
+  {
+    activeObjects[i]->endStep(stageStates[i]);
+  }
+}
+
+void Scene::integrateImplicitEuler(float dt)
+{
+  evaluate(states, &derivatives[0]);
+  implicitSolver.step(activeObjects, network, states, derivatives[0], dt, &stageStates);
+  
+  for(size_t i = 0; i < activeObjects.size(); ++i)
+  {
+    activeObjects[i]->endStep(stageStates[i]);
+  }
+}
+
+void Scene::collideBodies(float dt)
+{
+  PROFILE_ZONE("Scene::collideBodies");
+  
+  // XPBD handles ground contact as one of its constraints
+  collisions.update(physObjects, integrator == INTEGRATOR_XPBD ? NULL : collisionSurface);
+  
+  for(size_t i = 0; i < activeObjects.size(); ++i)
+  {
+    activeObjects[i]->setOnGround(false);
+  }
+  
+  // Touching bodies are simulated (and sleep) together from the next step on;
+  // an awake body touching a sleeping one wakes it
+  const std::vector<ContactManifold*>& manifolds = collisions.getManifolds();
+  contactPairs.clear();
+  for(size_t m = 0; m < manifolds.size(); ++m)
+  {
+    ContactManifold* manifold = manifolds[m];
+    if(!manifold->b)
+    {
+      manifold->a->setOnGround(true);
+      continue;
+    }
+    contactPairs.push_back(std::make_pair(manifold->a, manifold->b));
+    if(manifold->a->isAsleep() != manifold->b->isAsleep())
+    {
+      manifold->a->wake();
+      manifold->b->wake();
+    }
+  }
+  
+  contactSolver.solve(physObjects, manifolds, dt);
+}
+
+void Scene::updateIslands()
+{
+  PROFILE_ZONE("Scene::updateIslands");
+  
+  size_t numBodies = physObjects.size();
+  for(size_t i = 0; i < numBodies; ++i)
+  {
+    physObjects[i]->setIslandIndex(i);
+  }
+  
+  // Bodies connected by springs or touching each other form an island
+  islands.reset(numBodies);
+  for(size_t i = 0; i < numBodies; ++i)
+  {
+    const std::vector<LinkSpring>& links = physObjects[i]->getLinkSprings();
+    for(size_t j = 0; j < links.size(); ++j)
+    {
+      unsigned int other = links[j].other->getIslandIndex();
+      if(other < numBodies && physObjects[other] == links[j].other)
+      {
+        islands.join(i, other);
+      }
+    }
+  }
+  for(size_t i = 0; i < contactPairs.size(); ++i)
+  {
+    islands.join(contactPairs[i].first->getIslandIndex(), contactPairs[i].second->getIslandIndex());
+  }
+  islands.build();
+  
+  // The awake islands, laid out one after another, are what gets simulated.
+  // Anything woken since the last step wakes the rest of its island.
+  lastActiveObjects.swap(activeObjects);
+  activeObjects.clear();
+  activeIslands.clear();
+  for(size_t island = 0; island < islands.getNumIslands(); ++island)
+  {
+    const unsigned int* bodies = islands.getIsland(island);
+    size_t size = islands.getIslandSize(island);
+    bool awake = false;
+    for(size_t i = 0; i < size && !awake; ++i)
+    {
+      awake = !physObjects[bodies[i]]->isAsleep();
+    }
+    
+    if(awake)
+    {
+      IslandRange range;
+      range.bodyBegin = activeObjects.size();
+      for(size_t i = 0; i < size; ++i)
+      {
+        PhysModel* body = physObjects[bodies[i]];
+        if(body->isAsleep())
         {
-          physObjects[i]->bounce(0.3f, collisionSurface);
-          physObjects[i]->addCollision(collisionSurface);
+          body->wake();
         }
+        activeObjects.push_back(body);
       }
-      else
+      range.bodyEnd = activeObjects.size();
+      activeIslands.push_back(range);
+    }
+  }
+  
+  // The network only sees awake bodies, so rebuild it when they change
+  if(activeObjects != lastActiveObjects)
+  {
+    network.invalidate();
+  }
+}
+
+void Scene::findIslandSprings()
+{
+  // Springs are gathered from the bodies in order, and never leave an island,
+  // so each island's springs are a contiguous run too
+  const std::vector<NetworkSpring>& springs = network.getSprings();
+  unsigned int spring = 0;
+  for(size_t island = 0; island < activeIslands.size(); ++island)
+  {
+    IslandRange& range = activeIslands[island];
+    range.springBegin = spring;
+    while(spring < springs.size() && springs[spring].a < range.bodyEnd)
+    {
+      ++spring;
+    }
+    range.springEnd = spring;
+  }
+}
+
+void Scene::updateSleep()
+{
+  PROFILE_ZONE("Scene::updateSleep");
+  
+  if(!sleepEnabled)
+  {
+    return;
+  }
+  
+  for(size_t i = 0; i < activeObjects.size(); ++i)
+  {
+    activeObjects[i]->updateSleepCounter();
+  }
+  
+  // An island only sleeps once all of its bodies have been at rest long enough
+  for(size_t island = 0; island < activeIslands.size(); ++island)
+  {
+    const IslandRange& range = activeIslands[island];
+    bool resting = true;
+    for(unsigned int i = range.bodyBegin; i < range.bodyEnd && resting; ++i)
+    {
+      resting = activeObjects[i]->getSleepCounter() >= SLEEP_STEPS;
+    }
+    
+    if(resting)
+    {
+      for(unsigned int i = range.bodyBegin; i < range.bodyEnd; ++i)
       {
-        physObjects[i]->removeCollision(collisionSurface);
+        activeObjects[i]->sleep();
       }
     }
-    physObjects[i]->setOnGround(false);
   }
 }
 
+void Scene::setDeterministic(bool deterministic, uint64_t seed)
+{
+  this->deterministic = deterministic;
+  random.seed(deterministic ? seed : time(NULL));
+  stateHash = FNV_OFFSET_BASIS;
+}
+
+static void hashBytes(uint64_t* hash, const void* data, size_t size)
+{
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  for(size_t i = 0; i < size; ++i)
+  {
+    *hash = (*hash ^ bytes[i]) * FNV_PRIME;
+  }
+}
+
+void Scene::hashState()
+{
+  // The primary values hold everything else, and the bodies are always in the
+  // order they were added
+  stateHash = FNV_OFFSET_BASIS;
+  for(size_t i = 0; i < physObjects.size(); ++i)
+  {
+    const PhysState& state = physObjects[i]->getState();
+    float values[13];
+    memcpy(values, &state.position[0], sizeof(float) * 3);
+    memcpy(values + 3, &state.linearMomentum[0], sizeof(float) * 3);
+    values[6] = state.orientation.w;
+    values[7] = state.orientation.x;
+    values[8] = state.orientation.y;
+    values[9] = state.orientation.z;
+    memcpy(values + 10, &state.angularMomentum[0], sizeof(float) * 3);
+    hashBytes(&stateHash, values, sizeof(values));
+  }
+}
+
+void Scene::step(float t, float dt)
+{
+  PROFILE_ZONE("Scene::step");
+  MemoryScope scope(MEMORY_PHYSICS);
+  uint64_t allocations = Memory::getNumAllocations();
+  
+  applyCommands();
+  updateIslands();
+  
+  if(network.isStale(activeObjects))
+  {
+    network.build(activeObjects);
+  }
+  findIslandSprings();
+  
+  integrate(dt);
+  
+  collideBodies(dt);
+  
+  updateSleep();
+  
+  if(deterministic)
+  {
+    hashState();
+  }
+  
+  if(recorder)
+  {
+    recorder->record(t + dt, physObjects);
+  }
+  
+  lastAllocations = Memory::getNumAllocations() - allocations;
+}
+
 PhysModel* Scene::select(glm::vec3 start, glm::vec3 end)
 {
   PhysModel* hit = NULL;
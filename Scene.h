@@ -1,11 +1,46 @@
 #ifndef SCENE_H
 #define SCENE_H
 
+#include <utility>
 #include <vector>
 #include "SceneObject.h"
 #include "PhysModel.h"
 #include "Light.h"
 #include "MatrixStack.h"
+#include "SceneCommand.h"
+#include "SPSCQueue.h"
+#include "SpringNetwork.h"
+#include "ImplicitEulerSolver.h"
+#include "XPBDSolver.h"
+#include "ThreadPool.h"
+#include "Islands.h"
+#include "CollisionWorld.h"
+#include "ContactSolver.h"
+#include "Random.h"
+#include "TrajectoryRecorder.h"
+
+#define SCENE_COMMAND_CAPACITY 256
+#define ISLAND_PARALLEL_GRAIN 8
+
+#define INTEGRATOR_RK4 0
+#define INTEGRATOR_IMPLICIT_EULER 1
+#define INTEGRATOR_XPBD 2
+#define INTEGRATOR_RK45 3
+
+#define RK45_DEFAULT_TOLERANCE 1e-4f
+#define RK45_MIN_STEP 1e-5f
+#define RK45_MAX_SUBSTEPS 1000
+#define RK45_STAGES 7
+
+class Force;
+class SpringForce;
+
+// An awake island, as ranges of the scene's active bodies and network springs
+struct IslandRange
+{
+  unsigned int bodyBegin, bodyEnd;
+  unsigned int springBegin, springEnd;
+};
 
 class Scene
 {
@@ -13,7 +48,67 @@ private:
   std::vector<SceneObject*> sceneObjects;
   std::vector<Light*> lights;
   std::vector<PhysModel*> physObjects;
+  std::vector<PhysModel*> activeObjects; // The awake ones, grouped by island
+  std::vector<PhysModel*> lastActiveObjects;
+  std::vector<IslandRange> activeIslands;
+  std::vector<std::pair<PhysModel*, PhysModel*> > contactPairs;
   Model* collisionSurface;
+  SpringNetwork network;
+  int integrator;
+  ImplicitEulerSolver implicitSolver;
+  XPBDSolver xpbdSolver;
+  IslandBuilder islands;
+  CollisionWorld collisions;
+  ContactSolver contactSolver;
+  ThreadPool* pool;
+  bool sleepEnabled;
+  
+  // Deterministic mode
+  Random random;
+  bool deterministic;
+  uint64_t stateHash;
+  
+  TrajectoryRecorder* recorder;
+  
+  // Integration scratch space, kept around to avoid allocating every step
+  std::vector<PhysState> states, stageStates;
+  std::vector<Derivative> derivatives[RK45_STAGES];
+  
+  // Adaptive integration
+  float adaptiveTolerance;
+  float adaptiveStep;
+  int lastSubsteps, lastRejected, lastEvaluations;
+  
+  uint64_t lastAllocations;
+  
+  // Edits queued by input handlers, applied at step boundaries
+  SPSCQueue<SceneCommand, SCENE_COMMAND_CAPACITY> commands;
+  int droppedCommands;
+  SpringForce* grabSpring;
+  
+  // Objects removed from the simulation, destroyed at the following boundary
+  std::vector<PhysModel*> deferredBodies;
+  std::vector<Force*> deferredForces;
+  
+  bool contains(PhysModel* physObject);
+  void apply(const SceneCommand& command);
+  void releaseDeferred();
+  void evaluate(const std::vector<PhysState>& states, std::vector<Derivative>* derivatives);
+  void evaluate(const IslandRange& island, const std::vector<PhysState>& states, std::vector<Derivative>* derivatives);
+  static void evaluateIslands(void* context, size_t begin, size_t end);
+  void integrate(float dt);
+  void integrateRK4(float dt);
+  void integrateRK4(const IslandRange& island, float dt);
+  static void integrateIslandsRK4(void* context, size_t begin, size_t end);
+  void integrateImplicitEuler(float dt);
+  void integrateXPBD(float dt);
+  void integrateRK45(float dt);
+  float estimateError(float h);
+  void collideBodies(float dt);
+  void updateIslands();
+  void findIslandSprings();
+  void updateSleep();
+  void hashState();
 
 public:
   static MatrixStack stack;
@@ -29,10 +124,178 @@ public:
   {
     collisionSurface = model;
   }
+  Model* getCollisionSurface()
+  {
+    return collisionSurface;
+  }
+  int getNumSceneObjects()
+  {
+    return sceneObjects.size();
+  }
+  SceneObject* getSceneObject(int index)
+  {
+    return sceneObjects[index];
+  }
   int getNumLights()
   {
     return lights.size();
   }
+  Light* getLight(int index)
+  {
+    return lights[index];
+  }
+  int getNumPhysObjects()
+  {
+    return physObjects.size();
+  }
+  PhysModel* getPhysObject(int index)
+  {
+    return physObjects[index];
+  }
+  // Bodies simulated during the last step; the rest were asleep
+  int getNumActiveObjects()
+  {
+    return activeObjects.size();
+  }
+  void setSleepEnabled(bool sleepEnabled)
+  {
+    this->sleepEnabled = sleepEnabled;
+  }
+  bool isSleepEnabled()
+  {
+    return sleepEnabled;
+  }
+  // Islands are simulated in parallel on this pool (the shared one by default)
+  void setThreadPool(ThreadPool* pool)
+  {
+    this->pool = pool;
+  }
+  // Islands of all bodies, and of the awake ones simulated during the last step
+  int getNumIslands()
+  {
+    return islands.getNumIslands();
+  }
+  int getNumActiveIslands()
+  {
+    return activeIslands.size();
+  }
+  // Number of islands of 2^i up to 2^(i+1) - 1 bodies, for i < ISLAND_HISTOGRAM_BUCKETS
+  const unsigned int* getIslandSizeHistogram()
+  {
+    return islands.getSizeHistogram();
+  }
+  // With the same seed and the same inputs, every step comes out bit for bit
+  // the same, on any number of threads: the random generator is reseeded, and
+  // each step's state is hashed so runs can be compared. Without it the
+  // generator is seeded from the clock.
+  void setDeterministic(bool deterministic, uint64_t seed = RANDOM_DEFAULT_SEED);
+  bool isDeterministic()
+  {
+    return deterministic;
+  }
+  // Anything random about the scene (not the simulation itself) comes from here
+  Random* getRandom()
+  {
+    return &random;
+  }
+  // FNV-1a hash of every body's state after the last step, in deterministic mode
+  uint64_t getStateHash()
+  {
+    return stateHash;
+  }
+  // Given every body's pose after each step, or none if NULL. The recorder
+  // isn't owned by the scene.
+  void setRecorder(TrajectoryRecorder* recorder)
+  {
+    this->recorder = recorder;
+  }
+  TrajectoryRecorder* getRecorder()
+  {
+    return recorder;
+  }
+  // Returns false, and counts the command as dropped, if the queue is full
+  bool queue(const SceneCommand& command);
+  void applyCommands();
+  // Commands queue() turned away so far
+  int getNumDroppedCommands()
+  {
+    return droppedCommands;
+  }
+  void deferDelete(PhysModel* physObject);
+  void deferDelete(Force* force);
+  // One of the INTEGRATOR_ values
+  void setIntegrator(int integrator)
+  {
+    this->integrator = integrator;
+  }
+  int getIntegrator()
+  {
+    return integrator;
+  }
+  ImplicitEulerSolver* getImplicitSolver()
+  {
+    return &implicitSolver;
+  }
+  XPBDSolver* getXPBDSolver()
+  {
+    return &xpbdSolver;
+  }
+  // Largest error per substep INTEGRATOR_RK45 accepts, relative to the size of
+  // the values (or absolute, for values smaller than one)
+  void setAdaptiveTolerance(float tolerance)
+  {
+    adaptiveTolerance = tolerance;
+  }
+  float getAdaptiveTolerance()
+  {
+    return adaptiveTolerance;
+  }
+  // The substep the adaptive integrator will try first
+  void setAdaptiveStep(float step)
+  {
+    adaptiveStep = step;
+  }
+  float getAdaptiveStep()
+  {
+    return adaptiveStep;
+  }
+  // Substeps taken (accepted and rejected) and derivative evaluations made by
+  // the adaptive integrator during the last step. At RK45_MAX_SUBSTEPS, the
+  // last substep covered whatever was left of the step and was accepted
+  // whatever its error.
+  int getLastSubsteps()
+  {
+    return lastSubsteps;
+  }
+  int getLastRejected()
+  {
+    return lastRejected;
+  }
+  int getLastEvaluations()
+  {
+    return lastEvaluations;
+  }
+  // Heap allocations made during the last step, on any thread (see Memory.h).
+  // Once a scene has settled into a steady state, this should be zero.
+  uint64_t getLastAllocations()
+  {
+    return lastAllocations;
+  }
+  CollisionWorld* getCollisionWorld()
+  {
+    return &collisions;
+  }
+  ContactSolver* getContactSolver()
+  {
+    return &contactSolver;
+  }
+  // Puts back a manifold saved from an earlier step, with its impulses, as if
+  // the collision pass had just found it
+  void addContact(const ContactManifold& manifold);
+  const SpringNetwork& getNetwork()
+  {
+    return network;
+  }
   void draw(float alpha);
   void step(float t, float dt);
   PhysModel* select(glm::vec3 start, glm::vec3 end);
@@ -0,0 +1,48 @@
+#ifndef SCENE_COMMAND_H
+#define SCENE_COMMAND_H
+
+#include <cstddef>
+
+#include "glm/glm.hpp"
+
+class PhysModel;
+class Light;
+
+#define COMMAND_ADD_BODY 0
+#define COMMAND_REMOVE_BODY 1
+#define COMMAND_ADD_LIGHT 2
+#define COMMAND_ADD_SPRING 3
+#define COMMAND_ADD_TWO_WAY_SPRING 4
+#define COMMAND_REMOVE_SPRING 5
+#define COMMAND_TOGGLE_GRAVITY 6
+#define COMMAND_GRAB 7
+#define COMMAND_MOVE_GRAB 8
+#define COMMAND_RELEASE_GRAB 9
+
+// A deferred edit to the scene, queued by input handlers and applied by the
+// simulation at the next step boundary. Only the fields relevant to the command
+// type need to be filled in.
+struct SceneCommand
+{
+  int type;
+  PhysModel* body;
+  PhysModel* otherBody;
+  Light* light;
+  glm::vec3 position;
+  glm::vec3 attachOffset, otherAttachOffset;
+  float k, b;
+
+  SceneCommand()
+    : type(-1), body(NULL), otherBody(NULL), light(NULL), k(0.0f), b(0.0f)
+  {
+    //
+  }
+
+  SceneCommand(int type, PhysModel* body = NULL)
+    : type(type), body(body), otherBody(NULL), light(NULL), k(0.0f), b(0.0f)
+  {
+    //
+  }
+};
+
+#endif
@@ -0,0 +1,698 @@
+#include "SceneFile.h"
+
+#include <stdio.h>
+#include <cstring>
+#include <map>
+#include <vector>
+
+#include "Json.h"
+#include "GravitationalForce.h"
+#include "SpringForce.h"
+#include "TwoWaySpringForce.h"
+
+#define NO_INDEX -1
+#define MAX_CONTACT_ITERATIONS 10000
+#define MAX_SEED 9007199254740992.0 // 2^53, past which not every whole number is a double
+
+struct SceneFileMesh
+{
+  std::string path;
+  bool scaleOnLoad;
+};
+
+struct SceneFileModel
+{
+  int mesh;
+  Material material;
+  glm::vec3 position;
+  glm::quat orientation;
+  float scale;
+};
+
+struct SceneFileBody
+{
+  int mesh;
+  Material material;
+  float mass, scale;
+  glm::vec3 position, velocity, angularVelocity;
+  glm::quat orientation;
+  bool gravity;
+  int colliderType;
+  glm::vec3 colliderSize;
+  ContactMaterial contact;
+};
+
+struct SceneFileAnchor
+{
+  int body;
+  glm::vec3 anchor, attachOffset;
+  float k, b;
+};
+
+struct SceneFileLink
+{
+  int a, b;
+  glm::vec3 attachOffset, otherAttachOffset;
+  float k, damping, restLength;
+};
+
+struct SceneFileLight
+{
+  glm::vec3 position, color, falloff;
+  int attachment;
+  bool hasModel;
+};
+
+// Reads members of the document, remembering the first thing wrong with it.
+// Where it went wrong is only spelled out on failure, so the many members
+// that are fine cost nothing to describe.
+struct SceneFileReader
+{
+  std::string* error;
+  bool failed;
+  const char* within; // The member of an element being read from, if not the element itself
+  
+  void fail(const char* section, size_t index, const char* key, const char* message)
+  {
+    if(failed)
+    {
+      return;
+    }
+    failed = true;
+    
+    if(error)
+    {
+      std::string member = within ? within : "";
+      if(key)
+      {
+        member += std::string(within ? "." : "") + key;
+      }
+      
+      char where[128];
+      if(index != (size_t)-1)
+      {
+        snprintf(where, sizeof(where), "%s[%zu]%s%s: ", section, index, member.empty() ? "" : ".", member.c_str());
+      }
+      else
+      {
+        snprintf(where, sizeof(where), "%s%s%s: ", section, member.empty() ? "" : ".", member.c_str());
+      }
+      *error = std::string(where) + message;
+    }
+  }
+  
+  // The members of an object that must be one if it's there, or NULL
+  const JsonValue* object(const JsonValue& parent, const char* key, const char* section, size_t index)
+  {
+    const JsonValue* value = parent.find(key);
+    if(value && !value->isObject())
+    {
+      fail(section, index, key, "expected an object");
+      return NULL;
+    }
+    return value;
+  }
+  
+  // A whole number from 0 to max
+  double count(const JsonValue& object, const char* key, double max, double fallback, const char* section, size_t index)
+  {
+    const JsonValue* value = object.find(key);
+    if(!value)
+    {
+      return fallback;
+    }
+    double number = value->getNumber();
+    if(!value->isNumber() || !(number >= 0.0 && number <= max) || number != (double)(uint64_t)number)
+    {
+      char message[64];
+      snprintf(message, sizeof(message), "expected a whole number from 0 to %.0f", max);
+      fail(section, index, key, message);
+      return fallback;
+    }
+    return number;
+  }
+  
+  float number(const JsonValue& object, const char* key, float fallback, const char* section, size_t index)
+  {
+    const JsonValue* value = object.find(key);
+    if(!value)
+    {
+      return fallback;
+    }
+    if(!value->isNumber())
+    {
+      fail(section, index, key, "expected a number");
+      return fallback;
+    }
+    return (float)value->getNumber();
+  }
+  
+  bool flag(const JsonValue& object, const char* key, bool fallback, const char* section, size_t index)
+  {
+    const JsonValue* value = object.find(key);
+    if(!value)
+    {
+      return fallback;
+    }
+    if(value->getType() != JSON_BOOL)
+    {
+      fail(section, index, key, "expected true or false");
+      return fallback;
+    }
+    return value->getBool();
+  }
+  
+  // Numbers in an array of a given length
+  bool numbers(const JsonValue& object, const char* key, float* values, size_t count, const char* section, size_t index)
+  {
+    const JsonValue* value = object.find(key);
+    if(!value)
+    {
+      return false;
+    }
+    
+    bool valid = value->isArray() && value->size() == count;
+    for(size_t i = 0; valid && i < count; ++i)
+    {
+      valid = (*value)[i].isNumber();
+      values[i] = (float)(*value)[i].getNumber();
+    }
+    if(!valid)
+    {
+      fail(section, index, key, count == 3 ? "expected an array of 3 numbers" : "expected an array of 4 numbers");
+    }
+    return valid;
+  }
+  
+  glm::vec3 vector(const JsonValue& object, const char* key, glm::vec3 fallback, const char* section, size_t index)
+  {
+    float values[3];
+    return numbers(object, key, values, 3, section, index) ? glm::vec3(values[0], values[1], values[2]) : fallback;
+  }
+  
+  // Written w, x, y, z, and normalized
+  glm::quat orientation(const JsonValue& object, const char* key, const char* section, size_t index)
+  {
+    float values[4];
+    if(!numbers(object, key, values, 4, section, index))
+    {
+      return glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+    }
+    
+    glm::quat orientation(values[0], values[1], values[2], values[3]);
+    if(!(glm::length(orientation) > 0.0f))
+    {
+      fail(section, index, key, "orientation has no length");
+      return glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+    }
+    return glm::normalize(orientation);
+  }
+  
+  // An index, or a name looked up in names; NO_INDEX if it isn't there
+  int reference(const JsonValue* value, const std::map<std::string, int>& names, size_t count,
+                const char* section, size_t index, const char* key)
+  {
+    if(value && value->isString())
+    {
+      std::map<std::string, int>::const_iterator it = names.find(value->getString());
+      if(it != names.end())
+      {
+        return it->second;
+      }
+      fail(section, index, key, "no such name");
+    }
+    else if(value && value->isNumber())
+    {
+      double number = value->getNumber();
+      if(number >= 0.0 && number < count && number == (int)number)
+      {
+        return (int)number;
+      }
+      fail(section, index, key, "index out of range");
+    }
+    else
+    {
+      fail(section, index, key, value ? "expected a name or an index" : "missing");
+    }
+    
+    return NO_INDEX;
+  }
+  
+  // Errors are put down to the member name of the element section[index]
+  Material material(const JsonValue& object, const char* section, size_t index, const char* name)
+  {
+    within = name;
+    Material material;
+    memset(static_cast<void*>(&material), 0, sizeof(material));
+    material.ambient = vector(object, "ambient", glm::vec3(0.0f), section, index);
+    material.diffuse = vector(object, "diffuse", glm::vec3(0.0f), section, index);
+    material.specular = vector(object, "specular", glm::vec3(0.0f), section, index);
+    material.emission = vector(object, "emission", glm::vec3(0.0f), section, index);
+    material.shininess = number(object, "shininess", 0.0f, section, index);
+    within = NULL;
+    return material;
+  }
+  
+  // Named, or written out in place
+  Material materialOf(const JsonValue& object, const std::map<std::string, Material>& materials,
+                      const char* section, size_t index)
+  {
+    const JsonValue* value = object.find("material");
+    if(value && value->isObject())
+    {
+      return material(*value, section, index, "material");
+    }
+    if(value && value->isString())
+    {
+      std::map<std::string, Material>::const_iterator it = materials.find(value->getString());
+      if(it != materials.end())
+      {
+        return it->second;
+      }
+      fail(section, index, "material", "no such material");
+    }
+    else if(value)
+    {
+      fail(section, index, "material", "expected a name or a material");
+    }
+    
+    Material material;
+    memset(static_cast<void*>(&material), 0, sizeof(material));
+    return material;
+  }
+  
+  // Each element of a section, which must be an array of objects if it's there
+  const JsonValue* section(const JsonValue& document, const char* key)
+  {
+    const JsonValue* value = document.find(key);
+    if(!value)
+    {
+      return NULL;
+    }
+    
+    bool valid = value->isArray();
+    for(size_t i = 0; valid && i < value->size(); ++i)
+    {
+      valid = (*value)[i].isObject();
+    }
+    if(!valid)
+    {
+      fail(key, -1, NULL, "expected an array of objects");
+      return NULL;
+    }
+    return value;
+  }
+};
+
+bool SceneFile::load(const char* text, size_t size, Scene* scene, std::string* error)
+{
+  JsonDocument parsed;
+  if(!parsed.parse(text, size, error))
+  {
+    return false;
+  }
+  const JsonValue& document = parsed.getRoot();
+  
+  SceneFileReader reader;
+  reader.error = error;
+  reader.failed = false;
+  reader.within = NULL;
+  if(!document.isObject())
+  {
+    reader.fail("scene", -1, NULL, "expected an object");
+    return false;
+  }
+  
+  // Read and check everything first, so nothing is built from a bad file
+  std::vector<SceneFileMesh> meshes;
+  std::map<std::string, int> meshNames;
+  const JsonValue* meshSection = document.find("meshes");
+  if(meshSection && !meshSection->isObject())
+  {
+    reader.fail("meshes", -1, NULL, "expected an object");
+  }
+  for(size_t i = 0; meshSection && meshSection->isObject() && i < meshSection->size(); ++i)
+  {
+    const JsonValue& record = (*meshSection)[i];
+    const char* name = meshSection->getKey(i);
+    const JsonValue* path = record.find("path");
+    if(!path || !path->isString())
+    {
+      reader.fail("meshes", -1, name, "expected an object with a path");
+      break;
+    }
+    
+    // The mesh parser doesn't say when it can't read a file
+    FILE* file = fopen(path->getString(), "r");
+    if(!file)
+    {
+      reader.fail("meshes", -1, name, "can't open the mesh file");
+      break;
+    }
+    fclose(file);
+    
+    SceneFileMesh mesh;
+    mesh.path = path->getString();
+    mesh.scaleOnLoad = reader.flag(record, "scaleOnLoad", false, "meshes", -1);
+    meshNames[name] = meshes.size();
+    meshes.push_back(mesh);
+  }
+  
+  std::map<std::string, Material> materials;
+  const JsonValue* materialSection = document.find("materials");
+  if(materialSection && !materialSection->isObject())
+  {
+    reader.fail("materials", -1, NULL, "expected an object");
+  }
+  for(size_t i = 0; materialSection && materialSection->isObject() && i < materialSection->size(); ++i)
+  {
+    if(!(*materialSection)[i].isObject())
+    {
+      reader.fail("materials", -1, materialSection->getKey(i), "expected an object");
+      break;
+    }
+    materials[materialSection->getKey(i)] = reader.material((*materialSection)[i], "materials", -1, materialSection->getKey(i));
+  }
+  
+  std::vector<SceneFileModel> models;
+  int surface = NO_INDEX;
+  const JsonValue* modelSection = reader.section(document, "models");
+  for(size_t i = 0; modelSection && i < modelSection->size(); ++i)
+  {
+    const JsonValue& record = (*modelSection)[i];
+    SceneFileModel model;
+    model.mesh = reader.reference(record.find("mesh"), meshNames, 0, "models", i, "mesh");
+    model.material = reader.materialOf(record, materials, "models", i);
+    model.position = reader.vector(record, "position", glm::vec3(0.0f), "models", i);
+    model.orientation = reader.orientation(record, "orientation", "models", i);
+    model.scale = reader.number(record, "scale", 1.0f, "models", i);
+    if(reader.flag(record, "collisionSurface", false, "models", i))
+    {
+      surface = i;
+    }
+    models.push_back(model);
+  }
+  
+  const JsonValue* bodySection = reader.section(document, "bodies");
+  size_t numBodies = bodySection ? bodySection->size() : 0;
+  std::vector<SceneFileBody> bodies(numBodies);
+  std::map<std::string, int> bodyNames;
+  for(size_t i = 0; i < numBodies && !reader.failed; ++i)
+  {
+    const JsonValue& record = (*bodySection)[i];
+    SceneFileBody& body = bodies[i];
+    body.mesh = reader.reference(record.find("mesh"), meshNames, 0, "bodies", i, "mesh");
+    body.material = reader.materialOf(record, materials, "bodies", i);
+    body.mass = reader.number(record, "mass", 1.0f, "bodies", i);
+    body.scale = reader.number(record, "scale", 1.0f, "bodies", i);
+    body.position = reader.vector(record, "position", glm::vec3(0.0f), "bodies", i);
+    body.velocity = reader.vector(record, "velocity", glm::vec3(0.0f), "bodies", i);
+    body.angularVelocity = reader.vector(record, "angularVelocity", glm::vec3(0.0f), "bodies", i);
+    body.orientation = reader.orientation(record, "orientation", "bodies", i);
+    body.gravity = reader.flag(record, "gravity", true, "bodies", i);
+    if(!(body.mass > 0.0f) || !(body.scale > 0.0f))
+    {
+      reader.fail("bodies", i, NULL, "mass and scale must be positive");
+    }
+    
+    body.colliderType = COLLIDER_HULL;
+    body.colliderSize = glm::vec3(0.0f);
+    const JsonValue* collider = reader.object(record, "collider", "bodies", i);
+    if(collider)
+    {
+      reader.within = "collider";
+      const JsonValue* shape = collider->find("shape");
+      std::string type = shape && shape->isString() ? shape->getString() : "";
+      if(type == "sphere")
+      {
+        body.colliderType = COLLIDER_SPHERE;
+        body.colliderSize = glm::vec3(reader.number(*collider, "radius", 0.0f, "bodies", i), 0.0f, 0.0f);
+      }
+      else if(type == "box")
+      {
+        body.colliderType = COLLIDER_BOX;
+        body.colliderSize = reader.vector(*collider, "halfExtents", glm::vec3(0.0f), "bodies", i);
+      }
+      else if(type != "hull")
+      {
+        reader.fail("bodies", i, "shape", "must be \"hull\", \"sphere\" or \"box\"");
+      }
+      reader.within = NULL;
+      if(body.colliderType != COLLIDER_HULL && !(body.colliderSize.x > 0.0f))
+      {
+        reader.fail("bodies", i, "collider", "needs a positive size");
+      }
+    }
+    
+    const JsonValue* contact = reader.object(record, "contact", "bodies", i);
+    if(contact)
+    {
+      reader.within = "contact";
+      body.contact.restitution = reader.number(*contact, "restitution", body.contact.restitution, "bodies", i);
+      body.contact.staticFriction = reader.number(*contact, "staticFriction", body.contact.staticFriction, "bodies", i);
+      body.contact.kineticFriction = reader.number(*contact, "kineticFriction", body.contact.kineticFriction, "bodies", i);
+      reader.within = NULL;
+    }
+    
+    const JsonValue* name = record.find("name");
+    if(name && (!name->isString() || !bodyNames.insert(std::make_pair(name->getString(), (int)i)).second))
+    {
+      reader.fail("bodies", i, "name", name->isString() ? "used twice" : "expected a string");
+    }
+  }
+  
+  std::vector<SceneFileAnchor> anchors;
+  std::vector<SceneFileLink> links;
+  const JsonValue* springSection = reader.section(document, "springs");
+  for(size_t i = 0; springSection && i < springSection->size() && !reader.failed; ++i)
+  {
+    const JsonValue& record = (*springSection)[i];
+    const JsonValue* pair = record.find("bodies");
+    float k = reader.number(record, "k", 1.0f, "springs", i);
+    float b = reader.number(record, "b", 0.0f, "springs", i);
+    glm::vec3 attachOffset = reader.vector(record, "attach", glm::vec3(0.0f), "springs", i);
+    if(pair)
+    {
+      if(!pair->isArray() || pair->size() != 2)
+      {
+        reader.fail("springs", i, "bodies", "expected two bodies");
+        break;
+      }
+      
+      SceneFileLink link;
+      link.a = reader.reference(&(*pair)[0], bodyNames, numBodies, "springs", i, "bodies");
+      link.b = reader.reference(&(*pair)[1], bodyNames, numBodies, "springs", i, "bodies");
+      link.k = k;
+      link.damping = b;
+      link.attachOffset = attachOffset;
+      link.otherAttachOffset = reader.vector(record, "otherAttach", glm::vec3(0.0f), "springs", i);
+      link.restLength = reader.number(record, "restLength", 0.0f, "springs", i);
+      if(link.a == link.b && link.a != NO_INDEX)
+      {
+        reader.fail("springs", i, "bodies", "a spring needs two different bodies");
+      }
+      links.push_back(link);
+    }
+    else
+    {
+      SceneFileAnchor anchor;
+      anchor.body = reader.reference(record.find("body"), bodyNames, numBodies, "springs", i, "body");
+      anchor.anchor = reader.vector(record, "anchor", glm::vec3(0.0f), "springs", i);
+      anchor.k = k;
+      anchor.b = b;
+      anchor.attachOffset = attachOffset;
+      anchors.push_back(anchor);
+    }
+  }
+  
+  std::vector<SceneFileLight> lights;
+  const JsonValue* lightSection = reader.section(document, "lights");
+  for(size_t i = 0; lightSection && i < lightSection->size(); ++i)
+  {
+    const JsonValue& record = (*lightSection)[i];
+    SceneFileLight light;
+    light.position = reader.vector(record, "position", glm::vec3(0.0f), "lights", i);
+    light.color = reader.vector(record, "color", glm::vec3(1.0f), "lights", i);
+    light.falloff = reader.vector(record, "falloff", glm::vec3(1.0f, 0.0f, 0.0f), "lights", i);
+    light.hasModel = reader.flag(record, "model", false, "lights", i);
+    const JsonValue* attachment = record.find("attachTo");
+    light.attachment = attachment ? reader.reference(attachment, bodyNames, numBodies, "lights", i, "attachTo") : NO_INDEX;
+    lights.push_back(light);
+  }
+  
+  const JsonValue* settings = reader.object(document, "settings", "scene", -1);
+  int integrator = scene->getIntegrator();
+  if(settings)
+  {
+    const JsonValue* name = settings->find("integrator");
+    if(name)
+    {
+      std::string type = name->isString() ? name->getString() : "";
+      if(type == "rk4")
+      {
+        integrator = INTEGRATOR_RK4;
+      }
+      else if(type == "implicitEuler")
+      {
+        integrator = INTEGRATOR_IMPLICIT_EULER;
+      }
+      else if(type == "xpbd")
+      {
+        integrator = INTEGRATOR_XPBD;
+      }
+      else if(type == "rk45")
+      {
+        integrator = INTEGRATOR_RK45;
+      }
+      else
+      {
+        reader.fail("settings", -1, "integrator", "must be \"rk4\", \"implicitEuler\", \"xpbd\" or \"rk45\"");
+      }
+    }
+    
+    reader.count(*settings, "seed", MAX_SEED, 0.0, "settings", -1);
+    reader.count(*settings, "contactIterations", MAX_CONTACT_ITERATIONS, 0.0, "settings", -1);
+    reader.vector(*settings, "gravity", glm::vec3(0.0f), "settings", -1);
+    reader.flag(*settings, "sleep", true, "settings", -1);
+  }
+  
+  if(reader.failed)
+  {
+    return false;
+  }
+  
+  // Then build the scene
+  std::vector<Mesh*> loaded(meshes.size());
+  for(size_t i = 0; i < meshes.size(); ++i)
+  {
+    loaded[i] = Mesh::load(meshes[i].path.c_str(), meshes[i].scaleOnLoad);
+  }
+  
+  for(size_t i = 0; i < models.size(); ++i)
+  {
+    const SceneFileModel& record = models[i];
+    Model* model = new Model(loaded[record.mesh], record.material);
+    model->setPosition(record.position);
+    model->setRotation(glm::toMat4(record.orientation));
+    model->scale(record.scale);
+    scene->add(model);
+    if((int)i == surface)
+    {
+      scene->setCollisionSurface(model);
+    }
+  }
+  
+  PhysModel::getPool().reserve(PhysModel::getPool().size() + numBodies);
+  std::vector<PhysModel*> created(numBodies);
+  for(size_t i = 0; i < numBodies; ++i)
+  {
+    const SceneFileBody& record = bodies[i];
+    PhysModel* body = new PhysModel(loaded[record.mesh], record.material, record.mass, record.position);
+    body->scale(record.scale);
+    body->setCollider(record.colliderType, record.colliderSize);
+    body->setContactMaterial(record.contact);
+    if(record.gravity)
+    {
+      GravitationalForce::create(body);
+    }
+    created[i] = body;
+    scene->add(body);
+  }
+  
+  for(size_t i = 0; i < anchors.size(); ++i)
+  {
+    const SceneFileAnchor& record = anchors[i];
+    SpringForce::create(created[record.body], record.anchor, record.k, record.b, record.attachOffset);
+  }
+  for(size_t i = 0; i < links.size(); ++i)
+  {
+    const SceneFileLink& record = links[i];
+    TwoWaySpringForce::create(created[record.a], created[record.b], record.k, record.damping,
+                              record.attachOffset, record.otherAttachOffset, record.restLength);
+  }
+  
+  for(size_t i = 0; i < lights.size(); ++i)
+  {
+    const SceneFileLight& record = lights[i];
+    Light* light = new Light(record.position, record.color, record.falloff.x, record.falloff.y, record.falloff.z);
+    if(record.hasModel)
+    {
+      light->drawModel();
+    }
+    if(record.attachment != NO_INDEX)
+    {
+      light->attachTo(created[record.attachment]);
+    }
+    scene->add(light);
+  }
+  
+  // Orientations and velocities go in once the scale (and so the inertia) is
+  // final, as the starting state
+  for(size_t i = 0; i < numBodies; ++i)
+  {
+    const SceneFileBody& record = bodies[i];
+    PhysState state = created[i]->getState();
+    state.orientation = record.orientation;
+    state.linearMomentum = record.velocity * state.mass;
+    state.angularMomentum = state.worldInertia() * record.angularVelocity;
+    created[i]->restore(state, false, 0);
+  }
+  
+  if(settings)
+  {
+    scene->setIntegrator(integrator);
+    GravitationalForce::field = reader.vector(*settings, "gravity", GravitationalForce::field, "settings", -1);
+    scene->setSleepEnabled(reader.flag(*settings, "sleep", scene->isSleepEnabled(), "settings", -1));
+    const JsonValue* iterations = settings->find("contactIterations");
+    if(iterations)
+    {
+      scene->getContactSolver()->setIterations((int)iterations->getNumber());
+    }
+    const JsonValue* seed = settings->find("seed");
+    if(seed)
+    {
+      scene->setDeterministic(true, (uint64_t)seed->getNumber());
+    }
+  }
+  
+  return true;
+}
+
+bool SceneFile::load(const char* path, Scene* scene, std::string* error)
+{
+  FILE* file = fopen(path, "rb");
+  if(!file)
+  {
+    if(error)
+    {
+      *error = "can't open the file";
+    }
+    return false;
+  }
+  
+  std::vector<char> buffer;
+  if(fseek(file, 0, SEEK_END) == 0)
+  {
+    long size = ftell(file);
+    if(size > 0 && fseek(file, 0, SEEK_SET) == 0)
+    {
+      buffer.resize(size);
+      if(fread(buffer.data(), 1, size, file) != (size_t)size)
+      {
+        buffer.clear();
+      }
+    }
+  }
+  fclose(file);
+  
+  if(buffer.empty())
+  {
+    if(error)
+    {
+      *error = "can't read the file";
+    }
+    return false;
+  }
+  
+  return load(buffer.data(), buffer.size(), scene, error);
+}
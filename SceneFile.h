@@ -0,0 +1,50 @@
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+#include <string>
+
+#include "Scene.h"
+
+// Builds a scene from a JSON description, written by hand or by a tool:
+//
+//   {
+//     "meshes": { "bunny": { "path": "Models/bunny.orig.m", "scaleOnLoad": true } },
+//     "materials": { "purple": { "ambient": [r, g, b], "diffuse": [...],
+//                                "specular": [...], "emission": [...], "shininess": 200 } },
+//     "models": [ { "mesh": "plane", "material": "white", "position": [x, y, z],
+//                   "orientation": [w, x, y, z], "scale": 3, "collisionSurface": true } ],
+//     "bodies": [ { "name": "first", "mesh": "bunny", "material": "purple", "mass": 3,
+//                   "position": [...], "orientation": [...], "velocity": [...],
+//                   "angularVelocity": [...], "scale": 1, "gravity": true,
+//                   "collider": { "shape": "sphere", "radius": 0.5 },
+//                   "contact": { "restitution": 0.2, "staticFriction": 0.6,
+//                                "kineticFriction": 0.4 } } ],
+//     "springs": [ { "body": "first", "anchor": [...], "k": 4, "b": 0.5, "attach": [...] },
+//                  { "bodies": ["first", 1], "k": 4, "b": 0.5, "attach": [...],
+//                    "otherAttach": [...], "restLength": 1 } ],
+//     "lights": [ { "position": [...], "color": [...], "falloff": [constant, linear, square],
+//                   "attachTo": "first", "model": true } ],
+//     "settings": { "integrator": "rk4", "gravity": [...], "sleep": true,
+//                   "contactIterations": 10, "seed": 42 }
+//   }
+//
+// Every section and nearly every member can be left out; only a body's or a
+// model's mesh is required. A material can be named or written out in place.
+// Bodies are referred to by name or by index, colliders are "hull" (the
+// default), "sphere" (with "radius") or "box" (with "halfExtents"), and the
+// integrator is one of "rk4", "implicitEuler", "xpbd" or "rk45". The contact
+// iterations are a whole number up to 10000, and the seed one up to 2^53.
+// Members this doesn't know are ignored.
+//
+// The whole file is read and checked before anything is built, and bodies go
+// into pool storage reserved for all of them at once.
+class SceneFile
+{
+public:
+  // Adds everything described to a scene. Returns false, leaving the scene as
+  // it was, if the file can't be read or is wrong, and says why in error.
+  static bool load(const char* text, size_t size, Scene* scene, std::string* error = NULL);
+  static bool load(const char* path, Scene* scene, std::string* error = NULL);
+};
+
+#endif
@@ -0,0 +1,290 @@
+#include "SceneGenerator.h"
+
+#include <math.h>
+#include <cstring>
+#include <vector>
+
+#include "Random.h"
+#include "GravitationalForce.h"
+#include "SpringForce.h"
+#include "TwoWaySpringForce.h"
+
+#define GENERATOR_SPACING (2.0f * GENERATOR_RADIUS + GENERATOR_GAP)
+#define GENERATOR_STACK_GAP 0.01f    // Between bodies stacked in a pyramid
+#define GENERATOR_PIN_K 1000.0f      // Of the springs holding cloth and chains up
+
+// Makes room for a number of bodies, and a number of springs between them, in
+// one go
+static void reserve(size_t numBodies, size_t numLinks)
+{
+  PhysModel::getPool().reserve(PhysModel::getPool().size() + numBodies);
+  GravitationalForce::getPool().reserve(GravitationalForce::getPool().size() + numBodies);
+  TwoWaySpringForce::getPool().reserve(TwoWaySpringForce::getPool().size() + numLinks);
+}
+
+static PhysModel* addBody(Scene* scene, Mesh* mesh, const Material& material, glm::vec3 position)
+{
+  PhysModel* body = new PhysModel(mesh, material, 1.0f, position);
+  body->scale(GENERATOR_RADIUS);
+  body->setSphereCollider(1.0f);
+  GravitationalForce::create(body);
+  scene->add(body);
+  return body;
+}
+
+// Starts a body off turned and moving, once its scale (and so its inertia) is
+// final
+static void setMotion(PhysModel* body, glm::quat orientation, glm::vec3 velocity, glm::vec3 angularVelocity)
+{
+  PhysState state = body->getState();
+  state.orientation = orientation;
+  state.linearMomentum = velocity * state.mass;
+  state.angularMomentum = state.worldInertia() * angularVelocity;
+  body->restore(state, false, 0);
+}
+
+// Uniform over all rotations (Shoemake)
+static glm::quat randomOrientation(Random* random)
+{
+  float u = random->nextFloat(0.0f, 1.0f);
+  float a = random->nextFloat(0.0f, 2.0f * (float)M_PI);
+  float b = random->nextFloat(0.0f, 2.0f * (float)M_PI);
+  float r1 = sqrtf(1.0f - u), r2 = sqrtf(u);
+  return glm::quat(r2 * cosf(b), r1 * sinf(a), r1 * cosf(a), r2 * sinf(b));
+}
+
+void SceneGenerator::drop(Scene* scene, Mesh* mesh, Material material, int numBodies, glm::vec3 base, uint64_t seed)
+{
+  if(numBodies <= 0)
+  {
+    return;
+  }
+  
+  Random random(seed);
+  reserve(numBodies, 0);
+  
+  // Filled a layer at a time from the bottom. Jitter of up to half the gap
+  // either way keeps neighbours from starting inside each other.
+  int side = (int)ceil(cbrt((double)numBodies));
+  float half = (side - 1) * 0.5f;
+  for(int i = 0; i < numBodies; ++i)
+  {
+    int x = i % side, z = (i / side) % side, y = i / (side * side);
+    glm::vec3 position = base + glm::vec3((x - half) * GENERATOR_SPACING,
+                                          GENERATOR_DROP_HEIGHT + y * GENERATOR_SPACING,
+                                          (z - half) * GENERATOR_SPACING);
+    position += random.nextVec3(-0.5f * GENERATOR_GAP, 0.5f * GENERATOR_GAP);
+    
+    PhysModel* body = addBody(scene, mesh, material, position);
+    glm::quat orientation = randomOrientation(&random);
+    glm::vec3 velocity = random.nextVec3(-0.5f, 0.5f);
+    glm::vec3 angularVelocity = random.nextVec3(-1.0f, 1.0f);
+    setMotion(body, orientation, velocity, angularVelocity);
+  }
+}
+
+void SceneGenerator::cloth(Scene* scene, Mesh* mesh, Material material, int width, int depth, glm::vec3 base, uint64_t seed)
+{
+  if(width <= 0 || depth <= 0)
+  {
+    return;
+  }
+  
+  Random random(seed);
+  size_t numBodies = (size_t)width * depth;
+  reserve(numBodies, 4 * numBodies);
+  
+  // High enough that it hangs from the pins mostly clear of the ground
+  float height = GENERATOR_DROP_HEIGHT + (width > depth ? width : depth) * GENERATOR_SPACING;
+  float halfWidth = (width - 1) * 0.5f, halfDepth = (depth - 1) * 0.5f;
+  std::vector<PhysModel*> bodies(numBodies);
+  for(int z = 0; z < depth; ++z)
+  {
+    for(int x = 0; x < width; ++x)
+    {
+      // A ripple, so the sheet doesn't fall perfectly flat
+      glm::vec3 position = base + glm::vec3((x - halfWidth) * GENERATOR_SPACING,
+                                            height + random.nextFloat(-0.1f, 0.1f) * GENERATOR_GAP,
+                                            (z - halfDepth) * GENERATOR_SPACING);
+      bodies[(size_t)z * width + x] = addBody(scene, mesh, material, position);
+    }
+  }
+  
+  // Structural springs along and across, shear springs on both diagonals
+  float diagonal = GENERATOR_SPACING * sqrtf(2.0f);
+  for(int z = 0; z < depth; ++z)
+  {
+    for(int x = 0; x < width; ++x)
+    {
+      PhysModel* body = bodies[(size_t)z * width + x];
+      if(x + 1 < width)
+      {
+        TwoWaySpringForce::create(body, bodies[(size_t)z * width + x + 1], GENERATOR_SPRING_K, GENERATOR_SPRING_B,
+                                  glm::vec3(), glm::vec3(), GENERATOR_SPACING);
+      }
+      if(z + 1 < depth)
+      {
+        TwoWaySpringForce::create(body, bodies[(size_t)(z + 1) * width + x], GENERATOR_SPRING_K, GENERATOR_SPRING_B,
+                                  glm::vec3(), glm::vec3(), GENERATOR_SPACING);
+        if(x + 1 < width)
+        {
+          TwoWaySpringForce::create(body, bodies[(size_t)(z + 1) * width + x + 1], GENERATOR_SPRING_K, GENERATOR_SPRING_B,
+                                    glm::vec3(), glm::vec3(), diagonal);
+        }
+        if(x > 0)
+        {
+          TwoWaySpringForce::create(body, bodies[(size_t)(z + 1) * width + x - 1], GENERATOR_SPRING_K, GENERATOR_SPRING_B,
+                                    glm::vec3(), glm::vec3(), diagonal);
+        }
+      }
+    }
+  }
+  
+  PhysModel* left = bodies[(size_t)(depth - 1) * width];
+  PhysModel* right = bodies[numBodies - 1];
+  SpringForce::create(left, left->getState().position, GENERATOR_PIN_K, GENERATOR_SPRING_B, glm::vec3());
+  if(right != left)
+  {
+    SpringForce::create(right, right->getState().position, GENERATOR_PIN_K, GENERATOR_SPRING_B, glm::vec3());
+  }
+}
+
+void SceneGenerator::chains(Scene* scene, Mesh* mesh, Material material, int numChains, int length, glm::vec3 base, uint64_t seed)
+{
+  if(numChains <= 0 || length <= 0)
+  {
+    return;
+  }
+  
+  Random random(seed);
+  reserve((size_t)numChains * length, (size_t)numChains * (length - 1));
+  
+  // Chains reach along x from their anchors, so rows of them are laid closer
+  // together than columns, to cover a roughly square area
+  float reach = (length + 1) * GENERATOR_SPACING;
+  int columns = (int)ceil(sqrt(numChains * 2.0 * GENERATOR_SPACING / reach));
+  int rows = (numChains + columns - 1) / columns;
+  float height = GENERATOR_DROP_HEIGHT + reach;
+  for(int i = 0; i < numChains; ++i)
+  {
+    int column = i % columns, row = i / columns;
+    glm::vec3 anchor = base + glm::vec3((column - columns * 0.5f) * reach,
+                                        height,
+                                        (row - (rows - 1) * 0.5f) * 2.0f * GENERATOR_SPACING);
+    
+    // Laid out anywhere from 45 degrees below level to 45 above, so they
+    // don't all swing in step
+    float elevation = random.nextFloat(-0.25f, 0.25f) * (float)M_PI;
+    glm::vec3 direction(cosf(elevation), sinf(elevation), 0.0f);
+    
+    PhysModel* last = NULL;
+    for(int j = 0; j < length; ++j)
+    {
+      PhysModel* body = addBody(scene, mesh, material, anchor + direction * (j * GENERATOR_SPACING));
+      if(last)
+      {
+        TwoWaySpringForce::create(last, body, GENERATOR_SPRING_K, GENERATOR_SPRING_B,
+                                  glm::vec3(), glm::vec3(), GENERATOR_SPACING);
+      }
+      else
+      {
+        SpringForce::create(body, anchor, GENERATOR_PIN_K, GENERATOR_SPRING_B, glm::vec3());
+      }
+      last = body;
+    }
+  }
+}
+
+void SceneGenerator::pyramid(Scene* scene, Mesh* mesh, Material material, int levels, glm::vec3 base, uint64_t seed)
+{
+  if(levels <= 0)
+  {
+    return;
+  }
+  
+  Random random(seed);
+  reserve((size_t)levels * (levels + 1) * (2 * levels + 1) / 6, 0);
+  
+  // Each body sits over the middle of four in the layer below, a spacing
+  // apart from each of them, so every neighbour is just clear of it
+  float spacing = 2.0f * GENERATOR_RADIUS + GENERATOR_STACK_GAP;
+  float rise = spacing / sqrtf(2.0f);
+  for(int level = 0; level < levels; ++level)
+  {
+    int side = levels - level;
+    float half = (side - 1) * 0.5f;
+    float y = GENERATOR_RADIUS + 0.5f * GENERATOR_STACK_GAP + level * rise;
+    for(int z = 0; z < side; ++z)
+    {
+      for(int x = 0; x < side; ++x)
+      {
+        // Slightly off, so it doesn't stand or fall perfectly symmetrically
+        glm::vec3 position = base + glm::vec3((x - half) * spacing, y, (z - half) * spacing);
+        glm::vec3 offset = random.nextVec3(-0.25f, 0.25f) * GENERATOR_STACK_GAP;
+        offset.y = 0.0f;
+        addBody(scene, mesh, material, position + offset);
+      }
+    }
+  }
+}
+
+void SceneGenerator::pileAndChains(Scene* scene, Mesh* mesh, Material material, int numDropped, int numChains, int length,
+                                   glm::vec3 base, uint64_t seed)
+{
+  // However the layers fill, the pile is no taller than it is wide
+  float pileHeight = ceil(cbrt((double)numDropped)) * GENERATOR_SPACING;
+  drop(scene, mesh, material, numDropped, base, seed);
+  chains(scene, mesh, material, numChains, length, base + glm::vec3(0.0f, pileHeight, 0.0f), seed);
+}
+
+Model* SceneGenerator::ground(Scene* scene, Material material, float scale)
+{
+  Model* ground = new Model(Mesh::load(GENERATOR_GROUND_MESH, false), material);
+  ground->translate(glm::vec3(0.0f, -0.5f, 0.0f));
+  ground->scale(scale);
+  scene->add(ground);
+  scene->setCollisionSurface(ground);
+  return ground;
+}
+
+bool SceneGenerator::generate(const char* layout, int numBodies, Scene* scene, glm::vec3 base, uint64_t seed)
+{
+  Mesh* mesh = Mesh::load(GENERATOR_MESH, true);
+  Material material;
+  glm::vec3 baseColor(0.2f, 0.5f, 0.9f);
+  material.ambient = baseColor * 0.2f;
+  material.diffuse = baseColor * 0.6f;
+  material.specular = glm::vec3(0.3f, 0.3f, 0.3f);
+  material.emission = glm::vec3(0.0f);
+  material.shininess = 50.0f;
+  
+  if(strcmp(layout, "drop") == 0)
+  {
+    drop(scene, mesh, material, numBodies, base, seed);
+  }
+  else if(strcmp(layout, "cloth") == 0)
+  {
+    int side = (int)sqrt((double)numBodies);
+    cloth(scene, mesh, material, side, side, base, seed);
+  }
+  else if(strcmp(layout, "chains") == 0)
+  {
+    int length = numBodies < GENERATOR_CHAIN_LENGTH ? numBodies : GENERATOR_CHAIN_LENGTH;
+    chains(scene, mesh, material, length > 0 ? numBodies / length : 0, length, base, seed);
+  }
+  else if(strcmp(layout, "pyramid") == 0)
+  {
+    int levels = 0;
+    while((size_t)(levels + 1) * (levels + 2) * (2 * levels + 3) / 6 <= (size_t)numBodies)
+    {
+      ++levels;
+    }
+    pyramid(scene, mesh, material, levels, base, seed);
+  }
+  else
+  {
+    return false;
+  }
+  
+  return true;
+}
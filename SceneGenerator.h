@@ -0,0 +1,56 @@
+#ifndef SCENE_GENERATOR_H
+#define SCENE_GENERATOR_H
+
+#include <stdint.h>
+
+#include "Scene.h"
+
+#define GENERATOR_RADIUS 0.25f       // Of every body
+#define GENERATOR_GAP 0.25f          // Between neighbouring bodies
+#define GENERATOR_DROP_HEIGHT 2.0f   // Of the lowest bodies in a drop
+#define GENERATOR_CHAIN_LENGTH 32
+#define GENERATOR_SPRING_K 100.0f
+#define GENERATOR_SPRING_B 0.5f
+
+#define GENERATOR_MESH "SimpleModels/sphere.obj"
+#define GENERATOR_GROUND_MESH "SimpleModels/plane.m"
+
+// Builds scenes of any size, from a few bodies to millions, for scaling
+// studies and stress tests. Every layout is drawn from its own generator
+// seeded with the seed given, never from rand() or the scene's, so a size and
+// a seed always build the same scene.
+//
+// Bodies are spheres of GENERATOR_RADIUS with sphere colliders, so the mesh
+// should fit a unit sphere (as meshes scaled on load do). Each layout stands
+// on base, centred above it, and only adds bodies and springs: the ground
+// (which ground() can add), lights and settings are left to the caller.
+class SceneGenerator
+{
+public:
+  // Bodies on a jittered cube lattice above the ground, spinning and drifting
+  // a little, with gravity
+  static void drop(Scene* scene, Mesh* mesh, Material material, int numBodies, glm::vec3 base, uint64_t seed);
+  // A horizontal sheet of width by depth bodies, linked to their neighbours
+  // along and across the grid by two-way springs and pinned at the two far
+  // corners
+  static void cloth(Scene* scene, Mesh* mesh, Material material, int width, int depth, glm::vec3 base, uint64_t seed);
+  // Chains of two-way springs, each anchored at one end and laid out
+  // sideways at a random slope, to swing down
+  static void chains(Scene* scene, Mesh* mesh, Material material, int numChains, int length, glm::vec3 base, uint64_t seed);
+  // A square pyramid of bodies stacked in the hollows of the layer below
+  static void pyramid(Scene* scene, Mesh* mesh, Material material, int levels, glm::vec3 base, uint64_t seed);
+  // A drop, with chains hanging clear above where the top of the pile starts
+  static void pileAndChains(Scene* scene, Mesh* mesh, Material material, int numDropped, int numChains, int length,
+                            glm::vec3 base, uint64_t seed);
+  
+  // The floor plane half a unit down, scaled, and made the scene's collision
+  // surface. Its position is the base to build on.
+  static Model* ground(Scene* scene, Material material, float scale);
+  
+  // One of the layouts above by name ("drop", "cloth", "chains" or
+  // "pyramid"), sized to as close to numBodies as it allows without going
+  // over, with GENERATOR_MESH. Returns false for a name it doesn't know.
+  static bool generate(const char* layout, int numBodies, Scene* scene, glm::vec3 base, uint64_t seed);
+};
+
+#endif
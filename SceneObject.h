@@ -9,6 +9,9 @@ protected:
   glm::vec3 position_;
 
 public:
+  virtual ~SceneObject()
+  {
+  }
   virtual void translate(glm::vec3 trans);
   virtual void setPosition(glm::vec3 pos);
   virtual void resetTransforms();
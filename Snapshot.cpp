@@ -0,0 +1,596 @@
+#include "Snapshot.h"
+#include "GravitationalForce.h"
+#include "SpringForce.h"
+#include "TwoWaySpringForce.h"
+
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+
+#define SNAPSHOT_NONE -1
+
+// Scene-wide values
+struct SnapshotSettings
+{
+  int32_t integrator;
+  int32_t contactIterations;
+  int32_t surface;          // Model index, or SNAPSHOT_NONE
+  uint8_t sleepEnabled;
+  uint8_t deterministic;
+  uint64_t randomState;
+  glm::vec3 gravity;
+  float adaptiveTolerance;
+  float adaptiveStep;
+};
+
+struct SnapshotModel
+{
+  int32_t mesh;
+  uint8_t inScene;          // Drawn by the scene, rather than only collided with
+  Material material;
+  glm::vec3 position;
+  glm::mat4 rotation;
+  float scale;
+};
+
+struct SnapshotLink
+{
+  uint32_t a, b;
+  glm::vec3 attachOffset, otherAttachOffset;
+  float k, damping, restLength;
+};
+
+struct SnapshotAnchor
+{
+  uint32_t body;
+  AnchorSpring spring;
+};
+
+struct SnapshotLight
+{
+  glm::vec3 position, color, falloff;
+  int32_t attachment;       // Body index, or SNAPSHOT_NONE
+  uint8_t hasModel;
+};
+
+struct SnapshotManifold
+{
+  uint32_t a;
+  int32_t b;                // Body index, or SNAPSHOT_NONE for the ground
+  glm::vec3 normal;
+  int32_t numPoints;
+  ContactPoint points[MANIFOLD_MAX_POINTS];
+};
+
+// Every body field, one array each
+struct SnapshotBodies
+{
+  std::vector<int32_t> mesh;
+  std::vector<Material> material;
+  std::vector<float> scale;
+  std::vector<int32_t> colliderType;
+  std::vector<glm::vec3> colliderSize;
+  std::vector<ContactMaterial> contactMaterial;
+  std::vector<PhysState> state;
+  std::vector<uint8_t> flags;
+  std::vector<int32_t> sleepCounter;
+  std::vector<int32_t> gravityCount;
+  
+  void resize(size_t size)
+  {
+    mesh.resize(size);
+    material.resize(size);
+    scale.resize(size);
+    colliderType.resize(size);
+    colliderSize.resize(size);
+    contactMaterial.resize(size);
+    state.resize(size);
+    flags.resize(size);
+    sleepCounter.resize(size);
+    gravityCount.resize(size);
+  }
+};
+
+// Records are cleared before being filled, so padding doesn't carry whatever
+// was in memory into the file
+template <typename T>
+static void clear(T* record)
+{
+  memset(static_cast<void*>(record), 0, sizeof(T));
+}
+
+template <typename T>
+static void put(std::vector<char>* buffer, const T* values, size_t count = 1)
+{
+  if(count > 0)
+  {
+    const char* bytes = reinterpret_cast<const char*>(values);
+    buffer->insert(buffer->end(), bytes, bytes + sizeof(T) * count);
+  }
+}
+
+// Reads from a snapshot in memory, failing (for good) at the first read past
+// its end
+struct SnapshotReader
+{
+  const char* data;
+  size_t size, offset;
+  bool failed;
+  
+  template <typename T>
+  bool get(T* values, size_t count = 1)
+  {
+    if(failed || count > (size - offset) / sizeof(T))
+    {
+      failed = true;
+      return false;
+    }
+    
+    if(count > 0)
+    {
+      memcpy(static_cast<void*>(values), data + offset, sizeof(T) * count);
+      offset += sizeof(T) * count;
+    }
+    return true;
+  }
+  
+  template <typename T>
+  bool get(std::vector<T>* values, size_t count)
+  {
+    values->resize(failed || count > (size - offset) / sizeof(T) ? 0 : count);
+    return get(values->empty() ? NULL : &(*values)[0], count);
+  }
+};
+
+static int32_t indexOf(std::map<Mesh*, int32_t>* meshes, std::vector<Mesh*>* order, Mesh* mesh)
+{
+  std::map<Mesh*, int32_t>::iterator it = meshes->find(mesh);
+  if(it != meshes->end())
+  {
+    return it->second;
+  }
+  
+  int32_t index = order->size();
+  (*meshes)[mesh] = index;
+  order->push_back(mesh);
+  return index;
+}
+
+static void fillModel(SnapshotModel* record, Model* model, int32_t mesh, bool inScene)
+{
+  clear(record);
+  record->mesh = mesh;
+  record->inScene = inScene;
+  record->material = model->getMaterial();
+  record->position = model->getPosition();
+  record->rotation = model->getRotation();
+  record->scale = model->getScale();
+}
+
+void Snapshot::save(Scene* scene, std::vector<char>* buffer)
+{
+  std::map<Mesh*, int32_t> meshIndices;
+  std::vector<Mesh*> meshes;
+  
+  // Plain models, and the collision surface even if it isn't drawn
+  SnapshotSettings settings;
+  clear(&settings);
+  settings.surface = SNAPSHOT_NONE;
+  std::vector<SnapshotModel> models;
+  for(int i = 0; i < scene->getNumSceneObjects(); ++i)
+  {
+    Model* model = dynamic_cast<Model*>(scene->getSceneObject(i));
+    if(model)
+    {
+      if(model == scene->getCollisionSurface())
+      {
+        settings.surface = models.size();
+      }
+      models.push_back(SnapshotModel());
+      fillModel(&models.back(), model, indexOf(&meshIndices, &meshes, model->getMesh()), true);
+    }
+  }
+  Model* surface = scene->getCollisionSurface();
+  if(surface && settings.surface == SNAPSHOT_NONE)
+  {
+    settings.surface = models.size();
+    models.push_back(SnapshotModel());
+    fillModel(&models.back(), surface, indexOf(&meshIndices, &meshes, surface->getMesh()), false);
+  }
+  
+  settings.integrator = scene->getIntegrator();
+  settings.contactIterations = scene->getContactSolver()->getIterations();
+  settings.sleepEnabled = scene->isSleepEnabled();
+  settings.deterministic = scene->isDeterministic();
+  settings.randomState = scene->getRandom()->getState();
+  settings.gravity = GravitationalForce::field;
+  settings.adaptiveTolerance = scene->getAdaptiveTolerance();
+  settings.adaptiveStep = scene->getAdaptiveStep();
+  
+  // Bodies are referred to by their position in the scene. Pool indices are
+  // dense, so they make a cheap map to it.
+  size_t numBodies = scene->getNumPhysObjects();
+  std::vector<uint32_t> bodyIndices(PhysModel::getPool().capacity(), POOL_INVALID_INDEX);
+  SnapshotBodies bodies;
+  bodies.resize(numBodies);
+  std::vector<SnapshotAnchor> anchors;
+  std::vector<SnapshotLink> links;
+  for(size_t i = 0; i < numBodies; ++i)
+  {
+    PhysModel* body = scene->getPhysObject(i);
+    bodyIndices[body->getHandle().index] = i;
+    bodies.mesh[i] = indexOf(&meshIndices, &meshes, body->getMesh());
+    bodies.material[i] = body->getMaterial();
+    bodies.scale[i] = body->getScale();
+    bodies.colliderType[i] = body->getColliderType();
+    bodies.colliderSize[i] = body->getColliderSize();
+    bodies.contactMaterial[i] = body->getContactMaterial();
+    bodies.state[i] = body->getState();
+    bodies.flags[i] = (body->isAsleep() ? SNAPSHOT_ASLEEP : 0)
+                    | (body->isVisible() ? SNAPSHOT_VISIBLE : 0)
+                    | (body->isOnGround() ? SNAPSHOT_ON_GROUND : 0);
+    bodies.sleepCounter[i] = body->getSleepCounter();
+    bodies.gravityCount[i] = body->getGravityCount();
+    
+    const std::vector<AnchorSpring>& anchorSprings = body->getAnchorSprings();
+    for(size_t j = 0; j < anchorSprings.size(); ++j)
+    {
+      anchors.push_back(SnapshotAnchor());
+      clear(&anchors.back());
+      anchors.back().body = i;
+      anchors.back().spring = anchorSprings[j];
+    }
+  }
+  
+  // Springs to bodies outside the scene are left behind
+  for(size_t i = 0; i < numBodies; ++i)
+  {
+    const std::vector<LinkSpring>& linkSprings = scene->getPhysObject(i)->getLinkSprings();
+    for(size_t j = 0; j < linkSprings.size(); ++j)
+    {
+      const LinkSpring& spring = linkSprings[j];
+      uint32_t other = bodyIndices[spring.other->getHandle().index];
+      if(other == POOL_INVALID_INDEX || scene->getPhysObject(other) != spring.other)
+      {
+        continue;
+      }
+      
+      links.push_back(SnapshotLink());
+      SnapshotLink& link = links.back();
+      clear(&link);
+      link.a = i;
+      link.b = other;
+      link.attachOffset = spring.attachOffset;
+      link.otherAttachOffset = spring.otherAttachOffset;
+      link.k = spring.k;
+      link.damping = spring.b;
+      link.restLength = spring.restLength;
+    }
+  }
+  
+  std::vector<SnapshotLight> lights(scene->getNumLights());
+  for(size_t i = 0; i < lights.size(); ++i)
+  {
+    Light* light = scene->getLight(i);
+    clear(&lights[i]);
+    lights[i].position = light->getPosition();
+    lights[i].color = light->getColor();
+    lights[i].falloff = light->getFalloff();
+    lights[i].attachment = light->getAttachment() ? (int32_t)bodyIndices[light->getAttachment()->getHandle().index] : SNAPSHOT_NONE;
+    lights[i].hasModel = light->hasModel();
+  }
+  
+  const std::vector<ContactManifold*>& touching = scene->getCollisionWorld()->getManifolds();
+  std::vector<SnapshotManifold> manifolds(touching.size());
+  for(size_t i = 0; i < touching.size(); ++i)
+  {
+    const ContactManifold* manifold = touching[i];
+    clear(&manifolds[i]);
+    manifolds[i].a = bodyIndices[manifold->a->getHandle().index];
+    manifolds[i].b = manifold->b ? (int32_t)bodyIndices[manifold->b->getHandle().index] : SNAPSHOT_NONE;
+    manifolds[i].normal = manifold->normal;
+    manifolds[i].numPoints = manifold->numPoints;
+    memcpy(static_cast<void*>(manifolds[i].points), manifold->points, sizeof(manifold->points));
+  }
+  
+  SnapshotHeader header;
+  clear(&header);
+  header.magic = SNAPSHOT_MAGIC;
+  header.version = SNAPSHOT_VERSION;
+  header.stateSize = sizeof(PhysState);
+  header.numMeshes = meshes.size();
+  header.numModels = models.size();
+  header.numBodies = numBodies;
+  header.numAnchorSprings = anchors.size();
+  header.numLinkSprings = links.size();
+  header.numLights = lights.size();
+  header.numManifolds = manifolds.size();
+  
+  buffer->clear();
+  buffer->reserve(sizeof(header) + sizeof(settings) + numBodies * (sizeof(PhysState) + 128));
+  put(buffer, &header);
+  put(buffer, &settings);
+  for(size_t i = 0; i < meshes.size(); ++i)
+  {
+    uint32_t length = meshes[i]->path.size();
+    uint8_t scaled = meshes[i]->scaledOnLoad;
+    put(buffer, &length);
+    put(buffer, meshes[i]->path.data(), length);
+    put(buffer, &scaled);
+  }
+  put(buffer, models.data(), models.size());
+  put(buffer, bodies.mesh.data(), numBodies);
+  put(buffer, bodies.material.data(), numBodies);
+  put(buffer, bodies.scale.data(), numBodies);
+  put(buffer, bodies.colliderType.data(), numBodies);
+  put(buffer, bodies.colliderSize.data(), numBodies);
+  put(buffer, bodies.contactMaterial.data(), numBodies);
+  put(buffer, bodies.state.data(), numBodies);
+  put(buffer, bodies.flags.data(), numBodies);
+  put(buffer, bodies.sleepCounter.data(), numBodies);
+  put(buffer, bodies.gravityCount.data(), numBodies);
+  put(buffer, anchors.data(), anchors.size());
+  put(buffer, links.data(), links.size());
+  put(buffer, lights.data(), lights.size());
+  put(buffer, manifolds.data(), manifolds.size());
+}
+
+bool Snapshot::save(Scene* scene, const char* path)
+{
+  std::vector<char> buffer;
+  save(scene, &buffer);
+  
+  FILE* file = fopen(path, "wb");
+  if(!file)
+  {
+    return false;
+  }
+  bool written = fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+  return fclose(file) == 0 && written;
+}
+
+// Whether every index in a table refers to something that exists
+template <typename T>
+static bool inRange(const std::vector<T>& indices, size_t limit)
+{
+  for(size_t i = 0; i < indices.size(); ++i)
+  {
+    if(indices[i] < 0 || (size_t)indices[i] >= limit)
+    {
+      return false;
+    }
+  }
+  
+  return true;
+}
+
+bool Snapshot::load(const char* data, size_t size, Scene* scene)
+{
+  // Read and check everything first, so nothing is built from a bad file
+  SnapshotReader reader;
+  reader.data = data;
+  reader.size = size;
+  reader.offset = 0;
+  reader.failed = false;
+  
+  SnapshotHeader header;
+  if(!reader.get(&header) || header.magic != SNAPSHOT_MAGIC || header.version != SNAPSHOT_VERSION
+     || header.stateSize != sizeof(PhysState))
+  {
+    return false;
+  }
+  
+  SnapshotSettings settings;
+  reader.get(&settings);
+  std::vector<std::string> paths(header.numMeshes <= size ? header.numMeshes : 0);
+  std::vector<uint8_t> scaled(paths.size());
+  for(size_t i = 0; i < paths.size(); ++i)
+  {
+    uint32_t length = 0;
+    std::vector<char> path;
+    reader.get(&length);
+    reader.get(&path, length);
+    paths[i].assign(path.begin(), path.end());
+    reader.get(&scaled[i]);
+  }
+  
+  size_t numBodies = header.numBodies;
+  std::vector<SnapshotModel> models;
+  SnapshotBodies bodies;
+  reader.get(&models, header.numModels);
+  reader.get(&bodies.mesh, numBodies);
+  reader.get(&bodies.material, numBodies);
+  reader.get(&bodies.scale, numBodies);
+  reader.get(&bodies.colliderType, numBodies);
+  reader.get(&bodies.colliderSize, numBodies);
+  reader.get(&bodies.contactMaterial, numBodies);
+  reader.get(&bodies.state, numBodies);
+  reader.get(&bodies.flags, numBodies);
+  reader.get(&bodies.sleepCounter, numBodies);
+  reader.get(&bodies.gravityCount, numBodies);
+  
+  std::vector<SnapshotAnchor> anchors;
+  std::vector<SnapshotLink> links;
+  std::vector<SnapshotLight> lights;
+  std::vector<SnapshotManifold> manifolds;
+  reader.get(&anchors, header.numAnchorSprings);
+  reader.get(&links, header.numLinkSprings);
+  reader.get(&lights, header.numLights);
+  reader.get(&manifolds, header.numManifolds);
+  // Collider types run from COLLIDER_HULL (0) to COLLIDER_BOX
+  if(reader.failed || paths.size() != header.numMeshes || !inRange(bodies.mesh, paths.size())
+     || !inRange(bodies.colliderType, COLLIDER_BOX + 1) || !inRange(bodies.gravityCount, SNAPSHOT_MAX_GRAVITY + 1))
+  {
+    return false;
+  }
+  
+  std::vector<int64_t> references;
+  for(size_t i = 0; i < models.size(); ++i)
+  {
+    references.push_back(models[i].mesh);
+  }
+  if(!inRange(references, paths.size()))
+  {
+    return false;
+  }
+  references.clear();
+  for(size_t i = 0; i < anchors.size(); ++i)
+  {
+    references.push_back(anchors[i].body);
+  }
+  for(size_t i = 0; i < links.size(); ++i)
+  {
+    references.push_back(links[i].a);
+    references.push_back(links[i].b);
+  }
+  for(size_t i = 0; i < lights.size(); ++i)
+  {
+    if(lights[i].attachment != SNAPSHOT_NONE)
+    {
+      references.push_back(lights[i].attachment);
+    }
+  }
+  for(size_t i = 0; i < manifolds.size(); ++i)
+  {
+    references.push_back(manifolds[i].a);
+    if(manifolds[i].b != SNAPSHOT_NONE)
+    {
+      references.push_back(manifolds[i].b);
+    }
+    if(manifolds[i].numPoints < 0 || manifolds[i].numPoints > MANIFOLD_MAX_POINTS)
+    {
+      return false;
+    }
+  }
+  if(!inRange(references, numBodies)
+     || (settings.surface != SNAPSHOT_NONE && (settings.surface < 0 || (size_t)settings.surface >= models.size())))
+  {
+    return false;
+  }
+  
+  // Then build the scene
+  std::vector<Mesh*> meshes(paths.size());
+  for(size_t i = 0; i < paths.size(); ++i)
+  {
+    meshes[i] = Mesh::load(paths[i].c_str(), scaled[i] != 0);
+  }
+  
+  for(size_t i = 0; i < models.size(); ++i)
+  {
+    const SnapshotModel& record = models[i];
+    Model* model = new Model(meshes[record.mesh], record.material);
+    model->setPosition(record.position);
+    model->setRotation(record.rotation);
+    model->scale(record.scale);
+    if(record.inScene)
+    {
+      scene->add(model);
+    }
+    if((int32_t)i == settings.surface)
+    {
+      scene->setCollisionSurface(model);
+    }
+  }
+  
+  PhysModel::getPool().reserve(PhysModel::getPool().size() + numBodies);
+  std::vector<PhysModel*> created(numBodies);
+  for(size_t i = 0; i < numBodies; ++i)
+  {
+    const PhysState& state = bodies.state[i];
+    PhysModel* body = new PhysModel(meshes[bodies.mesh[i]], bodies.material[i], state.mass, state.position);
+    body->scale(bodies.scale[i]);
+    body->setCollider(bodies.colliderType[i], bodies.colliderSize[i]);
+    body->setContactMaterial(bodies.contactMaterial[i]);
+    for(int32_t j = 0; j < bodies.gravityCount[i]; ++j)
+    {
+      GravitationalForce::create(body);
+    }
+    created[i] = body;
+    scene->add(body);
+  }
+  
+  for(size_t i = 0; i < anchors.size(); ++i)
+  {
+    const AnchorSpring& spring = anchors[i].spring;
+    SpringForce::create(created[anchors[i].body], spring.anchor, spring.k, spring.b, spring.attachOffset);
+  }
+  for(size_t i = 0; i < links.size(); ++i)
+  {
+    const SnapshotLink& link = links[i];
+    TwoWaySpringForce::create(created[link.a], created[link.b], link.k, link.damping,
+                              link.attachOffset, link.otherAttachOffset, link.restLength);
+  }
+  
+  for(size_t i = 0; i < lights.size(); ++i)
+  {
+    const SnapshotLight& record = lights[i];
+    Light* light = new Light(record.position, record.color, record.falloff.x, record.falloff.y, record.falloff.z);
+    if(record.hasModel)
+    {
+      light->drawModel();
+    }
+    if(record.attachment != SNAPSHOT_NONE)
+    {
+      light->attachTo(created[record.attachment]);
+    }
+    scene->add(light);
+  }
+  
+  // Creating forces wakes bodies, so their states go in last
+  for(size_t i = 0; i < numBodies; ++i)
+  {
+    PhysModel* body = created[i];
+    body->restore(bodies.state[i], (bodies.flags[i] & SNAPSHOT_ASLEEP) != 0, bodies.sleepCounter[i]);
+    body->setVisible((bodies.flags[i] & SNAPSHOT_VISIBLE) != 0);
+    body->setOnGround((bodies.flags[i] & SNAPSHOT_ON_GROUND) != 0);
+  }
+  
+  for(size_t i = 0; i < manifolds.size(); ++i)
+  {
+    const SnapshotManifold& record = manifolds[i];
+    ContactManifold manifold;
+    manifold.a = created[record.a];
+    manifold.b = record.b == SNAPSHOT_NONE ? NULL : created[record.b];
+    manifold.normal = record.normal;
+    manifold.numPoints = record.numPoints;
+    memcpy(static_cast<void*>(manifold.points), record.points, sizeof(manifold.points));
+    scene->addContact(manifold);
+  }
+  
+  scene->setIntegrator(settings.integrator);
+  scene->getContactSolver()->setIterations(settings.contactIterations);
+  scene->setSleepEnabled(settings.sleepEnabled != 0);
+  scene->setDeterministic(settings.deterministic != 0);
+  scene->getRandom()->setState(settings.randomState);
+  scene->setAdaptiveTolerance(settings.adaptiveTolerance);
+  scene->setAdaptiveStep(settings.adaptiveStep);
+  GravitationalForce::field = settings.gravity;
+  return true;
+}
+
+bool Snapshot::load(const char* path, Scene* scene)
+{
+  FILE* file = fopen(path, "rb");
+  if(!file)
+  {
+    return false;
+  }
+  
+  std::vector<char> buffer;
+  if(fseek(file, 0, SEEK_END) == 0)
+  {
+    long size = ftell(file);
+    if(size > 0 && fseek(file, 0, SEEK_SET) == 0)
+    {
+      buffer.resize(size);
+      if(fread(buffer.data(), 1, size, file) != (size_t)size)
+      {
+        buffer.clear();
+      }
+    }
+  }
+  fclose(file);
+  
+  return !buffer.empty() && load(buffer.data(), buffer.size(), scene);
+}
@@ -0,0 +1,62 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "Scene.h"
+
+#define SNAPSHOT_MAGIC 0x504E5353u // "SSNP" in a little-endian file
+#define SNAPSHOT_VERSION 1
+
+#define SNAPSHOT_ASLEEP 0x1
+#define SNAPSHOT_VISIBLE 0x2
+#define SNAPSHOT_ON_GROUND 0x4
+
+// Most gravitational forces on one body a snapshot may ask for
+#define SNAPSHOT_MAX_GRAVITY 16
+
+// Sizes of everything that follows, so a reader can check the whole file
+// before building anything from it
+struct SnapshotHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t stateSize;       // sizeof(PhysState) in the build that saved it
+  uint32_t numMeshes;
+  uint32_t numModels;
+  uint32_t numBodies;
+  uint32_t numAnchorSprings;
+  uint32_t numLinkSprings;
+  uint32_t numLights;
+  uint32_t numManifolds;
+};
+
+// Saves a whole scene to a flat binary file and loads it back. After the
+// header and the scene's settings come the meshes (by path), the plain models
+// (the collision surface among them), then the bodies as one array per field,
+// then tables of springs, lights and contact manifolds referring to bodies by
+// index. The arrays are written and read in single blocks, so saving and
+// loading take little more than creating the objects.
+//
+// Only the latest state of each body is kept. Loading it into a fresh process
+// carries the simulation on exactly where it left off, contact impulses
+// included. The solvers' tuning (other than the contact solver's iterations)
+// and the camera are not part of a snapshot.
+//
+// Snapshots hold floats as they are in memory, so they only load on machines
+// with the same byte order and a build with the same PhysState layout.
+class Snapshot
+{
+public:
+  static void save(Scene* scene, std::vector<char>* buffer);
+  static bool save(Scene* scene, const char* path);
+  
+  // Adds everything in the snapshot to a scene, which should be empty. Returns
+  // false, leaving the scene as it was, if the data isn't a snapshot this
+  // build can read.
+  static bool load(const char* data, size_t size, Scene* scene);
+  static bool load(const char* path, Scene* scene);
+};
+
+#endif
@@ -2,14 +2,14 @@
 #include "PhysModel.h"
 
 Model* SpringForce::model;
+DEFINE_POOLED(SpringForce, MEMORY_FORCES)
 
 SpringForce* SpringForce::create(PhysModel* target, glm::vec3 position, float k, float b, glm::vec3 attachOffset)
 {
   return new SpringForce(target, position, k, b, attachOffset);
 }
 
-SpringForce::SpringForce(PhysModel* target, glm::vec3 position, float k, float b, glm::vec3 attachOffset)
-  : Force(target)
+void SpringForce::loadModel()
 {
   if(!model)
   {
@@ -24,46 +24,57 @@ SpringForce::SpringForce(PhysModel* target, glm::vec3 position, float k, float b
     model = new Model(sphereMesh, springMaterial);
     model->scale(0.15f);
   }
+}
+  
+SpringForce::SpringForce(PhysModel* target, glm::vec3 position, float k, float b, glm::vec3 attachOffset)
+  : Force(target)
+{
+  loadModel();
   
-  this->position = position;
-  this->k = k;
-  this->b = b;
-  this->attachOffset = attachOffset;
-  currentAttachPos = target->getPosition();
+  AnchorSpring spring;
+  spring.anchor = position;
+  spring.attachOffset = attachOffset;
+  spring.k = k;
+  spring.b = b;
+  recordIndex = target->addAnchorSpring(spring, this);
 }
 
-SpringForce::~SpringForce()
+SpringForce::SpringForce(PhysModel* target)
+  : Force(target)
 {
-  //
+  loadModel();
+  
+  recordIndex = 0;
 }
 
-void SpringForce::applyForce(PhysModel* target, const PhysState& state, Derivative* derivative)
+SpringForce::~SpringForce()
 {
-  glm::mat4 transMatrix = glm::translate(state.position);
-  glm::mat4 rotMatrix = glm::toMat4(state.orientation);
-  glm::mat4 scaleMatrix = glm::scale(glm::vec3(target->getScale()));
-  glm::mat4 transform = transMatrix * rotMatrix * scaleMatrix;
-  glm::vec4 attachmentOffset(attachOffset.x, attachOffset.y, attachOffset.z, 1.0f);
-  glm::vec4 attach = transform * attachmentOffset;
-  glm::vec3 attachPos(attach.x, attach.y, attach.z);
-  currentAttachPos = attachPos;
-  
-  glm::vec3 x = attachPos - this->position;
-  glm::vec3 v = state.velocity() + glm::cross(state.angularVelocity(), this->position - state.position);
-  
-  glm::vec3 f = (-k * x) - (b * v);
-  derivative->force += f;
-  derivative->torque += glm::cross(f, state.position - attachPos);
+  detach();
 }
 
-void SpringForce::draw(float alpha)
+void SpringForce::detach()
+{
+  if(target)
+  {
+    target->removeAnchorSpring(recordIndex);
+  }
+  Force::detach();
+}
+  
+void SpringForce::drawMarkers(glm::vec3 from, glm::vec3 to, float alpha)
 {
-  glm::vec3 toTarget = currentAttachPos - position;
+  glm::vec3 toTarget = to - from;
   
   for(int i = 0; i <= NUM_MARKERS; ++i)
   {
-    glm::vec3 markerPos = position + (toTarget * (i / (float)NUM_MARKERS));
+    glm::vec3 markerPos = from + (toTarget * (i / (float)NUM_MARKERS));
     model->setPosition(markerPos);
     model->draw(alpha);
   }
-}
\ No newline at end of file
+}
+
+void SpringForce::draw(float alpha)
+{
+  AnchorSpring* spring = target->getAnchorSpring(recordIndex);
+  drawMarkers(spring->anchor, target->getAttachPosition(spring->attachOffset), alpha);
+}
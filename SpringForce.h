@@ -12,25 +12,52 @@ class SpringForce : public Force
 {
 protected:
   static Model* model;
-  glm::vec3 position;
-  glm::vec3 attachOffset;
-  glm::vec3 currentAttachPos;
-  float k, b;
+  size_t recordIndex;
+  static void loadModel();
   SpringForce(PhysModel* target, glm::vec3 position, float k, float b, glm::vec3 attachOffset);
+  SpringForce(PhysModel* target); // For subclasses that keep their own records
+  void drawMarkers(glm::vec3 from, glm::vec3 to, float alpha);
   
 public:
+  DECLARE_POOLED(SpringForce)
+  
   static SpringForce* create(PhysModel* target, glm::vec3 position, float k, float b, glm::vec3 attachOffset = glm::vec3(-0.5f, 0.0f, 0.0f)); // TODO
   virtual ~SpringForce();
+  virtual void detach();
+  void relocate(size_t recordIndex)
+  {
+    this->recordIndex = recordIndex;
+  }
   void setPosition(glm::vec3 position)
   {
-    this->position = position;
+    if(target)
+    {
+      target->getAnchorSpring(recordIndex)->anchor = position;
+      target->wake();
+    }
   }
   void translate(glm::vec3 delta)
   {
-    this->position += delta;
+    if(target)
+    {
+      target->getAnchorSpring(recordIndex)->anchor += delta;
+      target->wake();
+    }
   }
-  virtual void applyForce(PhysModel* target, const PhysState& state, Derivative* derivative);
+  static void applyForce(const AnchorSpring& spring, float scale, const PhysState& state, Derivative* derivative);
   virtual void draw(float alpha);
 };
 
-#endif
\ No newline at end of file
+inline void SpringForce::applyForce(const AnchorSpring& spring, float scale, const PhysState& state, Derivative* derivative)
+{
+  glm::vec3 attachPos = state.position + (state.orientation * (spring.attachOffset * scale));
+  
+  glm::vec3 x = attachPos - spring.anchor;
+  glm::vec3 v = state.velocity() + glm::cross(state.angularVelocity(), spring.anchor - state.position);
+  
+  glm::vec3 f = (-spring.k * x) - (spring.b * v);
+  derivative->force += f;
+  derivative->torque += glm::cross(f, state.position - attachPos);
+}
+
+#endif
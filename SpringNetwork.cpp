@@ -0,0 +1,96 @@
+#include "SpringNetwork.h"
+#include "TwoWaySpringForce.h"
+#include "Profiler.h"
+
+SpringNetwork::SpringNetwork()
+{
+  builtChanges = 0;
+  stale = true;
+}
+
+// Each count only goes up, so the total changes whenever one does
+unsigned int SpringNetwork::countChanges(const std::vector<PhysModel*>& bodies)
+{
+  unsigned int changes = 0;
+  for(size_t i = 0; i < bodies.size(); ++i)
+  {
+    changes += bodies[i]->getSpringChanges();
+  }
+  return changes;
+}
+
+void SpringNetwork::build(const std::vector<PhysModel*>& bodies)
+{
+  PROFILE_ZONE("SpringNetwork::build");
+  
+  size_t numParticles = bodies.size();
+  for(size_t i = 0; i < numParticles; ++i)
+  {
+    bodies[i]->setNetworkIndex(i);
+  }
+  
+  // Gather the edges. Each spring is only recorded on its first body, so every
+  // spring is seen exactly once.
+  springs.clear();
+  for(size_t i = 0; i < numParticles; ++i)
+  {
+    const std::vector<LinkSpring>& links = bodies[i]->getLinkSprings();
+    for(size_t j = 0; j < links.size(); ++j)
+    {
+      const LinkSpring& link = links[j];
+      unsigned int other = link.other->getNetworkIndex();
+      if(other >= numParticles || bodies[other] != link.other)
+      {
+        continue; // Other end isn't part of this scene
+      }
+      
+      NetworkSpring spring;
+      spring.a = i;
+      spring.b = other;
+      spring.offsetA = link.attachOffset * bodies[i]->getScale();
+      spring.offsetB = link.otherAttachOffset * link.other->getScale();
+      spring.k = link.k;
+      spring.damping = link.b;
+      spring.restLength = link.restLength;
+      springs.push_back(spring);
+    }
+  }
+  
+  // Counting sort of the spring ends into rows
+  rowStart.assign(numParticles + 1, 0);
+  for(size_t s = 0; s < springs.size(); ++s)
+  {
+    ++rowStart[springs[s].a + 1];
+    ++rowStart[springs[s].b + 1];
+  }
+  for(size_t i = 0; i < numParticles; ++i)
+  {
+    rowStart[i + 1] += rowStart[i];
+  }
+  
+  adjacency.resize(springs.size() * 2);
+  fill.assign(rowStart.begin(), rowStart.end() - 1);
+  for(size_t s = 0; s < springs.size(); ++s)
+  {
+    adjacency[fill[springs[s].a]++] = s;
+    adjacency[fill[springs[s].b]++] = s;
+  }
+  
+  builtChanges = countChanges(bodies);
+  stale = false;
+}
+
+void SpringNetwork::applyForces(const std::vector<PhysState>& states, std::vector<Derivative>* derivatives, size_t begin, size_t end) const
+{
+  if(begin >= end)
+  {
+    return;
+  }
+  
+  Derivative* out = &(*derivatives)[0];
+  for(size_t s = begin; s < end; ++s)
+  {
+    const NetworkSpring& spring = springs[s];
+    TwoWaySpringForce::applyForce(spring, states[spring.a], states[spring.b], &out[spring.a], &out[spring.b]);
+  }
+}
@@ -0,0 +1,83 @@
+#ifndef SPRING_NETWORK_H
+#define SPRING_NETWORK_H
+
+#include <vector>
+
+#include "PhysModel.h"
+
+#define NETWORK_INVALID_INDEX 0xFFFFFFFFu
+
+// A spring between two particles (bodies) of the network. Attach offsets are
+// already scaled by their body's scale.
+struct NetworkSpring
+{
+  unsigned int a, b;
+  glm::vec3 offsetA, offsetB;
+  float k, damping, restLength;
+};
+
+// All body-to-body springs of a scene, as a graph in compressed sparse row form:
+// the springs incident to particle i are adjacency[rowStart[i]] up to
+// adjacency[rowStart[i + 1]]. Particle indices are the bodies' indices in the
+// vector the network was built from. Forces are evaluated once per spring and
+// scattered to both ends, so applyForces() walks springs and never needs the
+// rows; they are there for ImplicitEulerSolver, which lays its stiffness
+// matrix out along them.
+//
+// Each body counts the changes to its springs and scale, so a network knows
+// it's out of date from its own bodies alone, whatever other scenes do.
+class SpringNetwork
+{
+private:
+  unsigned int builtChanges; // The bodies' spring changes added up, when built
+  bool stale;
+  
+  static unsigned int countChanges(const std::vector<PhysModel*>& bodies);
+  
+  std::vector<NetworkSpring> springs;
+  std::vector<unsigned int> rowStart;
+  std::vector<unsigned int> adjacency;
+  std::vector<unsigned int> fill; // Scratch, kept to avoid allocating every build
+
+public:
+  SpringNetwork();
+  
+  // Called when the set or order of bodies the network was built from changes
+  void invalidate()
+  {
+    stale = true;
+  }
+  // Whether it needs building again from the same bodies, as one of their
+  // springs or scales has changed
+  bool isStale(const std::vector<PhysModel*>& bodies) const
+  {
+    return stale || countChanges(bodies) != builtChanges;
+  }
+  
+  void build(const std::vector<PhysModel*>& bodies);
+  void applyForces(const std::vector<PhysState>& states, std::vector<Derivative>* derivatives) const
+  {
+    applyForces(states, derivatives, 0, springs.size());
+  }
+  // Only springs [begin, end), so separate ranges can be evaluated in parallel
+  void applyForces(const std::vector<PhysState>& states, std::vector<Derivative>* derivatives, size_t begin, size_t end) const;
+  
+  size_t getNumParticles() const
+  {
+    return rowStart.empty() ? 0 : rowStart.size() - 1;
+  }
+  const std::vector<NetworkSpring>& getSprings() const
+  {
+    return springs;
+  }
+  const std::vector<unsigned int>& getRowStart() const
+  {
+    return rowStart;
+  }
+  const std::vector<unsigned int>& getAdjacency() const
+  {
+    return adjacency;
+  }
+};
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+
+// Each test is a program of its own (make check builds and runs them all from
+// the repository root). A failed CHECK is printed and counted, and the test
+// carries on; CHECK_EXIT() makes the count the exit status.
+static int checkFailures = 0;
+
+#define CHECK(condition) \
+  do \
+  { \
+    if(!(condition)) \
+    { \
+      printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+      ++checkFailures; \
+    } \
+  } while(0)
+
+#define CHECK_EXIT() \
+  do \
+  { \
+    printf("%s: %s\n", __FILE__, checkFailures ? "FAILED" : "passed"); \
+    return checkFailures ? 1 : 0; \
+  } while(0)
+
+#endif
@@ -0,0 +1,114 @@
+/*
+ * The single-producer / single-consumer ring buffer scene edits go through,
+ * and the count Scene keeps of edits it had to drop.
+ */
+
+#include <thread>
+
+#include "Check.h"
+#include "../SPSCQueue.h"
+#include "../Scene.h"
+
+#define STRESS_VALUES 1000000
+
+static void testFillAndDrain()
+{
+  SPSCQueue<int, 8> queue;
+  int value;
+  CHECK(queue.empty());
+  CHECK(!queue.pop(&value));
+
+  // One slot is kept free
+  for(int i = 0; i < 7; ++i)
+  {
+    CHECK(queue.push(i));
+  }
+  CHECK(!queue.push(7));
+  CHECK(!queue.empty());
+
+  for(int i = 0; i < 7; ++i)
+  {
+    CHECK(queue.pop(&value));
+    CHECK(value == i);
+  }
+  CHECK(!queue.pop(&value));
+  CHECK(queue.empty());
+}
+
+static void testWrapAround()
+{
+  SPSCQueue<int, 4> queue;
+  int value;
+  for(int i = 0; i < 100; ++i)
+  {
+    CHECK(queue.push(2 * i));
+    CHECK(queue.push(2 * i + 1));
+    CHECK(queue.pop(&value));
+    CHECK(value == 2 * i);
+    CHECK(queue.pop(&value));
+    CHECK(value == 2 * i + 1);
+  }
+  CHECK(queue.empty());
+}
+
+static void produce(SPSCQueue<int, 64>* queue)
+{
+  for(int i = 0; i < STRESS_VALUES; ++i)
+  {
+    while(!queue->push(i))
+    {
+      std::this_thread::yield();
+    }
+  }
+}
+
+// Every value arrives once, in order, with the producer on another thread
+static void testTwoThreads()
+{
+  SPSCQueue<int, 64> queue;
+  std::thread producer(produce, &queue);
+
+  int expected = 0;
+  bool ordered = true;
+  while(expected < STRESS_VALUES)
+  {
+    int value;
+    if(!queue.pop(&value))
+    {
+      std::this_thread::yield();
+      continue;
+    }
+    ordered = ordered && value == expected;
+    ++expected;
+  }
+  producer.join();
+
+  CHECK(ordered);
+  CHECK(queue.empty());
+}
+
+static void testSceneCountsDrops()
+{
+  Scene scene;
+  CHECK(scene.getNumDroppedCommands() == 0);
+
+  // Commands that don't touch anything, never applied
+  for(int i = 0; i < SCENE_COMMAND_CAPACITY - 1; ++i)
+  {
+    CHECK(scene.queue(SceneCommand()));
+  }
+  CHECK(scene.getNumDroppedCommands() == 0);
+  CHECK(!scene.queue(SceneCommand()));
+  CHECK(!scene.queue(SceneCommand()));
+  CHECK(scene.getNumDroppedCommands() == 2);
+}
+
+int main()
+{
+  testFillAndDrain();
+  testWrapAround();
+  testTwoThreads();
+  testSceneCountsDrops();
+
+  CHECK_EXIT();
+}
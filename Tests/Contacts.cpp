@@ -0,0 +1,188 @@
+/*
+ * The contact solver: a stack of boxes resting on the ground holds still,
+ * bounces give back no more than their restitution allows, and sliding slows
+ * no faster than friction allows, with each integrator that uses it.
+ *
+ * Run from the repository root (meshes are loaded by relative path).
+ */
+
+#include <math.h>
+#include <stdio.h>
+
+#include "Check.h"
+#include "../ContactSolver.h"
+#include "../GravitationalForce.h"
+#include "../SceneGenerator.h"
+
+#define STEP_DT (1.0f / 60.0f)
+#define HALF_SIZE 0.25f   // Of the boxes, and the radius of the balls
+#define STACK_HEIGHT 5
+#define STACK_STEPS 300
+#define STACK_DRIFT (0.2f * HALF_SIZE) // How far a stacked box may sway: a tenth of its width
+#define DROP_HEIGHT 2.0f
+#define SLIDE_SPEED 3.0f
+#define DRAG 0.2f         // Air resistance per unit mass, against the velocity
+
+// XPBD keeps its own ground contacts, without the contact solver
+static const int integrators[] = { INTEGRATOR_RK4, INTEGRATOR_RK45, INTEGRATOR_IMPLICIT_EULER };
+
+static PhysModel* addBody(Scene* scene, glm::vec3 position, bool box, const ContactMaterial& material)
+{
+  PhysModel* body = new PhysModel(Mesh::load(GENERATOR_MESH, true), Material(), 1.0f, position);
+  body->scale(HALF_SIZE);
+  if(box)
+  {
+    body->setBoxCollider(glm::vec3(1.0f));
+  }
+  else
+  {
+    body->setSphereCollider(1.0f);
+  }
+  body->setContactMaterial(material);
+  GravitationalForce::create(body);
+  scene->add(body);
+  return body;
+}
+
+static void testStack(int integrator)
+{
+  Scene scene;
+  scene.setIntegrator(integrator);
+  float ground = SceneGenerator::ground(&scene, Material(), 1.0f)->getPosition().y;
+
+  PhysModel* boxes[STACK_HEIGHT];
+  glm::vec3 placed[STACK_HEIGHT];
+  for(int i = 0; i < STACK_HEIGHT; ++i)
+  {
+    placed[i] = glm::vec3(0.0f, ground + HALF_SIZE * (2 * i + 1), 0.0f);
+    boxes[i] = addBody(&scene, placed[i], true, ContactMaterial());
+  }
+
+  // Each contact under a box may settle a little past its slop, but no further
+  bool held = true;
+  for(int step = 0; step < STACK_STEPS; ++step)
+  {
+    scene.step(step * STEP_DT, STEP_DT);
+    for(int i = 0; i < STACK_HEIGHT; ++i)
+    {
+      glm::vec3 moved = boxes[i]->getState().position - placed[i];
+      held = held && glm::length(glm::vec2(moved.x, moved.z)) <= STACK_DRIFT
+             && fabsf(moved.y) <= (i + 1) * 3.0f * CONTACT_SLOP;
+    }
+  }
+  if(!held)
+  {
+    printf("integrator %d: the stack moved\n", integrator);
+  }
+  CHECK(held);
+
+  // And, having held, went to sleep
+  bool asleep = true;
+  for(int i = 0; i < STACK_HEIGHT; ++i)
+  {
+    asleep = asleep && boxes[i]->isAsleep();
+  }
+  CHECK(asleep);
+}
+
+// The first bounce of a ball dropped on the ground. The ground takes the
+// ball's material, so restitution is the ball's.
+static void testRestitution(int integrator, float restitution)
+{
+  Scene scene;
+  scene.setIntegrator(integrator);
+  float ground = SceneGenerator::ground(&scene, Material(), 1.0f)->getPosition().y;
+  ContactMaterial material;
+  material.restitution = restitution;
+  PhysModel* ball = addBody(&scene, glm::vec3(0.0f, ground + HALF_SIZE + DROP_HEIGHT, 0.0f), false, material);
+
+  // The step that hits is the first that doesn't speed the ball up. It hits
+  // at the speed the step would otherwise have reached.
+  float speed = 0.0f, impact = 0.0f, rebound = 0.0f;
+  for(int step = 0; step < 120 && impact == 0.0f; ++step)
+  {
+    scene.step(step * STEP_DT, STEP_DT);
+    float falling = speed * (1.0f - DRAG * STEP_DT) + GRAVITY * STEP_DT;
+    float now = ball->getState().velocity().y;
+    if(now > falling - 0.5f * GRAVITY * STEP_DT)
+    {
+      impact = -falling;
+      rebound = now;
+    }
+    speed = now;
+  }
+
+  bool bounced = rebound <= (restitution + 0.02f) * impact && rebound >= (restitution - 0.05f) * impact;
+  if(!bounced)
+  {
+    printf("integrator %d, restitution %g: hit at %g, rebounded at %g\n", integrator, restitution, impact, rebound);
+  }
+  CHECK(impact > 0.9f * sqrtf(-2.0f * GRAVITY * DROP_HEIGHT));
+  CHECK(bounced);
+}
+
+// A box sliding along the ground from SLIDE_SPEED
+static void testFriction(int integrator, float friction)
+{
+  Scene scene;
+  scene.setIntegrator(integrator);
+  float ground = SceneGenerator::ground(&scene, Material(), 1.0f)->getPosition().y;
+  ContactMaterial material;
+  material.staticFriction = material.kineticFriction = friction;
+  PhysModel* box = addBody(&scene, glm::vec3(0.0f, ground + HALF_SIZE, 0.0f), true, material);
+  box->setVelocities(glm::vec3(SLIDE_SPEED, 0.0f, 0.0f), glm::vec3(0.0f));
+
+  // The box has a mass of one, so its change in velocity is the impulse on
+  // it. Past gravity and drag, what the ground takes off its sliding can be no
+  // more than friction times what it pushes it up by.
+  bool limited = true;
+  glm::vec3 velocity(SLIDE_SPEED, 0.0f, 0.0f);
+  for(int step = 0; step < 120; ++step)
+  {
+    scene.step(step * STEP_DT, STEP_DT);
+    glm::vec3 expected = velocity * (1.0f - DRAG * STEP_DT) + glm::vec3(0.0f, GRAVITY * STEP_DT, 0.0f);
+    velocity = box->getState().velocity();
+    glm::vec3 impulse = velocity - expected;
+    float normal = glm::max(impulse.y, 0.0f);
+    float tangent = glm::length(glm::vec2(impulse.x, impulse.z));
+    limited = limited && tangent <= 1.05f * friction * normal + 2e-3f;
+  }
+  float speed = glm::length(glm::vec2(velocity.x, velocity.z));
+  if(!limited)
+  {
+    printf("integrator %d, friction %g: slowed faster than friction allows\n", integrator, friction);
+  }
+  CHECK(limited);
+
+  float travelled = box->getState().position.x;
+  if(friction > 0.0f)
+  {
+    // Stopped, at about where friction alone would have stopped it (drag
+    // brings it in a little sooner)
+    float expected = SLIDE_SPEED * SLIDE_SPEED / (2.0f * friction * -GRAVITY);
+    CHECK(speed < 0.05f);
+    CHECK(travelled > 0.8f * expected && travelled < 1.05f * expected);
+  }
+  else
+  {
+    // Slowed by drag alone
+    CHECK(speed > 0.9f * SLIDE_SPEED * expf(-DRAG * 120 * STEP_DT));
+  }
+}
+
+int main()
+{
+  GLBridge::setHeadless(true);
+
+  for(int i = 0; i < 3; ++i)
+  {
+    testStack(integrators[i]);
+    testRestitution(integrators[i], 0.0f);
+    testRestitution(integrators[i], 0.5f);
+    testRestitution(integrators[i], 1.0f);
+    testFriction(integrators[i], 0.0f);
+    testFriction(integrators[i], 0.5f);
+  }
+
+  CHECK_EXIT();
+}
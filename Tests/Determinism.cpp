@@ -0,0 +1,77 @@
+/*
+ * Deterministic mode: the same scene stepped with every integrator on 1, 3
+ * and 8 threads must give the same state hash after every step.
+ *
+ * Run from the repository root (meshes are loaded by relative path).
+ */
+
+#include <vector>
+
+#include "Check.h"
+#include "../Scene.h"
+#include "../SceneGenerator.h"
+#include "../ThreadPool.h"
+
+#define SEED 1234
+#define NUM_DROPPED 100
+#define NUM_CHAINS 4
+#define CHAIN_LENGTH 16
+#define NUM_STEPS 90 // Long enough for the drop to land
+#define STEP_DT (1.0f / 60.0f)
+
+static void buildScene(Scene* scene)
+{
+  Model* floor = SceneGenerator::ground(scene, Material(), 10.0f);
+  SceneGenerator::pileAndChains(scene, Mesh::load(GENERATOR_MESH, true), Material(), NUM_DROPPED, NUM_CHAINS, CHAIN_LENGTH,
+                                floor->getPosition(), SEED);
+}
+
+// The hash after each step
+static std::vector<uint64_t> run(int integrator, int numThreads)
+{
+  ThreadPool pool(numThreads);
+  Scene scene;
+  scene.setThreadPool(&pool);
+  scene.setDeterministic(true, SEED);
+  scene.setIntegrator(integrator);
+  buildScene(&scene);
+
+  std::vector<uint64_t> hashes;
+  for(int step = 0; step < NUM_STEPS; ++step)
+  {
+    scene.step(step * STEP_DT, STEP_DT);
+    hashes.push_back(scene.getStateHash());
+  }
+  return hashes;
+}
+
+int main()
+{
+  GLBridge::setHeadless(true);
+
+  static const int integrators[] = { INTEGRATOR_RK4, INTEGRATOR_RK45, INTEGRATOR_IMPLICIT_EULER, INTEGRATOR_XPBD };
+  static const char* names[] = { "rk4", "rk45", "implicit", "xpbd" };
+  static const int threadCounts[] = { 3, 8 };
+  for(int i = 0; i < 4; ++i)
+  {
+    std::vector<uint64_t> expected = run(integrators[i], 1);
+    CHECK(expected.front() != expected.back());
+    for(int j = 0; j < 2; ++j)
+    {
+      std::vector<uint64_t> hashes = run(integrators[i], threadCounts[j]);
+      int firstDifferent = -1;
+      for(int step = NUM_STEPS - 1; step >= 0; --step)
+      {
+        firstDifferent = hashes[step] != expected[step] ? step : firstDifferent;
+      }
+      printf("%-10s %d threads: %s", names[i], threadCounts[j], firstDifferent < 0 ? "same\n" : "differs");
+      if(firstDifferent >= 0)
+      {
+        printf(" from step %d\n", firstDifferent);
+      }
+      CHECK(firstDifferent < 0);
+    }
+  }
+
+  CHECK_EXIT();
+}
@@ -0,0 +1,109 @@
+/*
+ * Continuous collision: a body fast enough to pass through the ground, or
+ * through a box resting on it, in one step is stopped on top instead, with
+ * each integrator. Speeds run from a few samples a step up to the
+ * CCD_MAX_SAMPLES cap and past it.
+ *
+ * Run from the repository root (meshes are loaded by relative path).
+ */
+
+#include <math.h>
+#include <stdio.h>
+
+#include "Check.h"
+#include "../CollisionWorld.h"
+#include "../GravitationalForce.h"
+#include "../SceneGenerator.h"
+
+#define STEP_DT (1.0f / 60.0f)
+#define NUM_STEPS 60
+#define BOX_HALF_WIDTH 1.5f
+#define BOX_HALF_HEIGHT 0.25f
+#define BOX_MASS 50.0f
+#define MAX_SINK (0.5f * GENERATOR_RADIUS) // How far into something a body may end a step
+
+// A sweep samples a body's path every half width, so a step's travel in half
+// widths is how many samples it needs
+static const float samplesNeeded[] = { 4.0f, CCD_MAX_SAMPLES, 2.0f * CCD_MAX_SAMPLES };
+
+static PhysModel* addBall(Scene* scene, glm::vec3 position, float speed)
+{
+  PhysModel* ball = new PhysModel(Mesh::load(GENERATOR_MESH, true), Material(), 1.0f, position);
+  ball->scale(GENERATOR_RADIUS);
+  ball->setSphereCollider(1.0f);
+  GravitationalForce::create(ball);
+  scene->add(ball);
+  ball->setVelocities(glm::vec3(0.0f, -speed, 0.0f), glm::vec3(0.0f));
+  return ball;
+}
+
+// Drops a ball needing samples samples in its first step, onto the ground or
+// onto a box resting on it, and checks nothing ever ends up in what's below it
+static void drop(int integrator, float samples, bool ontoBox)
+{
+  Scene scene;
+  scene.setIntegrator(integrator);
+  float ground = SceneGenerator::ground(&scene, Material(), 1.0f)->getPosition().y;
+
+  PhysModel* box = NULL;
+  float top = ground;
+  if(ontoBox)
+  {
+    box = new PhysModel(Mesh::load(GENERATOR_MESH, true), Material(), BOX_MASS,
+                        glm::vec3(0.0f, ground + BOX_HALF_HEIGHT, 0.0f));
+    box->setBoxCollider(glm::vec3(BOX_HALF_WIDTH, BOX_HALF_HEIGHT, BOX_HALF_WIDTH));
+    GravitationalForce::create(box);
+    scene.add(box);
+    top += 2.0f * BOX_HALF_HEIGHT;
+  }
+
+  // Starting high enough that the first step ends part way through what's below
+  float travel = samples * GENERATOR_RADIUS;
+  float speed = travel / STEP_DT;
+  PhysModel* ball = addBall(&scene, glm::vec3(0.1f, top + GENERATOR_RADIUS + 0.4f * travel, 0.1f), speed);
+
+  bool swept = false, above = true;
+  for(int step = 0; step < NUM_STEPS; ++step)
+  {
+    scene.step(step * STEP_DT, STEP_DT);
+    swept = swept || scene.getCollisionWorld()->getNumFastBodies() > 0;
+
+    glm::vec3 position = ball->getState().position;
+    float floor = ground;
+    if(box)
+    {
+      glm::vec3 boxPosition = box->getState().position;
+      above = above && boxPosition.y - BOX_HALF_HEIGHT >= ground - MAX_SINK;
+      // Over the box, the ball must stay on it
+      if(fabsf(position.x - boxPosition.x) < BOX_HALF_WIDTH && fabsf(position.z - boxPosition.z) < BOX_HALF_WIDTH)
+      {
+        floor = boxPosition.y + BOX_HALF_HEIGHT;
+      }
+    }
+    above = above && position.y - GENERATOR_RADIUS >= floor - MAX_SINK;
+  }
+
+  if(!above)
+  {
+    printf("integrator %d, %g samples, onto the %s: ended up below\n", integrator, samples, ontoBox ? "box" : "ground");
+  }
+  CHECK(swept);
+  CHECK(above);
+}
+
+int main()
+{
+  GLBridge::setHeadless(true);
+
+  static const int integrators[] = { INTEGRATOR_RK4, INTEGRATOR_RK45, INTEGRATOR_IMPLICIT_EULER, INTEGRATOR_XPBD };
+  for(int i = 0; i < 4; ++i)
+  {
+    for(size_t j = 0; j < sizeof(samplesNeeded) / sizeof(samplesNeeded[0]); ++j)
+    {
+      drop(integrators[i], samplesNeeded[j], false);
+      drop(integrators[i], samplesNeeded[j], true);
+    }
+  }
+
+  CHECK_EXIT();
+}
@@ -0,0 +1,175 @@
+/*
+ * GJK/EPA against shapes whose penetration is known in closed form: random
+ * pairs of spheres, and of boxes that are axis aligned.
+ */
+
+#include <math.h>
+
+#include "Check.h"
+#include "../Narrowphase.h"
+#include "../Random.h"
+
+#define NUM_PAIRS 20000
+#define DEPTH_TOLERANCE 0.001f // Of the size of the shapes
+#define NORMAL_TOLERANCE 0.05f // Length of the difference from the true normal
+
+static Collider sphere(glm::vec3 position, float radius, glm::quat orientation)
+{
+  Collider collider;
+  collider.type = COLLIDER_SPHERE;
+  collider.hull = NULL;
+  collider.size = glm::vec3(radius, radius, radius);
+  collider.position = position;
+  collider.orientation = orientation;
+  collider.scale = 1.0f;
+  return collider;
+}
+
+static Collider box(glm::vec3 position, glm::vec3 halfExtents)
+{
+  Collider collider;
+  collider.type = COLLIDER_BOX;
+  collider.hull = NULL;
+  collider.size = halfExtents;
+  collider.position = position;
+  collider.orientation = glm::quat();
+  collider.scale = 1.0f;
+  return collider;
+}
+
+static glm::vec3 randomDirection(Random* random)
+{
+  for(;;)
+  {
+    glm::vec3 v = random->nextVec3(-1.0f, 1.0f);
+    float length = glm::length(v);
+    if(length > 0.1f && length <= 1.0f)
+    {
+      return v / length;
+    }
+  }
+}
+
+static glm::quat randomOrientation(Random* random)
+{
+  glm::vec3 axis = randomDirection(random);
+  float angle = random->nextFloat(0.0f, 6.2831853f);
+  return glm::quat(cosf(angle * 0.5f), axis * sinf(angle * 0.5f));
+}
+
+static void testSpheres()
+{
+  Random random(1);
+  int missed = 0, wrongDepth = 0, wrongNormal = 0, falseHits = 0;
+  float worstDepth = 0.0f, worstNormal = 0.0f;
+  for(int i = 0; i < NUM_PAIRS; ++i)
+  {
+    float radiusA = random.nextFloat(0.1f, 2.0f);
+    float radiusB = random.nextFloat(0.1f, 2.0f);
+    glm::vec3 positionA = random.nextVec3(-10.0f, 10.0f);
+    glm::vec3 normal = randomDirection(&random);
+    // Mostly overlapping, some apart
+    float distance = random.nextFloat(0.0f, 1.2f) * (radiusA + radiusB);
+    glm::quat orientationA = randomOrientation(&random);
+    glm::quat orientationB = randomOrientation(&random);
+
+    Collider a = sphere(positionA, radiusA, orientationA);
+    Collider b = sphere(positionA + normal * distance, radiusB, orientationB);
+    Penetration penetration;
+    bool hit = findPenetration(a, b, &penetration);
+
+    float depth = radiusA + radiusB - distance;
+    float tolerance = DEPTH_TOLERANCE * (radiusA + radiusB);
+    if(depth < -tolerance)
+    {
+      falseHits += hit;
+      continue;
+    }
+    if(depth < tolerance || distance < tolerance)
+    {
+      continue; // Only just touching, or concentric with no one normal
+    }
+
+    if(!hit)
+    {
+      ++missed;
+      continue;
+    }
+    float depthError = fabs(penetration.depth - depth) / (radiusA + radiusB);
+    float normalError = glm::length(penetration.normal - normal);
+    worstDepth = depthError > worstDepth ? depthError : worstDepth;
+    worstNormal = normalError > worstNormal ? normalError : worstNormal;
+    wrongDepth += depthError > DEPTH_TOLERANCE;
+    wrongNormal += normalError > NORMAL_TOLERANCE;
+  }
+
+  printf("spheres: %d missed, %d false hits, %d wrong depth (worst %g), %d wrong normal (worst %g)\n",
+         missed, falseHits, wrongDepth, worstDepth, wrongNormal, worstNormal);
+  CHECK(missed == 0);
+  CHECK(falseHits == 0);
+  CHECK(wrongDepth == 0);
+  CHECK(wrongNormal == 0);
+}
+
+// Axis aligned boxes separate along the axis they overlap least on
+static void testBoxes()
+{
+  Random random(2);
+  int missed = 0, wrongDepth = 0, wrongNormal = 0;
+  for(int i = 0; i < NUM_PAIRS; ++i)
+  {
+    glm::vec3 extentsA = random.nextVec3(0.1f, 2.0f);
+    glm::vec3 extentsB = random.nextVec3(0.1f, 2.0f);
+    glm::vec3 positionA = random.nextVec3(-10.0f, 10.0f);
+    glm::vec3 offset = random.nextVec3(-1.0f, 1.0f) * (extentsA + extentsB);
+
+    int axis = 0;
+    float depth = 1e30f;
+    for(int j = 0; j < 3; ++j)
+    {
+      float overlap = extentsA[j] + extentsB[j] - fabs(offset[j]);
+      if(overlap < depth)
+      {
+        depth = overlap;
+        axis = j;
+      }
+    }
+
+    // Skip near ties between axes, and near touching
+    float size = glm::length(extentsA + extentsB);
+    bool tied = false;
+    for(int j = 0; j < 3; ++j)
+    {
+      float overlap = extentsA[j] + extentsB[j] - fabs(offset[j]);
+      tied = tied || (j != axis && overlap - depth < DEPTH_TOLERANCE * size);
+    }
+    if(tied || depth < DEPTH_TOLERANCE * size)
+    {
+      continue;
+    }
+
+    glm::vec3 normal;
+    normal[axis] = offset[axis] < 0.0f ? -1.0f : 1.0f;
+    Penetration penetration;
+    if(!findPenetration(box(positionA, extentsA), box(positionA + offset, extentsB), &penetration))
+    {
+      ++missed;
+      continue;
+    }
+    wrongDepth += fabs(penetration.depth - depth) > DEPTH_TOLERANCE * size;
+    wrongNormal += glm::length(penetration.normal - normal) > NORMAL_TOLERANCE;
+  }
+
+  printf("boxes: %d missed, %d wrong depth, %d wrong normal\n", missed, wrongDepth, wrongNormal);
+  CHECK(missed == 0);
+  CHECK(wrongDepth == 0);
+  CHECK(wrongNormal == 0);
+}
+
+int main()
+{
+  testSpheres();
+  testBoxes();
+
+  CHECK_EXIT();
+}
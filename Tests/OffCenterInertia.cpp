@@ -0,0 +1,88 @@
+/*
+ * Bodies turn about their mesh's origin, so a mesh whose center of mass isn't
+ * there has its inertia tensor moved out to it, at any mass and scale.
+ *
+ * Run from the repository root (meshes are loaded by relative path).
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "Check.h"
+#include "../PhysModel.h"
+
+// A box centered on (0, 0, CENTER_Z). The loader only centers meshes in x and
+// y, so it stays off center.
+#define SIZE_X 1.0f
+#define SIZE_Y 2.0f
+#define SIZE_Z 2.0f
+#define CENTER_Z 2.0f
+
+static void writeBox(const char* path)
+{
+  FILE* file = fopen(path, "w");
+  for(int i = 0; i < 8; ++i)
+  {
+    fprintf(file, "v %f %f %f\n", ((i & 1) - 0.5f) * SIZE_X, (((i >> 1) & 1) - 0.5f) * SIZE_Y,
+            CENTER_Z + (((i >> 2) & 1) - 0.5f) * SIZE_Z);
+  }
+  // Wound to face out
+  static const int faces[6][4] = { { 1, 3, 4, 2 }, { 5, 6, 8, 7 }, { 1, 2, 6, 5 },
+                                   { 3, 7, 8, 4 }, { 1, 5, 7, 3 }, { 2, 4, 8, 6 } };
+  for(int i = 0; i < 6; ++i)
+  {
+    fprintf(file, "f %d %d %d\n", faces[i][0], faces[i][1], faces[i][2]);
+    fprintf(file, "f %d %d %d\n", faces[i][0], faces[i][2], faces[i][3]);
+  }
+  fclose(file);
+}
+
+static bool near(const glm::mat3& a, const glm::mat3& b)
+{
+  float worst = 0.0f;
+  for(int i = 0; i < 3; ++i)
+  {
+    for(int j = 0; j < 3; ++j)
+    {
+      worst = fmaxf(worst, fabsf(a[i][j] - b[i][j]));
+    }
+  }
+  return worst <= 1e-4f * fmaxf(1.0f, fabsf(b[0][0]));
+}
+
+// A solid box's tensor about the origin, with the box's center at (0, 0, z)
+static glm::mat3 boxInertia(float mass, float scale, float z)
+{
+  glm::vec3 size = glm::vec3(SIZE_X, SIZE_Y, SIZE_Z) * scale;
+  glm::vec3 squared = size * size;
+  glm::mat3 inertia(0.0f);
+  inertia[0][0] = mass * ((squared.y + squared.z) / 12.0f + z * z);
+  inertia[1][1] = mass * ((squared.x + squared.z) / 12.0f + z * z);
+  inertia[2][2] = mass * (squared.x + squared.y) / 12.0f;
+  return inertia;
+}
+
+int main()
+{
+  GLBridge::setHeadless(true);
+
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/off_center_box_%d.obj", (int)getpid());
+  writeBox(path);
+  Mesh* mesh = Mesh::load(path, false);
+  unlink(path);
+
+  CHECK(fabsf(mesh->volume - SIZE_X * SIZE_Y * SIZE_Z) < 1e-4f);
+  CHECK(glm::length(mesh->centerOfMass - glm::vec3(0.0f, 0.0f, CENTER_Z)) < 1e-5f);
+
+  PhysModel* body = new PhysModel(mesh, Material(), 3.0f);
+  CHECK(near(body->getState().inertia, boxInertia(3.0f, 1.0f, CENTER_Z)));
+  CHECK(near(body->getState().inverseInertia, glm::inverse(boxInertia(3.0f, 1.0f, CENTER_Z))));
+
+  // Scaling moves the center of mass out with the rest of the box
+  body->scale(2.0f);
+  CHECK(near(body->getState().inertia, boxInertia(3.0f, 2.0f, 2.0f * CENTER_Z)));
+
+  CHECK_EXIT();
+}
@@ -0,0 +1,124 @@
+/*
+ * Pool's generation handles, which resolve to NULL once their object is gone,
+ * and pooled classes outliving the static objects that use them.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "Check.h"
+#include "../Pool.h"
+
+struct Item
+{
+  int value;
+
+  DECLARE_POOLED(Item)
+};
+
+// Holds on to an item until static destruction, after main has returned
+struct Holder
+{
+  Item* item;
+  PoolHandle handle;
+
+  ~Holder()
+  {
+    if(item && Item::getPool().get(handle) != item)
+    {
+      _exit(1);
+    }
+    delete item;
+  }
+};
+
+// Constructed before the pool, so destroyed after it if the pool were a plain
+// static
+static Holder holder;
+
+DEFINE_POOLED(Item, MEMORY_OTHER)
+
+static void testHandles()
+{
+  Pool<Item> pool;
+  Item* item = ::new(pool.allocate()) Item();
+  item->value = 1;
+  PoolHandle handle = pool.handleOf(item);
+  CHECK(pool.get(handle) == item);
+  CHECK(pool.size() == 1);
+
+  pool.release(item);
+  CHECK(pool.get(handle) == NULL);
+  CHECK(pool.size() == 0);
+
+  // The slot is recycled under a new generation; the old handle stays dead
+  Item* reused = ::new(pool.allocate()) Item();
+  PoolHandle reusedHandle = pool.handleOf(reused);
+  CHECK(reused == item);
+  CHECK(reusedHandle.index == handle.index);
+  CHECK(reusedHandle.generation != handle.generation);
+  CHECK(pool.get(handle) == NULL);
+  CHECK(pool.get(reusedHandle) == reused);
+
+  CHECK(pool.get(PoolHandle()) == NULL);
+  PoolHandle outOfRange;
+  outOfRange.index = pool.capacity();
+  CHECK(pool.get(outOfRange) == NULL);
+
+  pool.release(reused);
+}
+
+static void testGrowth()
+{
+  Pool<Item> pool;
+  pool.reserve(10);
+  CHECK(pool.capacity() == POOL_BLOCK_SIZE);
+
+  // Addresses and handles survive the pool growing past a block
+  Item* items[POOL_BLOCK_SIZE + 1];
+  PoolHandle handles[POOL_BLOCK_SIZE + 1];
+  for(int i = 0; i < POOL_BLOCK_SIZE + 1; ++i)
+  {
+    items[i] = ::new(pool.allocate()) Item();
+    items[i]->value = i;
+    handles[i] = pool.handleOf(items[i]);
+  }
+  CHECK(pool.capacity() == 2 * POOL_BLOCK_SIZE);
+  CHECK(pool.size() == POOL_BLOCK_SIZE + 1);
+
+  bool resolved = true;
+  for(int i = 0; i < POOL_BLOCK_SIZE + 1; ++i)
+  {
+    resolved = resolved && pool.get(handles[i]) == items[i] && items[i]->value == i;
+  }
+  CHECK(resolved);
+
+  for(int i = 0; i < POOL_BLOCK_SIZE + 1; ++i)
+  {
+    pool.release(items[i]);
+  }
+  CHECK(pool.size() == 0);
+}
+
+static void testPooledClass()
+{
+  Item* item = new Item();
+  PoolHandle handle = Item::getPool().handleOf(item);
+  CHECK(Item::getPool().size() == 1);
+  CHECK(Item::getPool().get(handle) == item);
+  delete item;
+  CHECK(Item::getPool().size() == 0);
+  CHECK(Item::getPool().get(handle) == NULL);
+
+  holder.item = new Item();
+  holder.handle = Item::getPool().handleOf(holder.item);
+}
+
+int main()
+{
+  testHandles();
+  testGrowth();
+  testPooledClass();
+
+  CHECK_EXIT();
+}
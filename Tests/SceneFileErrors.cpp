@@ -0,0 +1,172 @@
+/*
+ * Scene files: JSON that doesn't parse and scenes that are wrong are refused
+ * with an error saying where, leaving the scene alone, and a good file builds.
+ *
+ * Run from the repository root (meshes are loaded by relative path).
+ */
+
+#include <string.h>
+#include <string>
+
+#include "Check.h"
+#include "../ContactSolver.h"
+#include "../Json.h"
+#include "../SceneFile.h"
+
+// A mesh and a body to hang the member being tested off
+#define MESHES "\"meshes\": { \"ball\": { \"path\": \"SimpleModels/sphere.obj\" } }"
+
+struct ErrorCase
+{
+  const char* text;
+  const char* error;
+};
+
+static const ErrorCase jsonCases[] =
+{
+  { "", "line 1: unexpected end" },
+  { "{\n\"a\": 1,\n}", "line 3: expected a key" },
+  { "{ \"a\" 1 }", "line 1: expected ':'" },
+  { "[1, 2", "line 1: expected ',' or ']'" },
+  { "[1 2]", "line 1: expected ',' or ']'" },
+  { "{ \"a\": 1 } x", "line 1: text after the document" },
+  { "\"unfinished", "line 1: unfinished string" },
+  { "\"\\x\"", "line 1: bad escape" },
+  { "\"\\ud800\"", "line 1: unpaired surrogate" },
+  { "01", "line 1: text after the document" },
+  { "-", "line 1: bad number" },
+  { "1e", "line 1: bad number" },
+  { "\n\ntrue false", "line 3: text after the document" },
+  { "nul", "line 1: unexpected character" },
+};
+
+static const ErrorCase sceneCases[] =
+{
+  { "[]", "scene: expected an object" },
+  { "{ \"meshes\": [] }", "meshes: expected an object" },
+  { "{ \"meshes\": { \"ball\": { \"path\": \"no/such.obj\" } } }", "meshes.ball: can't open the mesh file" },
+  { "{ \"bodies\": [ 1 ] }", "bodies: expected an array of objects" },
+  { "{ " MESHES ", \"bodies\": [ {} ] }", "bodies[0].mesh: missing" },
+  { "{ " MESHES ", \"bodies\": [ { \"mesh\": \"cube\" } ] }", "bodies[0].mesh: no such name" },
+  { "{ " MESHES ", \"bodies\": [ { \"mesh\": \"ball\", \"mass\": 0 } ] }", "bodies[0]: mass and scale must be positive" },
+  { "{ " MESHES ", \"bodies\": [ { \"mesh\": \"ball\", \"position\": [1, 2] } ] }",
+    "bodies[0].position: expected an array of 3 numbers" },
+  { "{ " MESHES ", \"bodies\": [ { \"mesh\": \"ball\", \"orientation\": [0, 0, 0, 0] } ] }",
+    "bodies[0].orientation: orientation has no length" },
+
+  // Materials, named and in place
+  { "{ \"materials\": { \"red\": { \"diffuse\": [1, 0] } } }", "materials.red.diffuse: expected an array of 3 numbers" },
+  { "{ \"materials\": { \"red\": 1 } }", "materials.red: expected an object" },
+  { "{ " MESHES ", \"bodies\": [ { \"mesh\": \"ball\" }, { \"mesh\": \"ball\", \"material\": { \"shininess\": \"high\" } } ] }",
+    "bodies[1].material.shininess: expected a number" },
+  { "{ " MESHES ", \"models\": [ { \"mesh\": \"ball\", \"material\": { \"ambient\": 1 } } ] }",
+    "models[0].material.ambient: expected an array of 3 numbers" },
+  { "{ " MESHES ", \"bodies\": [ { \"mesh\": \"ball\", \"material\": \"red\" } ] }", "bodies[0].material: no such material" },
+
+  // Colliders and contact materials
+  { "{ " MESHES ", \"bodies\": [ { \"mesh\": \"ball\", \"collider\": { \"shape\": \"cone\" } } ] }",
+    "bodies[0].collider.shape: must be \"hull\", \"sphere\" or \"box\"" },
+  { "{ " MESHES ", \"bodies\": [ { \"mesh\": \"ball\", \"collider\": { \"shape\": \"sphere\", \"radius\": \"big\" } } ] }",
+    "bodies[0].collider.radius: expected a number" },
+  { "{ " MESHES ", \"bodies\": [ { \"mesh\": \"ball\", \"collider\": { \"shape\": \"box\" } } ] }",
+    "bodies[0].collider: needs a positive size" },
+  { "{ " MESHES ", \"bodies\": [ { \"mesh\": \"ball\", \"collider\": \"sphere\" } ] }", "bodies[0].collider: expected an object" },
+  { "{ " MESHES ", \"bodies\": [ { \"mesh\": \"ball\", \"contact\": 0.5 } ] }", "bodies[0].contact: expected an object" },
+  { "{ " MESHES ", \"bodies\": [ { \"mesh\": \"ball\", \"contact\": { \"restitution\": [] } } ] }",
+    "bodies[0].contact.restitution: expected a number" },
+
+  // Names and springs
+  { "{ " MESHES ", \"bodies\": [ { \"mesh\": \"ball\", \"name\": \"a\" }, { \"mesh\": \"ball\", \"name\": \"a\" } ] }",
+    "bodies[1].name: used twice" },
+  { "{ " MESHES ", \"bodies\": [ { \"mesh\": \"ball\" } ], \"springs\": [ { \"body\": 1 } ] }", "springs[0].body: index out of range" },
+  { "{ " MESHES ", \"bodies\": [ { \"mesh\": \"ball\" } ], \"springs\": [ { \"bodies\": [0, 0] } ] }",
+    "springs[0].bodies: a spring needs two different bodies" },
+  { "{ " MESHES ", \"bodies\": [ { \"mesh\": \"ball\" } ], \"springs\": [ { \"bodies\": [0] } ] }", "springs[0].bodies: expected two bodies" },
+  { "{ \"lights\": [ { \"attachTo\": \"nobody\" } ] }", "lights[0].attachTo: no such name" },
+
+  // Settings
+  { "{ \"settings\": 1 }", "scene.settings: expected an object" },
+  { "{ \"settings\": { \"integrator\": \"euler\" } }", "settings.integrator: must be \"rk4\", \"implicitEuler\", \"xpbd\" or \"rk45\"" },
+  { "{ \"settings\": { \"contactIterations\": -1 } }", "settings.contactIterations: expected a whole number from 0 to 10000" },
+  { "{ \"settings\": { \"contactIterations\": 2.5 } }", "settings.contactIterations: expected a whole number from 0 to 10000" },
+  { "{ \"settings\": { \"contactIterations\": 1e10 } }", "settings.contactIterations: expected a whole number from 0 to 10000" },
+  { "{ \"settings\": { \"seed\": -1 } }", "settings.seed: expected a whole number from 0 to 9007199254740992" },
+  { "{ \"settings\": { \"seed\": 0.5 } }", "settings.seed: expected a whole number from 0 to 9007199254740992" },
+  { "{ \"settings\": { \"seed\": 1e30 } }", "settings.seed: expected a whole number from 0 to 9007199254740992" },
+  { "{ \"settings\": { \"seed\": \"42\" } }", "settings.seed: expected a whole number from 0 to 9007199254740992" },
+};
+
+static void testJsonErrors()
+{
+  for(size_t i = 0; i < sizeof(jsonCases) / sizeof(jsonCases[0]); ++i)
+  {
+    JsonDocument document;
+    std::string error;
+    bool parsed = document.parse(jsonCases[i].text, strlen(jsonCases[i].text), &error);
+    if(parsed || error != jsonCases[i].error)
+    {
+      printf("%s: got \"%s\"\n", jsonCases[i].text, parsed ? "(parsed)" : error.c_str());
+    }
+    CHECK(!parsed && error == jsonCases[i].error);
+  }
+
+  // Nested past the limit
+  std::string deep(JSON_MAX_DEPTH + 1, '[');
+  JsonDocument document;
+  std::string error;
+  CHECK(!document.parse(deep.data(), deep.size(), &error));
+  CHECK(error == "line 1: nested too deeply");
+}
+
+static void testSceneErrors()
+{
+  for(size_t i = 0; i < sizeof(sceneCases) / sizeof(sceneCases[0]); ++i)
+  {
+    Scene scene;
+    std::string error;
+    bool loaded = SceneFile::load(sceneCases[i].text, strlen(sceneCases[i].text), &scene, &error);
+    if(loaded || error != sceneCases[i].error)
+    {
+      printf("%s: got \"%s\"\n", sceneCases[i].text, loaded ? "(loaded)" : error.c_str());
+    }
+    CHECK(!loaded && error == sceneCases[i].error);
+    CHECK(scene.getNumSceneObjects() == 0 && scene.getNumPhysObjects() == 0);
+  }
+
+  Scene scene;
+  std::string error;
+  CHECK(!SceneFile::load("no/such/scene.json", &scene, &error));
+  CHECK(error == "can't open the file");
+}
+
+static void testGoodScene()
+{
+  static const char* text =
+    "{ " MESHES ",\n"
+    "  \"materials\": { \"red\": { \"diffuse\": [1, 0, 0] } },\n"
+    "  \"bodies\": [ { \"name\": \"a\", \"mesh\": \"ball\", \"material\": \"red\" },\n"
+    "              { \"mesh\": \"ball\", \"material\": { \"diffuse\": [0, 1, 0] }, \"position\": [0, 2, 0],\n"
+    "                \"collider\": { \"shape\": \"sphere\", \"radius\": 0.5 }, \"contact\": { \"restitution\": 0.25 } } ],\n"
+    "  \"springs\": [ { \"bodies\": [\"a\", 1], \"k\": 4 } ],\n"
+    "  \"settings\": { \"integrator\": \"xpbd\", \"contactIterations\": 0, \"seed\": 9007199254740992 }\n"
+    "}";
+  Scene scene;
+  std::string error;
+  CHECK(SceneFile::load(text, strlen(text), &scene, &error));
+  CHECK(error.empty());
+  CHECK(scene.getNumPhysObjects() == 2);
+  CHECK(scene.getIntegrator() == INTEGRATOR_XPBD);
+  CHECK(scene.getContactSolver()->getIterations() == 0);
+  CHECK(scene.getPhysObject(1)->getColliderType() == COLLIDER_SPHERE);
+}
+
+int main()
+{
+  GLBridge::setHeadless(true);
+
+  testJsonErrors();
+  testSceneErrors();
+  testGoodScene();
+
+  CHECK_EXIT();
+}
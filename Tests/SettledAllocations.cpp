@@ -0,0 +1,52 @@
+/*
+ * Once a scene has settled, stepping it must not touch the heap, whichever
+ * integrator steps it (see Scene::getLastAllocations).
+ *
+ * Run from the repository root (meshes are loaded by relative path).
+ */
+
+#include "Check.h"
+#include "../Scene.h"
+#include "../SceneGenerator.h"
+
+#define SEED 5
+#define NUM_DROPPED 50
+#define NUM_CHAINS 4
+#define CHAIN_LENGTH 16
+#define SETTLE_STEPS 600 // Chains keep swinging, but their contacts stop growing
+#define CHECKED_STEPS 200
+#define STEP_DT (1.0f / 60.0f)
+
+int main()
+{
+  GLBridge::setHeadless(true);
+
+  static const int integrators[] = { INTEGRATOR_RK4, INTEGRATOR_RK45, INTEGRATOR_IMPLICIT_EULER, INTEGRATOR_XPBD };
+  static const char* names[] = { "rk4", "rk45", "implicit", "xpbd" };
+  for(int i = 0; i < 4; ++i)
+  {
+    Scene scene;
+    scene.setDeterministic(true, SEED);
+    scene.setIntegrator(integrators[i]);
+    Model* floor = SceneGenerator::ground(&scene, Material(), 3.0f);
+    SceneGenerator::pileAndChains(&scene, Mesh::load(GENERATOR_MESH, true), Material(), NUM_DROPPED, NUM_CHAINS, CHAIN_LENGTH,
+                                  floor->getPosition(), SEED);
+
+    int step = 0;
+    for(; step < SETTLE_STEPS; ++step)
+    {
+      scene.step(step * STEP_DT, STEP_DT);
+    }
+
+    uint64_t allocations = 0;
+    for(int j = 0; j < CHECKED_STEPS; ++j, ++step)
+    {
+      scene.step(step * STEP_DT, STEP_DT);
+      allocations += scene.getLastAllocations();
+    }
+    printf("%-10s %llu allocations over %d settled steps\n", names[i], (unsigned long long)allocations, CHECKED_STEPS);
+    CHECK(allocations == 0);
+  }
+
+  CHECK_EXIT();
+}
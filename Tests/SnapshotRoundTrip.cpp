@@ -0,0 +1,177 @@
+/*
+ * Snapshots: a scene saved part way through and loaded into a fresh scene
+ * carries on exactly as the original does, and damaged snapshots are turned
+ * away without touching the scene.
+ *
+ * Run from the repository root (meshes are loaded by relative path).
+ */
+
+#include <string.h>
+#include <vector>
+
+#include "Check.h"
+#include "../GravitationalForce.h"
+#include "../Scene.h"
+#include "../SceneGenerator.h"
+#include "../Snapshot.h"
+
+#define SEED 99
+#define NUM_BODIES 5
+#define STEP_DT (1.0f / 60.0f)
+
+// Colliders and gravity vary from body to body, so their arrays stand out in
+// the snapshot
+static const int colliderTypes[NUM_BODIES] = { COLLIDER_SPHERE, COLLIDER_BOX, COLLIDER_SPHERE, COLLIDER_BOX, COLLIDER_HULL };
+static const int gravityCounts[NUM_BODIES] = { 1, 2, 3, 1, 2 };
+
+static void buildScene(Scene* scene)
+{
+  Model* floor = SceneGenerator::ground(scene, Material(), 10.0f);
+
+  Mesh* mesh = Mesh::load(GENERATOR_MESH, true);
+  for(int i = 0; i < NUM_BODIES; ++i)
+  {
+    PhysModel* body = new PhysModel(mesh, Material(), 1.0f, glm::vec3(i * 0.6f - 1.2f, 1.0f + 0.3f * i, 0.0f));
+    body->scale(GENERATOR_RADIUS);
+    body->setCollider(colliderTypes[i], glm::vec3(1.0f, 1.0f, 1.0f));
+    for(int j = 0; j < gravityCounts[i]; ++j)
+    {
+      GravitationalForce::create(body);
+    }
+    scene->add(body);
+  }
+  SceneGenerator::chains(scene, mesh, Material(), 2, 8, floor->getPosition() + glm::vec3(0.0f, 3.0f, 0.0f), SEED);
+}
+
+// Where the int32 values given start in the buffer, or -1
+static long find(const std::vector<char>& buffer, const int* values, int count)
+{
+  std::vector<int32_t> pattern(values, values + count);
+  size_t size = pattern.size() * sizeof(int32_t);
+  for(size_t i = 0; i + size <= buffer.size(); ++i)
+  {
+    if(memcmp(&buffer[i], pattern.data(), size) == 0)
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static void setInt(std::vector<char>* buffer, long offset, int32_t value)
+{
+  memcpy(&(*buffer)[offset], &value, sizeof(value));
+}
+
+static bool loads(const std::vector<char>& buffer, size_t size)
+{
+  Scene scene;
+  bool loaded = Snapshot::load(buffer.data(), size, &scene);
+  // Nothing may be added from a snapshot that was turned away
+  CHECK(loaded || (scene.getNumSceneObjects() == 0 && scene.getNumPhysObjects() == 0));
+  return loaded;
+}
+
+static void testRoundTrip(const std::vector<char>& buffer, Scene* original, int step)
+{
+  Scene loaded;
+  loaded.setDeterministic(true, SEED);
+  CHECK(Snapshot::load(buffer.data(), buffer.size(), &loaded));
+  CHECK(loaded.getNumPhysObjects() == original->getNumPhysObjects());
+  CHECK(loaded.getNumSceneObjects() == original->getNumSceneObjects());
+  CHECK(loaded.getIntegrator() == original->getIntegrator());
+
+  for(int i = 0; i < NUM_BODIES; ++i)
+  {
+    PhysModel* body = loaded.getPhysObject(i);
+    CHECK(body->getColliderType() == colliderTypes[i]);
+    CHECK(body->getGravityCount() == gravityCounts[i]);
+  }
+
+  // Saved again straight away, it's the same snapshot
+  std::vector<char> again;
+  Snapshot::save(&loaded, &again);
+  CHECK(again == buffer);
+
+  // And both carry on the same
+  bool same = true;
+  for(int i = 0; i < 60; ++i, ++step)
+  {
+    original->step(step * STEP_DT, STEP_DT);
+    loaded.step(step * STEP_DT, STEP_DT);
+    same = same && original->getStateHash() == loaded.getStateHash();
+  }
+  CHECK(same);
+}
+
+static void testDamaged(const std::vector<char>& buffer)
+{
+  CHECK(loads(buffer, buffer.size()));
+
+  // Cut short anywhere
+  bool turnedAway = true;
+  for(size_t size = 0; size < buffer.size(); size += 1 + size / 16)
+  {
+    turnedAway = turnedAway && !loads(buffer, size);
+  }
+  CHECK(turnedAway);
+
+  std::vector<char> damaged = buffer;
+  setInt(&damaged, 0, 0);
+  CHECK(!loads(damaged, damaged.size()));
+
+  long colliders = find(buffer, colliderTypes, NUM_BODIES);
+  CHECK(colliders >= 0);
+  if(colliders >= 0)
+  {
+    damaged = buffer;
+    setInt(&damaged, colliders + sizeof(int32_t), COLLIDER_BOX + 1);
+    CHECK(!loads(damaged, damaged.size()));
+    setInt(&damaged, colliders + sizeof(int32_t), -1);
+    CHECK(!loads(damaged, damaged.size()));
+  }
+
+  long gravity = find(buffer, gravityCounts, NUM_BODIES);
+  CHECK(gravity >= 0);
+  if(gravity >= 0)
+  {
+    damaged = buffer;
+    setInt(&damaged, gravity, SNAPSHOT_MAX_GRAVITY + 1);
+    CHECK(!loads(damaged, damaged.size()));
+    setInt(&damaged, gravity, 2000000000);
+    CHECK(!loads(damaged, damaged.size()));
+    setInt(&damaged, gravity, -1);
+    CHECK(!loads(damaged, damaged.size()));
+  }
+}
+
+int main()
+{
+  GLBridge::setHeadless(true);
+
+  static const int integrators[] = { INTEGRATOR_RK4, INTEGRATOR_RK45, INTEGRATOR_IMPLICIT_EULER, INTEGRATOR_XPBD };
+  for(int i = 0; i < 4; ++i)
+  {
+    Scene scene;
+    scene.setDeterministic(true, SEED);
+    scene.setIntegrator(integrators[i]);
+    buildScene(&scene);
+
+    // Part way through the fall, with contacts on the ground
+    int step = 0;
+    for(; step < 50; ++step)
+    {
+      scene.step(step * STEP_DT, STEP_DT);
+    }
+
+    std::vector<char> buffer;
+    Snapshot::save(&scene, &buffer);
+    testRoundTrip(buffer, &scene, step);
+    if(i == 0)
+    {
+      testDamaged(buffer);
+    }
+  }
+
+  CHECK_EXIT();
+}
@@ -0,0 +1,68 @@
+/*
+ * SpringNetwork goes stale when, and only when, the springs or scale of one of
+ * the bodies it was built from change.
+ *
+ * Run from the repository root (meshes are loaded by relative path).
+ */
+
+#include <vector>
+
+#include "Check.h"
+#include "../SceneGenerator.h"
+#include "../SpringNetwork.h"
+#include "../TwoWaySpringForce.h"
+
+static std::vector<PhysModel*> makeBodies(Mesh* mesh, int count)
+{
+  std::vector<PhysModel*> bodies;
+  for(int i = 0; i < count; ++i)
+  {
+    bodies.push_back(new PhysModel(mesh, Material(), 1.0f, glm::vec3(i, 0.0f, 0.0f)));
+  }
+  return bodies;
+}
+
+int main()
+{
+  GLBridge::setHeadless(true);
+
+  Mesh* mesh = Mesh::load(GENERATOR_MESH, true);
+  std::vector<PhysModel*> bodies = makeBodies(mesh, 3);
+  std::vector<PhysModel*> others = makeBodies(mesh, 2);
+  TwoWaySpringForce::create(bodies[0], bodies[1], 4.0f, 0.5f, glm::vec3(0.5f, 0.0f, 0.0f), glm::vec3(), 1.0f);
+
+  SpringNetwork network;
+  CHECK(network.isStale(bodies));
+  network.build(bodies);
+  CHECK(!network.isStale(bodies));
+  CHECK(network.getSprings().size() == 1);
+  CHECK(network.getSprings()[0].offsetA == glm::vec3(0.5f, 0.0f, 0.0f));
+
+  // Springs between bodies it wasn't built from (another scene's) leave it be
+  TwoWaySpringForce* elsewhere = TwoWaySpringForce::create(others[0], others[1], 4.0f, 0.5f, glm::vec3(), glm::vec3(), 1.0f);
+  CHECK(!network.isStale(bodies));
+  delete elsewhere;
+  CHECK(!network.isStale(bodies));
+
+  // Its own bodies' springs do
+  TwoWaySpringForce* added = TwoWaySpringForce::create(bodies[1], bodies[2], 4.0f, 0.5f, glm::vec3(), glm::vec3(), 1.0f);
+  CHECK(network.isStale(bodies));
+  network.build(bodies);
+  CHECK(network.getSprings().size() == 2);
+  delete added;
+  CHECK(network.isStale(bodies));
+  network.build(bodies);
+  CHECK(network.getSprings().size() == 1);
+
+  // And so does a rescale, as the network keeps attach offsets scaled
+  bodies[0]->scale(2.0f);
+  CHECK(network.isStale(bodies));
+  network.build(bodies);
+  CHECK(!network.isStale(bodies));
+  CHECK(network.getSprings()[0].offsetA == glm::vec3(0.5f, 0.0f, 0.0f) * bodies[0]->getScale());
+
+  network.invalidate();
+  CHECK(network.isStale(bodies));
+
+  CHECK_EXIT();
+}
@@ -0,0 +1,294 @@
+/*
+ * Trajectory files: the varint and quantizing helpers, a recording read back
+ * frame by frame and out of order, damaged files, and playback's playhead.
+ *
+ * Run from the repository root (meshes are loaded by relative path).
+ */
+
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+#include "Check.h"
+#include "../Random.h"
+#include "../Scene.h"
+#include "../SceneGenerator.h"
+#include "../TrajectoryPlayer.h"
+#include "../TrajectoryReader.h"
+#include "../TrajectoryRecorder.h"
+
+#define NUM_BODIES 20
+#define NUM_FRAMES 200
+#define FEWER_FROM 150 // Frames from here on leave the last body out
+#define KEYFRAME_INTERVAL 16
+#define FRAME_TIME (1.0 / 60.0)
+
+static void testVarints()
+{
+  static const uint32_t unsignedValues[] = { 0, 1, 127, 128, 16383, 16384, 0x7FFFFFFF, 0xFFFFFFFF };
+  static const int32_t signedValues[] = { 0, 1, -1, 63, -64, 64, 0x7FFFFFFF, (int32_t)0x80000000 };
+  // Seven bits a byte; small values of either sign take one
+  static const size_t sizes[] = { 1, 1, 1, 1, 1, 1, 2, 1, 2, 1, 3, 2, 5, 5, 5, 5 };
+  std::vector<unsigned char> buffer;
+  bool sized = true;
+  for(int i = 0; i < 8; ++i)
+  {
+    size_t before = buffer.size();
+    putVarint(unsignedValues[i], &buffer);
+    sized = sized && buffer.size() - before == sizes[2 * i];
+    before = buffer.size();
+    putSigned(signedValues[i], &buffer);
+    sized = sized && buffer.size() - before == sizes[2 * i + 1];
+  }
+  CHECK(sized);
+
+  const unsigned char* data = buffer.data();
+  const unsigned char* end = data + buffer.size();
+  bool same = true;
+  for(int i = 0; i < 8; ++i)
+  {
+    uint32_t u;
+    int32_t s;
+    same = same && getVarint(&data, end, &u) && u == unsignedValues[i];
+    same = same && getSigned(&data, end, &s) && s == signedValues[i];
+  }
+  CHECK(same);
+  CHECK(data == end);
+
+  // Cut off mid-number, and too long to be a uint32_t
+  uint32_t value;
+  unsigned char cut[] = { 0x80, 0x80 };
+  data = cut;
+  CHECK(!getVarint(&data, cut + 2, &value));
+  unsigned char tooLong[] = { 0x80, 0x80, 0x80, 0x80, 0x80, 0x01 };
+  data = tooLong;
+  CHECK(!getVarint(&data, tooLong + 6, &value));
+}
+
+static void testQuantize()
+{
+  Random random(7);
+  float worstPosition = 0.0f, worstOrientation = 0.0f;
+  for(int i = 0; i < 10000; ++i)
+  {
+    glm::vec3 position = random.nextVec3(-100.0f, 100.0f);
+    glm::quat orientation = glm::normalize(glm::quat(random.nextFloat(-1.0f, 1.0f), random.nextVec3(-1.0f, 1.0f)));
+    float p[3] = { position.x, position.y, position.z };
+    float q[4] = { orientation.w, orientation.x, orientation.y, orientation.z };
+
+    int32_t values[TRAJECTORY_COMPONENTS];
+    quantizePose(p, q, TRAJECTORY_DEFAULT_QUANTUM, values);
+    CHECK(values[3] >= 0);
+    dequantizePose(values, TRAJECTORY_DEFAULT_QUANTUM, p, q);
+
+    float positionError = glm::length(glm::vec3(p[0], p[1], p[2]) - position);
+    // q and -q are the same turn
+    float orientationError = 1.0f - fabsf(glm::dot(glm::normalize(glm::quat(q[0], q[1], q[2], q[3])), orientation));
+    worstPosition = positionError > worstPosition ? positionError : worstPosition;
+    worstOrientation = orientationError > worstOrientation ? orientationError : worstOrientation;
+  }
+  // Half a quantum on each axis, plus float rounding at 100 units
+  CHECK(worstPosition <= TRAJECTORY_DEFAULT_QUANTUM);
+  CHECK(worstOrientation <= 1e-6f);
+}
+
+// The pose every body is recorded at in a frame. Some bodies never move, to
+// give frames bodies to skip.
+static PhysState poseAt(PhysState state, int body, int frame)
+{
+  float t = (body % 3 == 0) ? 0.0f : frame * (float)FRAME_TIME * (1 + body % 5);
+  state.position = glm::vec3(body - 10.0f + sinf(t), 1.0f + body * 0.1f + t * t, cosf(t));
+  state.orientation = glm::angleAxis(t * 90.0f, glm::normalize(glm::vec3(1.0f, body, 2.0f)));
+  return state;
+}
+
+static void record(const char* path, const std::vector<PhysModel*>& bodies)
+{
+  TrajectoryRecorder recorder;
+  CHECK(recorder.open(path, TRAJECTORY_DEFAULT_QUANTUM, KEYFRAME_INTERVAL));
+  std::vector<PhysModel*> fewer(bodies.begin(), bodies.end() - 1);
+  for(int frame = 0; frame < NUM_FRAMES; ++frame)
+  {
+    for(int i = 0; i < NUM_BODIES; ++i)
+    {
+      bodies[i]->restore(poseAt(bodies[i]->getState(), i, frame), false, 0);
+    }
+    recorder.record(frame * FRAME_TIME, frame < FEWER_FROM ? bodies : fewer);
+  }
+  recorder.close();
+  CHECK(!recorder.hasFailed());
+  CHECK(recorder.getNumFrames() == NUM_FRAMES);
+}
+
+// Whether the reader has frame as recorded
+static bool matches(TrajectoryReader* reader, const std::vector<PhysModel*>& bodies, int frame)
+{
+  uint32_t numBodies = frame < FEWER_FROM ? NUM_BODIES : NUM_BODIES - 1;
+  bool same = reader->getFrame() == (uint32_t)frame && reader->getTime() == frame * FRAME_TIME
+              && reader->getNumBodies() == numBodies;
+  for(uint32_t i = 0; same && i < numBodies; ++i)
+  {
+    PhysState expected = poseAt(bodies[i]->getState(), i, frame);
+    glm::vec3 position;
+    glm::quat orientation;
+    reader->getPose(i, &position, &orientation);
+    same = glm::length(position - expected.position) <= TRAJECTORY_DEFAULT_QUANTUM
+           && fabsf(glm::dot(orientation, glm::normalize(expected.orientation))) >= 1.0f - 1e-6f;
+  }
+  return same;
+}
+
+static void testRoundTrip(const char* path, const std::vector<PhysModel*>& bodies)
+{
+  TrajectoryReader reader;
+  CHECK(reader.open(path));
+  CHECK(reader.getNumFrames() == NUM_FRAMES);
+  // A chunk every KEYFRAME_INTERVAL frames, and one more where the body
+  // count changes part way through one
+  CHECK(reader.getNumKeyframes() == (NUM_FRAMES + KEYFRAME_INTERVAL - 1) / KEYFRAME_INTERVAL + 1);
+  CHECK(reader.getKeyframe(reader.findKeyframe(FEWER_FROM)) == FEWER_FROM);
+  CHECK(reader.getKeyframe(reader.findKeyframe(KEYFRAME_INTERVAL + 3)) == KEYFRAME_INTERVAL);
+
+  bool same = true;
+  for(int frame = 0; frame < NUM_FRAMES; ++frame)
+  {
+    same = same && (frame == 0 ? reader.seek(0) : reader.next()) && matches(&reader, bodies, frame);
+  }
+  CHECK(same);
+  CHECK(!reader.next());
+
+  // Out of order, backwards and within a chunk
+  Random random(3);
+  same = true;
+  for(int i = 0; i < 500; ++i)
+  {
+    int frame = random.next() % NUM_FRAMES;
+    same = same && reader.seek(frame) && matches(&reader, bodies, frame);
+  }
+  CHECK(same);
+  CHECK(!reader.seek(NUM_FRAMES));
+}
+
+static std::vector<char> readFile(const char* path)
+{
+  std::vector<char> data;
+  FILE* file = fopen(path, "rb");
+  char buffer[4096];
+  size_t size;
+  while(file && (size = fread(buffer, 1, sizeof(buffer), file)) > 0)
+  {
+    data.insert(data.end(), buffer, buffer + size);
+  }
+  if(file)
+  {
+    fclose(file);
+  }
+  return data;
+}
+
+static void writeFile(const char* path, const std::vector<char>& data)
+{
+  FILE* file = fopen(path, "wb");
+  fwrite(data.data(), 1, data.size(), file);
+  fclose(file);
+}
+
+static void testDamaged(const char* path, const char* damagedPath)
+{
+  std::vector<char> data = readFile(path);
+  TrajectoryReader reader;
+  CHECK(reader.open(path));
+  int numKeyframes = reader.getNumKeyframes();
+  uint32_t lastKeyframe = reader.getKeyframe(numKeyframes - 1);
+
+  // A recording cut off part way keeps its whole chunks
+  std::vector<char> cut(data.begin(), data.end() - 10);
+  writeFile(damagedPath, cut);
+  CHECK(reader.open(damagedPath));
+  CHECK(reader.getNumKeyframes() == numKeyframes - 1);
+  CHECK(reader.getNumFrames() == lastKeyframe);
+  CHECK(reader.seek(lastKeyframe - 1));
+
+  // Not a trajectory at all
+  std::vector<char> header(data.begin(), data.begin() + sizeof(TrajectoryHeader));
+  header[0] ^= 1;
+  writeFile(damagedPath, header);
+  CHECK(!reader.open(damagedPath));
+
+  // A chunk claiming more bodies than its payload could hold is refused
+  // rather than sized to
+  std::vector<char> damaged = data;
+  uint32_t numBodies = 0x7FFFFFFF;
+  memcpy(&damaged[sizeof(TrajectoryHeader) + offsetof(TrajectoryChunkHeader, numBodies)], &numBodies, sizeof(numBodies));
+  writeFile(damagedPath, damaged);
+  CHECK(reader.open(damagedPath));
+  CHECK(!reader.seek(0));
+  CHECK(reader.getNumBodies() == 0);
+  CHECK(reader.seek(KEYFRAME_INTERVAL));
+}
+
+static void testPlayer(const char* path, const std::vector<PhysModel*>& bodies)
+{
+  TrajectoryPlayer player;
+  CHECK(player.open(path));
+  CHECK(player.getNumFrames() == NUM_FRAMES);
+
+  Scene scene;
+  for(int i = 0; i < NUM_BODIES; ++i)
+  {
+    scene.add(bodies[i]);
+  }
+
+  // Half way between two frames
+  player.seek(10.5);
+  CHECK(fabsf(player.apply(&scene) - 0.5f) < 1e-6f);
+  CHECK(fabs(player.getTime() - 10.5 * FRAME_TIME) < 1e-9);
+
+  // Keyframes either side
+  player.seekKeyframe(true);
+  CHECK(player.getPlayhead() == KEYFRAME_INTERVAL);
+  player.seekKeyframe(false);
+  CHECK(player.getPlayhead() == 0.0);
+
+  // Played at double speed, and stopping at the end
+  player.setSpeed(2.0f);
+  player.advance(3 * FRAME_TIME);
+  CHECK(fabs(player.getPlayhead() - 6.0) < 1e-9);
+  player.advance(NUM_FRAMES * FRAME_TIME);
+  CHECK(player.getPlayhead() == NUM_FRAMES - 1);
+  CHECK(player.isPaused());
+  player.apply(&scene);
+  CHECK(fabs(player.getTime() - (NUM_FRAMES - 1) * FRAME_TIME) < 1e-9);
+}
+
+int main()
+{
+  GLBridge::setHeadless(true);
+
+  testVarints();
+  testQuantize();
+
+  char path[64], damagedPath[64];
+  snprintf(path, sizeof(path), "/tmp/trajectory_test_%d.trj", (int)getpid());
+  snprintf(damagedPath, sizeof(damagedPath), "/tmp/trajectory_test_%d_damaged.trj", (int)getpid());
+
+  Mesh* mesh = Mesh::load(GENERATOR_MESH, true);
+  std::vector<PhysModel*> bodies;
+  for(int i = 0; i < NUM_BODIES; ++i)
+  {
+    bodies.push_back(new PhysModel(mesh, Material()));
+  }
+
+  record(path, bodies);
+  testRoundTrip(path, bodies);
+  testDamaged(path, damagedPath);
+  testPlayer(path, bodies);
+
+  unlink(path);
+  unlink(damagedPath);
+
+  CHECK_EXIT();
+}
@@ -0,0 +1,123 @@
+#include "ThreadPool.h"
+#include "Memory.h"
+
+ThreadPool::ThreadPool(int numThreads)
+{
+  if(numThreads <= 0)
+  {
+    numThreads = std::thread::hardware_concurrency();
+  }
+  
+  generation = 0;
+  pending = 0;
+  quitting = false;
+  function = NULL;
+  context = NULL;
+  count = grain = 0;
+  next = 0;
+  tag = MEMORY_OTHER;
+  
+  // The caller counts as one of the threads
+  for(int i = 1; i < numThreads; ++i)
+  {
+    workers.push_back(std::thread(&ThreadPool::work, this));
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    quitting = true;
+  }
+  wake.notify_all();
+  
+  for(size_t i = 0; i < workers.size(); ++i)
+  {
+    workers[i].join();
+  }
+}
+
+ThreadPool* ThreadPool::shared()
+{
+  static ThreadPool pool;
+  return &pool;
+}
+
+void ThreadPool::parallelFor(size_t count, size_t grain, ParallelFunction function, void* context)
+{
+  if(grain == 0)
+  {
+    grain = 1;
+  }
+  
+  if(count <= grain || workers.empty())
+  {
+    function(context, 0, count);
+    return;
+  }
+  
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->function = function;
+    this->context = context;
+    this->count = count;
+    this->grain = grain;
+    next = 0;
+    tag = Memory::getTag();
+    pending = workers.size();
+    ++generation;
+  }
+  wake.notify_all();
+  
+  runChunks();
+  
+  // Every worker has to check in before the loop's state can be reused
+  std::unique_lock<std::mutex> lock(mutex);
+  while(pending > 0)
+  {
+    done.wait(lock);
+  }
+}
+
+void ThreadPool::runChunks()
+{
+  size_t begin;
+  while((begin = next.fetch_add(grain)) < count)
+  {
+    size_t end = begin + grain < count ? begin + grain : count;
+    function(context, begin, end);
+  }
+}
+
+void ThreadPool::work()
+{
+  unsigned long seen = 0;
+  while(true)
+  {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      while(!quitting && generation == seen)
+      {
+        wake.wait(lock);
+      }
+      
+      if(quitting)
+      {
+        return;
+      }
+      seen = generation;
+    }
+    
+    MemoryScope scope(tag);
+    runChunks();
+    
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if(--pending == 0)
+      {
+        done.notify_one();
+      }
+    }
+  }
+}
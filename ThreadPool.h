@@ -0,0 +1,52 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Processes items [begin, end) of a parallel loop
+typedef void (*ParallelFunction)(void* context, size_t begin, size_t end);
+
+// A fixed set of worker threads for data-parallel loops. The calling thread
+// takes part in the work, and parallelFor() only returns once every item has
+// been processed. Only one thread may issue loops at a time.
+class ThreadPool
+{
+private:
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable wake, done;
+  unsigned long generation;
+  int pending;
+  bool quitting;
+  
+  // Current loop
+  ParallelFunction function;
+  void* context;
+  size_t count, grain;
+  std::atomic<size_t> next;
+  int tag; // The caller's MEMORY_ tag, which the workers allocate under too
+  
+  void work();
+  void runChunks();
+
+public:
+  // Zero threads means one per hardware thread, counting the caller
+  ThreadPool(int numThreads = 0);
+  ~ThreadPool();
+  
+  // Splits [0, count) into chunks of grain items. Loops no bigger than one chunk
+  // run inline on the caller.
+  void parallelFor(size_t count, size_t grain, ParallelFunction function, void* context);
+  int getNumThreads()
+  {
+    return workers.size() + 1;
+  }
+  
+  static ThreadPool* shared();
+};
+
+#endif
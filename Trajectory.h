@@ -0,0 +1,121 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include <stdint.h>
+#include <cmath>
+#include <vector>
+
+#define TRAJECTORY_MAGIC 0x4A525454u        // "TTRJ" in a little-endian file
+#define TRAJECTORY_CHUNK_MAGIC 0x4B4E4843u  // "CHNK"
+#define TRAJECTORY_VERSION 1
+#define TRAJECTORY_COMPONENTS 7             // Position, then orientation w, x, y, z
+#define TRAJECTORY_ORIENTATION_SCALE 32767.0f
+
+#define TRAJECTORY_DEFAULT_QUANTUM 0.0001f  // Positions are kept to a tenth of a millimetre
+#define TRAJECTORY_DEFAULT_KEYFRAME_INTERVAL 64
+
+// A trajectory file is this header followed by chunks, each a chunk header
+// and its payload. The first frame of every chunk is a keyframe holding every
+// body's pose outright; the others hold only the change since the frame
+// before, so any frame can be rebuilt from its chunk alone.
+struct TrajectoryHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  float quantum;             // Position step, in world units
+  uint32_t keyframeInterval; // Frames per chunk
+};
+
+struct TrajectoryChunkHeader
+{
+  uint32_t magic;
+  uint32_t firstFrame;
+  uint32_t numFrames;
+  uint32_t numBodies;        // The same for every frame in the chunk
+  uint32_t payloadSize;
+};
+
+// Frames in a payload start with their time as a raw double. A keyframe then
+// has the TRAJECTORY_COMPONENTS quantized values of each body in turn. Other
+// frames have, for each body that moved, the number of bodies skipped since
+// the last one that did, then its changes; the frame ends with a skip past the
+// last body. Every number is a little-endian base-128 varint, signed ones
+// zigzag encoded, so a body at rest costs nothing and a slow one a few bytes.
+
+// Position in quanta, and orientation with w made non-negative (q and -q are
+// the same turn) in steps of 1/TRAJECTORY_ORIENTATION_SCALE
+inline void quantizePose(const float* position, const float* orientation, float quantum, int32_t* values)
+{
+  float sign = orientation[0] < 0.0f ? -1.0f : 1.0f;
+  for(int i = 0; i < 3; ++i)
+  {
+    values[i] = (int32_t)lrintf(position[i] / quantum);
+  }
+  for(int i = 0; i < 4; ++i)
+  {
+    values[3 + i] = (int32_t)lrintf(sign * orientation[i] * TRAJECTORY_ORIENTATION_SCALE);
+  }
+}
+
+inline void dequantizePose(const int32_t* values, float quantum, float* position, float* orientation)
+{
+  for(int i = 0; i < 3; ++i)
+  {
+    position[i] = values[i] * quantum;
+  }
+  for(int i = 0; i < 4; ++i)
+  {
+    orientation[i] = values[3 + i] / TRAJECTORY_ORIENTATION_SCALE;
+  }
+}
+
+inline void putVarint(uint32_t value, std::vector<unsigned char>* buffer)
+{
+  while(value >= 0x80)
+  {
+    buffer->push_back((unsigned char)(value | 0x80));
+    value >>= 7;
+  }
+  buffer->push_back((unsigned char)value);
+}
+
+inline void putSigned(int32_t value, std::vector<unsigned char>* buffer)
+{
+  putVarint(((uint32_t)value << 1) ^ (uint32_t)(value >> 31), buffer);
+}
+
+// Return false rather than read past end
+inline bool getVarint(const unsigned char** data, const unsigned char* end, uint32_t* value)
+{
+  *value = 0;
+  for(int shift = 0; shift < 35; shift += 7)
+  {
+    if(*data == end)
+    {
+      return false;
+    }
+    
+    unsigned char byte = *(*data)++;
+    *value |= (uint32_t)(byte & 0x7F) << shift;
+    if(!(byte & 0x80))
+    {
+      return true;
+    }
+  }
+  
+  return false;
+}
+
+inline bool getSigned(const unsigned char** data, const unsigned char* end, int32_t* value)
+{
+  uint32_t encoded;
+  if(!getVarint(data, end, &encoded))
+  {
+    return false;
+  }
+  
+  *value = (int32_t)(encoded >> 1) ^ -(int32_t)(encoded & 1);
+  return true;
+}
+
+#endif
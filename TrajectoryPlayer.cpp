@@ -0,0 +1,177 @@
+#include "TrajectoryPlayer.h"
+
+#include <algorithm>
+#include <cmath>
+
+#define PLAYER_DEFAULT_FRAME_TIME (1.0 / 60.0)
+
+TrajectoryPlayer::TrajectoryPlayer()
+{
+  playhead = 0.0;
+  frameTime = PLAYER_DEFAULT_FRAME_TIME;
+  speed = 1.0f;
+  paused = false;
+  fromFrame = (uint32_t)-1;
+  fromTime = toTime = 0.0;
+}
+
+bool TrajectoryPlayer::open(const char* path)
+{
+  fromFrame = (uint32_t)-1;
+  if(!reader.open(path) || reader.getNumFrames() == 0)
+  {
+    return false;
+  }
+  
+  // Frames are a step apart, and steps are all the same length
+  frameTime = PLAYER_DEFAULT_FRAME_TIME;
+  if(reader.getNumFrames() > 1 && reader.seek(0))
+  {
+    double start = reader.getTime();
+    if(reader.seek(1) && reader.getTime() > start)
+    {
+      frameTime = reader.getTime() - start;
+    }
+  }
+  
+  playhead = 0.0;
+  paused = false;
+  return true;
+}
+
+void TrajectoryPlayer::advance(double seconds)
+{
+  if(paused || reader.getNumFrames() == 0)
+  {
+    return;
+  }
+  
+  double last = reader.getNumFrames() - 1;
+  playhead += seconds * speed / frameTime;
+  if(playhead <= 0.0 || playhead >= last)
+  {
+    playhead = std::max(0.0, std::min(playhead, last));
+    paused = true;
+  }
+}
+
+void TrajectoryPlayer::seek(double frame)
+{
+  if(reader.getNumFrames() > 0)
+  {
+    playhead = std::max(0.0, std::min(frame, (double)(reader.getNumFrames() - 1)));
+  }
+}
+
+void TrajectoryPlayer::seekKeyframe(bool forward)
+{
+  if(reader.getNumFrames() == 0)
+  {
+    return;
+  }
+  
+  int keyframe = reader.findKeyframe((uint32_t)playhead);
+  if(forward)
+  {
+    playhead = keyframe + 1 < reader.getNumKeyframes() ? reader.getKeyframe(keyframe + 1) : reader.getNumFrames() - 1;
+  }
+  else if(playhead > reader.getKeyframe(keyframe) || keyframe == 0)
+  {
+    playhead = reader.getKeyframe(keyframe);
+  }
+  else
+  {
+    playhead = reader.getKeyframe(keyframe - 1);
+  }
+}
+
+void TrajectoryPlayer::setSpeed(float speed)
+{
+  float magnitude = std::max(PLAYER_MIN_SPEED, std::min(fabsf(speed), PLAYER_MAX_SPEED));
+  this->speed = speed < 0.0f ? -magnitude : magnitude;
+}
+
+double TrajectoryPlayer::getTime()
+{
+  if(fromFrame == (uint32_t)-1)
+  {
+    return 0.0;
+  }
+  
+  return fromTime + (toTime - fromTime) * std::max(0.0, std::min(playhead - fromFrame, 1.0));
+}
+
+void TrajectoryPlayer::readPoses(std::vector<glm::vec3>* positions, std::vector<glm::quat>* orientations)
+{
+  uint32_t numBodies = reader.getNumBodies();
+  positions->resize(numBodies);
+  orientations->resize(numBodies);
+  for(uint32_t i = 0; i < numBodies; ++i)
+  {
+    reader.getPose(i, &(*positions)[i], &(*orientations)[i]);
+  }
+}
+
+bool TrajectoryPlayer::load(uint32_t frame)
+{
+  if(frame == fromFrame)
+  {
+    return true;
+  }
+  
+  // Playing forwards, the next frame is already decoded, and the reader only
+  // has to decode one more after it
+  if(fromFrame != (uint32_t)-1 && frame == fromFrame + 1)
+  {
+    fromPositions.swap(toPositions);
+    fromOrientations.swap(toOrientations);
+    fromTime = toTime;
+  }
+  else
+  {
+    if(!reader.seek(frame))
+    {
+      fromFrame = (uint32_t)-1;
+      return false;
+    }
+    readPoses(&fromPositions, &fromOrientations);
+    fromTime = reader.getTime();
+  }
+  fromFrame = frame;
+  
+  if(frame + 1 < reader.getNumFrames() && reader.seek(frame + 1))
+  {
+    readPoses(&toPositions, &toOrientations);
+    toTime = reader.getTime();
+  }
+  else
+  {
+    toPositions = fromPositions;
+    toOrientations = fromOrientations;
+    toTime = fromTime;
+  }
+  
+  return true;
+}
+
+float TrajectoryPlayer::apply(Scene* scene)
+{
+  if(reader.getNumFrames() == 0)
+  {
+    return 0.0f;
+  }
+  
+  uint32_t frame = std::min((uint32_t)playhead, reader.getNumFrames() - 1);
+  if(!load(frame))
+  {
+    return 0.0f;
+  }
+  
+  size_t numBodies = std::min((size_t)scene->getNumPhysObjects(), std::min(fromPositions.size(), toPositions.size()));
+  for(size_t i = 0; i < numBodies; ++i)
+  {
+    scene->getPhysObject(i)->setDrawnPoses(fromPositions[i], fromOrientations[i], toPositions[i], toOrientations[i]);
+  }
+  
+  return (float)(playhead - frame);
+}
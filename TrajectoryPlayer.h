@@ -0,0 +1,78 @@
+#ifndef TRAJECTORY_PLAYER_H
+#define TRAJECTORY_PLAYER_H
+
+#include <vector>
+
+#include "Scene.h"
+#include "TrajectoryReader.h"
+
+#define PLAYER_MIN_SPEED 0.0625f
+#define PLAYER_MAX_SPEED 16.0f
+
+// Plays a recorded trajectory back onto a scene's bodies, in place of
+// stepping it. The playhead is a fractional frame; the frames either side of
+// it are decoded and handed to the bodies to draw between, so playback is
+// smooth at any speed and frame rate. Bodies are matched to the recording by
+// index, so the scene should be built the way the recorded one was (from the
+// same snapshot or seed).
+class TrajectoryPlayer
+{
+private:
+  TrajectoryReader reader;
+  double playhead;
+  double frameTime;  // Recorded time between frames
+  float speed;
+  bool paused;
+  
+  // The decoded frames either side of the playhead
+  uint32_t fromFrame;
+  double fromTime, toTime;
+  std::vector<glm::vec3> fromPositions, toPositions;
+  std::vector<glm::quat> fromOrientations, toOrientations;
+  
+  void readPoses(std::vector<glm::vec3>* positions, std::vector<glm::quat>* orientations);
+  bool load(uint32_t frame);
+
+public:
+  TrajectoryPlayer();
+  
+  bool open(const char* path);
+  
+  // Moves the playhead on by an amount of real time, stopping at either end
+  void advance(double seconds);
+  // Moves the playhead to a frame, which needn't be whole (for scrubbing)
+  void seek(double frame);
+  // Jumps to the keyframe before the playhead, or the one after it
+  void seekKeyframe(bool forward);
+  
+  // Poses the scene's bodies at the playhead, returning how far it is from one
+  // frame to the next, to draw the scene with
+  float apply(Scene* scene);
+  
+  // Negative speeds play backwards
+  void setSpeed(float speed);
+  float getSpeed()
+  {
+    return speed;
+  }
+  void setPaused(bool paused)
+  {
+    this->paused = paused;
+  }
+  bool isPaused()
+  {
+    return paused;
+  }
+  double getPlayhead()
+  {
+    return playhead;
+  }
+  uint32_t getNumFrames()
+  {
+    return reader.getNumFrames();
+  }
+  // Recorded time at the playhead, as of the last apply
+  double getTime();
+};
+
+#endif
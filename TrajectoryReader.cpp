@@ -0,0 +1,221 @@
+#include "TrajectoryReader.h"
+
+#include <cstring>
+
+TrajectoryReader::TrajectoryReader()
+{
+  numFrames = 0;
+  chunkIndex = -1;
+  payload = NULL;
+  cursor = 0;
+  frame = (uint32_t)-1;
+  time = 0.0;
+}
+
+TrajectoryReader::~TrajectoryReader()
+{
+  close();
+}
+
+bool TrajectoryReader::open(const char* path)
+{
+  close();
+  
+  if(!file.open(path) || file.getSize() < sizeof(header))
+  {
+    close();
+    return false;
+  }
+  
+  memcpy(&header, file.getData(), sizeof(header));
+  if(header.magic != TRAJECTORY_MAGIC || header.version != TRAJECTORY_VERSION || !(header.quantum > 0.0f))
+  {
+    close();
+    return false;
+  }
+  
+  // Hop over the payloads, stopping at the first chunk that isn't all there
+  size_t size = file.getSize();
+  size_t offset = sizeof(header);
+  while(size - offset >= sizeof(TrajectoryChunkHeader))
+  {
+    TrajectoryChunkHeader chunkHeader;
+    memcpy(&chunkHeader, file.getData() + offset, sizeof(chunkHeader));
+    offset += sizeof(chunkHeader);
+    if(chunkHeader.magic != TRAJECTORY_CHUNK_MAGIC || chunkHeader.firstFrame != numFrames
+       || chunkHeader.numFrames == 0 || chunkHeader.payloadSize > size - offset)
+    {
+      break;
+    }
+    
+    TrajectoryChunk chunk;
+    chunk.firstFrame = chunkHeader.firstFrame;
+    chunk.numFrames = chunkHeader.numFrames;
+    chunk.numBodies = chunkHeader.numBodies;
+    chunk.payloadSize = chunkHeader.payloadSize;
+    chunk.offset = offset;
+    chunks.push_back(chunk);
+    
+    numFrames += chunk.numFrames;
+    offset += chunk.payloadSize;
+  }
+  
+  return true;
+}
+
+void TrajectoryReader::close()
+{
+  file.close();
+  chunks.clear();
+  numFrames = 0;
+  chunkIndex = -1;
+  payload = NULL;
+  frame = (uint32_t)-1;
+  values.clear();
+}
+
+int TrajectoryReader::findChunk(uint32_t frame)
+{
+  int low = 0, high = chunks.size() - 1;
+  while(low < high)
+  {
+    int middle = (low + high + 1) / 2;
+    if(chunks[middle].firstFrame <= frame)
+    {
+      low = middle;
+    }
+    else
+    {
+      high = middle - 1;
+    }
+  }
+  
+  return low;
+}
+
+// Returns false, leaving no chunk loaded, if the chunk claims more bodies
+// than its payload could hold
+bool TrajectoryReader::loadChunk(int index)
+{
+  const TrajectoryChunk& chunk = chunks[index];
+  
+  // A keyframe takes a byte at least for each value after its time, and the
+  // payload was checked against the file size when it was opened
+  if(chunk.payloadSize < sizeof(double)
+     || chunk.numBodies > (chunk.payloadSize - sizeof(double)) / TRAJECTORY_COMPONENTS)
+  {
+    chunkIndex = -1;
+    return false;
+  }
+  
+  chunkIndex = index;
+  payload = file.getData() + chunk.offset;
+  cursor = 0;
+  frame = chunk.firstFrame - 1;
+  values.assign(chunk.numBodies * TRAJECTORY_COMPONENTS, 0);
+  return true;
+}
+
+bool TrajectoryReader::decodeFrame()
+{
+  const unsigned char* data = payload + cursor;
+  const unsigned char* end = payload + chunks[chunkIndex].payloadSize;
+  if(end - data < (long)sizeof(double))
+  {
+    chunkIndex = -1;
+    return false;
+  }
+  memcpy(&time, data, sizeof(double));
+  data += sizeof(double);
+  
+  bool valid = true;
+  if(cursor == 0)
+  {
+    for(size_t i = 0; valid && i < values.size(); ++i)
+    {
+      valid = getSigned(&data, end, &values[i]);
+    }
+  }
+  else
+  {
+    uint32_t numBodies = getNumBodies();
+    uint32_t body = 0;
+    for(;;)
+    {
+      uint32_t skip;
+      if(!getVarint(&data, end, &skip) || skip > numBodies - body)
+      {
+        valid = false;
+        break;
+      }
+      
+      body += skip;
+      if(body == numBodies)
+      {
+        break;
+      }
+      
+      int32_t* value = &values[body * TRAJECTORY_COMPONENTS];
+      for(int c = 0; valid && c < TRAJECTORY_COMPONENTS; ++c)
+      {
+        int32_t delta = 0;
+        valid = getSigned(&data, end, &delta);
+        value[c] = (int32_t)((uint32_t)value[c] + (uint32_t)delta);
+      }
+      if(!valid)
+      {
+        break;
+      }
+      ++body;
+    }
+  }
+  
+  if(!valid)
+  {
+    chunkIndex = -1;
+    return false;
+  }
+  
+  cursor = data - payload;
+  ++frame;
+  return true;
+}
+
+bool TrajectoryReader::seek(uint32_t frame)
+{
+  if(frame >= numFrames)
+  {
+    return false;
+  }
+  
+  // Carry on through the current chunk if the frame is ahead in it, otherwise
+  // start again from the keyframe of the chunk holding it
+  bool ahead = chunkIndex >= 0 && frame > this->frame
+               && frame < chunks[chunkIndex].firstFrame + chunks[chunkIndex].numFrames;
+  if(chunkIndex >= 0 && frame == this->frame)
+  {
+    return true;
+  }
+  if(!ahead && !loadChunk(findChunk(frame)))
+  {
+    return false;
+  }
+  
+  while(this->frame != frame)
+  {
+    if(!decodeFrame())
+    {
+      return false;
+    }
+  }
+  
+  return true;
+}
+
+void TrajectoryReader::getPose(uint32_t body, glm::vec3* position, glm::quat* orientation)
+{
+  float p[3], q[4];
+  dequantizePose(&values[body * TRAJECTORY_COMPONENTS], header.quantum, p, q);
+  *position = glm::vec3(p[0], p[1], p[2]);
+  *orientation = glm::normalize(glm::quat(q[0], q[1], q[2], q[3]));
+}
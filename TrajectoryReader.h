@@ -0,0 +1,102 @@
+#ifndef TRAJECTORY_READER_H
+#define TRAJECTORY_READER_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "glm/glm.hpp"
+#include "glm/gtc/quaternion.hpp"
+#include "MappedFile.h"
+#include "Trajectory.h"
+
+// Where a chunk's payload is in the file
+struct TrajectoryChunk
+{
+  uint32_t firstFrame;
+  uint32_t numFrames;
+  uint32_t numBodies;
+  uint32_t payloadSize;
+  size_t offset;
+};
+
+// Reads a file written by TrajectoryRecorder, mapped into memory. Opening it
+// only touches the chunk headers, hopping from one to the next, to index
+// where each keyframe is; seeking then decodes from the nearest keyframe at or
+// before the frame asked for, and moving forward one frame decodes just that
+// frame. A chunk cut off at the end (by a crash, or a recording still going)
+// is left out.
+class TrajectoryReader
+{
+private:
+  MappedFile file;
+  TrajectoryHeader header;
+  std::vector<TrajectoryChunk> chunks;
+  uint32_t numFrames;
+  
+  // The chunk being decoded and how far into it
+  int chunkIndex;
+  const unsigned char* payload;
+  size_t cursor;
+  uint32_t frame;
+  double time;
+  std::vector<int32_t> values;
+  
+  int findChunk(uint32_t frame);
+  bool loadChunk(int index);
+  bool decodeFrame();
+
+public:
+  TrajectoryReader();
+  ~TrajectoryReader();
+  
+  // Returns false if the file isn't a trajectory this build can read
+  bool open(const char* path);
+  void close();
+  
+  // Decodes a frame, after which its poses can be read. Returns false if it's
+  // out of range or the data is damaged.
+  bool seek(uint32_t frame);
+  bool next()
+  {
+    return seek(frame + 1);
+  }
+  
+  uint32_t getNumFrames()
+  {
+    return numFrames;
+  }
+  // Keyframes are the first frames of the chunks
+  int getNumKeyframes()
+  {
+    return chunks.size();
+  }
+  uint32_t getKeyframe(int index)
+  {
+    return chunks[index].firstFrame;
+  }
+  // The last keyframe at or before a frame, which must be in range
+  int findKeyframe(uint32_t frame)
+  {
+    return findChunk(frame);
+  }
+  uint32_t getFrame()
+  {
+    return frame;
+  }
+  double getTime()
+  {
+    return time;
+  }
+  uint32_t getNumBodies()
+  {
+    return values.size() / TRAJECTORY_COMPONENTS;
+  }
+  // Quantized: see TrajectoryHeader
+  float getQuantum()
+  {
+    return header.quantum;
+  }
+  void getPose(uint32_t body, glm::vec3* position, glm::quat* orientation);
+};
+
+#endif
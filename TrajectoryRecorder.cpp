@@ -0,0 +1,237 @@
+#include "TrajectoryRecorder.h"
+
+#include <cstring>
+
+TrajectoryRecorder::TrajectoryRecorder()
+{
+  file = NULL;
+  quantum = TRAJECTORY_DEFAULT_QUANTUM;
+  keyframeInterval = TRAJECTORY_DEFAULT_KEYFRAME_INTERVAL;
+  numFrames = numStalls = 0;
+  closing = false;
+  bytesWritten = 0;
+  failed = false;
+}
+
+TrajectoryRecorder::~TrajectoryRecorder()
+{
+  close();
+}
+
+bool TrajectoryRecorder::open(const char* path, float quantum, unsigned int keyframeInterval)
+{
+  close();
+  
+  file = fopen(path, "wb");
+  if(!file)
+  {
+    return false;
+  }
+  
+  this->quantum = quantum;
+  this->keyframeInterval = keyframeInterval > 0 ? keyframeInterval : 1;
+  numFrames = numStalls = 0;
+  closing = false;
+  failed = false;
+  
+  TrajectoryHeader header;
+  header.magic = TRAJECTORY_MAGIC;
+  header.version = TRAJECTORY_VERSION;
+  header.quantum = quantum;
+  header.keyframeInterval = this->keyframeInterval;
+  bytesWritten = sizeof(header);
+  if(fwrite(&header, sizeof(header), 1, file) != 1)
+  {
+    failed = true;
+  }
+  
+  chunk.firstFrame = chunk.numFrames = 0;
+  payload.clear();
+  for(size_t i = 0; i < sizeof(frames) / sizeof(frames[0]); ++i)
+  {
+    spare.push(&frames[i]);
+  }
+  
+  writer = std::thread(&TrajectoryRecorder::write, this);
+  return true;
+}
+
+void TrajectoryRecorder::close()
+{
+  if(!file)
+  {
+    return;
+  }
+  
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    closing = true;
+  }
+  wake.notify_one();
+  writer.join();
+  
+  // Leave every frame spare, ready for the next file
+  TrajectoryFrame* frame;
+  while(spare.pop(&frame))
+  {
+    //
+  }
+  
+  if(fclose(file) != 0)
+  {
+    failed = true;
+  }
+  file = NULL;
+}
+
+void TrajectoryRecorder::record(double time, const std::vector<PhysModel*>& bodies)
+{
+  if(!file)
+  {
+    return;
+  }
+  
+  TrajectoryFrame* frame;
+  if(!spare.pop(&frame))
+  {
+    ++numStalls;
+    do
+    {
+      std::this_thread::yield();
+    }
+    while(!spare.pop(&frame));
+  }
+  
+  // Only a copy here; the writer does the rest
+  frame->time = time;
+  frame->poses.resize(bodies.size() * TRAJECTORY_COMPONENTS);
+  float* pose = frame->poses.data();
+  for(size_t i = 0; i < bodies.size(); ++i, pose += TRAJECTORY_COMPONENTS)
+  {
+    const PhysState& state = bodies[i]->getState();
+    pose[0] = state.position.x;
+    pose[1] = state.position.y;
+    pose[2] = state.position.z;
+    pose[3] = state.orientation.w;
+    pose[4] = state.orientation.x;
+    pose[5] = state.orientation.y;
+    pose[6] = state.orientation.z;
+  }
+  
+  // There are fewer frames than places in the queue, so this always fits
+  filled.push(frame);
+  ++numFrames;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+  }
+  wake.notify_one();
+}
+
+void TrajectoryRecorder::write()
+{
+  for(;;)
+  {
+    TrajectoryFrame* frame;
+    if(filled.pop(&frame))
+    {
+      encode(*frame);
+      spare.push(frame);
+      continue;
+    }
+    
+    // Nothing is recorded after closing starts, so an empty queue then is the end
+    std::unique_lock<std::mutex> lock(mutex);
+    if(closing && filled.empty())
+    {
+      break;
+    }
+    while(!closing && filled.empty())
+    {
+      wake.wait(lock);
+    }
+  }
+  
+  writeChunk();
+}
+
+void TrajectoryRecorder::encode(const TrajectoryFrame& frame)
+{
+  uint32_t numBodies = frame.poses.size() / TRAJECTORY_COMPONENTS;
+  if(chunk.numFrames == keyframeInterval || (chunk.numFrames > 0 && numBodies != chunk.numBodies))
+  {
+    writeChunk();
+  }
+  
+  current.resize(frame.poses.size());
+  for(uint32_t i = 0; i < numBodies; ++i)
+  {
+    const float* pose = &frame.poses[i * TRAJECTORY_COMPONENTS];
+    quantizePose(pose, pose + 3, quantum, &current[i * TRAJECTORY_COMPONENTS]);
+  }
+  
+  unsigned char time[sizeof(double)];
+  memcpy(time, &frame.time, sizeof(double));
+  payload.insert(payload.end(), time, time + sizeof(double));
+  
+  if(chunk.numFrames == 0)
+  {
+    chunk.numBodies = numBodies;
+    for(size_t i = 0; i < current.size(); ++i)
+    {
+      putSigned(current[i], &payload);
+    }
+  }
+  else
+  {
+    // Skips run from just past the last body written
+    uint32_t next = 0;
+    for(uint32_t i = 0; i < numBodies; ++i)
+    {
+      const int32_t* now = &current[i * TRAJECTORY_COMPONENTS];
+      const int32_t* before = &previous[i * TRAJECTORY_COMPONENTS];
+      if(memcmp(now, before, TRAJECTORY_COMPONENTS * sizeof(int32_t)) == 0)
+      {
+        continue;
+      }
+      
+      putVarint(i - next, &payload);
+      // Wrapping, so even a jump across the whole range comes back exactly
+      for(int c = 0; c < TRAJECTORY_COMPONENTS; ++c)
+      {
+        putSigned((int32_t)((uint32_t)now[c] - (uint32_t)before[c]), &payload);
+      }
+      next = i + 1;
+    }
+    putVarint(numBodies - next, &payload);
+  }
+  
+  ++chunk.numFrames;
+  previous.swap(current);
+}
+
+void TrajectoryRecorder::writeChunk()
+{
+  if(chunk.numFrames == 0)
+  {
+    return;
+  }
+  
+  chunk.magic = TRAJECTORY_CHUNK_MAGIC;
+  chunk.payloadSize = payload.size();
+  if(!failed)
+  {
+    if(fwrite(&chunk, sizeof(chunk), 1, file) == 1
+       && fwrite(payload.data(), 1, payload.size(), file) == payload.size())
+    {
+      bytesWritten += sizeof(chunk) + payload.size();
+    }
+    else
+    {
+      failed = true;
+    }
+  }
+  
+  chunk.firstFrame += chunk.numFrames;
+  chunk.numFrames = 0;
+  payload.clear();
+}
@@ -0,0 +1,102 @@
+#ifndef TRAJECTORY_RECORDER_H
+#define TRAJECTORY_RECORDER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "PhysModel.h"
+#include "SPSCQueue.h"
+#include "Trajectory.h"
+
+#define TRAJECTORY_QUEUE_CAPACITY 16 // Frames waiting to be written, plus one
+
+// Poses copied out of the scene, TRAJECTORY_COMPONENTS floats per body
+struct TrajectoryFrame
+{
+  double time;
+  std::vector<float> poses;
+};
+
+// Streams the pose of every body after each step to a trajectory file (see
+// Trajectory.h). The stepping thread only copies the poses into one of a
+// fixed set of frames; a writer thread quantizes and encodes them and writes
+// each chunk once it is full. If the writer falls behind, recording waits for
+// a frame to come free rather than using more memory, so memory stays at a
+// few frames plus one chunk however long the run.
+//
+// Bodies are identified by their index in the scene. A frame with a different
+// number of bodies than the one before starts a new chunk, but removing one
+// body and adding another between steps isn't noticed.
+class TrajectoryRecorder
+{
+private:
+  FILE* file;
+  float quantum;
+  unsigned int keyframeInterval;
+  
+  TrajectoryFrame frames[TRAJECTORY_QUEUE_CAPACITY - 1];
+  SPSCQueue<TrajectoryFrame*, TRAJECTORY_QUEUE_CAPACITY> filled; // To the writer
+  SPSCQueue<TrajectoryFrame*, TRAJECTORY_QUEUE_CAPACITY> spare;  // Back again
+  unsigned int numFrames;
+  unsigned int numStalls;
+  
+  std::thread writer;
+  std::mutex mutex;
+  std::condition_variable wake;
+  bool closing;
+  
+  // Writer thread only
+  TrajectoryChunkHeader chunk;
+  std::vector<unsigned char> payload;
+  std::vector<int32_t> previous, current;
+  std::atomic<uint64_t> bytesWritten;
+  std::atomic<bool> failed;
+  
+  void write();
+  void encode(const TrajectoryFrame& frame);
+  void writeChunk();
+
+public:
+  TrajectoryRecorder();
+  ~TrajectoryRecorder();
+  
+  // Starts a new file, quantizing positions to steps of quantum and starting a
+  // chunk every keyframeInterval frames. Returns false if it can't be created.
+  bool open(const char* path, float quantum = TRAJECTORY_DEFAULT_QUANTUM,
+            unsigned int keyframeInterval = TRAJECTORY_DEFAULT_KEYFRAME_INTERVAL);
+  // Writes whatever is still queued and finishes the file
+  void close();
+  
+  // Adds a frame of the bodies' latest poses, at time
+  void record(double time, const std::vector<PhysModel*>& bodies);
+  
+  bool isOpen()
+  {
+    return file != NULL;
+  }
+  unsigned int getNumFrames()
+  {
+    return numFrames;
+  }
+  // Times record had to wait for the writer
+  unsigned int getNumStalls()
+  {
+    return numStalls;
+  }
+  uint64_t getBytesWritten()
+  {
+    return bytesWritten;
+  }
+  // Whether a write has failed; the file stops at the last whole chunk
+  bool hasFailed()
+  {
+    return failed;
+  }
+};
+
+#endif
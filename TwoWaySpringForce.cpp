@@ -1,69 +1,51 @@
 #include "TwoWaySpringForce.h"
 
-TwoWaySpringForce* TwoWaySpringForce::create(PhysModel* target, PhysModel* secondTarget, float k, float b, glm::vec3 attachOffset, glm::vec3 secondAttachOffset)
+DEFINE_POOLED(TwoWaySpringForce, MEMORY_FORCES)
+
+TwoWaySpringForce* TwoWaySpringForce::create(PhysModel* target, PhysModel* secondTarget, float k, float b, glm::vec3 attachOffset, glm::vec3 secondAttachOffset, float restLength)
 {
-  return new TwoWaySpringForce(target, secondTarget, k, b, attachOffset, secondAttachOffset);
+  return new TwoWaySpringForce(target, secondTarget, k, b, attachOffset, secondAttachOffset, restLength);
 }
 
-TwoWaySpringForce::TwoWaySpringForce(PhysModel* target, PhysModel* secondTarget, float k, float b, glm::vec3 attachOffset, glm::vec3 secondAttachOffset)
-  : SpringForce(target, glm::vec3(), k, b, attachOffset)
+TwoWaySpringForce::TwoWaySpringForce(PhysModel* target, PhysModel* secondTarget, float k, float b, glm::vec3 attachOffset, glm::vec3 secondAttachOffset, float restLength)
+  : SpringForce(target)
 {
   this->secondTarget = secondTarget;
   secondTarget->addForce(this);
   
-  this->secondAttachOffset = secondAttachOffset;
-  
-  currentAttachPos = target->getPosition();
-  secondCurrentAttachPos = secondTarget->getPosition();
+  // Only the first body records the spring, so the network sees it once
+  LinkSpring spring;
+  spring.other = secondTarget;
+  spring.attachOffset = attachOffset;
+  spring.otherAttachOffset = secondAttachOffset;
+  spring.k = k;
+  spring.b = b;
+  spring.restLength = restLength;
+  recordIndex = target->addLinkSpring(spring, this);
 }
 
-void TwoWaySpringForce::applyForce(PhysModel* target, const PhysState& state, Derivative* derivative)
+void TwoWaySpringForce::detach()
 {
-  // x = vector difference between the target point and attachment point on the object
-  
-  glm::mat4 transMatrix = glm::translate(state.position);
-  glm::mat4 rotMatrix = glm::toMat4(state.orientation);
-  glm::mat4 scaleMatrix = glm::scale(glm::vec3(target->getScale()));
-  glm::mat4 transform = transMatrix * rotMatrix * scaleMatrix;
-  glm::vec3 attachPos;
-  
-  glm::vec3 otherPos;
-  if(target == this->target)
+  if(secondTarget)
   {
-    glm::vec4 attachmentOffset(attachOffset.x, attachOffset.y, attachOffset.z, 1.0f);
-    glm::vec4 attach = transform * attachmentOffset;
-    attachPos = glm::vec3(attach.x, attach.y, attach.z);
-
-    otherPos = this->secondTarget->getPosition();
-    currentAttachPos = attachPos;
+    secondTarget->removeForce(this);
+    secondTarget = NULL;
   }
-  else
-  {
-    glm::vec4 attachmentOffset(secondAttachOffset.x, secondAttachOffset.y, secondAttachOffset.z, 1.0f);
-    glm::vec4 attach = transform * attachmentOffset;
-    attachPos = glm::vec3(attach.x, attach.y, attach.z);
   
-    otherPos = this->target->getPosition();
-    secondCurrentAttachPos = attachPos;
+  if(target)
+  {
+    target->removeLinkSpring(recordIndex);
   }
   
-  glm::vec3 x = attachPos - otherPos;
-  glm::vec3 v = state.velocity() + glm::cross(state.angularVelocity(), otherPos - state.position);
-  
-  glm::vec3 f = (-k * x) - (b * v);
-  f *= 0.5f; // TODO
-  derivative->force += f;
-  derivative->torque += glm::cross(f, state.position - attachPos);
+  // Skip SpringForce::detach(), we have no anchor record
+  Force::detach();
 }
 
 void TwoWaySpringForce::draw(float alpha)
 {
-  glm::vec3 toTarget = secondCurrentAttachPos - currentAttachPos;
+  LinkSpring* spring = target->getLinkSpring(recordIndex);
+  glm::vec3 attachPos = target->getAttachPosition(spring->attachOffset);
+  glm::vec3 secondAttachPos = secondTarget->getAttachPosition(spring->otherAttachOffset);
   
-  for(int i = 0; i <= NUM_MARKERS; ++i)
-  {
-    glm::vec3 markerPos = currentAttachPos + (toTarget * (i / (float)NUM_MARKERS));
-    model->setPosition(markerPos);
-    model->draw(alpha);
-  }
-}
\ No newline at end of file
+  drawMarkers(attachPos, secondAttachPos, alpha);
+}
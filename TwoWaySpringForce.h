@@ -3,23 +3,54 @@
 
 #include "Force.h"
 #include "SpringForce.h"
+#include "SpringNetwork.h"
 
 class TwoWaySpringForce : public SpringForce
 {
 private:
   PhysModel* secondTarget;
-  glm::vec3 secondCurrentAttachPos;
-  glm::vec3 secondAttachOffset;
-  TwoWaySpringForce(PhysModel* target, PhysModel* secondTarget, float k, float b, glm::vec3 attachOffset, glm::vec3 secondAttachOffset);
+  TwoWaySpringForce(PhysModel* target, PhysModel* secondTarget, float k, float b, glm::vec3 attachOffset, glm::vec3 secondAttachOffset, float restLength);
 
 public:
-  static TwoWaySpringForce* create(PhysModel* target, PhysModel* secondTarget, float k, float b, glm::vec3 attachOffset = glm::vec3(-0.5f, 0.0f, 0.0f), glm::vec3 secondAttachOffset = glm::vec3(-0.5f, 0.0f, 0.0f)); // TODO
+  DECLARE_POOLED(TwoWaySpringForce)
+  
+  static TwoWaySpringForce* create(PhysModel* target, PhysModel* secondTarget, float k, float b, glm::vec3 attachOffset = glm::vec3(-0.5f, 0.0f, 0.0f), glm::vec3 secondAttachOffset = glm::vec3(-0.5f, 0.0f, 0.0f), float restLength = 0.0f); // TODO
   virtual ~TwoWaySpringForce()
   {
-    secondTarget->removeForce(this);
+    detach();
   }
-  virtual void applyForce(PhysModel* target, const PhysState& state, Derivative* derivative);
+  virtual void detach();
+  static void applyForce(const NetworkSpring& spring, const PhysState& stateA, const PhysState& stateB, Derivative* derivativeA, Derivative* derivativeB);
   virtual void draw(float alpha);
 };
 
-#endif
\ No newline at end of file
+inline void TwoWaySpringForce::applyForce(const NetworkSpring& spring, const PhysState& stateA, const PhysState& stateB, Derivative* derivativeA, Derivative* derivativeB)
+{
+  glm::vec3 armA = stateA.orientation * spring.offsetA;
+  glm::vec3 armB = stateB.orientation * spring.offsetB;
+  
+  // x = vector difference between the two attachment points
+  glm::vec3 x = (stateA.position + armA) - (stateB.position + armB);
+  if(spring.restLength > 0.0f)
+  {
+    float length = glm::length(x);
+    if(length > 0.0f)
+    {
+      x *= (length - spring.restLength) / length;
+    }
+  }
+  
+  // v = relative velocity of the two attachment points
+  glm::vec3 vA = stateA.velocity() + glm::cross(stateA.angularVelocity(), armA);
+  glm::vec3 vB = stateB.velocity() + glm::cross(stateB.angularVelocity(), armB);
+  glm::vec3 v = vA - vB;
+  
+  // Equal and opposite
+  glm::vec3 f = (-spring.k * x) - (spring.damping * v);
+  derivativeA->force += f;
+  derivativeA->torque += glm::cross(armA, f);
+  derivativeB->force -= f;
+  derivativeB->torque -= glm::cross(armB, f);
+}
+
+#endif
@@ -0,0 +1,322 @@
+#include "XPBDSolver.h"
+
+// Passed to the parallel loop for one color
+struct SolveRangeContext
+{
+  XPBDSolver* solver;
+  std::vector<PhysState>* states;
+  unsigned int colorBegin;
+  float h;
+};
+
+// Moves a body by a positional impulse p applied at arm
+static void applyCorrection(PhysState* state, glm::vec3 arm, glm::vec3 p)
+{
+  state->position += p * state->inverseMass;
+  glm::vec3 rotation = state->worldInverseInertia() * glm::cross(arm, p);
+  glm::quat delta = 0.5f * glm::quat(0.0f, rotation.x, rotation.y, rotation.z) * state->orientation;
+  state->orientation = glm::normalize(state->orientation + delta);
+}
+
+XPBDSolver::XPBDSolver()
+{
+  substeps = XPBD_DEFAULT_SUBSTEPS;
+  iterations = XPBD_DEFAULT_ITERATIONS;
+  pool = ThreadPool::shared();
+  hasGround = false;
+  groundHeight = 0.0f;
+}
+
+void XPBDSolver::buildConstraints(const std::vector<PhysModel*>& bodies, const SpringNetwork& network, Model* collisionSurface)
+{
+  constraints.clear();
+  
+  Constraint constraint;
+  constraint.lambda = 0.0f;
+  constraint.collider = Collider();
+  constraint.staticFriction = constraint.kineticFriction = 0.0f;
+  
+  const std::vector<NetworkSpring>& springs = network.getSprings();
+  for(size_t s = 0; s < springs.size(); ++s)
+  {
+    constraint.type = CONSTRAINT_DISTANCE;
+    constraint.a = springs[s].a;
+    constraint.b = springs[s].b;
+    constraint.offsetA = springs[s].offsetA;
+    constraint.offsetB = springs[s].offsetB;
+    constraint.restLength = springs[s].restLength;
+    constraint.compliance = springs[s].k > 0.0f ? 1.0f / springs[s].k : 0.0f;
+    constraints.push_back(constraint);
+  }
+  
+  hasGround = collisionSurface != NULL;
+  if(hasGround)
+  {
+    Bounds bounds = collisionSurface->getMesh()->bounds;
+    groundMin = bounds.min * collisionSurface->getScale() + collisionSurface->getPosition();
+    groundMax = bounds.max * collisionSurface->getScale() + collisionSurface->getPosition();
+    groundHeight = groundMax.y;
+  }
+  
+  for(size_t i = 0; i < bodies.size(); ++i)
+  {
+    const std::vector<AnchorSpring>& anchors = bodies[i]->getAnchorSprings();
+    for(size_t j = 0; j < anchors.size(); ++j)
+    {
+      constraint.type = CONSTRAINT_ATTACHMENT;
+      constraint.a = constraint.b = i;
+      constraint.offsetA = anchors[j].attachOffset * bodies[i]->getScale();
+      constraint.offsetB = anchors[j].anchor;
+      constraint.restLength = 0.0f;
+      constraint.compliance = anchors[j].k > 0.0f ? 1.0f / anchors[j].k : 0.0f;
+      constraints.push_back(constraint);
+    }
+    
+    if(hasGround)
+    {
+      constraint.type = CONSTRAINT_GROUND;
+      constraint.a = constraint.b = i;
+      constraint.collider = bodies[i]->getCollider();
+      constraint.staticFriction = bodies[i]->getContactMaterial().staticFriction;
+      constraint.kineticFriction = bodies[i]->getContactMaterial().kineticFriction;
+      constraint.restLength = 0.0f;
+      constraint.compliance = 0.0f;
+      constraints.push_back(constraint);
+    }
+  }
+}
+
+void XPBDSolver::color(size_t numBodies)
+{
+  // Greedy coloring: each constraint takes the lowest color neither of its
+  // bodies has been given yet. Anything past the last color shares it, and that
+  // color is solved serially.
+  bodyColors.assign(numBodies, 0);
+  constraintColors.resize(constraints.size());
+  colorCounts.assign(XPBD_MAX_COLORS + 2, 0);
+  
+  for(size_t c = 0; c < constraints.size(); ++c)
+  {
+    const Constraint& constraint = constraints[c];
+    unsigned long long used = bodyColors[constraint.a];
+    if(constraint.type == CONSTRAINT_DISTANCE)
+    {
+      used |= bodyColors[constraint.b];
+    }
+    
+    unsigned int color = 0;
+    while(color < XPBD_MAX_COLORS && (used & (1ULL << color)))
+    {
+      ++color;
+    }
+    
+    if(color < XPBD_MAX_COLORS)
+    {
+      bodyColors[constraint.a] |= 1ULL << color;
+      if(constraint.type == CONSTRAINT_DISTANCE)
+      {
+        bodyColors[constraint.b] |= 1ULL << color;
+      }
+    }
+    
+    constraintColors[c] = color;
+    ++colorCounts[color + 1];
+  }
+  
+  // Counting sort into color order, dropping empty colors at the end
+  unsigned int numColors = XPBD_MAX_COLORS + 1;
+  while(numColors > 0 && colorCounts[numColors] == 0)
+  {
+    --numColors;
+  }
+  
+  colorStart.assign(numColors + 1, 0);
+  for(unsigned int i = 0; i < numColors; ++i)
+  {
+    colorStart[i + 1] = colorStart[i] + colorCounts[i + 1];
+  }
+  
+  colorFill.assign(colorStart.begin(), colorStart.end());
+  order.resize(constraints.size());
+  for(size_t c = 0; c < constraints.size(); ++c)
+  {
+    order[colorFill[constraintColors[c]]++] = c;
+  }
+}
+
+void XPBDSolver::solve(Constraint* constraint, std::vector<PhysState>* states, float h)
+{
+  PhysState& stateA = (*states)[constraint->a];
+  
+  if(constraint->type == CONSTRAINT_GROUND)
+  {
+    // The proxy's lowest point at the current orientation
+    Collider& collider = constraint->collider;
+    collider.position = stateA.position;
+    collider.orientation = glm::normalize(stateA.orientation);
+    glm::vec3 lowest = collider.support(glm::vec3(0.0f, -1.0f, 0.0f));
+    glm::vec3 arm = lowest - stateA.position;
+    float depth = groundHeight - lowest.y;
+    if(depth <= 0.0f
+       || lowest.x < groundMin.x || lowest.x > groundMax.x
+       || lowest.z < groundMin.z || lowest.z > groundMax.z)
+    {
+      return;
+    }
+    
+    // Push out at the contact point, so a tilted body also rights itself, then
+    // hold back sliding in proportion to how hard we pushed
+    glm::vec3 up(0.0f, 1.0f, 0.0f);
+    glm::vec3 axis = glm::cross(arm, up);
+    float w = stateA.inverseMass + glm::dot(axis, stateA.worldInverseInertia() * axis);
+    applyCorrection(&stateA, arm, up * (depth / w));
+    
+    glm::vec3 moved = stateA.position - previous[constraint->a].position;
+    glm::vec3 tangential(moved.x, 0.0f, moved.z);
+    float slide = glm::length(tangential);
+    if(slide < constraint->staticFriction * depth)
+    {
+      stateA.position -= tangential;
+    }
+    else if(slide > 0.0f)
+    {
+      stateA.position -= tangential * glm::min(1.0f, constraint->kineticFriction * depth / slide);
+    }
+    return;
+  }
+  
+  glm::vec3 armA = stateA.orientation * constraint->offsetA;
+  glm::vec3 pointA = stateA.position + armA;
+  
+  PhysState* stateB = NULL;
+  glm::vec3 armB, pointB;
+  if(constraint->type == CONSTRAINT_DISTANCE)
+  {
+    stateB = &(*states)[constraint->b];
+    armB = stateB->orientation * constraint->offsetB;
+    pointB = stateB->position + armB;
+  }
+  else
+  {
+    pointB = constraint->offsetB;
+  }
+  
+  glm::vec3 d = pointA - pointB;
+  float length = glm::length(d);
+  if(length < 1e-6f)
+  {
+    return;
+  }
+  
+  glm::vec3 n = d / length;
+  float c = length - constraint->restLength;
+  
+  // Generalized inverse masses of the two ends along n
+  glm::vec3 axisA = glm::cross(armA, n);
+  float w = stateA.inverseMass + glm::dot(axisA, stateA.worldInverseInertia() * axisA);
+  if(stateB)
+  {
+    glm::vec3 axisB = glm::cross(armB, n);
+    w += stateB->inverseMass + glm::dot(axisB, stateB->worldInverseInertia() * axisB);
+  }
+  
+  float alpha = constraint->compliance / (h * h);
+  float deltaLambda = (-c - alpha * constraint->lambda) / (w + alpha);
+  constraint->lambda += deltaLambda;
+  
+  glm::vec3 p = n * deltaLambda;
+  applyCorrection(&stateA, armA, p);
+  if(stateB)
+  {
+    applyCorrection(stateB, armB, -p);
+  }
+}
+
+void XPBDSolver::solveRange(void* context, size_t begin, size_t end)
+{
+  SolveRangeContext* range = static_cast<SolveRangeContext*>(context);
+  XPBDSolver* solver = range->solver;
+  for(size_t i = begin; i < end; ++i)
+  {
+    unsigned int c = solver->order[range->colorBegin + i];
+    solver->solve(&solver->constraints[c], range->states, range->h);
+  }
+}
+
+void XPBDSolver::step(const std::vector<PhysModel*>& bodies,
+                      const SpringNetwork& network,
+                      Model* collisionSurface,
+                      const std::vector<PhysState>& states,
+                      float dt,
+                      std::vector<PhysState>* result)
+{
+  size_t numBodies = bodies.size();
+  buildConstraints(bodies, network, collisionSurface);
+  color(numBodies);
+  
+  *result = states;
+  float h = dt / substeps;
+  
+  for(int substep = 0; substep < substeps; ++substep)
+  {
+    // Predict with everything but the springs, which are constraints here
+    previous = *result;
+    for(size_t i = 0; i < numBodies; ++i)
+    {
+      PhysState& state = (*result)[i];
+      Derivative derivative = bodies[i]->evaluate(state, false);
+      
+      state.linearMomentum += derivative.force * h;
+      state.angularMomentum += derivative.torque * h;
+      state.position += state.velocity() * h;
+      glm::vec3 angularVelocity = state.angularVelocity();
+      glm::quat spin = 0.5f * glm::quat(0.0f, angularVelocity.x, angularVelocity.y, angularVelocity.z) * state.orientation;
+      state.orientation = glm::normalize(state.orientation + spin * h);
+    }
+    
+    for(size_t c = 0; c < constraints.size(); ++c)
+    {
+      constraints[c].lambda = 0.0f;
+    }
+    
+    // Gauss-Seidel from one color to the next. Constraints within a color share
+    // no bodies, so they can be solved in parallel.
+    SolveRangeContext context;
+    context.solver = this;
+    context.states = result;
+    context.h = h;
+    for(int iteration = 0; iteration < iterations; ++iteration)
+    {
+      for(size_t color = 0; color + 1 < colorStart.size(); ++color)
+      {
+        context.colorBegin = colorStart[color];
+        size_t count = colorStart[color + 1] - colorStart[color];
+        if(color == XPBD_MAX_COLORS)
+        {
+          solveRange(&context, 0, count); // Overflow color may share bodies
+        }
+        else
+        {
+          pool->parallelFor(count, XPBD_PARALLEL_GRAIN, &XPBDSolver::solveRange, &context);
+        }
+      }
+    }
+    
+    // Velocities are whatever moved the bodies where they ended up
+    for(size_t i = 0; i < numBodies; ++i)
+    {
+      PhysState& state = (*result)[i];
+      const PhysState& before = previous[i];
+      
+      state.linearMomentum = (state.position - before.position) * (state.mass / h);
+      
+      glm::quat delta = state.orientation * glm::conjugate(before.orientation);
+      glm::vec3 angularVelocity = glm::vec3(delta.x, delta.y, delta.z) * (2.0f / h);
+      if(delta.w < 0.0f)
+      {
+        angularVelocity = -angularVelocity;
+      }
+      state.angularMomentum = state.worldInertia() * angularVelocity;
+    }
+  }
+}
@@ -0,0 +1,98 @@
+#ifndef XPBD_SOLVER_H
+#define XPBD_SOLVER_H
+
+#include <vector>
+
+#include "PhysModel.h"
+#include "SpringNetwork.h"
+#include "ThreadPool.h"
+#include "Collider.h"
+
+#define XPBD_DEFAULT_SUBSTEPS 4
+#define XPBD_DEFAULT_ITERATIONS 4
+#define XPBD_PARALLEL_GRAIN 256
+#define XPBD_MAX_COLORS 64
+
+#define CONSTRAINT_DISTANCE 0
+#define CONSTRAINT_ATTACHMENT 1
+#define CONSTRAINT_GROUND 2
+
+struct Constraint
+{
+  int type;
+  unsigned int a, b;
+  glm::vec3 offsetA;    // Attach point on body a, scaled
+  glm::vec3 offsetB;    // Attach point on body b, or the fixed point in the world
+  float restLength;
+  float compliance;     // Inverse stiffness, 0 for rigid
+  Collider collider;    // Ground contacts: body a's collision proxy
+  float staticFriction, kineticFriction; // Ground contacts: body a's material
+  float lambda;
+};
+
+// Extended position based dynamics. Springs become compliant distance
+// constraints (compliance = 1 / k), springs to fixed points become attachment
+// constraints, and the collision surface becomes a ground contact constraint
+// with friction. Constraints are greedily graph colored so that no two in the
+// same color share a body; colors are then solved one after another
+// (Gauss-Seidel) while the constraints within a color are solved in parallel.
+// Positional constraints stay stable at timesteps far larger than penalty
+// springs under RK4 allow.
+class XPBDSolver
+{
+private:
+  int substeps, iterations;
+  ThreadPool* pool;
+  
+  std::vector<Constraint> constraints;
+  std::vector<unsigned int> order;        // Constraint indices, grouped by color
+  std::vector<unsigned int> colorStart;   // Start of each color in order
+  std::vector<unsigned int> colorCounts;  // Constraints of each color, offset by one
+  std::vector<unsigned int> colorFill;    // Where the next of each color goes in order
+  std::vector<unsigned long long> bodyColors;
+  std::vector<unsigned int> constraintColors;
+  std::vector<PhysState> previous;
+  
+  bool hasGround;
+  float groundHeight;
+  glm::vec3 groundMin, groundMax;
+  
+  void buildConstraints(const std::vector<PhysModel*>& bodies, const SpringNetwork& network, Model* collisionSurface);
+  void color(size_t numBodies);
+  void solve(Constraint* constraint, std::vector<PhysState>* states, float h);
+  static void solveRange(void* context, size_t begin, size_t end);
+
+public:
+  XPBDSolver();
+  
+  // Takes the states at the start of the step, and writes the states at the end
+  void step(const std::vector<PhysModel*>& bodies,
+            const SpringNetwork& network,
+            Model* collisionSurface,
+            const std::vector<PhysState>& states,
+            float dt,
+            std::vector<PhysState>* result);
+  
+  void setSubsteps(int substeps)
+  {
+    this->substeps = substeps;
+  }
+  void setIterations(int iterations)
+  {
+    this->iterations = iterations;
+  }
+  void setThreadPool(ThreadPool* pool)
+  {
+    this->pool = pool;
+  }
+  int getNumColors()
+  {
+    return colorStart.empty() ? 0 : colorStart.size() - 1;
+  }
+  size_t getNumConstraints()
+  {
+    return constraints.size();
+  }
+};
+
+#endif
@@ -5,6 +5,8 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <chrono>
 
 #include "GLSL_helper.h"
 #include "glm/glm.hpp"
@@ -22,12 +24,23 @@
 #include "SpringForce.h"
 #include "TwoWaySpringForce.h"
 #include "GravitationalForce.h"
+#include "Snapshot.h"
+#include "SceneFile.h"
+#include "SceneGenerator.h"
+#include "TrajectoryPlayer.h"
+#include "Profiler.h"
+#include "Metrics.h"
+#include "Memory.h"
 
 using namespace std;
 
 #define FRAME_DELAY 16
 
 #define WINDOW_TITLE "Physics!"
+#define CHECKPOINT_PATH "checkpoint.snap"
+#define TRACE_PATH "profile.json"
+#define METRICS_PUBLISH_INTERVAL 1000 // ms
+#define OVERLAY_LINE_HEIGHT 15        // px
 
 #define CONTROL_DISABLED 0
 #define ADD_MODEL 1
@@ -44,10 +57,14 @@ static bool walkingForward, walkingBackward, walkingLeft, walkingRight;
 static bool scenePause = false;
 static bool stepMode = false;
 static int controlMode = CONTROL_DISABLED;
-static PhysModel* lastHit, *grabbed;
+// Handles rather than pointers, so a removed body can't be dereferenced
+static PoolHandle lastHit, grabbed;
 static glm::vec3 nearPos, lastNearPos, lastIntoScreen;
 
 static Scene scene;
+static TrajectoryRecorder recorder; // Closed on exit, after the scene's last step
+static TrajectoryPlayer player;
+static bool replaying = false;
 static Camera* camera;
 
 static int ShadeProg;
@@ -61,18 +78,35 @@ static GLint h_uCameraPos;
 
 static PhysModel* bunnyModel, *secondBunnyModel;
 static Model* worldFloor;
-static SpringForce* softMouseForce;
-
-float randFloat(float low, float high)
-{
-  return low + (float)rand() / ((float)RAND_MAX / (high - low));
-}
+static bool grabbing;
+
+static MetricsRegistry metrics;
+static MetricsExporter metricsExporter;
+static Metric* bodiesMetric, *activeBodiesMetric, *forcesMetric, *contactsMetric;
+static Metric* stepsMetric, *stepsPerFrameMetric, *stepTimeMetric, *cappedFramesMetric;
+static Metric* drawCallsMetric;
+static Metric* droppedCommandsMetric;
+static Metric* stepAllocationsMetric;
+static Metric* memoryMetrics[MEMORY_TAGS];
+static bool showOverlay = false;
 
 glm::vec3 randVec3(float low, float high)
 {
-  return glm::vec3(randFloat(low, high), randFloat(low, high), randFloat(low, high));
+  return scene.getRandom()->nextVec3(low, high);
 }
 
+void InitFloor()
+{
+  Material floorMaterial;
+  glm::vec3 baseFloorColor(1.0f, 1.0f, 1.0f);
+  floorMaterial.ambient = baseFloorColor * 0.3f;
+  floorMaterial.diffuse = baseFloorColor * 0.6f;
+  floorMaterial.specular = glm::vec3(0.1f, 0.1f, 0.1f);
+  floorMaterial.emission = baseFloorColor * 0.0f;
+  floorMaterial.shininess = 10.0f;
+  worldFloor = SceneGenerator::ground(&scene, floorMaterial, 3.0f);
+}
+
 void InitGeom()
 {
   Material bunnyMaterial;
@@ -87,35 +121,85 @@ void InitGeom()
   
   GravitationalForce::create(bunnyModel);
 
-  Material floorMaterial;
-  glm::vec3 baseFloorColor(1.0f, 1.0f, 1.0f);
-  floorMaterial.ambient = baseFloorColor * 0.3f;
-  floorMaterial.diffuse = baseFloorColor * 0.6f;
-  floorMaterial.specular = glm::vec3(0.1f, 0.1f, 0.1f);
-  floorMaterial.emission = baseFloorColor * 0.0f;
-  floorMaterial.shininess = 10.0f;
-  Mesh* floorMesh = Mesh::load("SimpleModels/plane.m", false);
-  worldFloor = new Model(floorMesh, floorMaterial);
-  worldFloor->translate(glm::vec3(0.0f, -0.5f, 0.0f));
-  worldFloor->scale(3.0f);
-  
   Light* sceneLight = new Light(glm::vec3(0.0f, 0.0f, 0.0f), randVec3(0.0f, 0.5f), 0.1f, 0.005f, 0.001f);
   sceneLight->drawModel();
   sceneLight->attachTo(bunnyModel);
 
-  scene.add(worldFloor);
+  InitFloor();
   scene.add(bunnyModel);
   scene.add(sceneLight);
-  
-  scene.setCollisionSurface(worldFloor);
-
-  camera = new Camera(h_uViewMatrix, h_uCameraPos);
 }
 
+void InitMetrics()
+{
+  static const double stepsPerFrameBounds[] = { 0, 1, 2, 3, 4, 6, 8, 12 };
+  static const double stepTimeBounds[] = { 0.0005, 0.001, 0.002, 0.004, 0.008, 0.016, 0.032, 0.064, 0.128 };
+  
+  bodiesMetric = metrics.addGauge("physics_bodies", "Bodies in the scene");
+  activeBodiesMetric = metrics.addGauge("physics_active_bodies", "Bodies simulated in the last step; the rest were asleep");
+  forcesMetric = metrics.addGauge("physics_forces", "Forces acting on bodies, springs included");
+  contactsMetric = metrics.addGauge("physics_contacts", "Contact points resolved in the last step");
+  stepsMetric = metrics.addCounter("physics_steps_total", "Steps simulated");
+  stepsPerFrameMetric = metrics.addHistogram("physics_steps_per_frame", "Steps taken to catch up with the clock each frame",
+                                             stepsPerFrameBounds, sizeof(stepsPerFrameBounds) / sizeof(double));
+  stepTimeMetric = metrics.addHistogram("physics_step_seconds", "Wall clock time of each step",
+                                        stepTimeBounds, sizeof(stepTimeBounds) / sizeof(double));
+  cappedFramesMetric = metrics.addCounter("physics_capped_frames_total", "Frames so far behind that simulated time was dropped");
+  drawCallsMetric = metrics.addGauge("render_draw_calls", "Draw calls made in the last frame");
+  droppedCommandsMetric = metrics.addCounter("scene_dropped_commands_total", "Edits from input lost to a full command queue");
+  stepAllocationsMetric = metrics.addGauge("physics_step_allocations", "Heap allocations made by the last step");
+  for(int i = 0; i < MEMORY_TAGS; ++i)
+  {
+    char name[64], help[64];
+    snprintf(name, sizeof(name), "memory_%s_bytes", Memory::getTagName(i));
+    snprintf(help, sizeof(help), "Heap memory in use by %s", Memory::getTagName(i));
+    memoryMetrics[i] = metrics.addGauge(name, help);
+  }
+}
+
+// Every metric, in the top left corner
+void DrawOverlay()
+{
+  glDisable(GL_DEPTH_TEST);
+  glMatrixMode(GL_PROJECTION);
+  glPushMatrix();
+  glLoadIdentity();
+  glOrtho(0.0, g_width, g_height, 0.0, -1.0, 1.0);
+  glMatrixMode(GL_MODELVIEW);
+  glPushMatrix();
+  glLoadIdentity();
+  glColor3f(1.0f, 1.0f, 1.0f);
+  
+  char line[128];
+  for(int i = 0; i < metrics.getNumMetrics(); ++i)
+  {
+    Metric* metric = metrics.getMetric(i);
+    if(metric->type == METRIC_HISTOGRAM)
+    {
+      snprintf(line, sizeof(line), "%-28s %-10.4g p50 <= %-8.4g p99 <= %.4g", metric->name.c_str(), metric->value,
+               metric->quantile(0.5), metric->quantile(0.99));
+    }
+    else
+    {
+      snprintf(line, sizeof(line), "%-28s %.10g", metric->name.c_str(), metric->value);
+    }
+    
+    glRasterPos2f(OVERLAY_LINE_HEIGHT, (i + 2) * OVERLAY_LINE_HEIGHT);
+    for(const char* c = line; *c; ++c)
+    {
+      glutBitmapCharacter(GLUT_BITMAP_8_BY_13, *c);
+    }
+  }
+  
+  glPopMatrix();
+  glMatrixMode(GL_PROJECTION);
+  glPopMatrix();
+  glMatrixMode(GL_MODELVIEW);
+  glEnable(GL_DEPTH_TEST);
+}
+
 void Initialize()
 {
-  srand(time(NULL));
-
   glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
 
   // Depth Buffer Setup
@@ -131,6 +215,8 @@ static float alpha = 1.0f;
 /* Main display function */
 void Draw(void)
 {
+  PROFILE_ZONE("Draw");
+  
   // Clear
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -150,9 +236,15 @@ void Draw(void)
 
   // Models
   scene.draw(alpha);
+  drawCallsMetric->set(GLBridge::getNumDrawCalls());
 
   // Disable the shader
   glUseProgram(0);
+  
+  if(showOverlay)
+  {
+    DrawOverlay();
+  }
 
   glutSwapBuffers();
 }
@@ -170,8 +262,54 @@ void ReshapeGL(int width, int height)
 #define WALK_SPEED 0.01f
 float extraSpeed = 0.0f;
 
+// Playback controls in replay mode; returns false for any other key
+bool replayKeyboard(unsigned char key)
+{
+  switch(key)
+  {
+  case 'p':
+    // Playing on from the end it stopped at starts over
+    if(player.isPaused())
+    {
+      double last = player.getNumFrames() - 1;
+      if(player.getSpeed() > 0.0f && player.getPlayhead() >= last)
+      {
+        player.seek(0.0);
+      }
+      else if(player.getSpeed() < 0.0f && player.getPlayhead() <= 0.0)
+      {
+        player.seek(last);
+      }
+    }
+    player.setPaused(!player.isPaused());
+    return true;
+  case '[':
+    player.setSpeed(player.getSpeed() * 0.5f);
+    return true;
+  case ']':
+    player.setSpeed(player.getSpeed() * 2.0f);
+    return true;
+  case 'r':
+    player.setSpeed(-player.getSpeed());
+    return true;
+  case ',':
+    player.seekKeyframe(false);
+    return true;
+  case '.':
+    player.seekKeyframe(true);
+    return true;
+  }
+  
+  return false;
+}
+
 void keyboard(unsigned char key, int x, int y )
 {
+  if(replaying && replayKeyboard(key))
+  {
+    return;
+  }
+  
   char title[100];
   strncpy(title, WINDOW_TITLE, 100);
   switch(key)
@@ -225,7 +363,7 @@ void keyboard(unsigned char key, int x, int y )
     break;
   case '5':
     controlMode = ADD_TWO_WAY_SPRING;
-    lastHit = NULL;
+    lastHit = PoolHandle();
     glutSetWindowTitle(strcat(title, " - Add Two Way Spring"));
     break;
   case '6':
@@ -238,22 +376,49 @@ void keyboard(unsigned char key, int x, int y )
     break;
   case '8':
     controlMode = GRAB;
-    grabbed = NULL;
+    grabbed = PoolHandle();
     glutSetWindowTitle(strcat(title, " - Grab"));
     break;
   case '0':
     controlMode = CONTROL_DISABLED;
     glutSetWindowTitle(title);
     break;
+  case 'c':
+    // Keys are handled between steps, so the scene is whole
+    if(!Snapshot::save(&scene, CHECKPOINT_PATH))
+    {
+      printf("Error saving %s!\n", CHECKPOINT_PATH);
+    }
+    break;
+  case 't':
+    if(!Profiler::isEnabled())
+    {
+      printf("Profiling is compiled out (build with make profile)\n");
+    }
+    else if(!Profiler::writeTrace(TRACE_PATH))
+    {
+      printf("Error saving %s!\n", TRACE_PATH);
+    }
+    break;
+  case 'f':
+    if(!Profiler::isEnabled())
+    {
+      printf("Profiling is compiled out (build with make profile)\n");
+    }
+    Profiler::setReporting(!Profiler::isReporting());
+    break;
+  case 'm':
+    showOverlay = !showOverlay;
+    break;
   case 'q': case 'Q' :
     exit(EXIT_SUCCESS);
     break;
   }
   
-  if(controlMode != GRAB && softMouseForce)
+  if(controlMode != GRAB && grabbing)
   {
-    delete softMouseForce;
-    softMouseForce = NULL;
+    scene.queue(SceneCommand(COMMAND_RELEASE_GRAB));
+    grabbing = false;
   }
 }
 
@@ -291,10 +456,23 @@ void genNearAndFar(int x, int y, glm::vec3* nearCoords, glm::vec3* farCoords)
 }
 
 static int lastButton;
+// Dragging across the window in replay mode moves through the whole recording
+void scrub(int x)
+{
+  player.seek(x / g_width * (player.getNumFrames() - 1));
+}
+
 void mouseClick(int button, int state, int x, int y)
 {
   lastButton = button;
-  if((button == GLUT_LEFT_BUTTON || button == GLUT_MIDDLE_BUTTON) && state == GLUT_DOWN)
+  if(replaying && button == GLUT_LEFT_BUTTON)
+  {
+    if(state == GLUT_DOWN)
+    {
+      scrub(x);
+    }
+  }
+  else if((button == GLUT_LEFT_BUTTON || button == GLUT_MIDDLE_BUTTON) && state == GLUT_DOWN)
   {
     glm::vec3 nearCoords, farCoords;
     genNearAndFar(x, y, &nearCoords, &farCoords);
@@ -315,7 +493,10 @@ void mouseClick(int button, int state, int x, int y)
       PhysModel* toAdd = new PhysModel(bunnyMesh, bunnyMaterial, 3.0f, addPos);
       GravitationalForce::create(toAdd);
       
-      scene.add(toAdd);
+      if(!scene.queue(SceneCommand(COMMAND_ADD_BODY, toAdd)))
+      {
+        delete toAdd;
+      }
     }
     else
     {
@@ -325,45 +506,70 @@ void mouseClick(int button, int state, int x, int y)
         switch(controlMode)
         {
         case REMOVE_MODEL:
-          scene.remove(hit);
-          delete hit;
+          scene.queue(SceneCommand(COMMAND_REMOVE_BODY, hit));
           break;
         case ADD_LIGHT:
           if(scene.getNumLights() < MAX_LIGHTS)
           {
             Light* sceneLight = new Light(glm::vec3(0.0f, 0.0f, 0.0f), randVec3(0.0f, 0.5f), 0.1f, 0.005f, 0.001f);
             sceneLight->drawModel();
-            sceneLight->attachTo(hit);
-            scene.add(sceneLight);
+            
+            SceneCommand command(COMMAND_ADD_LIGHT, hit);
+            command.light = sceneLight;
+            if(!scene.queue(command))
+            {
+              delete sceneLight;
+            }
           }
           break;
         case ADD_SPRING:
-          SpringForce::create(hit, nearCoords, 4.0f, 0.5f, randVec3(-hit->getExtrema(), hit->getExtrema()));
-          break;
-        case ADD_TWO_WAY_SPRING:
-          if(lastHit && hit != lastHit)
           {
-            TwoWaySpringForce::create(hit, lastHit, 4.0f, 0.5f, randVec3(-hit->getExtrema(), hit->getExtrema()), randVec3(-lastHit->getExtrema(), lastHit->getExtrema()));
-            lastHit = NULL;
+            SceneCommand command(COMMAND_ADD_SPRING, hit);
+            command.position = nearCoords;
+            command.k = 4.0f;
+            command.b = 0.5f;
+            command.attachOffset = randVec3(-hit->getExtrema(), hit->getExtrema());
+            scene.queue(command);
           }
-          else
+          break;
+        case ADD_TWO_WAY_SPRING:
           {
-            lastHit = hit;
+            PhysModel* lastHitModel = PhysModel::fromHandle(lastHit);
+            if(lastHitModel && hit != lastHitModel)
+            {
+              SceneCommand command(COMMAND_ADD_TWO_WAY_SPRING, hit);
+              command.otherBody = lastHitModel;
+              command.k = 4.0f;
+              command.b = 0.5f;
+              command.attachOffset = randVec3(-hit->getExtrema(), hit->getExtrema());
+              command.otherAttachOffset = randVec3(-lastHitModel->getExtrema(), lastHitModel->getExtrema());
+              scene.queue(command);
+              lastHit = PoolHandle();
+            }
+            else
+            {
+              lastHit = hit->getHandle();
+            }
           }
           break;
         case REMOVE_SPRING:
-          hit->deleteSpringForce();
+          scene.queue(SceneCommand(COMMAND_REMOVE_SPRING, hit));
           break;
         case TOGGLE_GRAVITY:
-          hit->toggleGravity();
+          scene.queue(SceneCommand(COMMAND_TOGGLE_GRAVITY, hit));
           break;
         case GRAB:
           nearPos = lastNearPos = nearCoords;
           lastIntoScreen = glm::normalize(farCoords - nearCoords);
-          if(!softMouseForce)
+          if(!grabbing)
           {
-            grabbed = hit;
-            softMouseForce = SpringForce::create(hit, hit->getPosition(), 6.0f, 0.5f, randVec3(-hit->getExtrema(), hit->getExtrema()));
+            SceneCommand command(COMMAND_GRAB, hit);
+            command.position = hit->getPosition();
+            command.k = 6.0f;
+            command.b = 0.5f;
+            command.attachOffset = randVec3(-hit->getExtrema(), hit->getExtrema());
+            grabbing = scene.queue(command);
+            grabbed = hit->getHandle();
           }
           break;
         default:
@@ -373,10 +579,10 @@ void mouseClick(int button, int state, int x, int y)
     }
   }
   
-  if(state == GLUT_UP && controlMode == GRAB)
+  if(state == GLUT_UP && controlMode == GRAB && grabbing)
   {
-    delete softMouseForce;
-    softMouseForce = NULL;
+    scene.queue(SceneCommand(COMMAND_RELEASE_GRAB));
+    grabbing = false;
   }
   
   lastMouseX = x;
@@ -388,20 +594,27 @@ void mouseClick(int button, int state, int x, int y)
 
 void mouseMotion(int x, int y)
 {
-  if(lastButton == GLUT_LEFT_BUTTON)
+  if(replaying && lastButton == GLUT_LEFT_BUTTON)
+  {
+    scrub(x);
+  }
+  else if(lastButton == GLUT_LEFT_BUTTON)
   {
     glm::vec3 nearCoords, farCoords;
     genNearAndFar(x, y, &nearCoords, &farCoords);
     glm::vec3 intoScreen = glm::normalize(farCoords - nearCoords);
     
-    if(controlMode == GRAB && softMouseForce && grabbed)
+    PhysModel* grabbedModel = PhysModel::fromHandle(grabbed);
+    if(controlMode == GRAB && grabbing && grabbedModel)
     {
-      glm::vec3 toGrabbed = grabbed->getPosition() - nearPos;
+      glm::vec3 toGrabbed = grabbedModel->getPosition() - nearPos;
       lastIntoScreen = glm::normalize(lastIntoScreen);
       intoScreen *= glm::length(toGrabbed);
       lastIntoScreen *= glm::length(toGrabbed);;
       
-      softMouseForce->translate(intoScreen - lastIntoScreen);
+      SceneCommand command(COMMAND_MOVE_GRAB);
+      command.position = intoScreen - lastIntoScreen;
+      scene.queue(command);
       lastIntoScreen = intoScreen;
       
       lastNearPos = nearPos;
@@ -421,37 +634,78 @@ void mouseMotion(int x, int y)
 
 static int currentTime;
 static double accumulator = 0.0;
+static int lastPublished;
 
 static double t = 0.0;
 const static double dt = 1.0 / 60.0;
 
-void loop(int value)
+void loop(int)
 {
+  // A frame runs from one loop to the next, taking in the draw between
+  PROFILE_FRAME();
+  PROFILE_ZONE("loop");
+  
   int now = glutGet(GLUT_ELAPSED_TIME);
   int frameTime = now - currentTime;
   if(frameTime > 250)
   {
     frameTime = 250; // Cap the frame time to avoid spiraling
+    cappedFramesMetric->increment();
   }
   currentTime = now;
   
-  if(!scenePause)
+  if(replaying)
+  {
+    // Nothing is simulated; the recording poses the bodies instead
+    player.advance(frameTime / 1000.0);
+  }
+  else if(scenePause)
+  {
+    // Nothing is stepping, so this frame is the only boundary edits can land on
+    scene.applyCommands();
+  }
+  else
   {
     accumulator += (frameTime / 1000.0);
     
+    int steps = 0;
     while(accumulator >= dt)
     {
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
       scene.step(t, dt);
+      stepTimeMetric->observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
       t += dt;
       accumulator -= dt;
+      ++steps;
+    }
+    stepsMetric->increment(steps);
+    stepsPerFrameMetric->observe(steps);
+  }
+  
+  bodiesMetric->set(scene.getNumPhysObjects());
+  activeBodiesMetric->set(scene.getNumActiveObjects());
+  forcesMetric->set(GravitationalForce::getPool().size() + SpringForce::getPool().size() + TwoWaySpringForce::getPool().size());
+  contactsMetric->set(scene.getContactSolver()->getNumConstraints());
+  droppedCommandsMetric->set(scene.getNumDroppedCommands());
+  stepAllocationsMetric->set(scene.getLastAllocations());
+  for(int i = 0; i < MEMORY_TAGS; ++i)
+  {
+    memoryMetrics[i]->set(Memory::getStats(i).bytes);
+  }
+  if(metricsExporter.isOpen() && now - lastPublished >= METRICS_PUBLISH_INTERVAL)
+  {
+    if(!metricsExporter.publish(metrics))
+    {
+      printf("Error publishing metrics!\n");
     }
+    lastPublished = now;
   }
   
   // Render using an interpolated state in order to prevent any jittering caused
   // by the physics rate and frame rate not being in sync (note this is purely a
   // visual thing - the actual physics steps that are kept throughout the
   // simulation do not use the interpolated values).
-  alpha = accumulator / dt;
+  alpha = replaying ? player.apply(&scene) : accumulator / dt;
 
   if(walkingForward)
   {
@@ -486,6 +740,61 @@ int main(int argc, char *argv[])
   g_height = 720;
 
   glutInit(&argc, argv);
+  
+  // --seed N runs deterministically, for reproducing a session, --scene PATH
+  // builds the scene from a scene file and --load PATH from a snapshot instead
+  // of the usual one, --generate LAYOUT N builds one of SceneGenerator's
+  // layouts of about N bodies on the floor (from the --seed given, if any),
+  // --record PATH writes every step's poses to a trajectory file,
+  // --replay PATH plays one back onto the scene instead of simulating it, and
+  // --metrics PATH and --metrics-socket PATH publish the metrics every second
+  // to a file and to a UNIX socket
+  uint64_t seed = RANDOM_DEFAULT_SEED;
+  const char* scenePath = NULL;
+  const char* layout = NULL;
+  int numGenerated = 0;
+  const char* snapshotPath = NULL;
+  const char* trajectoryPath = NULL;
+  const char* replayPath = NULL;
+  const char* metricsPath = NULL;
+  const char* metricsSocketPath = NULL;
+  for(int i = 1; i + 1 < argc; ++i)
+  {
+    if(strcmp(argv[i], "--seed") == 0)
+    {
+      seed = strtoull(argv[i + 1], NULL, 0);
+      scene.setDeterministic(true, seed);
+    }
+    else if(strcmp(argv[i], "--scene") == 0)
+    {
+      scenePath = argv[i + 1];
+    }
+    else if(strcmp(argv[i], "--generate") == 0 && i + 2 < argc)
+    {
+      layout = argv[i + 1];
+      numGenerated = atoi(argv[i + 2]);
+    }
+    else if(strcmp(argv[i], "--load") == 0)
+    {
+      snapshotPath = argv[i + 1];
+    }
+    else if(strcmp(argv[i], "--record") == 0)
+    {
+      trajectoryPath = argv[i + 1];
+    }
+    else if(strcmp(argv[i], "--replay") == 0)
+    {
+      replayPath = argv[i + 1];
+    }
+    else if(strcmp(argv[i], "--metrics") == 0)
+    {
+      metricsPath = argv[i + 1];
+    }
+    else if(strcmp(argv[i], "--metrics-socket") == 0)
+    {
+      metricsSocketPath = argv[i + 1];
+    }
+  }
   glutInitWindowSize(g_width, g_height);
   glutInitDisplayMode(GLUT_RGB | GLUT_DOUBLE | GLUT_DEPTH);
   glutCreateWindow(WINDOW_TITLE);
@@ -523,7 +832,69 @@ int main(int argc, char *argv[])
   ShadeProg = GLBridge::getShaderProgram();
   /******************************************/
 
-  InitGeom();
+  std::string error;
+  if(snapshotPath)
+  {
+    if(!Snapshot::load(snapshotPath, &scene))
+    {
+      printf("Error loading %s!\n", snapshotPath);
+      return 1;
+    }
+  }
+  else if(scenePath)
+  {
+    if(!SceneFile::load(scenePath, &scene, &error))
+    {
+      printf("Error loading %s: %s\n", scenePath, error.c_str());
+      return 1;
+    }
+  }
+  else if(layout)
+  {
+    InitFloor();
+    if(!SceneGenerator::generate(layout, numGenerated, &scene, worldFloor->getPosition(), seed))
+    {
+      printf("Unknown layout %s (drop, cloth, chains or pyramid)!\n", layout);
+      return 1;
+    }
+  }
+  else
+  {
+    InitGeom();
+  }
+  
+  if(trajectoryPath)
+  {
+    if(!recorder.open(trajectoryPath))
+    {
+      printf("Error creating %s!\n", trajectoryPath);
+      return 1;
+    }
+    scene.setRecorder(&recorder);
+  }
+  
+  if(replayPath)
+  {
+    if(!player.open(replayPath))
+    {
+      printf("Error loading %s!\n", replayPath);
+      return 1;
+    }
+    replaying = true;
+  }
+  InitMetrics();
+  if(metricsPath && !metricsExporter.openFile(metricsPath))
+  {
+    printf("Error creating %s!\n", metricsPath);
+    return 1;
+  }
+  if(metricsSocketPath && !metricsExporter.openSocket(metricsSocketPath))
+  {
+    printf("Error listening on %s!\n", metricsSocketPath);
+    return 1;
+  }
+  
+  camera = new Camera(h_uViewMatrix, h_uCameraPos);
 
   currentTime = glutGet(GLUT_ELAPSED_TIME);
   loop(FRAME_DELAY);